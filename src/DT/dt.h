@@ -7,6 +7,7 @@
 #include "vector.h"
 #include "dataset.h"
 #include "utils.h"
+#include "model_file.h"
 
 typedef struct DT_Node{
     u_int8_t feature_idx;
@@ -18,12 +19,31 @@ typedef struct DT_Node{
     Vector* vec;
 }DT_Node;
 
+// A tree node in a model file, children by index in preorder (see dt_classifier_save)
+typedef struct DT_FlatNode{
+    float threshold;
+    uint32_t left;
+    uint32_t right;
+    u_int8_t feature_idx;
+    u_int8_t is_leaf;
+    u_int8_t class;
+    u_int8_t reserved;
+}DT_FlatNode;
+
+#define DT_FLAT_NULL UINT32_MAX
+
 typedef struct DT_Classifier{
     DT_Node* root;
     unsigned char num_classes;
     Dataset* total_dataset;
     Dataset* train_dataset;
     Dataset* test_dataset;
+
+    // Tree used in place when loaded from a file, see dt_classifier_load
+    const DT_FlatNode* flat;
+    uint32_t num_flat_nodes;
+    unsigned char num_features;
+    ModelFile* file;
 }DT_Classifier;
 
 DT_Node* dt_node_create(){
@@ -46,6 +66,10 @@ DT_Classifier* dt_classifier_create(){
     classifier->total_dataset = NULL;
     classifier->train_dataset = NULL;
     classifier->test_dataset = NULL;
+    classifier->flat = NULL;
+    classifier->num_flat_nodes = 0;
+    classifier->num_features = 0;
+    classifier->file = NULL;
     return classifier;
 };
 
@@ -86,12 +110,15 @@ void dt_classifier_destroy(DT_Classifier** classifier){
     dataset_destroy(&(*classifier)->total_dataset);
     dataset_destroy(&(*classifier)->train_dataset);
 
-    for (unsigned short i = 0; i < (*classifier)->test_dataset->vec->size; i++){
-        Point* p = vector_at((*classifier)->test_dataset->vec, i);
-        vec_point_destroy(&p);
+    if ((*classifier)->test_dataset != NULL){
+        for (unsigned short i = 0; i < (*classifier)->test_dataset->vec->size; i++){
+            Point* p = vector_at((*classifier)->test_dataset->vec, i);
+            vec_point_destroy(&p);
+        }
     }
 
     dataset_destroy(&(*classifier)->test_dataset);
+    model_file_unmap((*classifier)->file);
     free(*classifier);
     *classifier = NULL;
 };
@@ -238,6 +265,115 @@ unsigned char dt_classifier_predict(DT_Node* node, Point* p){
     }
 };
 
+#pragma region DT Files
+/*
+A fitted tree is saved as an array of DT_FlatNode in preorder, leaves carry their class.
+dt_classifier_load maps the file and dt_classifier_predict_flat walks the mapped nodes in
+place, the datasets are not saved. The file records the dimension of the training points,
+a walk never reads a feature beyond it or beyond the query point.
+*/
+
+#define DT_SECTION_META 1
+#define DT_SECTION_NODES 2
+
+typedef struct {
+    uint32_t num_nodes;
+    u_int8_t num_classes;
+    u_int8_t num_features;  // dimension of the training points
+    u_int8_t reserved[2];
+}DTFileMeta;
+
+uint32_t dt_node_count(DT_Node* node){
+    if (node == NULL) return 0;
+    return 1 + dt_node_count(node->left) + dt_node_count(node->right);
+};
+
+// Writes node and its subtrees from index *next on, returns the index of node
+uint32_t dt_node_flatten(DT_Node* node, DT_FlatNode* nodes, uint32_t* next){
+    if (node == NULL) return DT_FLAT_NULL;
+
+    const uint32_t idx = (*next)++;
+    memset(nodes + idx, 0, sizeof(DT_FlatNode));
+    nodes[idx].threshold = node->threshold;
+    nodes[idx].feature_idx = node->feature_idx;
+    nodes[idx].is_leaf = node->is_leaf;
+    nodes[idx].class = node->is_leaf ? node->vec->data[0].class : 255;
+    nodes[idx].left = dt_node_flatten(node->left, nodes, next);
+    nodes[idx].right = dt_node_flatten(node->right, nodes, next);
+    return idx;
+};
+
+// dt_classifier_predict on the flat tree, 255 if the tree or the point cannot be walked
+unsigned char dt_classifier_predict_flat(DT_Classifier* classifier, Point* p){
+    uint32_t idx = 0;
+    while (idx < classifier->num_flat_nodes){
+        const DT_FlatNode* node = classifier->flat + idx;
+        if (node->is_leaf) return node->class;
+        if (node->feature_idx >= classifier->num_features || node->feature_idx >= p->dim) break;
+
+        const uint32_t next = p->point[node->feature_idx] <= node->threshold ? node->left : node->right;
+        // Preorder, children always come after their parent
+        if (next <= idx) break;
+        idx = next;
+    }
+    return 255;
+};
+
+char dt_classifier_save(DT_Classifier* classifier, const char* path){
+    if (classifier->root == NULL){
+        printf("Root node does not exist.\n");
+        return 0;
+    }
+
+    DTFileMeta meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.num_nodes = dt_node_count(classifier->root);
+    meta.num_classes = classifier->num_classes;
+    meta.num_features = classifier->root->vec && classifier->root->vec->size ? classifier->root->vec->data[0].dim : 0;
+
+    DT_FlatNode* nodes = (DT_FlatNode*)malloc(meta.num_nodes * sizeof(DT_FlatNode));
+    uint32_t next = 0;
+    dt_node_flatten(classifier->root, nodes, &next);
+
+    ModelFileChunk chunks[2] = {
+        {DT_SECTION_META, &meta, sizeof(meta)},
+        {DT_SECTION_NODES, nodes, meta.num_nodes * sizeof(DT_FlatNode)},
+    };
+    const char ok = model_file_write(path, MODEL_FILE_KIND_DT_CLASSIFIER, chunks, 2);
+    free(nodes);
+    return ok;
+};
+
+// Maps a saved tree, returns NULL if the file cannot be used
+DT_Classifier* dt_classifier_load(const char* path){
+    ModelFile* file = model_file_map(path, MODEL_FILE_KIND_DT_CLASSIFIER);
+    if (file == NULL) return NULL;
+
+    uint64_t meta_size = 0, nodes_size = 0;
+    const DTFileMeta* meta = (const DTFileMeta*)model_file_section(file, DT_SECTION_META, &meta_size);
+    const DT_FlatNode* nodes = (const DT_FlatNode*)model_file_section(file, DT_SECTION_NODES, &nodes_size);
+    char ok = meta != NULL && nodes != NULL && meta_size == sizeof(DTFileMeta) && meta->num_nodes > 0
+              && nodes_size == meta->num_nodes * sizeof(DT_FlatNode);
+    for (uint32_t i = 0; ok && i < meta->num_nodes; i++){
+        ok = !nodes[i].is_leaf || nodes[i].class < meta->num_classes;
+    }
+    if (!ok){
+        printf("Model file %s has no valid decision tree.\n", path);
+        model_file_unmap(file);
+        return NULL;
+    }
+
+    DT_Classifier* classifier = dt_classifier_create();
+    classifier->num_classes = meta->num_classes;
+    classifier->num_features = meta->num_features;
+    classifier->flat = nodes;
+    classifier->num_flat_nodes = meta->num_nodes;
+    classifier->file = file;
+    return classifier;
+};
+
+#pragma endregion DT Files
+
 Metrics* dt_classifier_evaluate(DT_Classifier* dt_classifier){
     if (dt_classifier->test_dataset == NULL){
         printf("Test dataset does not exist.\n");
@@ -253,7 +389,9 @@ Metrics* dt_classifier_evaluate(DT_Classifier* dt_classifier){
     for (unsigned short int i = 0; i < N; i++){
         Point* p = vector_at(dt_classifier->test_dataset->vec, i);
 	
-        int predicted_class = dt_classifier_predict(dt_classifier->root, p);
+        int predicted_class = dt_classifier->root ? dt_classifier_predict(dt_classifier->root, p) : dt_classifier_predict_flat(dt_classifier, p);
+        // 255: no class for this point, counted as a miss
+        if (predicted_class >= num_classes) continue;
         if (predicted_class == p->class){
             correct[predicted_class]++;
             true_positives[predicted_class]++;
@@ -39,7 +39,7 @@ void matrix_tanh(Matrix* X){
         for (size_t i = 0; i < X->n_rows; i++){
             for (size_t j = 0; j < X->n_cols; j++){
                 double x = matrix_get(X, i, j);
-                matrix_set(X, i, j, exp(2*x - 1)/exp(2*x + 1));
+                matrix_set(X, i, j, tanh(x));
             }
         }
     }
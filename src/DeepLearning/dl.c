@@ -3,18 +3,22 @@
 #include "optimizer.h"
 #include "matrix.h"
 #include "loss.h"
+#include "model_fit.h"
 
 void main(void){
 
-    double arr[4][1] = {
-        {1.0},
-        {2.5},
-        {6.0},
-        {4.0},
-    };
-    
-    Matrix* X = matrix_create_from_array(4, 1, arr);
-    Matrix* _X = matrix_copy(X);
+    // data: 256 samples of 4 features, the labels are two fixed sums of them
+        const size_t N = 256;
+        Matrix* X = NULL;
+        Matrix* y = NULL;
+        matrix_create(&X, 4, N);
+        matrix_create(&y, 2, N);
+        for (size_t n = 0; n < N; n++){
+            for (size_t f = 0; f < 4; f++) X->data[f * N + n] = (double)rand() / (double)RAND_MAX;
+            y->data[n] = X->data[n] + 2.5 * X->data[N + n];
+            y->data[N + n] = 6.0 * X->data[2 * N + n] - 4.0 * X->data[3 * N + n];
+        }
+
     Sequential_NN_* sequential_nn = NULL;
     init_sequential_nn_(&sequential_nn, 4, 3, 2);
     
@@ -24,38 +28,27 @@ void main(void){
     }
 
     // Stack layers on the sequential Model
-        add_feed_forward_layer_(sequential_nn, sequential_nn->hidden_size, sequential_nn->input_size, 0);
-        add_feed_forward_layer_(sequential_nn, sequential_nn->hidden_size, sequential_nn->hidden_size, 0);
+        add_feed_forward_layer_(sequential_nn, sequential_nn->hidden_size, sequential_nn->input_size, 1);
+        add_feed_forward_layer_(sequential_nn, sequential_nn->hidden_size, sequential_nn->hidden_size, 1);
         add_feed_forward_layer_(sequential_nn, sequential_nn->output_size, sequential_nn->hidden_size, 0);
         print_sequential_nn_(sequential_nn);
 
-    // Forward Pass 
-        forward_sequential_nn_(sequential_nn, _X);
-    
     // Optimizer
         Adam_Optimizer_* optimizer = NULL;
 
         printf("INITIALIZE OPTIMIZER.\n");
-        init_Adam_optimizer_(&optimizer, 0.004f, 0.5f, 0.9f, 0.9f, 0.000001f, sequential_nn->layers, sequential_nn->num_layers);
-
-    // data
-        double label[2][1] = {30, 20};
-        Matrix* y = matrix_create_from_array(2, 1, label);
-
-    // Loss Calculation
-        Matrix* loss = NULL;
-        L2_loss(_X, y, &loss);
-        matrix_print(loss);
+        init_Adam_optimizer_(&optimizer, 0.004f, 0.01f, 0.9f, 0.999f, 0.000001f, sequential_nn->layers, sequential_nn->num_layers);
 
-    // Propagate back the gradients top-to-bottom 
-        printf("BACKPROPAGATION.\n");
-        backpropagate_sequential_nn_(sequential_nn, _X, y, 0);
+    // Train: shuffled mini-batches, prepared by the loader thread while the previous one trains
+        printf("TRAINING.\n");
+        ModelFitConfig_ config = model_fit_default_config();
+        config.epochs = 10;
+        config.batch_size = 16;
+        config.verbose = 1;
+        ModelFitEpoch_* history = model_fit_(sequential_nn, optimizer, X, y, &config);
 
-    // Optimize
-        printf("OPTIMIZATION.\n");
-        optimize_adam_(optimizer, sequential_nn->layers);
-        
     // Free allocated dynamic memory
+        free(history);
         destroy_sequential_nn_(sequential_nn);
         free(sequential_nn);
         destroy_adam_optimizer_(optimizer);
@@ -64,8 +57,4 @@ void main(void){
         free(X);
         matrix_destroy(y);
         free(y);
-        matrix_destroy(loss);
-        free(loss);
-        matrix_destroy(_X);
-        free(_X);
 };
\ No newline at end of file
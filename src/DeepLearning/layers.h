@@ -7,6 +7,8 @@
 #include "./act_fn..h"
 #include <math.h>
 #include "tensor.h"
+#include "forward_mode.h"
+#include "lazy_tensor.h"
 
 /**
  * @file layers.h
@@ -65,6 +67,44 @@ void feed_forward_layer_forward(Layer* layer, Tensor* X){
     ff_layer->act_fn(X);
 };
 
+// Forward-mode pass: act(W X + b) with tangents, the parameters are constants
+JVPTensor* feed_forward_layer_jvp(Layer* layer, JVPTensor* X){
+    if (layer == NULL || X == NULL){
+        printf("Layer or X is pointing to NULL in feed_forward_layer_jvp.\n");
+        exit(1);
+    }
+    FeedForwardLayer* ff_layer = layer->layer.ff_layer;
+
+    void (*act_fn)(JVPTensor* X) = jvp_activation_for(ff_layer->act_fn);
+    if (act_fn == NULL){
+        printf("Activation function of the layer has no forward-mode counterpart.\n");
+        exit(1);
+    }
+
+    JVPTensor* Z = jvp_tensor_dot_product_tensor(ff_layer->weights, X);
+    jvp_tensor_add_tensor_inplace(Z, ff_layer->biases);
+    act_fn(Z);
+    return Z;
+};
+
+// Lazy pass: act(W X + b), the bias add and the activation fuse into one node
+LazyTensor* feed_forward_layer_lazy(Layer* layer, LazyContext* ctx, LazyTensor* X){
+    if (layer == NULL || X == NULL){
+        printf("Layer or X is pointing to NULL in feed_forward_layer_lazy.\n");
+        exit(1);
+    }
+    FeedForwardLayer* ff_layer = layer->layer.ff_layer;
+
+    LazyTensor* (*act_fn)(LazyContext* ctx, LazyTensor* X) = lazy_activation_for(ff_layer->act_fn);
+    if (act_fn == NULL){
+        printf("Activation function of the layer has no lazy counterpart.\n");
+        exit(1);
+    }
+
+    LazyTensor* Z = lazy_matmul(ctx, lazy_tensor(ctx, ff_layer->weights), X);
+    return act_fn(ctx, lazy_add(ctx, Z, lazy_tensor(ctx, ff_layer->biases)));
+};
+
 void feed_forward_layer_destroy(Layer* layer){
     if (layer == NULL){
         printf("Layer is pointing to NULL in feed_forward_layer_destroy.\n");
@@ -163,22 +203,37 @@ typedef struct FeedForwardLayer_{
     size_t num_neurons;
     void (*act_fn)(Matrix* X);
     char act_fn_mapping;
-    Matrix* a_prev;
+    const Matrix* a_prev;   // input of the last forward pass, not owned
+    Matrix* input;          // copy of the input for feed_forward_pass
+    Matrix* a;              // activations of the last forward pass
     Matrix* weights;
     Matrix* biases;
     Matrix* da_dz;
+    Matrix* grad_z;
     Matrix* grad_delta;
     Matrix* grad_W;
     Matrix* grad_b;
+    double* panel;          // GEMM workspace
 }FeedForwardLayer_;
 
 typedef enum {
     FF,
+    CONV2D,
+    POOL2D,
+    EMBEDDING,
+    LSTM,
+    GRU,
+    ATTENTION,
     //add more types as needed
 }LayerType_;
 
 typedef union {
     FeedForwardLayer_* ff_layer;
+    struct Conv2DLayer_* conv_layer;
+    struct Pool2DLayer_* pool_layer;
+    struct EmbeddingLayer_* embedding_layer;
+    struct RecurrentLayer_* recurrent_layer;
+    struct AttentionLayer_* attention_layer;
     void* layer;
 }LayerUnion_;
 
@@ -189,113 +244,157 @@ typedef struct {
 
 
 
-void set_da_dz_feed_forward_layer(FeedForwardLayer_* layer, Matrix* z){
-    // In the backpropagation method the upcoming gradients must be considered for the 
-    // calculation of delta_L too
+/*
+The layerwise path works on mini-batches: X is n_features x B with one sample per column.
+act_fn_mapping selects the activation, 0 linear, 1 relu, 2 sigmoid, 3 tanh.
+*/
 
-    Matrix* da_dz = NULL;    
-    matrix_create(&da_dz, z->n_rows, z->n_cols);
+// Activation derivative da/dz of an n x B batch, from the activations a = act(z)
+void set_da_dz_feed_forward_layer(FeedForwardLayer_* layer, Matrix* a){
+    if (layer->da_dz == NULL) matrix_create(&layer->da_dz, a->n_rows, a->n_cols);
+    else matrix_realloc(layer->da_dz, a->n_rows, a->n_cols);
+
+    const size_t n = a->n_rows * a->n_cols;
+    double* da_dz = layer->da_dz->data;
 
     switch(layer->act_fn_mapping){
         case 0: // linear
-            for (size_t i = 0; i < da_dz->n_rows; i++){
-                for (size_t j = 0; j < da_dz->n_cols; j++){
-                    matrix_set(da_dz, i, j, 1.0);
-                }
-            } 
+            for (size_t k = 0; k < n; k++) da_dz[k] = 1.0;
             break;
-        case 1: // relu            
-            for (size_t i = 0; i < da_dz->n_rows; i++){
-                for (size_t j = 0; j < da_dz->n_cols; j++){
-                    if (matrix_get(z, i, j) <= 0) continue;
-                    matrix_set(da_dz, i, j, 1.0);
-                }
+        case 1: // relu
+            for (size_t k = 0; k < n; k++) da_dz[k] = a->data[k] > 0 ? 1.0 : 0.0;
+            break;
+        case 2: // sigmoid
+            for (size_t k = 0; k < n; k++) da_dz[k] = a->data[k] * (1.0 - a->data[k]);
+            break;
+        case 3: // tanh
+            for (size_t k = 0; k < n; k++) da_dz[k] = 1.0 - a->data[k] * a->data[k];
+            break;
+        default:
+            printf("Selected mapping for the activation function does not exist.\n");
+            exit(0);
+    }
+};
+
+// a = act(a), da_dz = da/dz for n activations of one row
+static inline void feed_forward_activate(const char act_fn_mapping, double* a, double* da_dz, const size_t n){
+    switch(act_fn_mapping){
+        case 0: // linear
+            for (size_t j = 0; j < n; j++) da_dz[j] = 1.0;
+            break;
+        case 1: // relu
+            for (size_t j = 0; j < n; j++){
+                const char active = a[j] > 0;
+                a[j] = active ? a[j] : 0.0;
+                da_dz[j] = active ? 1.0 : 0.0;
             }
             break;
         case 2: // sigmoid
-            double z_i_j, d_a_d_z_i_j;
-            for (size_t i = 0; i < da_dz->n_rows; i++){
-                for (size_t j = 0; j < da_dz->n_cols; j++){
-                    z_i_j = matrix_get(z, i, j);
-                    d_a_d_z_i_j = z_i_j * (1.0 - z_i_j);
-                    matrix_set(da_dz, i, j, d_a_d_z_i_j);
-                }
+            for (size_t j = 0; j < n; j++){
+                a[j] = 1/(1 + exp(-a[j]));
+                da_dz[j] = a[j] * (1.0 - a[j]);
             }
             break;
         case 3: // tanh
-            printf("NOT IMPLEMENTED YET\n.");
-            matrix_destroy(da_dz);
-            free(da_dz);
-            exit(0);
+            for (size_t j = 0; j < n; j++){
+                a[j] = tanh(a[j]);
+                da_dz[j] = 1.0 - a[j] * a[j];
+            }
             break;
+        default:
+            printf("Selected mapping for the activation function does not exist.\n");
+            exit(0);
     }
-    layer->da_dz = da_dz;
 };
 
-// Feed Forward Pass
-void feed_forward_pass(FeedForwardLayer_* layer, Matrix* X){
-    layer->a_prev = matrix_copy(X);
-    Matrix* _X = matrix_copy(X);
-    Matrix* W = matrix_copy(layer->weights);
-    Matrix* b = matrix_copy(layer->biases);
-
-    matrix_multiply(W, _X, &X, 0); // X = W*X | num_neurons x 1
-    matrix_destroy(_X);
-    free(_X);
-    _X = matrix_copy(X);
-    matrix_add(_X, b, &X, 0); // X = X + B | num_neurons x 1
-
-    layer->act_fn(X);
-    
-    // store da_dz of the layer for backprop
-    set_da_dz_feed_forward_layer(layer, X);
+/*
+Fused linear + bias + activation: layer->a = act(W*X + b), layer->da_dz = da/dz in one sweep.
+The bias seeds the GEMM accumulators, and every row block of the output gets its activation and
+derivative right after its last panel is added, while it is still in cache.
+*/
+static void feed_forward_fused_kernel(FeedForwardLayer_* layer, const Matrix* X){
+    const Matrix* W = layer->weights;
+    const size_t m = W->n_rows, k = W->n_cols, n = X->n_cols;
+    double* a = layer->a->data;
+    double* da_dz = layer->da_dz->data;
+
+    for (size_t jc = 0; jc < n; jc += GEMM_NC){
+        const size_t nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+
+        for (size_t i = 0; i < m; i++){
+            const double b_i = layer->biases->data[i];
+            double* c = a + i * n + jc;
+            for (size_t j = 0; j < nc; j++) c[j] = b_i;
+            if (k == 0) feed_forward_activate(layer->act_fn_mapping, c, da_dz + i * n + jc, nc);
+        }
 
-    matrix_destroy(W);
-    free(W);
-    matrix_destroy(b);
-    free(b);
-    matrix_destroy(_X);
-    free(_X);
-  
-};
+        for (size_t pc = 0; pc < k; pc += GEMM_KC){
+            const size_t kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            const char last = pc + kc == k;
+            gemm_pack_panel(X, 0, 1.0, pc, kc, jc, nc, layer->panel);
 
-void backprop_feed_forward_layer(FeedForwardLayer_* layer, Matrix* delta_grad_next){ 
-    double delta_grad_j = 0.0;
-    double delta_grad_val = 0.0;
-    double da_dz_k = 0.0;
-    double delta_k = 0.0;
-    double w_k_j = 0.0;
-
-    // Set grad_delta of the layer
-        for (size_t j = 0; j < layer->grad_delta->n_rows; j++){    
-                
-            delta_grad_val = 0.0;
-
-            for (size_t k = 0; k < delta_grad_next->n_rows; k++){
-                da_dz_k = matrix_get(layer->da_dz, k, 0);            
-                delta_k = matrix_get(delta_grad_next, k, 0);
-                w_k_j = matrix_get(layer->weights, k, j);
-                delta_grad_val += delta_k * w_k_j * da_dz_k;
+            for (size_t i = 0; i < m; i++){
+                double* c = a + i * n + jc;
+                gemm_panel_row(W, 0, i, pc, kc, layer->panel, nc, c);
+                if (last) feed_forward_activate(layer->act_fn_mapping, c, da_dz + i * n + jc, nc);
             }
-            matrix_set(layer->grad_delta, j, 0, delta_grad_val);
         }
+    }
+};
 
-    // set gradient weights
-        double dC_dw_j_k = 0.0;
-        for (size_t j = 0; j < layer->grad_W->n_rows; j++){
-            for (size_t k = 0; k < layer->grad_W->n_cols; k++){
-                dC_dw_j_k = matrix_get(delta_grad_next, j, 0) * matrix_get(layer->a_prev, k, 0);
-                matrix_set(layer->grad_W, j, k, dC_dw_j_k);            
-            }
-        }
+// Hot path: X (n_features x B) -> layer->a (n_neurons x B), da_dz alongside. Nothing is copied,
+// and nothing is allocated while the batch size stays the same. X is read again by the backward
+// pass, so it must not change until then.
+const Matrix* feed_forward_forward_(FeedForwardLayer_* layer, const Matrix* X){
+    if (X->n_rows != layer->weights->n_cols){
+        printf("Input has %lu features, the layer expects %lu.\n", X->n_rows, layer->weights->n_cols);
+        exit(0);
+    }
 
-    // set bias gradients
-        double dC_db_j = 0.0;
-        for (size_t j = 0; j < layer->grad_b->n_rows; j++){
-            dC_db_j = matrix_get(delta_grad_next, j, 0);
-            matrix_set(layer->grad_b, j, 0, dC_db_j);
-        }
+    layer->a_prev = X;
+    matrix_resize(&layer->a, layer->weights->n_rows, X->n_cols);
+    matrix_resize(&layer->da_dz, layer->weights->n_rows, X->n_cols);
+    feed_forward_fused_kernel(layer, X);
+    return layer->a;
+};
 
+// Feed Forward Pass
+// X (n_features x B) is replaced by the activations act(W*X + b) (n_neurons x B). The layer
+// keeps a copy of the input for the backward pass.
+void feed_forward_pass(FeedForwardLayer_* layer, Matrix* X){
+    matrix_resize(&layer->input, X->n_rows, X->n_cols);
+    memcpy(layer->input->data, X->data, X->n_rows * X->n_cols * sizeof(double));
+
+    const Matrix* a = feed_forward_forward_(layer, layer->input);
+    matrix_resize(&X, a->n_rows, a->n_cols);
+    memcpy(X->data, a->data, a->n_rows * a->n_cols * sizeof(double));
+};
+
+// delta_grad_next is dC/da of the layer output (n_neurons x B), one column per sample.
+// grad_W and grad_b receive the mean over the batch, grad_delta the per-sample dC/da of the
+// layer input (n_features x B) for the layer below.
+void backprop_feed_forward_layer(FeedForwardLayer_* layer, Matrix* delta_grad_next){ 
+    const size_t batch_size = delta_grad_next->n_cols;
+    const size_t n = delta_grad_next->n_rows * batch_size;
+
+    // dC/dz = dC/da * da/dz
+    matrix_resize(&layer->grad_z, delta_grad_next->n_rows, batch_size);
+    for (size_t k = 0; k < n; k++) layer->grad_z->data[k] = delta_grad_next->data[k] * layer->da_dz->data[k];
+
+    // set gradient weights: dC/dz * a_prev^T / B
+    matrix_gemm_with_panel(0, 1, 1.0 / (double)batch_size, layer->grad_z, layer->a_prev, 0.0, layer->grad_W, layer->panel);
+
+    // set bias gradients: row means of dC/dz
+    for (size_t j = 0; j < layer->grad_b->n_rows; j++){
+        const double* row = layer->grad_z->data + j * batch_size;
+        double sum = 0.0;
+        for (size_t b = 0; b < batch_size; b++) sum += row[b];
+        layer->grad_b->data[j] = sum / (double)batch_size;
+    }
+
+    // Set grad_delta of the layer: W^T * dC/dz
+    matrix_resize(&layer->grad_delta, layer->weights->n_cols, batch_size);
+    matrix_gemm_with_panel(1, 0, 1.0, layer->weights, layer->grad_z, 0.0, layer->grad_delta, layer->panel);
 };
 
 // Garbage Collector Funcs
@@ -322,13 +421,25 @@ void destroy_feed_forward_layer_(FeedForwardLayer_* layer){
     free(layer->da_dz);
     layer->da_dz = NULL;
 
+    matrix_destroy(layer->grad_z);
+    free(layer->grad_z);
+    layer->grad_z = NULL;
+
     matrix_destroy(layer->grad_delta);
     free(layer->grad_delta);
     layer->grad_delta = NULL;
 
-    matrix_destroy(layer->a_prev);
-    free(layer->a_prev);
+    matrix_destroy(layer->input);
+    free(layer->input);
+    layer->input = NULL;
+
+    matrix_destroy(layer->a);
+    free(layer->a);
+    layer->a = NULL;
     layer->a_prev = NULL;
+
+    free(layer->panel);
+    layer->panel = NULL;
 };
 
 // Allocate memory for FFNN
@@ -354,16 +465,21 @@ FeedForwardLayer_* create_feed_forward_layer(size_t next_num_neurons, size_t num
 
     // Initialize bias_grad
     layer->grad_b = NULL;
-    matrix_create(&(layer->grad_b), next_num_neurons, num_neurons);
+    matrix_create(&(layer->grad_b), next_num_neurons, 1);
 
     // Initialize delta_grad
     layer->grad_delta = NULL;
     matrix_create(&(layer->grad_delta), num_neurons, 1);
     
-    // Initialize a_i
-    //layer->da_dz = NULL;
-    //matrix_create(&(layer->da_dz), next_num_neurons, 1);
+    // Sized by the first batch
+    layer->a_prev = NULL;
+    layer->input = NULL;
+    layer->a = NULL;
+    layer->da_dz = NULL;
+    layer->grad_z = NULL;
+    layer->panel = (double*)malloc(GEMM_PANEL_SIZE * sizeof(double));
 
+    layer->act_fn_mapping = act_fn_mapping;
     switch(act_fn_mapping){
         case 0:
             layer->act_fn = matrix_linear;
@@ -419,23 +535,34 @@ void init_feed_forward_layer_(FeedForwardLayer_** layer_dptr, size_t next_num_ne
 
     // Initialize bias_grad
     (*layer_dptr)->grad_b = NULL;
-    matrix_create(&((*layer_dptr)->grad_b), next_num_neurons, num_neurons);
+    matrix_create(&((*layer_dptr)->grad_b), next_num_neurons, 1);
 
     // Initialize delta_grad
     (*layer_dptr)->grad_delta = NULL;
     matrix_create(&((*layer_dptr)->grad_delta), num_neurons, 1);
 
+    // Sized by the first batch
+    (*layer_dptr)->a_prev = NULL;
+    (*layer_dptr)->input = NULL;
+    (*layer_dptr)->a = NULL;
+    (*layer_dptr)->da_dz = NULL;
+    (*layer_dptr)->grad_z = NULL;
+    (*layer_dptr)->panel = (double*)malloc(GEMM_PANEL_SIZE * sizeof(double));
+
     // set act_fn_mapping
     (*layer_dptr)->act_fn_mapping = act_fn_mapping;
 
     switch(act_fn_mapping){
         case 0:
-            (*layer_dptr)->act_fn = matrix_relu;
+            (*layer_dptr)->act_fn = matrix_linear;
             break;
         case 1:
-            (*layer_dptr)->act_fn = matrix_sigmoid;
+            (*layer_dptr)->act_fn = matrix_relu;
             break;
         case 2:
+            (*layer_dptr)->act_fn = matrix_sigmoid;
+            break;
+        case 3:
             (*layer_dptr)->act_fn = matrix_tanh;
             break;
         default:
@@ -446,4 +573,1271 @@ void init_feed_forward_layer_(FeedForwardLayer_** layer_dptr, size_t next_num_ne
 
 #pragma endregion Feed Forward Layerwise
 
-#endif // LAYERS_H_
\ No newline at end of file
+#pragma region Convolution Layerwise
+/*
+Spatial layers of the layerwise path. A batch is still one sample per column, a sample being
+an image of C channels of H x W flattened into the column in one of two layouts:
+
+    CONV_NCHW   feature (c * H + h) * W + w     channels first
+    CONV_NHWC   feature (h * W + w) * C + c     channels last
+
+Both layers keep the layout, the output is laid out like the input.
+
+CONV2D runs as im2col + GEMM. im2col copies every receptive field into a column block of
+cols ((C k k) x (OH OW B), row (c * k + i) * k + j, column (oh * OW + ow) * B + b), so the
+whole batch is one GEMM with the F x (C k k) weights:
+
+    forward     Z = W * cols + b,  a = act(Z)
+    backward    grad_W = grad_z * cols^T / B,  grad_b = row sums of grad_z / B
+                grad_cols = W^T * grad_z,      grad_delta = col2im(grad_cols)
+
+The GEMM output, (f, oh, ow, b) in memory, is already the NCHW output, NHWC outputs are
+permuted from it. A layer has F (C k k + 1) parameters instead of (F OH OW)(C H W + 1) for
+the dense layer with the same input and output, and 2 F (C k k) OH OW flops per sample.
+
+POOL2D is max or average pooling over k x k windows with stride, without padding, per
+channel. It has no parameters, max pooling remembers the winning input of every output.
+*/
+
+typedef enum {
+    CONV_NCHW,
+    CONV_NHWC,
+}ConvLayout_;
+
+typedef enum {
+    POOL_MAX,
+    POOL_AVG,
+}PoolMode_;
+
+typedef struct Conv2DLayer_{
+    size_t in_channels;
+    size_t in_height;
+    size_t in_width;
+    size_t out_channels;
+    size_t out_height;
+    size_t out_width;
+    size_t kernel_size;
+    size_t stride;
+    size_t padding;
+    ConvLayout_ layout;
+    char act_fn_mapping;
+    const Matrix* a_prev;   // input of the last forward pass, not owned
+    Matrix* input;          // copy of the input when the layer comes first in a model
+    Matrix* cols;           // im2col of a_prev
+    Matrix* z;              // NHWC only, activations in GEMM order before the permute
+    Matrix* a;              // activations of the last forward pass, (F OH OW) x B
+    Matrix* weights;        // F x (C k k)
+    Matrix* biases;         // F x 1
+    Matrix* da_dz;          // GEMM order
+    Matrix* grad_z;         // GEMM order
+    Matrix* grad_cols;
+    Matrix* grad_delta;     // (C H W) x B
+    Matrix* grad_W;
+    Matrix* grad_b;
+    double* panel;          // GEMM workspace
+}Conv2DLayer_;
+
+typedef struct Pool2DLayer_{
+    size_t channels;
+    size_t in_height;
+    size_t in_width;
+    size_t out_height;
+    size_t out_width;
+    size_t kernel_size;
+    size_t stride;
+    PoolMode_ mode;
+    ConvLayout_ layout;
+    const Matrix* a_prev;
+    Matrix* input;
+    Matrix* a;
+    Matrix* grad_delta;
+    size_t* argmax;         // max pooling, input row of every output element
+    size_t argmax_size;
+}Pool2DLayer_;
+
+static inline size_t conv_feature_index(const ConvLayout_ layout, const size_t C, const size_t H, const size_t W, const size_t c, const size_t h, const size_t w){
+    return layout == CONV_NCHW ? (c * H + h) * W + w : (h * W + w) * C + c;
+};
+
+Conv2DLayer_* create_conv2d_layer(const size_t in_channels, const size_t in_height, const size_t in_width, const size_t out_channels, const size_t kernel_size, const size_t stride, const size_t padding, const ConvLayout_ layout, const char act_fn_mapping){
+    if (kernel_size == 0 || stride == 0 || in_height + 2 * padding < kernel_size || in_width + 2 * padding < kernel_size){
+        printf("Kernel does not fit the input in create_conv2d_layer.\n");
+        exit(0);
+    }
+    if (act_fn_mapping < 0 || act_fn_mapping > 3){
+        printf("Selected mapping for the activation function does not exist.\n");
+        exit(0);
+    }
+
+    Conv2DLayer_* layer = (Conv2DLayer_*)calloc(1, sizeof(Conv2DLayer_));
+    layer->in_channels = in_channels;
+    layer->in_height = in_height;
+    layer->in_width = in_width;
+    layer->out_channels = out_channels;
+    layer->out_height = (in_height + 2 * padding - kernel_size) / stride + 1;
+    layer->out_width = (in_width + 2 * padding - kernel_size) / stride + 1;
+    layer->kernel_size = kernel_size;
+    layer->stride = stride;
+    layer->padding = padding;
+    layer->layout = layout;
+    layer->act_fn_mapping = act_fn_mapping;
+
+    // Uniform in +-1/sqrt(fan_in)
+    const size_t fan_in = in_channels * kernel_size * kernel_size;
+    const double range = 1.0 / sqrt((double)fan_in);
+    matrix_create(&layer->weights, out_channels, fan_in);
+    for (size_t k = 0; k < out_channels * fan_in; k++) layer->weights->data[k] = range * (2.0 * rand() / (double)RAND_MAX - 1.0);
+    matrix_create(&layer->biases, out_channels, 1);
+    matrix_create(&layer->grad_W, out_channels, fan_in);
+    matrix_create(&layer->grad_b, out_channels, 1);
+
+    // The rest is sized by the first batch
+    layer->panel = (double*)malloc(GEMM_PANEL_SIZE * sizeof(double));
+    return layer;
+};
+
+void conv2d_im2col(const Conv2DLayer_* layer, const Matrix* X, Matrix* cols){
+    const size_t C = layer->in_channels, H = layer->in_height, W = layer->in_width;
+    const size_t K = layer->kernel_size, OH = layer->out_height, OW = layer->out_width;
+    const size_t B = X->n_cols, P = OH * OW;
+
+    for (size_t c = 0; c < C; c++){
+        for (size_t i = 0; i < K; i++){
+            for (size_t j = 0; j < K; j++){
+                double* dst = cols->data + ((c * K + i) * K + j) * P * B;
+                for (size_t oh = 0; oh < OH; oh++){
+                    const long h = (long)(oh * layer->stride + i) - (long)layer->padding;
+                    for (size_t ow = 0; ow < OW; ow++){
+                        const long w = (long)(ow * layer->stride + j) - (long)layer->padding;
+                        double* out = dst + (oh * OW + ow) * B;
+                        if (h < 0 || w < 0 || h >= (long)H || w >= (long)W){
+                            memset(out, 0, B * sizeof(double));
+                            continue;
+                        }
+                        memcpy(out, X->data + conv_feature_index(layer->layout, C, H, W, c, (size_t)h, (size_t)w) * B, B * sizeof(double));
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Adds every column block back onto the input it was copied from
+void conv2d_col2im(const Conv2DLayer_* layer, const Matrix* cols, Matrix* X){
+    const size_t C = layer->in_channels, H = layer->in_height, W = layer->in_width;
+    const size_t K = layer->kernel_size, OH = layer->out_height, OW = layer->out_width;
+    const size_t B = X->n_cols, P = OH * OW;
+    memset(X->data, 0, X->n_rows * B * sizeof(double));
+
+    for (size_t c = 0; c < C; c++){
+        for (size_t i = 0; i < K; i++){
+            for (size_t j = 0; j < K; j++){
+                const double* src = cols->data + ((c * K + i) * K + j) * P * B;
+                for (size_t oh = 0; oh < OH; oh++){
+                    const long h = (long)(oh * layer->stride + i) - (long)layer->padding;
+                    if (h < 0 || h >= (long)H) continue;
+                    for (size_t ow = 0; ow < OW; ow++){
+                        const long w = (long)(ow * layer->stride + j) - (long)layer->padding;
+                        if (w < 0 || w >= (long)W) continue;
+                        double* x = X->data + conv_feature_index(layer->layout, C, H, W, c, (size_t)h, (size_t)w) * B;
+                        const double* in = src + (oh * OW + ow) * B;
+                        for (size_t b = 0; b < B; b++) x[b] += in[b];
+                    }
+                }
+            }
+        }
+    }
+};
+
+// X ((C H W) x B) -> layer->a ((F OH OW) x B). The backward pass reads the im2col copy in
+// layer->cols, not X.
+const Matrix* conv2d_forward_(Conv2DLayer_* layer, const Matrix* X){
+    const size_t C = layer->in_channels, K = layer->kernel_size, F = layer->out_channels;
+    if (X->n_rows != C * layer->in_height * layer->in_width){
+        printf("Input has %lu features, the layer expects %lu.\n", X->n_rows, C * layer->in_height * layer->in_width);
+        exit(0);
+    }
+    const size_t B = X->n_cols, P = layer->out_height * layer->out_width;
+
+    layer->a_prev = X;
+    matrix_resize(&layer->cols, C * K * K, P * B);
+    conv2d_im2col(layer, X, layer->cols);
+
+    Matrix** z = layer->layout == CONV_NCHW ? &layer->a : &layer->z;
+    matrix_resize(z, F, P * B);
+    matrix_resize(&layer->da_dz, F, P * B);
+    matrix_gemm_with_panel(0, 0, 1.0, layer->weights, layer->cols, 0.0, *z, layer->panel);
+    for (size_t f = 0; f < F; f++){
+        double* row = (*z)->data + f * P * B;
+        const double b_f = layer->biases->data[f];
+        for (size_t k = 0; k < P * B; k++) row[k] += b_f;
+        feed_forward_activate(layer->act_fn_mapping, row, layer->da_dz->data + f * P * B, P * B);
+    }
+
+    if (layer->layout == CONV_NCHW){
+        layer->a->n_rows = F * P;
+        layer->a->n_cols = B;
+        return layer->a;
+    }
+
+    matrix_resize(&layer->a, P * F, B);
+    for (size_t f = 0; f < F; f++){
+        for (size_t p = 0; p < P; p++){
+            memcpy(layer->a->data + (p * F + f) * B, layer->z->data + (f * P + p) * B, B * sizeof(double));
+        }
+    }
+    return layer->a;
+};
+
+// delta_grad_next is dC/da of the layer output ((F OH OW) x B). grad_W and grad_b receive the
+// mean over the batch, grad_delta the per-sample dC/da of the layer input ((C H W) x B).
+void backprop_conv2d_layer_(Conv2DLayer_* layer, const Matrix* delta_grad_next){
+    const size_t F = layer->out_channels, P = layer->out_height * layer->out_width;
+    const size_t B = delta_grad_next->n_cols;
+    const double* da_dz = layer->da_dz->data;
+
+    // dC/dz in GEMM order
+    matrix_resize(&layer->grad_z, F, P * B);
+    double* grad_z = layer->grad_z->data;
+    if (layer->layout == CONV_NCHW){
+        for (size_t k = 0; k < F * P * B; k++) grad_z[k] = delta_grad_next->data[k] * da_dz[k];
+    }else{
+        for (size_t f = 0; f < F; f++){
+            for (size_t p = 0; p < P; p++){
+                const double* delta = delta_grad_next->data + (p * F + f) * B;
+                const size_t row = (f * P + p) * B;
+                for (size_t b = 0; b < B; b++) grad_z[row + b] = delta[b] * da_dz[row + b];
+            }
+        }
+    }
+
+    matrix_gemm_with_panel(0, 1, 1.0 / (double)B, layer->grad_z, layer->cols, 0.0, layer->grad_W, layer->panel);
+    for (size_t f = 0; f < F; f++){
+        double sum = 0.0;
+        for (size_t k = 0; k < P * B; k++) sum += grad_z[f * P * B + k];
+        layer->grad_b->data[f] = sum / (double)B;
+    }
+
+    matrix_resize(&layer->grad_cols, layer->cols->n_rows, P * B);
+    matrix_gemm_with_panel(1, 0, 1.0, layer->weights, layer->grad_z, 0.0, layer->grad_cols, layer->panel);
+    matrix_resize(&layer->grad_delta, layer->in_channels * layer->in_height * layer->in_width, B);
+    conv2d_col2im(layer, layer->grad_cols, layer->grad_delta);
+};
+
+void destroy_conv2d_layer_(Conv2DLayer_* layer){
+    if (layer == NULL) return;
+    Matrix* matrices[12] = {layer->input, layer->cols, layer->z, layer->a, layer->weights, layer->biases, layer->da_dz,
+                            layer->grad_z, layer->grad_cols, layer->grad_delta, layer->grad_W, layer->grad_b};
+    for (size_t i = 0; i < 12; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    free(layer->panel);
+    memset(layer, 0, sizeof(Conv2DLayer_));
+};
+
+Pool2DLayer_* create_pool2d_layer(const size_t channels, const size_t in_height, const size_t in_width, const size_t kernel_size, const size_t stride, const PoolMode_ mode, const ConvLayout_ layout){
+    if (kernel_size == 0 || stride == 0 || in_height < kernel_size || in_width < kernel_size){
+        printf("Window does not fit the input in create_pool2d_layer.\n");
+        exit(0);
+    }
+
+    Pool2DLayer_* layer = (Pool2DLayer_*)calloc(1, sizeof(Pool2DLayer_));
+    layer->channels = channels;
+    layer->in_height = in_height;
+    layer->in_width = in_width;
+    layer->out_height = (in_height - kernel_size) / stride + 1;
+    layer->out_width = (in_width - kernel_size) / stride + 1;
+    layer->kernel_size = kernel_size;
+    layer->stride = stride;
+    layer->mode = mode;
+    layer->layout = layout;
+    return layer;
+};
+
+// X ((C H W) x B) -> layer->a ((C OH OW) x B), one window row of B samples at a time
+const Matrix* pool2d_forward_(Pool2DLayer_* layer, const Matrix* X){
+    const size_t C = layer->channels, H = layer->in_height, W = layer->in_width;
+    const size_t K = layer->kernel_size, OH = layer->out_height, OW = layer->out_width;
+    if (X->n_rows != C * H * W){
+        printf("Input has %lu features, the layer expects %lu.\n", X->n_rows, C * H * W);
+        exit(0);
+    }
+    const size_t B = X->n_cols;
+
+    layer->a_prev = X;
+    matrix_resize(&layer->a, C * OH * OW, B);
+    if (layer->mode == POOL_MAX && layer->argmax_size != C * OH * OW * B){
+        layer->argmax_size = C * OH * OW * B;
+        layer->argmax = (size_t*)realloc(layer->argmax, layer->argmax_size * sizeof(size_t));
+    }
+
+    for (size_t c = 0; c < C; c++){
+        for (size_t oh = 0; oh < OH; oh++){
+            for (size_t ow = 0; ow < OW; ow++){
+                const size_t o = conv_feature_index(layer->layout, C, OH, OW, c, oh, ow);
+                double* out = layer->a->data + o * B;
+                size_t* arg = layer->mode == POOL_MAX ? layer->argmax + o * B : NULL;
+
+                for (size_t i = 0; i < K; i++){
+                    for (size_t j = 0; j < K; j++){
+                        const size_t in_row = conv_feature_index(layer->layout, C, H, W, c, oh * layer->stride + i, ow * layer->stride + j);
+                        const double* x = X->data + in_row * B;
+                        const char first = i == 0 && j == 0;
+                        if (layer->mode == POOL_AVG){
+                            for (size_t b = 0; b < B; b++) out[b] = (first ? 0.0 : out[b]) + x[b];
+                            continue;
+                        }
+                        for (size_t b = 0; b < B; b++){
+                            if (first || x[b] > out[b]){
+                                out[b] = x[b];
+                                arg[b] = in_row;
+                            }
+                        }
+                    }
+                }
+                if (layer->mode == POOL_AVG){
+                    for (size_t b = 0; b < B; b++) out[b] /= (double)(K * K);
+                }
+            }
+        }
+    }
+    return layer->a;
+};
+
+// Routes dC/da of the output back to the inputs of every window
+void backprop_pool2d_layer_(Pool2DLayer_* layer, const Matrix* delta_grad_next){
+    const size_t C = layer->channels, H = layer->in_height, W = layer->in_width;
+    const size_t K = layer->kernel_size, OH = layer->out_height, OW = layer->out_width;
+    const size_t B = delta_grad_next->n_cols;
+
+    matrix_resize(&layer->grad_delta, C * H * W, B);
+    memset(layer->grad_delta->data, 0, C * H * W * B * sizeof(double));
+    for (size_t c = 0; c < C; c++){
+        for (size_t oh = 0; oh < OH; oh++){
+            for (size_t ow = 0; ow < OW; ow++){
+                const size_t o = conv_feature_index(layer->layout, C, OH, OW, c, oh, ow);
+                const double* delta = delta_grad_next->data + o * B;
+
+                if (layer->mode == POOL_MAX){
+                    const size_t* arg = layer->argmax + o * B;
+                    for (size_t b = 0; b < B; b++) layer->grad_delta->data[arg[b] * B + b] += delta[b];
+                    continue;
+                }
+                for (size_t i = 0; i < K; i++){
+                    for (size_t j = 0; j < K; j++){
+                        double* g = layer->grad_delta->data + conv_feature_index(layer->layout, C, H, W, c, oh * layer->stride + i, ow * layer->stride + j) * B;
+                        for (size_t b = 0; b < B; b++) g[b] += delta[b] / (double)(K * K);
+                    }
+                }
+            }
+        }
+    }
+};
+
+void destroy_pool2d_layer_(Pool2DLayer_* layer){
+    if (layer == NULL) return;
+    Matrix* matrices[3] = {layer->input, layer->a, layer->grad_delta};
+    for (size_t i = 0; i < 3; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    free(layer->argmax);
+    memset(layer, 0, sizeof(Pool2DLayer_));
+};
+
+#pragma endregion Convolution Layerwise
+
+#pragma region Embedding Layerwise
+/*
+Lookup table for categorical features. The input holds num_fields integer ids per sample
+(num_fields x B, stored as doubles), the output the concatenated rows of every field
+((num_fields dim) x B, feature f * dim + d). The table is vocab_size x dim, one row per id.
+
+Only the rows of the ids in the batch take part in a step, so backward does not produce a
+dense vocab_size x dim gradient. It collects the distinct ids of the batch in touched and
+their gradients, batch means like the other layers, in the first num_touched rows of grad_rows.
+optimize_adam_ then updates only those rows and their moments (lazy Adam), and a step
+costs O(B num_fields dim) whatever the vocabulary size.
+
+Ids carry no gradient, an embedding layer has to be the first layer of a model.
+*/
+
+#define EMBEDDING_NO_SLOT ((size_t)-1)
+
+typedef struct EmbeddingLayer_{
+    size_t vocab_size;
+    size_t dim;
+    size_t num_fields;
+    Matrix* weights;        // vocab_size x dim
+    Matrix* a;              // (num_fields dim) x B
+    size_t* ids;            // ids of the last forward pass, field-major like the input
+    size_t num_ids;
+    size_t* touched;        // distinct ids of the last backward pass
+    size_t num_touched;
+    Matrix* grad_rows;      // sized for every id of the batch, row k < num_touched belongs to touched[k]
+    size_t* row_slot;       // vocab_size, slot of an id in touched while backward runs
+}EmbeddingLayer_;
+
+EmbeddingLayer_* create_embedding_layer(const size_t vocab_size, const size_t dim, const size_t num_fields){
+    if (vocab_size == 0 || dim == 0 || num_fields == 0){
+        printf("Embedding layer needs a vocabulary, a dimension and at least one field.\n");
+        exit(0);
+    }
+
+    EmbeddingLayer_* layer = (EmbeddingLayer_*)calloc(1, sizeof(EmbeddingLayer_));
+    layer->vocab_size = vocab_size;
+    layer->dim = dim;
+    layer->num_fields = num_fields;
+
+    // Uniform in +-1/sqrt(dim)
+    const double range = 1.0 / sqrt((double)dim);
+    matrix_create(&layer->weights, vocab_size, dim);
+    for (size_t k = 0; k < vocab_size * dim; k++) layer->weights->data[k] = range * (2.0 * rand() / (double)RAND_MAX - 1.0);
+
+    layer->row_slot = (size_t*)malloc(vocab_size * sizeof(size_t));
+    for (size_t id = 0; id < vocab_size; id++) layer->row_slot[id] = EMBEDDING_NO_SLOT;
+    return layer;
+};
+
+// X (num_fields x B ids) -> layer->a ((num_fields dim) x B)
+const Matrix* embedding_forward_(EmbeddingLayer_* layer, const Matrix* X){
+    if (X->n_rows != layer->num_fields){
+        printf("Input has %lu fields, the layer expects %lu.\n", X->n_rows, layer->num_fields);
+        exit(0);
+    }
+    const size_t B = X->n_cols, dim = layer->dim;
+
+    if (layer->num_ids != layer->num_fields * B){
+        layer->num_ids = layer->num_fields * B;
+        layer->ids = (size_t*)realloc(layer->ids, layer->num_ids * sizeof(size_t));
+        layer->touched = (size_t*)realloc(layer->touched, layer->num_ids * sizeof(size_t));
+    }
+    for (size_t k = 0; k < layer->num_ids; k++){
+        const double id = X->data[k];
+        if (id < 0.0 || id >= (double)layer->vocab_size || id != floor(id)){
+            printf("Id %f is not in the vocabulary of %lu ids.\n", id, layer->vocab_size);
+            exit(0);
+        }
+        layer->ids[k] = (size_t)id;
+    }
+
+    matrix_resize(&layer->a, layer->num_fields * dim, B);
+    for (size_t f = 0; f < layer->num_fields; f++){
+        for (size_t b = 0; b < B; b++){
+            const double* row = layer->weights->data + layer->ids[f * B + b] * dim;
+            double* out = layer->a->data + f * dim * B + b;
+            for (size_t d = 0; d < dim; d++) out[d * B] = row[d];
+        }
+    }
+    return layer->a;
+};
+
+// Sums dC/da of every lookup into the row of its id, ids repeated in the batch share a row
+void backprop_embedding_layer_(EmbeddingLayer_* layer, const Matrix* delta_grad_next){
+    const size_t B = delta_grad_next->n_cols, dim = layer->dim;
+    matrix_resize(&layer->grad_rows, layer->num_ids, dim);
+
+    layer->num_touched = 0;
+    for (size_t f = 0; f < layer->num_fields; f++){
+        for (size_t b = 0; b < B; b++){
+            const size_t id = layer->ids[f * B + b];
+            if (layer->row_slot[id] == EMBEDDING_NO_SLOT){
+                layer->row_slot[id] = layer->num_touched;
+                layer->touched[layer->num_touched] = id;
+                memset(layer->grad_rows->data + layer->num_touched * dim, 0, dim * sizeof(double));
+                layer->num_touched++;
+            }
+            double* grad = layer->grad_rows->data + layer->row_slot[id] * dim;
+            const double* delta = delta_grad_next->data + f * dim * B + b;
+            for (size_t d = 0; d < dim; d++) grad[d] += delta[d * B] / (double)B;
+        }
+    }
+
+    // Leave the slots clean for the next batch, touching only what was set
+    for (size_t k = 0; k < layer->num_touched; k++) layer->row_slot[layer->touched[k]] = EMBEDDING_NO_SLOT;
+};
+
+void destroy_embedding_layer_(EmbeddingLayer_* layer){
+    if (layer == NULL) return;
+    Matrix* matrices[3] = {layer->weights, layer->a, layer->grad_rows};
+    for (size_t i = 0; i < 3; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    free(layer->ids);
+    free(layer->touched);
+    free(layer->row_slot);
+    memset(layer, 0, sizeof(EmbeddingLayer_));
+};
+
+#pragma endregion Embedding Layerwise
+
+#pragma region Recurrent Layerwise
+/*
+LSTM and GRU layers over sequences of seq_len steps. A sample column holds the whole sequence,
+step after step ((T I) x B, feature t * I + i), the output is the last hidden state (H x B)
+or, with return_sequences, the hidden state of every step ((T H) x B, feature t * H + h).
+
+All G gates (LSTM: i, f, g, o, GRU: r, z, n) are stacked into one (G H) x I input matrix
+W_x and one (G H) x H recurrent matrix W_h, so a layer runs
+
+    gates = W_x * [x_0 .. x_T-1] + b            one GEMM for the whole sequence, up front
+    for t:  gates_t += W_h * h_t-1              one GEMM per step
+            h_t, c_t = cell(gates_t, c_t-1)     one fused elementwise pass
+
+    LSTM    c_t = f * c_t-1 + i * g,  h_t = o * tanh(c_t)
+    GRU     n = tanh(x_n + b_n + r * (W_hn h_t-1)),  h_t = (1 - z) * n + z * h_t-1
+
+The activated gates, hidden and cell states of every step stay in buffers sized on the first
+batch, backward reads them instead of recomputing. It runs the steps in reverse with one
+W_h^T GEMM per step and ends with single GEMMs for grad_W_x and the input gradient over the
+whole sequence. With bptt_steps > 0 the gradient carried through h and c is cut every
+bptt_steps steps, counted back from the last step (truncated BPTT). Without return_sequences
+nothing reaches the steps before the first cut and backward stops there.
+
+W_x and W_h share one allocation, params, which the optimizer updates as a single
+(G H) x (I + H) block. It is a flat view of both, not the matrix [W_x W_h].
+*/
+
+typedef struct RecurrentLayer_{
+    LayerType_ cell;            // LSTM or GRU
+    size_t input_size;
+    size_t hidden_size;
+    size_t seq_len;
+    size_t num_gates;
+    size_t bptt_steps;          // 0 backpropagates through the whole sequence
+    char return_sequences;
+    Matrix* params;             // W_x followed by W_h
+    Matrix* grad_params;
+    Matrix W_x;                 // (G H) x I, view into params
+    Matrix W_h;                 // (G H) x H, view into params
+    Matrix grad_W_x;
+    Matrix grad_W_h;
+    Matrix* biases;             // (G H) x 1
+    Matrix* grad_b;
+    Matrix* xs;                 // I x (T B), the input of step t in columns t * B ..
+    Matrix* gates;              // (G H) x (T B), activated gates of every step
+    Matrix* hn;                 // GRU, H x (T B), W_hn h_t-1 of every step
+    Matrix* hs;                 // ((T + 1) H) x B, h_-1 = 0 and the hidden state of every step
+    Matrix* cs;                 // LSTM, ((T + 1) H) x B, cell states
+    Matrix* zh;                 // (G H) x B, W_h h_t-1 of the current step
+    Matrix* a;
+    Matrix* dzx;                // (G H) x (T B), dC/d(gates pre-activation) of the input side
+    Matrix* dzh;                // (G H) x B, dC/d(W_h h_t-1) of the current step
+    Matrix* dh;                 // H x B, dC/dh carried to the step before
+    Matrix* dc;                 // LSTM, H x B, dC/dc carried to the step before
+    Matrix* grad_xs;
+    Matrix* grad_delta;         // (T I) x B
+    double* panel;
+}RecurrentLayer_;
+
+static inline double recurrent_sigmoid(const double x){
+    return 1.0 / (1.0 + exp(-x));
+};
+
+RecurrentLayer_* create_recurrent_layer(const LayerType_ cell, const size_t input_size, const size_t hidden_size, const size_t seq_len, const char return_sequences, const size_t bptt_steps){
+    if (cell != LSTM && cell != GRU){
+        printf("Recurrent layers are LSTM or GRU.\n");
+        exit(0);
+    }
+    if (input_size == 0 || hidden_size == 0 || seq_len == 0){
+        printf("Recurrent layer needs an input, a hidden state and at least one step.\n");
+        exit(0);
+    }
+
+    RecurrentLayer_* layer = (RecurrentLayer_*)calloc(1, sizeof(RecurrentLayer_));
+    layer->cell = cell;
+    layer->input_size = input_size;
+    layer->hidden_size = hidden_size;
+    layer->seq_len = seq_len;
+    layer->num_gates = cell == LSTM ? 4 : 3;
+    layer->bptt_steps = bptt_steps;
+    layer->return_sequences = return_sequences;
+
+    const size_t GH = layer->num_gates * hidden_size;
+    matrix_create(&layer->params, GH, input_size + hidden_size);
+    matrix_create(&layer->grad_params, GH, input_size + hidden_size);
+    layer->W_x = (Matrix){layer->params->data, GH, input_size};
+    layer->W_h = (Matrix){layer->params->data + GH * input_size, GH, hidden_size};
+    layer->grad_W_x = (Matrix){layer->grad_params->data, GH, input_size};
+    layer->grad_W_h = (Matrix){layer->grad_params->data + GH * input_size, GH, hidden_size};
+    matrix_create(&layer->biases, GH, 1);
+    matrix_create(&layer->grad_b, GH, 1);
+
+    // Uniform in +-1/sqrt(H), LSTM forget gates start open
+    const double range = 1.0 / sqrt((double)hidden_size);
+    for (size_t k = 0; k < GH * (input_size + hidden_size); k++) layer->params->data[k] = range * (2.0 * rand() / (double)RAND_MAX - 1.0);
+    if (cell == LSTM){
+        for (size_t u = 0; u < hidden_size; u++) layer->biases->data[hidden_size + u] = 1.0;
+    }
+
+    layer->panel = (double*)malloc(GEMM_PANEL_SIZE * sizeof(double));
+    return layer;
+};
+
+// X ((T I) x B) -> layer->a, (H x B) or ((T H) x B) with return_sequences
+const Matrix* recurrent_forward_(RecurrentLayer_* layer, const Matrix* X){
+    const size_t I = layer->input_size, H = layer->hidden_size, T = layer->seq_len, GH = layer->num_gates * H;
+    if (X->n_rows != T * I){
+        printf("Input has %lu features, the layer expects %lu steps of %lu.\n", X->n_rows, T, I);
+        exit(0);
+    }
+    const size_t B = X->n_cols, TB = T * B;
+
+    // Input projection of every step in one GEMM
+    matrix_resize(&layer->xs, I, TB);
+    for (size_t t = 0; t < T; t++){
+        for (size_t i = 0; i < I; i++) memcpy(layer->xs->data + i * TB + t * B, X->data + (t * I + i) * B, B * sizeof(double));
+    }
+    matrix_resize(&layer->gates, GH, TB);
+    matrix_gemm_with_panel(0, 0, 1.0, &layer->W_x, layer->xs, 0.0, layer->gates, layer->panel);
+
+    matrix_resize(&layer->hs, (T + 1) * H, B);
+    matrix_resize(&layer->zh, GH, B);
+    memset(layer->hs->data, 0, H * B * sizeof(double));
+    if (layer->cell == LSTM){
+        matrix_resize(&layer->cs, (T + 1) * H, B);
+        memset(layer->cs->data, 0, H * B * sizeof(double));
+    }else{
+        matrix_resize(&layer->hn, H, TB);
+    }
+
+    double* gates = layer->gates->data;
+    const double* zh = layer->zh->data;
+    const double* bias = layer->biases->data;
+    for (size_t t = 0; t < T; t++){
+        const Matrix h_prev = {layer->hs->data + t * H * B, H, B};
+        double* h = layer->hs->data + (t + 1) * H * B;
+        matrix_gemm_with_panel(0, 0, 1.0, &layer->W_h, &h_prev, 0.0, layer->zh, layer->panel);
+
+        for (size_t u = 0; u < H; u++){
+            for (size_t b = 0; b < B; b++){
+                const size_t col = t * B + b, k = u * B + b;
+                if (layer->cell == LSTM){
+                    double* gi = gates + u * TB + col;
+                    double* gf = gates + (H + u) * TB + col;
+                    double* gg = gates + (2 * H + u) * TB + col;
+                    double* go = gates + (3 * H + u) * TB + col;
+                    *gi = recurrent_sigmoid(*gi + zh[u * B + b] + bias[u]);
+                    *gf = recurrent_sigmoid(*gf + zh[(H + u) * B + b] + bias[H + u]);
+                    *gg = tanh(*gg + zh[(2 * H + u) * B + b] + bias[2 * H + u]);
+                    *go = recurrent_sigmoid(*go + zh[(3 * H + u) * B + b] + bias[3 * H + u]);
+
+                    const double c = *gf * layer->cs->data[t * H * B + k] + *gi * *gg;
+                    layer->cs->data[(t + 1) * H * B + k] = c;
+                    h[k] = *go * tanh(c);
+                }else{
+                    double* gr = gates + u * TB + col;
+                    double* gz = gates + (H + u) * TB + col;
+                    double* gn = gates + (2 * H + u) * TB + col;
+                    const double hn = zh[(2 * H + u) * B + b];
+                    *gr = recurrent_sigmoid(*gr + zh[u * B + b] + bias[u]);
+                    *gz = recurrent_sigmoid(*gz + zh[(H + u) * B + b] + bias[H + u]);
+                    *gn = tanh(*gn + bias[2 * H + u] + *gr * hn);
+                    layer->hn->data[u * TB + col] = hn;
+                    h[k] = (1.0 - *gz) * *gn + *gz * h_prev.data[k];
+                }
+            }
+        }
+    }
+
+    if (layer->return_sequences){
+        matrix_resize(&layer->a, T * H, B);
+        memcpy(layer->a->data, layer->hs->data + H * B, T * H * B * sizeof(double));
+    }else{
+        matrix_resize(&layer->a, H, B);
+        memcpy(layer->a->data, layer->hs->data + T * H * B, H * B * sizeof(double));
+    }
+    return layer->a;
+};
+
+// delta_grad_next is dC/da of the layer output. Parameter gradients are batch means,
+// grad_delta the per-sample dC/dx ((T I) x B).
+void backprop_recurrent_layer_(RecurrentLayer_* layer, const Matrix* delta_grad_next){
+    const size_t I = layer->input_size, H = layer->hidden_size, T = layer->seq_len, GH = layer->num_gates * H;
+    const size_t B = delta_grad_next->n_cols, TB = T * B;
+    const size_t k_cut = layer->bptt_steps;
+
+    matrix_resize(&layer->dzx, GH, TB);
+    matrix_resize(&layer->dzh, GH, B);
+    matrix_resize(&layer->dh, H, B);
+    memset(layer->dh->data, 0, H * B * sizeof(double));
+    if (layer->cell == LSTM){
+        matrix_resize(&layer->dc, H, B);
+        memset(layer->dc->data, 0, H * B * sizeof(double));
+    }
+    // Steps cut off by the truncation are never written
+    if (k_cut > 0 && !layer->return_sequences) memset(layer->dzx->data, 0, GH * TB * sizeof(double));
+    memset(layer->grad_params->data, 0, GH * (I + H) * sizeof(double));
+
+    const double* gates = layer->gates->data;
+    double* dzx = layer->dzx->data;
+    double* dzh = layer->dzh->data;
+    double* dh = layer->dh->data;
+    for (size_t t = T; t-- > 0;){
+        const Matrix h_prev = {layer->hs->data + t * H * B, H, B};
+
+        if (layer->return_sequences || t == T - 1){
+            const double* delta = delta_grad_next->data + (layer->return_sequences ? t * H * B : 0);
+            for (size_t k = 0; k < H * B; k++) dh[k] += delta[k];
+        }
+
+        for (size_t u = 0; u < H; u++){
+            for (size_t b = 0; b < B; b++){
+                const size_t col = t * B + b, k = u * B + b;
+                const double dh_k = dh[k];
+                if (layer->cell == LSTM){
+                    const double gi = gates[u * TB + col], gf = gates[(H + u) * TB + col];
+                    const double gg = gates[(2 * H + u) * TB + col], go = gates[(3 * H + u) * TB + col];
+                    const double tanh_c = tanh(layer->cs->data[(t + 1) * H * B + k]);
+                    const double dc_k = layer->dc->data[k] + dh_k * go * (1.0 - tanh_c * tanh_c);
+
+                    dzx[u * TB + col] = dzh[u * B + b] = dc_k * gg * gi * (1.0 - gi);
+                    dzx[(H + u) * TB + col] = dzh[(H + u) * B + b] = dc_k * layer->cs->data[t * H * B + k] * gf * (1.0 - gf);
+                    dzx[(2 * H + u) * TB + col] = dzh[(2 * H + u) * B + b] = dc_k * gi * (1.0 - gg * gg);
+                    dzx[(3 * H + u) * TB + col] = dzh[(3 * H + u) * B + b] = dh_k * tanh_c * go * (1.0 - go);
+                    layer->dc->data[k] = dc_k * gf;
+                }else{
+                    const double gr = gates[u * TB + col], gz = gates[(H + u) * TB + col], gn = gates[(2 * H + u) * TB + col];
+                    const double dn = dh_k * (1.0 - gz) * (1.0 - gn * gn);
+                    const double dr = dn * layer->hn->data[u * TB + col] * gr * (1.0 - gr);
+                    const double dz = dh_k * (h_prev.data[k] - gn) * gz * (1.0 - gz);
+
+                    dzx[u * TB + col] = dzh[u * B + b] = dr;
+                    dzx[(H + u) * TB + col] = dzh[(H + u) * B + b] = dz;
+                    dzx[(2 * H + u) * TB + col] = dn;
+                    dzh[(2 * H + u) * B + b] = dn * gr;
+                    // Direct path h_t = ... + z * h_t-1, the recurrent GEMM adds to it
+                    dh[k] = dh_k * gz;
+                }
+            }
+        }
+
+        matrix_gemm_with_panel(0, 1, 1.0 / (double)B, layer->dzh, &h_prev, 1.0, &layer->grad_W_h, layer->panel);
+        matrix_gemm_with_panel(1, 0, 1.0, &layer->W_h, layer->dzh, layer->cell == LSTM ? 0.0 : 1.0, layer->dh, layer->panel);
+
+        if (k_cut > 0 && (T - t) % k_cut == 0){
+            if (!layer->return_sequences) break;
+            memset(dh, 0, H * B * sizeof(double));
+            if (layer->cell == LSTM) memset(layer->dc->data, 0, H * B * sizeof(double));
+        }
+    }
+
+    // Input side of the whole sequence in one GEMM each
+    matrix_gemm_with_panel(0, 1, 1.0 / (double)B, layer->dzx, layer->xs, 0.0, &layer->grad_W_x, layer->panel);
+    for (size_t r = 0; r < GH; r++){
+        double sum = 0.0;
+        for (size_t k = 0; k < TB; k++) sum += dzx[r * TB + k];
+        layer->grad_b->data[r] = sum / (double)B;
+    }
+    matrix_resize(&layer->grad_xs, I, TB);
+    matrix_gemm_with_panel(1, 0, 1.0, &layer->W_x, layer->dzx, 0.0, layer->grad_xs, layer->panel);
+    matrix_resize(&layer->grad_delta, T * I, B);
+    for (size_t t = 0; t < T; t++){
+        for (size_t i = 0; i < I; i++) memcpy(layer->grad_delta->data + (t * I + i) * B, layer->grad_xs->data + i * TB + t * B, B * sizeof(double));
+    }
+};
+
+void destroy_recurrent_layer_(RecurrentLayer_* layer){
+    if (layer == NULL) return;
+    Matrix* matrices[17] = {layer->params, layer->grad_params, layer->biases, layer->grad_b, layer->xs, layer->gates, layer->hn, layer->hs, layer->cs,
+                            layer->zh, layer->a, layer->dzx, layer->dzh, layer->dh, layer->dc, layer->grad_xs, layer->grad_delta};
+    for (size_t i = 0; i < 17; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    free(layer->panel);
+    memset(layer, 0, sizeof(RecurrentLayer_));
+};
+
+#pragma endregion Recurrent Layerwise
+
+#pragma region Attention Layerwise
+/*
+Multi-head self-attention over N tokens of D features. A sample column holds the tokens one
+after the other ((N D) x B, feature n * D + d) and the output has the same shape:
+
+    [Q K V] = W_qkv x + b_qkv                        one GEMM over all tokens of the batch
+    O_h     = softmax(Q_h K_h^T / sqrt(D / heads)) V_h    per sample and head
+    a       = W_o [O_1 .. O_heads] + b_o             one GEMM
+
+The N x N scores are never stored. Every head walks over tiles of ATTENTION_TILE_ROWS queries
+and ATTENTION_TILE_COLS keys with an online softmax: each key tile rescales the running row
+maxima, row sums and output rows, then adds P V of the tile through the blocked GEMM. Only the
+log-sum-exp of each query row is kept for backward, which recomputes the probabilities of a
+tile from it instead of reading them back, so activations are O(N D) per sample rather than
+O(heads N^2).
+
+W_qkv and W_o are stored one above the other in params ((4 D) x D), b_qkv and b_o likewise
+in biases, which is what the optimizer updates.
+*/
+
+#define ATTENTION_TILE_ROWS 64
+#define ATTENTION_TILE_COLS 64
+
+typedef struct AttentionLayer_{
+    size_t seq_len;
+    size_t model_dim;
+    size_t num_heads;
+    size_t head_dim;
+    Matrix* params;             // W_qkv above W_o
+    Matrix* grad_params;
+    Matrix W_qkv;               // (3 D) x D, view into params
+    Matrix W_o;                 // D x D, view into params
+    Matrix grad_W_qkv;
+    Matrix grad_W_o;
+    Matrix* biases;             // b_qkv above b_o
+    Matrix* grad_b;
+    Matrix* xs;                 // D x (B N), token n of sample b in column b N + n
+    Matrix* qkv;                // (3 D) x (B N)
+    Matrix* heads;              // Q, K and V of every sample and head as N x head_dim blocks
+    Matrix* o_heads;            // attention output of every sample and head, N x head_dim blocks
+    Matrix* lse;                // log-sum-exp of every query row
+    Matrix* oc;                 // D x (B N), heads side by side
+    Matrix* out;                // D x (B N)
+    Matrix* a;                  // (N D) x B
+    Matrix* s_tile;             // scores and probabilities of one tile
+    Matrix* dp_tile;
+    double* row_max;
+    double* row_sum;
+    Matrix* d_out;
+    Matrix* d_oc;
+    Matrix* d_o_heads;
+    Matrix* d_heads;
+    Matrix* d_rows;             // rowsum(dO * O) of one head
+    Matrix* d_qkv;
+    Matrix* grad_xs;
+    Matrix* grad_delta;         // (N D) x B
+    double* panel;
+}AttentionLayer_;
+
+AttentionLayer_* create_attention_layer(const size_t seq_len, const size_t model_dim, const size_t num_heads){
+    if (seq_len == 0 || num_heads == 0 || model_dim % num_heads != 0){
+        printf("Attention layer needs tokens and a model dimension divisible by the number of heads.\n");
+        exit(0);
+    }
+
+    AttentionLayer_* layer = (AttentionLayer_*)calloc(1, sizeof(AttentionLayer_));
+    const size_t D = model_dim;
+    layer->seq_len = seq_len;
+    layer->model_dim = D;
+    layer->num_heads = num_heads;
+    layer->head_dim = D / num_heads;
+
+    matrix_create(&layer->params, 4 * D, D);
+    matrix_create(&layer->grad_params, 4 * D, D);
+    layer->W_qkv = (Matrix){layer->params->data, 3 * D, D};
+    layer->W_o = (Matrix){layer->params->data + 3 * D * D, D, D};
+    layer->grad_W_qkv = (Matrix){layer->grad_params->data, 3 * D, D};
+    layer->grad_W_o = (Matrix){layer->grad_params->data + 3 * D * D, D, D};
+    matrix_create(&layer->biases, 4 * D, 1);
+    matrix_create(&layer->grad_b, 4 * D, 1);
+
+    // Uniform in +-1/sqrt(D)
+    const double range = 1.0 / sqrt((double)D);
+    for (size_t k = 0; k < 4 * D * D; k++) layer->params->data[k] = range * (2.0 * rand() / (double)RAND_MAX - 1.0);
+
+    matrix_create(&layer->s_tile, ATTENTION_TILE_ROWS, ATTENTION_TILE_COLS);
+    matrix_create(&layer->dp_tile, ATTENTION_TILE_ROWS, ATTENTION_TILE_COLS);
+    layer->row_max = (double*)malloc(ATTENTION_TILE_ROWS * sizeof(double));
+    layer->row_sum = (double*)malloc(ATTENTION_TILE_ROWS * sizeof(double));
+    layer->panel = (double*)malloc(GEMM_PANEL_SIZE * sizeof(double));
+    return layer;
+};
+
+// N x head_dim block of Q (s = 0), K (1) or V (2) of sample b and head h
+static inline double* attention_head(const AttentionLayer_* layer, const Matrix* heads, const size_t s, const size_t B, const size_t b, const size_t h){
+    return heads->data + ((s * B + b) * layer->num_heads + h) * layer->seq_len * layer->head_dim;
+};
+
+// Online softmax over the key tiles of every query tile of one head, O and lse are written
+static void attention_head_forward(AttentionLayer_* layer, const double* Q, const double* K, const double* V, double* O, double* lse){
+    const size_t N = layer->seq_len, dh = layer->head_dim;
+    const double scale = 1.0 / sqrt((double)dh);
+    double* m = layer->row_max;
+    double* l = layer->row_sum;
+
+    for (size_t i0 = 0; i0 < N; i0 += ATTENTION_TILE_ROWS){
+        const size_t br = N - i0 < ATTENTION_TILE_ROWS ? N - i0 : ATTENTION_TILE_ROWS;
+        const Matrix Q_i = {(double*)Q + i0 * dh, br, dh};
+        Matrix O_i = {O + i0 * dh, br, dh};
+        memset(O_i.data, 0, br * dh * sizeof(double));
+        for (size_t r = 0; r < br; r++){
+            m[r] = -INFINITY;
+            l[r] = 0.0;
+        }
+
+        for (size_t j0 = 0; j0 < N; j0 += ATTENTION_TILE_COLS){
+            const size_t bc = N - j0 < ATTENTION_TILE_COLS ? N - j0 : ATTENTION_TILE_COLS;
+            const Matrix K_j = {(double*)K + j0 * dh, bc, dh};
+            const Matrix V_j = {(double*)V + j0 * dh, bc, dh};
+            Matrix S = {layer->s_tile->data, br, bc};
+            matrix_gemm_with_panel(0, 1, scale, &Q_i, &K_j, 0.0, &S, layer->panel);
+
+            for (size_t r = 0; r < br; r++){
+                double* s_r = S.data + r * bc;
+                double m_new = m[r];
+                for (size_t c = 0; c < bc; c++) m_new = s_r[c] > m_new ? s_r[c] : m_new;
+                const double correction = exp(m[r] - m_new);
+                double sum = 0.0;
+                for (size_t c = 0; c < bc; c++){
+                    s_r[c] = exp(s_r[c] - m_new);
+                    sum += s_r[c];
+                }
+                l[r] = l[r] * correction + sum;
+                m[r] = m_new;
+                for (size_t j = 0; j < dh; j++) O_i.data[r * dh + j] *= correction;
+            }
+            matrix_gemm_with_panel(0, 0, 1.0, &S, &V_j, 1.0, &O_i, layer->panel);
+        }
+
+        for (size_t r = 0; r < br; r++){
+            for (size_t j = 0; j < dh; j++) O_i.data[r * dh + j] /= l[r];
+            lse[i0 + r] = m[r] + log(l[r]);
+        }
+    }
+};
+
+// X ((N D) x B) -> layer->a ((N D) x B)
+const Matrix* attention_forward_(AttentionLayer_* layer, const Matrix* X){
+    const size_t N = layer->seq_len, D = layer->model_dim, H = layer->num_heads, dh = layer->head_dim;
+    if (X->n_rows != N * D){
+        printf("Input has %lu features, the layer expects %lu tokens of %lu.\n", X->n_rows, N, D);
+        exit(0);
+    }
+    const size_t B = X->n_cols, BN = B * N;
+
+    matrix_resize(&layer->xs, D, BN);
+    for (size_t n = 0; n < N; n++){
+        for (size_t d = 0; d < D; d++){
+            const double* x = X->data + (n * D + d) * B;
+            for (size_t b = 0; b < B; b++) layer->xs->data[d * BN + b * N + n] = x[b];
+        }
+    }
+    matrix_resize(&layer->qkv, 3 * D, BN);
+    matrix_gemm_with_panel(0, 0, 1.0, &layer->W_qkv, layer->xs, 0.0, layer->qkv, layer->panel);
+
+    // Bias and split into per-head blocks
+    matrix_resize(&layer->heads, 3 * B * H * N, dh);
+    for (size_t s = 0; s < 3; s++){
+        for (size_t h = 0; h < H; h++){
+            for (size_t j = 0; j < dh; j++){
+                const size_t row = s * D + h * dh + j;
+                const double* q = layer->qkv->data + row * BN;
+                const double bias = layer->biases->data[row];
+                for (size_t b = 0; b < B; b++){
+                    double* block = attention_head(layer, layer->heads, s, B, b, h);
+                    for (size_t n = 0; n < N; n++) block[n * dh + j] = q[b * N + n] + bias;
+                }
+            }
+        }
+    }
+
+    matrix_resize(&layer->o_heads, B * H * N, dh);
+    matrix_resize(&layer->lse, B * H * N, 1);
+    for (size_t b = 0; b < B; b++){
+        for (size_t h = 0; h < H; h++){
+            const size_t block = (b * H + h) * N;
+            attention_head_forward(layer, attention_head(layer, layer->heads, 0, B, b, h), attention_head(layer, layer->heads, 1, B, b, h),
+                                   attention_head(layer, layer->heads, 2, B, b, h), layer->o_heads->data + block * dh, layer->lse->data + block);
+        }
+    }
+
+    matrix_resize(&layer->oc, D, BN);
+    for (size_t b = 0; b < B; b++){
+        for (size_t h = 0; h < H; h++){
+            const double* o = layer->o_heads->data + (b * H + h) * N * dh;
+            for (size_t n = 0; n < N; n++){
+                for (size_t j = 0; j < dh; j++) layer->oc->data[(h * dh + j) * BN + b * N + n] = o[n * dh + j];
+            }
+        }
+    }
+    matrix_resize(&layer->out, D, BN);
+    matrix_gemm_with_panel(0, 0, 1.0, &layer->W_o, layer->oc, 0.0, layer->out, layer->panel);
+
+    matrix_resize(&layer->a, N * D, B);
+    for (size_t d = 0; d < D; d++){
+        const double* out = layer->out->data + d * BN;
+        const double bias = layer->biases->data[3 * D + d];
+        for (size_t b = 0; b < B; b++){
+            for (size_t n = 0; n < N; n++) layer->a->data[(n * D + d) * B + b] = out[b * N + n] + bias;
+        }
+    }
+    return layer->a;
+};
+
+// Recomputes the probabilities of every tile from lse and accumulates dQ, dK and dV of one head
+static void attention_head_backward(AttentionLayer_* layer, const double* Q, const double* K, const double* V, const double* O, const double* lse,
+                                    const double* dO, double* dQ, double* dK, double* dV){
+    const size_t N = layer->seq_len, dh = layer->head_dim;
+    const double scale = 1.0 / sqrt((double)dh);
+
+    // D_n = rowsum(dO * O), the softmax backward term of every query row
+    matrix_resize(&layer->d_rows, N, 1);
+    double* d_rows = layer->d_rows->data;
+    for (size_t n = 0; n < N; n++){
+        double sum = 0.0;
+        for (size_t j = 0; j < dh; j++) sum += dO[n * dh + j] * O[n * dh + j];
+        d_rows[n] = sum;
+    }
+    memset(dQ, 0, N * dh * sizeof(double));
+    memset(dK, 0, N * dh * sizeof(double));
+    memset(dV, 0, N * dh * sizeof(double));
+
+    for (size_t j0 = 0; j0 < N; j0 += ATTENTION_TILE_COLS){
+        const size_t bc = N - j0 < ATTENTION_TILE_COLS ? N - j0 : ATTENTION_TILE_COLS;
+        const Matrix K_j = {(double*)K + j0 * dh, bc, dh};
+        const Matrix V_j = {(double*)V + j0 * dh, bc, dh};
+        Matrix dK_j = {dK + j0 * dh, bc, dh};
+        Matrix dV_j = {dV + j0 * dh, bc, dh};
+
+        for (size_t i0 = 0; i0 < N; i0 += ATTENTION_TILE_ROWS){
+            const size_t br = N - i0 < ATTENTION_TILE_ROWS ? N - i0 : ATTENTION_TILE_ROWS;
+            const Matrix Q_i = {(double*)Q + i0 * dh, br, dh};
+            const Matrix dO_i = {(double*)dO + i0 * dh, br, dh};
+            Matrix dQ_i = {dQ + i0 * dh, br, dh};
+            Matrix P = {layer->s_tile->data, br, bc};
+            Matrix dP = {layer->dp_tile->data, br, bc};
+
+            matrix_gemm_with_panel(0, 1, scale, &Q_i, &K_j, 0.0, &P, layer->panel);
+            for (size_t r = 0; r < br; r++){
+                for (size_t c = 0; c < bc; c++) P.data[r * bc + c] = exp(P.data[r * bc + c] - lse[i0 + r]);
+            }
+            matrix_gemm_with_panel(1, 0, 1.0, &P, &dO_i, 1.0, &dV_j, layer->panel);
+            matrix_gemm_with_panel(0, 1, 1.0, &dO_i, &V_j, 0.0, &dP, layer->panel);
+
+            // dS = P * (dP - D), dP is overwritten
+            for (size_t r = 0; r < br; r++){
+                for (size_t c = 0; c < bc; c++) dP.data[r * bc + c] = P.data[r * bc + c] * (dP.data[r * bc + c] - d_rows[i0 + r]);
+            }
+            matrix_gemm_with_panel(0, 0, scale, &dP, &K_j, 1.0, &dQ_i, layer->panel);
+            matrix_gemm_with_panel(1, 0, scale, &dP, &Q_i, 1.0, &dK_j, layer->panel);
+        }
+    }
+};
+
+// delta_grad_next is dC/da ((N D) x B). Parameter gradients are batch means,
+// grad_delta the per-sample dC/dx.
+void backprop_attention_layer_(AttentionLayer_* layer, const Matrix* delta_grad_next){
+    const size_t N = layer->seq_len, D = layer->model_dim, H = layer->num_heads, dh = layer->head_dim;
+    const size_t B = delta_grad_next->n_cols, BN = B * N;
+
+    // Output projection
+    matrix_resize(&layer->d_out, D, BN);
+    for (size_t d = 0; d < D; d++){
+        double sum = 0.0;
+        for (size_t n = 0; n < N; n++){
+            const double* delta = delta_grad_next->data + (n * D + d) * B;
+            for (size_t b = 0; b < B; b++){
+                layer->d_out->data[d * BN + b * N + n] = delta[b];
+                sum += delta[b];
+            }
+        }
+        layer->grad_b->data[3 * D + d] = sum / (double)B;
+    }
+    matrix_gemm_with_panel(0, 1, 1.0 / (double)B, layer->d_out, layer->oc, 0.0, &layer->grad_W_o, layer->panel);
+    matrix_resize(&layer->d_oc, D, BN);
+    matrix_gemm_with_panel(1, 0, 1.0, &layer->W_o, layer->d_out, 0.0, layer->d_oc, layer->panel);
+
+    // Attention of every sample and head
+    matrix_resize(&layer->d_o_heads, B * H * N, dh);
+    for (size_t b = 0; b < B; b++){
+        for (size_t h = 0; h < H; h++){
+            double* d_o = layer->d_o_heads->data + (b * H + h) * N * dh;
+            for (size_t n = 0; n < N; n++){
+                for (size_t j = 0; j < dh; j++) d_o[n * dh + j] = layer->d_oc->data[(h * dh + j) * BN + b * N + n];
+            }
+        }
+    }
+    matrix_resize(&layer->d_heads, 3 * B * H * N, dh);
+    for (size_t b = 0; b < B; b++){
+        for (size_t h = 0; h < H; h++){
+            const size_t block = (b * H + h) * N;
+            attention_head_backward(layer, attention_head(layer, layer->heads, 0, B, b, h), attention_head(layer, layer->heads, 1, B, b, h),
+                                    attention_head(layer, layer->heads, 2, B, b, h), layer->o_heads->data + block * dh, layer->lse->data + block,
+                                    layer->d_o_heads->data + block * dh, attention_head(layer, layer->d_heads, 0, B, b, h),
+                                    attention_head(layer, layer->d_heads, 1, B, b, h), attention_head(layer, layer->d_heads, 2, B, b, h));
+        }
+    }
+
+    // Input projection
+    matrix_resize(&layer->d_qkv, 3 * D, BN);
+    for (size_t s = 0; s < 3; s++){
+        for (size_t h = 0; h < H; h++){
+            for (size_t j = 0; j < dh; j++){
+                const size_t row = s * D + h * dh + j;
+                double* d_q = layer->d_qkv->data + row * BN;
+                double sum = 0.0;
+                for (size_t b = 0; b < B; b++){
+                    const double* block = attention_head(layer, layer->d_heads, s, B, b, h);
+                    for (size_t n = 0; n < N; n++){
+                        d_q[b * N + n] = block[n * dh + j];
+                        sum += block[n * dh + j];
+                    }
+                }
+                layer->grad_b->data[row] = sum / (double)B;
+            }
+        }
+    }
+    matrix_gemm_with_panel(0, 1, 1.0 / (double)B, layer->d_qkv, layer->xs, 0.0, &layer->grad_W_qkv, layer->panel);
+    matrix_resize(&layer->grad_xs, D, BN);
+    matrix_gemm_with_panel(1, 0, 1.0, &layer->W_qkv, layer->d_qkv, 0.0, layer->grad_xs, layer->panel);
+
+    matrix_resize(&layer->grad_delta, N * D, B);
+    for (size_t n = 0; n < N; n++){
+        for (size_t d = 0; d < D; d++){
+            double* g = layer->grad_delta->data + (n * D + d) * B;
+            for (size_t b = 0; b < B; b++) g[b] = layer->grad_xs->data[d * BN + b * N + n];
+        }
+    }
+};
+
+void destroy_attention_layer_(AttentionLayer_* layer){
+    if (layer == NULL) return;
+    Matrix* matrices[22] = {layer->params, layer->grad_params, layer->biases, layer->grad_b, layer->xs, layer->qkv, layer->heads, layer->o_heads,
+                            layer->lse, layer->oc, layer->out, layer->a, layer->s_tile, layer->dp_tile, layer->d_out, layer->d_oc, layer->d_o_heads,
+                            layer->d_heads, layer->d_rows, layer->d_qkv, layer->grad_xs, layer->grad_delta};
+    for (size_t i = 0; i < 22; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    free(layer->row_max);
+    free(layer->row_sum);
+    free(layer->panel);
+    memset(layer, 0, sizeof(AttentionLayer_));
+};
+
+#pragma endregion Attention Layerwise
+
+// Dense parameters and gradients of a layerwise layer, returns 0 for layers without them.
+// Embeddings have sparse gradients and are updated row by row instead.
+char layer_params_(const Layer_* layer_ptr, Matrix** weights, Matrix** biases, Matrix** grad_W, Matrix** grad_b){
+    switch(layer_ptr->type){
+        case FF:
+            *weights = layer_ptr->layer.ff_layer->weights;
+            *biases = layer_ptr->layer.ff_layer->biases;
+            *grad_W = layer_ptr->layer.ff_layer->grad_W;
+            *grad_b = layer_ptr->layer.ff_layer->grad_b;
+            return 1;
+        case CONV2D:
+            *weights = layer_ptr->layer.conv_layer->weights;
+            *biases = layer_ptr->layer.conv_layer->biases;
+            *grad_W = layer_ptr->layer.conv_layer->grad_W;
+            *grad_b = layer_ptr->layer.conv_layer->grad_b;
+            return 1;
+        case LSTM:
+        case GRU:
+            *weights = layer_ptr->layer.recurrent_layer->params;
+            *biases = layer_ptr->layer.recurrent_layer->biases;
+            *grad_W = layer_ptr->layer.recurrent_layer->grad_params;
+            *grad_b = layer_ptr->layer.recurrent_layer->grad_b;
+            return 1;
+        case ATTENTION:
+            *weights = layer_ptr->layer.attention_layer->params;
+            *biases = layer_ptr->layer.attention_layer->biases;
+            *grad_W = layer_ptr->layer.attention_layer->grad_params;
+            *grad_b = layer_ptr->layer.attention_layer->grad_b;
+            return 1;
+        default:
+            *weights = *biases = *grad_W = *grad_b = NULL;
+            return 0;
+    }
+};
+
+// Features per sample a layerwise layer reads and writes
+size_t layer_input_size_(const Layer_* layer_ptr){
+    switch(layer_ptr->type){
+        case FF: return layer_ptr->layer.ff_layer->weights->n_cols;
+        case CONV2D:{
+            const Conv2DLayer_* conv = layer_ptr->layer.conv_layer;
+            return conv->in_channels * conv->in_height * conv->in_width;
+        }
+        case POOL2D:{
+            const Pool2DLayer_* pool = layer_ptr->layer.pool_layer;
+            return pool->channels * pool->in_height * pool->in_width;
+        }
+        case EMBEDDING: return layer_ptr->layer.embedding_layer->num_fields;
+        case LSTM:
+        case GRU: return layer_ptr->layer.recurrent_layer->seq_len * layer_ptr->layer.recurrent_layer->input_size;
+        case ATTENTION: return layer_ptr->layer.attention_layer->seq_len * layer_ptr->layer.attention_layer->model_dim;
+        default:
+            printf("Layer type not supported.\n");
+            exit(0);
+    }
+};
+
+size_t layer_output_size_(const Layer_* layer_ptr){
+    switch(layer_ptr->type){
+        case FF: return layer_ptr->layer.ff_layer->weights->n_rows;
+        case CONV2D:{
+            const Conv2DLayer_* conv = layer_ptr->layer.conv_layer;
+            return conv->out_channels * conv->out_height * conv->out_width;
+        }
+        case POOL2D:{
+            const Pool2DLayer_* pool = layer_ptr->layer.pool_layer;
+            return pool->channels * pool->out_height * pool->out_width;
+        }
+        case EMBEDDING: return layer_ptr->layer.embedding_layer->num_fields * layer_ptr->layer.embedding_layer->dim;
+        case LSTM:
+        case GRU:{
+            const RecurrentLayer_* recurrent = layer_ptr->layer.recurrent_layer;
+            return recurrent->return_sequences ? recurrent->seq_len * recurrent->hidden_size : recurrent->hidden_size;
+        }
+        case ATTENTION: return layer_ptr->layer.attention_layer->seq_len * layer_ptr->layer.attention_layer->model_dim;
+        default:
+            printf("Layer type not supported.\n");
+            exit(0);
+    }
+};
+
+// Forward pass of any layerwise layer, the input must stay unchanged until its backward pass
+const Matrix* layer_forward_(Layer_* layer_ptr, const Matrix* X){
+    switch(layer_ptr->type){
+        case FF: return feed_forward_forward_(layer_ptr->layer.ff_layer, X);
+        case CONV2D: return conv2d_forward_(layer_ptr->layer.conv_layer, X);
+        case POOL2D: return pool2d_forward_(layer_ptr->layer.pool_layer, X);
+        case EMBEDDING: return embedding_forward_(layer_ptr->layer.embedding_layer, X);
+        case LSTM:
+        case GRU: return recurrent_forward_(layer_ptr->layer.recurrent_layer, X);
+        case ATTENTION: return attention_forward_(layer_ptr->layer.attention_layer, X);
+        default:
+            printf("Layer type not supported.\n");
+            exit(0);
+    }
+};
+
+// Backward pass of any layerwise layer, returns dC/dx of its input (NULL for embeddings)
+const Matrix* layer_backward_(Layer_* layer_ptr, Matrix* delta_grad_next){
+    switch(layer_ptr->type){
+        case FF:
+            backprop_feed_forward_layer(layer_ptr->layer.ff_layer, delta_grad_next);
+            return layer_ptr->layer.ff_layer->grad_delta;
+        case CONV2D:
+            backprop_conv2d_layer_(layer_ptr->layer.conv_layer, delta_grad_next);
+            return layer_ptr->layer.conv_layer->grad_delta;
+        case POOL2D:
+            backprop_pool2d_layer_(layer_ptr->layer.pool_layer, delta_grad_next);
+            return layer_ptr->layer.pool_layer->grad_delta;
+        case EMBEDDING:
+            backprop_embedding_layer_(layer_ptr->layer.embedding_layer, delta_grad_next);
+            return NULL;
+        case LSTM:
+        case GRU:
+            backprop_recurrent_layer_(layer_ptr->layer.recurrent_layer, delta_grad_next);
+            return layer_ptr->layer.recurrent_layer->grad_delta;
+        case ATTENTION:
+            backprop_attention_layer_(layer_ptr->layer.attention_layer, delta_grad_next);
+            return layer_ptr->layer.attention_layer->grad_delta;
+        default:
+            printf("Layer type not supported.\n");
+            exit(0);
+    }
+};
+
+// Feed forward layers read their input again in backward, the others keep what they need
+static inline char layer_reads_input_in_backward_(const Layer_* layer_ptr){
+    return layer_ptr->type == FF;
+};
+
+#endif // LAYERS_H_
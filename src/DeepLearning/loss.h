@@ -36,17 +36,24 @@ void L2_loss(Matrix* prediction, Matrix* label, Matrix** loss){
     *loss = _loss;    
 };
 
+// Squared error diff^T diff per sample, averaged over the batch
 Tensor* L2_loss_tensor(Tensor* prediction, Tensor* label){
     if (prediction->n_rows != label->n_rows || prediction->n_cols != label->n_cols){
         printf("Tensor sizes do not match\n.");
         exit(0);
     }
     Tensor* diff = tensor_subtract(prediction, label); 
-    Tensor* diff_T = tensor_transpose(diff);
+    Tensor* diff_T = tensor_transpose(diff);    // view, shares the nodes of diff
     Tensor* loss = tensor_dot_product(diff_T, diff);
     
     tensor_detach(diff);
     tensor_detach(diff_T);
+
+    if (loss->n_batch > 1){
+        Tensor* mean = tensor_batch_mean(loss);
+        tensor_detach(loss);
+        loss = mean;
+    }
     return loss;
 };
  
@@ -0,0 +1,587 @@
+#ifndef __MODEL_FIT_H__
+#define __MODEL_FIT_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "matrix.h"
+#include "models.h"
+#include "optimizer.h"
+#include "loss.h"
+#include "thread_pool.h"
+
+#pragma region Model Fit
+/*
+Training loop of a Sequential_NN_: epochs over a dataset held in memory, shuffled and cut into
+mini-batches, one forward pass, backward pass and optimizer step per batch:
+
+    ModelFitConfig_ config = model_fit_default_config();
+    config.epochs = 20;
+    config.batch_size = 64;
+    ModelFitEpoch_* history = model_fit_(model, optimizer, X, y, &config);     // config.epochs entries
+    free(history);
+
+X (input_size x N) and y (output_size x N) hold one sample per column like every layerwise
+pass. A batch gathers its columns in the shuffled order into a contiguous input_size x B
+block, a strided copy that is worth taking off the training thread.
+
+A loader thread assembles the batches ahead of the training thread into two slots:
+
+    loader    waits until slot k % 2 is free, gathers batch k into it, marks it ready
+    trainer   waits until slot k % 2 is ready, trains on it, frees it again
+
+so batch k + 1 is prepared while batch k trains. The slots are allocated once at the full
+batch size, 64 byte aligned and locked into memory when the limits allow (see
+ModelFitLoader_.pinned), and every batch is written into the same pages. config.prepare runs on
+the loader thread after the gather, for normalisation or augmentation of the batch in place.
+
+Per epoch model_fit_ reports the mean loss, samples per second and the data stall, the share
+of the epoch the training thread spent waiting for a batch that was not ready yet. A stall
+near zero means data preparation is hidden behind compute.
+
+With config.num_workers > 1 every batch is split by columns across that many threads, see
+Data Parallel below. The result is the same step as on one thread up to rounding.
+*/
+
+#define MODEL_FIT_ALIGNMENT 64
+
+typedef struct {
+    size_t epochs;
+    size_t batch_size;
+    char shuffle;
+    unsigned int seed;          // of the shuffles, the same seed gives the same batches
+    char loss_fn;               // see backpropagate_sequential_nn_
+    char verbose;               // one line per epoch
+    size_t num_workers;         // threads sharing every batch, 0 picks thread_pool_default_threads()
+    void (*prepare)(Matrix* X_batch, Matrix* y_batch, void* ctx);
+    void* prepare_ctx;
+}ModelFitConfig_;
+
+typedef struct {
+    double loss;                // mean over the samples of the epoch, before their step
+    double seconds;
+    double stall_seconds;
+    double samples_per_sec;
+    double stall_percent;
+}ModelFitEpoch_;
+
+ModelFitConfig_ model_fit_default_config(void){
+    ModelFitConfig_ config = {0};
+    config.epochs = 1;
+    config.batch_size = 32;
+    config.shuffle = 1;
+    config.seed = 42;
+    config.num_workers = 1;
+    return config;
+};
+
+static double model_fit_time(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+};
+
+// Fisher-Yates over perm, rand_r keeps the loader thread off the global rand() state
+void model_fit_shuffle(size_t* perm, const size_t n, unsigned int* seed){
+    for (size_t i = n; i > 1; i--){
+        const size_t j = (size_t)rand_r(seed) % i;
+        const size_t tmp = perm[i - 1];
+        perm[i - 1] = perm[j];
+        perm[j] = tmp;
+    }
+};
+
+// Columns perm[begin .. begin + count] of src into the rows x count block dst
+void model_fit_gather(const Matrix* src, const size_t* perm, const size_t begin, const size_t count, double* dst){
+    const size_t N = src->n_cols;
+    for (size_t r = 0; r < src->n_rows; r++){
+        const double* row = src->data + r * N;
+        double* out = dst + r * count;
+        for (size_t b = 0; b < count; b++) out[b] = row[perm[begin + b]];
+    }
+};
+
+typedef struct {
+    Matrix X;                   // views into the slot storage, n_cols is the batch size
+    Matrix y;
+    char ready;
+}ModelFitSlot_;
+
+typedef struct ModelFitLoader_{
+    const Matrix* X;
+    const Matrix* y;
+    const ModelFitConfig_* config;
+    size_t num_batches;         // per epoch
+    size_t* perm;
+    unsigned int seed;
+
+    ModelFitSlot_ slots[2];
+    double* storage;            // both slots, X and y
+    size_t storage_bytes;
+    char pinned;                // storage is locked into memory
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t freed;
+    char shutdown;
+}ModelFitLoader_;
+
+static void* model_fit_loader_main(void* arg){
+    ModelFitLoader_* loader = (ModelFitLoader_*)arg;
+    const size_t N = loader->X->n_cols, B = loader->config->batch_size;
+    size_t k = 0;
+
+    for (size_t epoch = 0; epoch < loader->config->epochs; epoch++){
+        if (loader->config->shuffle) model_fit_shuffle(loader->perm, N, &loader->seed);
+        for (size_t batch = 0; batch < loader->num_batches; batch++, k++){
+            ModelFitSlot_* slot = loader->slots + k % 2;
+            pthread_mutex_lock(&loader->lock);
+            while (slot->ready && !loader->shutdown) pthread_cond_wait(&loader->freed, &loader->lock);
+            const char shutdown = loader->shutdown;
+            pthread_mutex_unlock(&loader->lock);
+            if (shutdown) return NULL;
+
+            const size_t begin = batch * B, count = begin + B <= N ? B : N - begin;
+            slot->X.n_cols = slot->y.n_cols = count;
+            model_fit_gather(loader->X, loader->perm, begin, count, slot->X.data);
+            model_fit_gather(loader->y, loader->perm, begin, count, slot->y.data);
+            if (loader->config->prepare != NULL) loader->config->prepare(&slot->X, &slot->y, loader->config->prepare_ctx);
+
+            pthread_mutex_lock(&loader->lock);
+            slot->ready = 1;
+            pthread_cond_signal(&loader->filled);
+            pthread_mutex_unlock(&loader->lock);
+        }
+    }
+    return NULL;
+};
+
+ModelFitLoader_* model_fit_loader_start(const Matrix* X, const Matrix* y, const ModelFitConfig_* config){
+    ModelFitLoader_* loader = (ModelFitLoader_*)calloc(1, sizeof(ModelFitLoader_));
+    if (loader == NULL){
+        printf("Failed to allocate memory for the loader.\n");
+        exit(1);
+    }
+    const size_t N = X->n_cols, B = config->batch_size;
+    loader->X = X;
+    loader->y = y;
+    loader->config = config;
+    loader->num_batches = (N + B - 1) / B;
+    loader->seed = config->seed;
+    loader->perm = (size_t*)malloc(N * sizeof(size_t));
+    for (size_t i = 0; i < N; i++) loader->perm[i] = i;
+
+    const size_t slot_size = (X->n_rows + y->n_rows) * B;
+    void* storage = NULL;
+    loader->storage_bytes = 2 * slot_size * sizeof(double);
+    if (posix_memalign(&storage, MODEL_FIT_ALIGNMENT, loader->storage_bytes) != 0){
+        printf("Failed to allocate the batch slots in model_fit_loader_start.\n");
+        exit(1);
+    }
+    loader->storage = (double*)storage;
+    memset(loader->storage, 0, loader->storage_bytes);
+    loader->pinned = mlock(loader->storage, loader->storage_bytes) == 0;
+    for (size_t s = 0; s < 2; s++){
+        double* base = loader->storage + s * slot_size;
+        loader->slots[s].X = (Matrix){base, X->n_rows, B};
+        loader->slots[s].y = (Matrix){base + X->n_rows * B, y->n_rows, B};
+    }
+
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->filled, NULL);
+    pthread_cond_init(&loader->freed, NULL);
+    if (pthread_create(&loader->thread, NULL, model_fit_loader_main, loader) != 0){
+        printf("Failed to start the loader thread.\n");
+        exit(1);
+    }
+    return loader;
+};
+
+// Slot of batch k once it is ready, the time spent waiting is added to stall_seconds
+ModelFitSlot_* model_fit_loader_acquire(ModelFitLoader_* loader, const size_t k, double* stall_seconds){
+    ModelFitSlot_* slot = loader->slots + k % 2;
+    pthread_mutex_lock(&loader->lock);
+    if (!slot->ready){
+        const double begin = model_fit_time();
+        while (!slot->ready) pthread_cond_wait(&loader->filled, &loader->lock);
+        *stall_seconds += model_fit_time() - begin;
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return slot;
+};
+
+void model_fit_loader_release(ModelFitLoader_* loader, ModelFitSlot_* slot){
+    pthread_mutex_lock(&loader->lock);
+    slot->ready = 0;
+    pthread_cond_signal(&loader->freed);
+    pthread_mutex_unlock(&loader->lock);
+};
+
+void model_fit_loader_destroy(ModelFitLoader_* loader){
+    if (loader == NULL) return;
+
+    pthread_mutex_lock(&loader->lock);
+    loader->shutdown = 1;
+    pthread_cond_broadcast(&loader->freed);
+    pthread_mutex_unlock(&loader->lock);
+    pthread_join(loader->thread, NULL);
+
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->filled);
+    pthread_cond_destroy(&loader->freed);
+    if (loader->pinned) munlock(loader->storage, loader->storage_bytes);
+    free(loader->storage);
+    free(loader->perm);
+    free(loader);
+};
+
+// Summed loss of the batch, loss_fn as in backpropagate_sequential_nn_
+static double model_fit_batch_loss(const Matrix* a, const Matrix* y, const char loss_fn){
+    double loss = 0.0;
+    switch(loss_fn){
+        case 0: //L2 loss, sum of squared errors, what backward_L2_loss differentiates
+            for (size_t k = 0; k < a->n_rows * a->n_cols; k++) loss += (a->data[k] - y->data[k]) * (a->data[k] - y->data[k]);
+            break;
+        default:
+            printf("Selected loss function is not supported.\n");
+            exit(0);
+    }
+    return loss;
+};
+
+#pragma region Data Parallel
+/*
+Synchronous data parallel steps. Worker w of N trains on columns [w n / N, (w + 1) n / N) of a
+batch of n samples with its own replica of the model, then the gradients are reduced and the
+calling thread takes one optimizer step:
+
+    workers   copy their columns, forward, backward      (pool->run)
+    reduce    grad = sum_w n_w / n grad_w into the model  (pool->run)
+    step      optimize_adam_ on the model
+
+Replica 0 is the model itself. The other replicas are layers of the same shapes whose weights
+and biases are the model's matrices, so they only own activations and gradients. Nothing writes
+the weights until the optimizer step, after both pool runs returned.
+
+The reduction treats the gradients of a model as one flat vector, a table of segments (grad_W
+and grad_b of every layer, each with one pointer per replica). Worker w reduces range w of the
+vector for all replicas, in blocks of MODEL_FIT_REDUCE_BLOCK values: the block is scaled by n_w / n
+and summed as a binary tree, replica r += replica r + stride for stride 1, 2, 4 .., which ends in
+the model's gradient. Every block is read from the N replicas once and stays in cache for all
+log2 N levels, and workers never touch the same values, so no locks are needed.
+
+Embedding layers keep sparse row gradients and are not supported with more than one worker.
+*/
+
+#define MODEL_FIT_REDUCE_BLOCK 512
+
+typedef struct {
+    size_t offset;              // in the flat gradient vector
+    size_t length;
+    double** grads;             // one per replica, grads[0] is the model's
+}ModelFitSegment_;
+
+typedef struct {
+    size_t num_workers;
+    Sequential_NN_** replicas;
+    Matrix** inputs;            // columns of the batch, then the replica's output
+    Matrix** labels;
+    double* losses;
+    double* scales;             // n_w / n
+    size_t num_active;          // workers with at least one sample in this batch
+    const ModelFitSlot_* slot;
+    char loss_fn;
+    ModelFitSegment_* segments;
+    size_t num_segments;
+    size_t num_grads;
+    ThreadPool* pool;
+}ModelFitParallel_;
+
+// Layers of the same shapes as model whose weights and biases are the model's
+Sequential_NN_* model_fit_replica(const Sequential_NN_* model){
+    Sequential_NN_* replica = (Sequential_NN_*)calloc(1, sizeof(Sequential_NN_));
+    *replica = *model;
+    replica->self = replica;
+    replica->layers = (Layer_*)malloc(model->num_layers * sizeof(Layer_));
+
+    for (size_t i = 0; i < model->num_layers; i++){
+        const Layer_* layer_ptr = model->layers + i;
+        Layer_* copy = replica->layers + i;
+        copy->type = layer_ptr->type;
+        switch(layer_ptr->type){
+            case FF:{
+                const FeedForwardLayer_* ff = layer_ptr->layer.ff_layer;
+                FeedForwardLayer_* ff_copy = (FeedForwardLayer_*)calloc(1, sizeof(FeedForwardLayer_));
+                init_feed_forward_layer_(&ff_copy, ff->next_num_neurons, ff->num_neurons, ff->act_fn_mapping);
+                matrix_destroy(ff_copy->weights);
+                free(ff_copy->weights);
+                matrix_destroy(ff_copy->biases);
+                free(ff_copy->biases);
+                ff_copy->weights = ff->weights;
+                ff_copy->biases = ff->biases;
+                copy->layer.ff_layer = ff_copy;
+                break;
+            }
+            case CONV2D:{
+                const Conv2DLayer_* conv = layer_ptr->layer.conv_layer;
+                Conv2DLayer_* conv_copy = create_conv2d_layer(conv->in_channels, conv->in_height, conv->in_width, conv->out_channels, conv->kernel_size,
+                                                              conv->stride, conv->padding, conv->layout, conv->act_fn_mapping);
+                matrix_destroy(conv_copy->weights);
+                free(conv_copy->weights);
+                matrix_destroy(conv_copy->biases);
+                free(conv_copy->biases);
+                conv_copy->weights = conv->weights;
+                conv_copy->biases = conv->biases;
+                copy->layer.conv_layer = conv_copy;
+                break;
+            }
+            case POOL2D:{
+                const Pool2DLayer_* pool = layer_ptr->layer.pool_layer;
+                copy->layer.pool_layer = create_pool2d_layer(pool->channels, pool->in_height, pool->in_width, pool->kernel_size, pool->stride, pool->mode, pool->layout);
+                break;
+            }
+            case LSTM:
+            case GRU:{
+                const RecurrentLayer_* recurrent = layer_ptr->layer.recurrent_layer;
+                RecurrentLayer_* recurrent_copy = create_recurrent_layer(recurrent->cell, recurrent->input_size, recurrent->hidden_size, recurrent->seq_len,
+                                                                         recurrent->return_sequences, recurrent->bptt_steps);
+                matrix_destroy(recurrent_copy->params);
+                free(recurrent_copy->params);
+                matrix_destroy(recurrent_copy->biases);
+                free(recurrent_copy->biases);
+                recurrent_copy->params = recurrent->params;
+                recurrent_copy->biases = recurrent->biases;
+                recurrent_copy->W_x = recurrent->W_x;
+                recurrent_copy->W_h = recurrent->W_h;
+                copy->layer.recurrent_layer = recurrent_copy;
+                break;
+            }
+            case ATTENTION:{
+                const AttentionLayer_* attention = layer_ptr->layer.attention_layer;
+                AttentionLayer_* attention_copy = create_attention_layer(attention->seq_len, attention->model_dim, attention->num_heads);
+                matrix_destroy(attention_copy->params);
+                free(attention_copy->params);
+                matrix_destroy(attention_copy->biases);
+                free(attention_copy->biases);
+                attention_copy->params = attention->params;
+                attention_copy->biases = attention->biases;
+                attention_copy->W_qkv = attention->W_qkv;
+                attention_copy->W_o = attention->W_o;
+                copy->layer.attention_layer = attention_copy;
+                break;
+            }
+            default:
+                printf("Layer %lu cannot be replicated for data parallel training.\n", i);
+                exit(0);
+        }
+    }
+    return replica;
+};
+
+void model_fit_replica_destroy(Sequential_NN_* replica){
+    if (replica == NULL) return;
+
+    // The shared matrices stay with the model
+    for (size_t i = 0; i < replica->num_layers; i++){
+        Layer_* layer_ptr = replica->layers + i;
+        switch(layer_ptr->type){
+            case FF:
+                layer_ptr->layer.ff_layer->weights = layer_ptr->layer.ff_layer->biases = NULL;
+                break;
+            case CONV2D:
+                layer_ptr->layer.conv_layer->weights = layer_ptr->layer.conv_layer->biases = NULL;
+                break;
+            case LSTM:
+            case GRU:
+                layer_ptr->layer.recurrent_layer->params = layer_ptr->layer.recurrent_layer->biases = NULL;
+                break;
+            case ATTENTION:
+                layer_ptr->layer.attention_layer->params = layer_ptr->layer.attention_layer->biases = NULL;
+                break;
+            default:
+                break;
+        }
+    }
+    destroy_sequential_nn_(replica);
+    free(replica);
+};
+
+ModelFitParallel_* model_fit_parallel_create(Sequential_NN_* model, size_t num_workers, const char loss_fn){
+    if (num_workers == 0) num_workers = thread_pool_default_threads();
+    ModelFitParallel_* parallel = (ModelFitParallel_*)calloc(1, sizeof(ModelFitParallel_));
+    parallel->num_workers = num_workers;
+    parallel->loss_fn = loss_fn;
+    parallel->replicas = (Sequential_NN_**)malloc(num_workers * sizeof(Sequential_NN_*));
+    parallel->inputs = (Matrix**)calloc(num_workers, sizeof(Matrix*));
+    parallel->labels = (Matrix**)calloc(num_workers, sizeof(Matrix*));
+    parallel->losses = (double*)calloc(num_workers, sizeof(double));
+    parallel->scales = (double*)calloc(num_workers, sizeof(double));
+    parallel->replicas[0] = model;
+    for (size_t w = 1; w < num_workers; w++) parallel->replicas[w] = model_fit_replica(model);
+    if (num_workers == 1) return parallel;
+
+    // Segment table of the flat gradient vector
+    parallel->segments = (ModelFitSegment_*)malloc(2 * model->num_layers * sizeof(ModelFitSegment_));
+    for (size_t i = 0; i < model->num_layers; i++){
+        for (size_t part = 0; part < 2; part++){
+            ModelFitSegment_ segment = {parallel->num_grads, 0, (double**)malloc(num_workers * sizeof(double*))};
+            for (size_t w = 0; w < num_workers; w++){
+                Matrix *weights, *biases, *grad_W, *grad_b;
+                if (!layer_params_(parallel->replicas[w]->layers + i, &weights, &biases, &grad_W, &grad_b)) break;
+                const Matrix* grad = part == 0 ? grad_W : grad_b;
+                segment.grads[w] = grad->data;
+                segment.length = grad->n_rows * grad->n_cols;
+            }
+            if (segment.length == 0){
+                free(segment.grads);
+                continue;
+            }
+            parallel->segments[parallel->num_segments++] = segment;
+            parallel->num_grads += segment.length;
+        }
+    }
+    parallel->pool = thread_pool_new(num_workers);
+    return parallel;
+};
+
+void model_fit_parallel_destroy(ModelFitParallel_* parallel){
+    if (parallel == NULL) return;
+    for (size_t w = 0; w < parallel->num_workers; w++){
+        if (w > 0) model_fit_replica_destroy(parallel->replicas[w]);
+        matrix_destroy(parallel->inputs[w]);
+        free(parallel->inputs[w]);
+        matrix_destroy(parallel->labels[w]);
+        free(parallel->labels[w]);
+    }
+    for (size_t s = 0; s < parallel->num_segments; s++) free(parallel->segments[s].grads);
+    free(parallel->segments);
+    free(parallel->replicas);
+    free(parallel->inputs);
+    free(parallel->labels);
+    free(parallel->losses);
+    free(parallel->scales);
+    thread_pool_destroy(parallel->pool);
+    free(parallel);
+};
+
+// Columns [begin, begin + count) of the rows x n block src into mat
+static void model_fit_columns(const Matrix* src, const size_t begin, const size_t count, Matrix** mat){
+    matrix_resize(mat, src->n_rows, count);
+    for (size_t r = 0; r < src->n_rows; r++) memcpy((*mat)->data + r * count, src->data + r * src->n_cols + begin, count * sizeof(double));
+};
+
+static void model_fit_worker_step(void* ctx, const size_t worker){
+    ModelFitParallel_* parallel = (ModelFitParallel_*)ctx;
+    if (worker >= parallel->num_active) return;
+    const size_t n = parallel->slot->X.n_cols, active = parallel->num_active;
+    const size_t begin = worker * n / active, count = (worker + 1) * n / active - begin;
+    Sequential_NN_* replica = parallel->replicas[worker];
+
+    // forward_sequential_nn_ overwrites its input, the slot stays with the loader
+    model_fit_columns(&parallel->slot->X, begin, count, parallel->inputs + worker);
+    model_fit_columns(&parallel->slot->y, begin, count, parallel->labels + worker);
+    forward_sequential_nn_(replica, parallel->inputs[worker]);
+    parallel->losses[worker] = model_fit_batch_loss(parallel->inputs[worker], parallel->labels[worker], parallel->loss_fn);
+    backpropagate_sequential_nn_(replica, parallel->inputs[worker], parallel->labels[worker], parallel->loss_fn);
+    parallel->scales[worker] = (double)count / (double)n;
+};
+
+static void model_fit_reduce_block(const ModelFitParallel_* parallel, const ModelFitSegment_* segment, const size_t begin, const size_t end){
+    const size_t active = parallel->num_active;
+    for (size_t w = 0; w < active; w++){
+        double* grad = segment->grads[w];
+        const double scale = parallel->scales[w];
+        for (size_t k = begin; k < end; k++) grad[k] *= scale;
+    }
+    for (size_t stride = 1; stride < active; stride *= 2){
+        for (size_t w = 0; w + stride < active; w += 2 * stride){
+            double* dst = segment->grads[w];
+            const double* src = segment->grads[w + stride];
+            for (size_t k = begin; k < end; k++) dst[k] += src[k];
+        }
+    }
+};
+
+static void model_fit_worker_reduce(void* ctx, const size_t worker){
+    const ModelFitParallel_* parallel = (const ModelFitParallel_*)ctx;
+    const size_t N = parallel->num_workers, P = parallel->num_grads;
+    const size_t range_begin = worker * P / N, range_end = (worker + 1) * P / N;
+
+    for (size_t s = 0; s < parallel->num_segments; s++){
+        const ModelFitSegment_* segment = parallel->segments + s;
+        const size_t lo = segment->offset > range_begin ? segment->offset : range_begin;
+        const size_t hi = segment->offset + segment->length < range_end ? segment->offset + segment->length : range_end;
+        for (size_t k = lo; k < hi; k += MODEL_FIT_REDUCE_BLOCK){
+            const size_t block_end = k + MODEL_FIT_REDUCE_BLOCK < hi ? k + MODEL_FIT_REDUCE_BLOCK : hi;
+            model_fit_reduce_block(parallel, segment, k - segment->offset, block_end - segment->offset);
+        }
+    }
+};
+
+// Gradients of the batch in the slot into the model's gradients, returns the summed loss
+double model_fit_parallel_step(ModelFitParallel_* parallel, const ModelFitSlot_* slot){
+    const size_t n = slot->X.n_cols;
+    parallel->slot = slot;
+    parallel->num_active = n < parallel->num_workers ? n : parallel->num_workers;
+
+    if (parallel->num_workers == 1) model_fit_worker_step(parallel, 0);
+    else parallel->pool->run(parallel->pool, model_fit_worker_step, parallel);
+    if (parallel->num_active > 1) parallel->pool->run(parallel->pool, model_fit_worker_reduce, parallel);
+
+    double loss = 0.0;
+    for (size_t w = 0; w < parallel->num_active; w++) loss += parallel->losses[w];
+    return loss;
+};
+
+#pragma endregion Data Parallel
+
+// Trains model in place, returns config->epochs epoch reports the caller frees
+ModelFitEpoch_* model_fit_(Sequential_NN_* model, Adam_Optimizer_* optimizer, const Matrix* X, const Matrix* y, const ModelFitConfig_* config){
+    if (X->n_cols != y->n_cols || X->n_cols == 0){
+        printf("X and y need the same, non-zero number of samples in model_fit_.\n");
+        exit(0);
+    }
+    if (config->batch_size == 0 || config->epochs == 0){
+        printf("Batch size and epochs must be positive in model_fit_.\n");
+        exit(0);
+    }
+
+    ModelFitEpoch_* history = (ModelFitEpoch_*)calloc(config->epochs, sizeof(ModelFitEpoch_));
+    ModelFitParallel_* parallel = model_fit_parallel_create(model, config->num_workers, config->loss_fn);
+    ModelFitLoader_* loader = model_fit_loader_start(X, y, config);
+    size_t k = 0;
+
+    for (size_t epoch = 0; epoch < config->epochs; epoch++){
+        ModelFitEpoch_* report = history + epoch;
+        const double begin = model_fit_time();
+
+        for (size_t batch = 0; batch < loader->num_batches; batch++, k++){
+            ModelFitSlot_* slot = model_fit_loader_acquire(loader, k, &report->stall_seconds);
+            report->loss += model_fit_parallel_step(parallel, slot);
+            model_fit_loader_release(loader, slot);
+            optimize_adam_(optimizer, model->layers);
+        }
+
+        report->seconds = model_fit_time() - begin;
+        report->loss /= (double)X->n_cols;
+        report->samples_per_sec = (double)X->n_cols / report->seconds;
+        report->stall_percent = 100.0 * report->stall_seconds / report->seconds;
+        if (config->verbose){
+            printf("Epoch %lu/%lu  loss %.6f  %.0f samples/s  data stall %.1f%%\n",
+                   epoch + 1, config->epochs, report->loss, report->samples_per_sec, report->stall_percent);
+        }
+    }
+
+    model_fit_loader_destroy(loader);
+    model_fit_parallel_destroy(parallel);
+    return history;
+};
+
+#pragma endregion Model Fit
+
+#endif // __MODEL_FIT_H__
@@ -0,0 +1,435 @@
+#ifndef __MODEL_PLAN_H__
+#define __MODEL_PLAN_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "models.h"
+#include "model_file.h"
+
+#pragma region Model Plan
+/*
+A model plan is the frozen, inference-only form of a Sequential_NN or Sequential_NN_.
+Compiling copies the parameters once, so later training steps do not change the plan:
+
+    ModelPlan* plan = model_plan_compile(model, 32);      // up to 32 samples per pass
+    model_plan_predict(plan, x, y);                       // one sample, input_size -> output_size
+    model_plan_predict_batch(plan, X, n, Y);              // n samples, one after another in X and Y
+    model_plan_destroy(plan);
+
+All weights live in one 64 byte aligned buffer. Each layer's W is packed in panels of
+PLAN_MR output rows, interleaved by input (panel[k * PLAN_MR + r] = W[row + r][k]) and zero
+padded, so the micro-kernel streams one panel and keeps PLAN_MR x PLAN_NR results in registers.
+The bias seeds the accumulators and the activation is applied on the store.
+
+Intermediate activations ping-pong between two buffers allocated at compile time, predicting
+never allocates. The buffers are shared, so one plan must not be used by two threads at once.
+*/
+
+#define PLAN_MR 4          // output rows per weight panel
+#define PLAN_NR 4          // samples per micro-kernel call
+#define PLAN_ALIGNMENT 64
+
+typedef struct {
+    size_t n_in;
+    size_t n_out;
+    char act;              // 0 linear, 1 relu, 2 sigmoid, 3 tanh
+    size_t w_offset;       // packed panels in plan->weights
+    size_t b_offset;       // biases, padded to a multiple of PLAN_MR
+}ModelPlanLayer;
+
+typedef struct ModelPlan{
+    size_t num_layers;
+    size_t input_size;
+    size_t output_size;
+    size_t max_width;      // widest hidden layer
+    size_t max_batch;      // samples per pass through the buffers
+    ModelPlanLayer* layers;
+    size_t num_weights;
+    double* weights;
+    double* buffers[2];    // sample-major activations, max_batch x max_width each
+    ModelFile* file;       // weights point into this mapping when loaded, see model_plan_load
+}ModelPlan;
+
+static size_t model_plan_padded(const size_t n){
+    return (n + PLAN_MR - 1) / PLAN_MR * PLAN_MR;
+};
+
+static double* model_plan_alloc(const size_t n){
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, PLAN_ALIGNMENT, (n ? n : 1) * sizeof(double)) != 0){
+        printf("Failed to allocate the buffers in model_plan_alloc.\n");
+        exit(1);
+    }
+    memset(ptr, 0, (n ? n : 1) * sizeof(double));
+    return (double*)ptr;
+};
+
+// Sizes the layers and buffers, the weights are left to the caller
+static ModelPlan* model_plan_layout(const size_t num_layers, const size_t* sizes, const size_t max_batch){
+    if (num_layers == 0 || max_batch == 0){
+        printf("A model plan needs at least one layer and a batch size in model_plan_layout.\n");
+        exit(1);
+    }
+
+    ModelPlan* plan = (ModelPlan*)malloc(sizeof(ModelPlan));
+    plan->num_layers = num_layers;
+    plan->input_size = sizes[0];
+    plan->output_size = sizes[num_layers];
+    plan->max_batch = max_batch;
+    plan->layers = (ModelPlanLayer*)malloc(num_layers * sizeof(ModelPlanLayer));
+
+    size_t offset = 0;
+    plan->max_width = 0;
+    for (size_t l = 0; l < num_layers; l++){
+        ModelPlanLayer* layer = plan->layers + l;
+        layer->n_in = sizes[l];
+        layer->n_out = sizes[l + 1];
+        layer->act = 0;
+        layer->w_offset = offset;
+        offset += model_plan_padded(layer->n_out) * layer->n_in;
+        layer->b_offset = offset;
+        offset += model_plan_padded(layer->n_out);
+        if (l + 1 < num_layers && layer->n_out > plan->max_width) plan->max_width = layer->n_out;
+    }
+
+    plan->num_weights = offset;
+    plan->weights = NULL;
+    plan->buffers[0] = model_plan_alloc(max_batch * plan->max_width);
+    plan->buffers[1] = model_plan_alloc(max_batch * plan->max_width);
+    plan->file = NULL;
+    return plan;
+};
+
+// Layout plus zeroed weights, filled in by the compile functions
+static ModelPlan* model_plan_new(const size_t num_layers, const size_t* sizes, const size_t max_batch){
+    ModelPlan* plan = model_plan_layout(num_layers, sizes, max_batch);
+    plan->weights = model_plan_alloc(plan->num_weights);
+    return plan;
+};
+
+static void model_plan_set_weight(ModelPlan* plan, const size_t l, const size_t i, const size_t k, const double w){
+    const ModelPlanLayer* layer = plan->layers + l;
+    double* panel = plan->weights + layer->w_offset + (i / PLAN_MR) * PLAN_MR * layer->n_in;
+    panel[k * PLAN_MR + i % PLAN_MR] = w;
+};
+
+static void model_plan_set_bias(ModelPlan* plan, const size_t l, const size_t i, const double b){
+    plan->weights[plan->layers[l].b_offset + i] = b;
+};
+
+static double model_plan_get_weight(const ModelPlan* plan, const size_t l, const size_t i, const size_t k){
+    const ModelPlanLayer* layer = plan->layers + l;
+    const double* panel = plan->weights + layer->w_offset + (i / PLAN_MR) * PLAN_MR * layer->n_in;
+    return panel[k * PLAN_MR + i % PLAN_MR];
+};
+
+static double model_plan_get_bias(const ModelPlan* plan, const size_t l, const size_t i){
+    return plan->weights[plan->layers[l].b_offset + i];
+};
+
+ModelPlan* model_plan_compile(Sequential_NN* model, const size_t max_batch){
+    if (model == NULL || model->num_layers == 0){
+        printf("Model is empty in model_plan_compile.\n");
+        exit(1);
+    }
+
+    size_t* sizes = (size_t*)malloc((model->num_layers + 1) * sizeof(size_t));
+    sizes[0] = model->layers[0]->num_features;
+    for (size_t l = 0; l < model->num_layers; l++){
+        if (model->layers[l]->type != FEED_FORWARD){
+            printf("Layer type not supported in model_plan_compile.\n");
+            exit(1);
+        }
+        sizes[l + 1] = model->layers[l]->num_neurons;
+    }
+    ModelPlan* plan = model_plan_new(model->num_layers, sizes, max_batch);
+    free(sizes);
+
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff_layer = model->layers[l]->layer.ff_layer;
+        if (ff_layer->act_fn == tensor_relu_inplace) plan->layers[l].act = 1;
+        else if (ff_layer->act_fn == tensor_sigmoid_inplace) plan->layers[l].act = 2;
+        else if (ff_layer->act_fn == tensor_tanh_inplace) plan->layers[l].act = 3;
+        else {
+            printf("Activation function not supported in model_plan_compile.\n");
+            exit(1);
+        }
+
+        for (size_t i = 0; i < plan->layers[l].n_out; i++){
+            for (size_t k = 0; k < plan->layers[l].n_in; k++){
+                model_plan_set_weight(plan, l, i, k, tensor_get_val(ff_layer->weights, i, k));
+            }
+            model_plan_set_bias(plan, l, i, tensor_get_val(ff_layer->biases, i, 0));
+        }
+    }
+    return plan;
+};
+
+ModelPlan* model_plan_compile_(Sequential_NN_* model, const size_t max_batch){
+    if (model == NULL || model->num_layers == 0){
+        printf("Model is empty in model_plan_compile_.\n");
+        exit(1);
+    }
+
+    for (size_t l = 0; l < model->num_layers; l++){
+        if (model->layers[l].type != FF){
+            printf("Layer type not supported in model_plan_compile_.\n");
+            exit(1);
+        }
+    }
+    size_t* sizes = (size_t*)malloc((model->num_layers + 1) * sizeof(size_t));
+    sizes[0] = model->layers[0].layer.ff_layer->weights->n_cols;
+    for (size_t l = 0; l < model->num_layers; l++) sizes[l + 1] = model->layers[l].layer.ff_layer->weights->n_rows;
+    ModelPlan* plan = model_plan_new(model->num_layers, sizes, max_batch);
+    free(sizes);
+
+    for (size_t l = 0; l < model->num_layers; l++){
+        const FeedForwardLayer_* ff_layer = model->layers[l].layer.ff_layer;
+        plan->layers[l].act = ff_layer->act_fn_mapping;
+
+        for (size_t i = 0; i < plan->layers[l].n_out; i++){
+            for (size_t k = 0; k < plan->layers[l].n_in; k++){
+                model_plan_set_weight(plan, l, i, k, ff_layer->weights->data[i * plan->layers[l].n_in + k]);
+            }
+            model_plan_set_bias(plan, l, i, ff_layer->biases->data[i]);
+        }
+    }
+    return plan;
+};
+
+void model_plan_destroy(ModelPlan* plan){
+    if (plan == NULL) return;
+    free(plan->layers);
+    if (plan->file) model_file_unmap(plan->file);
+    else free(plan->weights);
+    free(plan->buffers[0]);
+    free(plan->buffers[1]);
+    free(plan);
+};
+
+static inline double model_plan_activate(const char act, const double z){
+    switch(act){
+        case 1: return z > 0 ? z : 0.0;
+        case 2: return 1/(1 + exp(-z));
+        case 3: return tanh(z);
+        default: return z;
+    }
+};
+
+// PLAN_MR rows of act(W x + b) for PLAN_NR samples
+static inline void model_plan_kernel_4x4(const double* panel, const double* bias, const double* x, const size_t n_in, const char act, double* y, const size_t n_out, const size_t rows){
+    double acc[PLAN_NR][PLAN_MR];
+    for (size_t s = 0; s < PLAN_NR; s++){
+        for (size_t r = 0; r < PLAN_MR; r++) acc[s][r] = bias[r];
+    }
+
+    const double* x0 = x;
+    const double* x1 = x + n_in;
+    const double* x2 = x + 2 * n_in;
+    const double* x3 = x + 3 * n_in;
+    for (size_t k = 0; k < n_in; k++){
+        const double* w = panel + k * PLAN_MR;
+        for (size_t r = 0; r < PLAN_MR; r++){
+            acc[0][r] += w[r] * x0[k];
+            acc[1][r] += w[r] * x1[k];
+            acc[2][r] += w[r] * x2[k];
+            acc[3][r] += w[r] * x3[k];
+        }
+    }
+
+    for (size_t s = 0; s < PLAN_NR; s++){
+        for (size_t r = 0; r < rows; r++) y[s * n_out + r] = model_plan_activate(act, acc[s][r]);
+    }
+};
+
+// PLAN_MR rows of act(W x + b) for one sample
+static inline void model_plan_kernel_4x1(const double* panel, const double* bias, const double* x, const size_t n_in, const char act, double* y, const size_t rows){
+    double acc[PLAN_MR];
+    for (size_t r = 0; r < PLAN_MR; r++) acc[r] = bias[r];
+
+    for (size_t k = 0; k < n_in; k++){
+        const double* w = panel + k * PLAN_MR;
+        for (size_t r = 0; r < PLAN_MR; r++) acc[r] += w[r] * x[k];
+    }
+
+    for (size_t r = 0; r < rows; r++) y[r] = model_plan_activate(act, acc[r]);
+};
+
+// One layer over n samples, x is n x n_in and y is n x n_out
+static void model_plan_layer(const ModelPlan* plan, const ModelPlanLayer* layer, const double* x, const size_t n, double* y){
+    const double* weights = plan->weights + layer->w_offset;
+    const double* biases = plan->weights + layer->b_offset;
+
+    for (size_t i = 0; i < layer->n_out; i += PLAN_MR){
+        const double* panel = weights + i * layer->n_in;
+        const size_t rows = layer->n_out - i < PLAN_MR ? layer->n_out - i : PLAN_MR;
+
+        size_t s = 0;
+        for (; s + PLAN_NR <= n; s += PLAN_NR){
+            model_plan_kernel_4x4(panel, biases + i, x + s * layer->n_in, layer->n_in, layer->act, y + s * layer->n_out + i, layer->n_out, rows);
+        }
+        for (; s < n; s++){
+            model_plan_kernel_4x1(panel, biases + i, x + s * layer->n_in, layer->n_in, layer->act, y + s * layer->n_out + i, rows);
+        }
+    }
+};
+
+// n samples of input_size in X, n outputs of output_size in Y
+void model_plan_predict_batch(const ModelPlan* plan, const double* X, const size_t n, double* Y){
+    for (size_t start = 0; start < n; start += plan->max_batch){
+        const size_t count = n - start < plan->max_batch ? n - start : plan->max_batch;
+        const double* x = X + start * plan->input_size;
+        double* y = Y + start * plan->output_size;
+
+        const double* in = x;
+        for (size_t l = 0; l < plan->num_layers; l++){
+            double* out = l + 1 == plan->num_layers ? y : plan->buffers[l % 2];
+            model_plan_layer(plan, plan->layers + l, in, count, out);
+            in = out;
+        }
+    }
+};
+
+void model_plan_predict(const ModelPlan* plan, const double* x, double* y){
+    model_plan_predict_batch(plan, x, 1, y);
+};
+
+#pragma endregion Model Plan
+
+#pragma region Model Plan Files
+/*
+A plan is saved as it is laid out in memory: a layer table and the packed, padded weights.
+model_plan_load maps the file and runs straight on the mapped weights, only the small layer
+table and the activation buffers are allocated. Files record PLAN_MR and are refused by a
+build that packs differently.
+
+    sequential_nn_save(model, "mlp.cml");                          // or model_plan_save(plan, ...)
+    ModelPlan* plan = model_plan_load("mlp.cml", 32);              // inference, in place
+    Sequential_NN* model = sequential_nn_load("mlp.cml");          // trainable copy
+*/
+
+#define MODEL_PLAN_SECTION_LAYERS 1
+#define MODEL_PLAN_SECTION_WEIGHTS 2
+
+typedef struct {
+    uint32_t n_in;
+    uint32_t n_out;
+    uint32_t act;
+    uint32_t panel_rows;
+    uint64_t w_offset;
+    uint64_t b_offset;
+}ModelPlanLayerRecord;
+
+char model_plan_save(const ModelPlan* plan, const char* path){
+    ModelPlanLayerRecord* records = (ModelPlanLayerRecord*)calloc(plan->num_layers, sizeof(ModelPlanLayerRecord));
+    for (size_t l = 0; l < plan->num_layers; l++){
+        records[l].n_in = (uint32_t)plan->layers[l].n_in;
+        records[l].n_out = (uint32_t)plan->layers[l].n_out;
+        records[l].act = (uint32_t)plan->layers[l].act;
+        records[l].panel_rows = PLAN_MR;
+        records[l].w_offset = plan->layers[l].w_offset;
+        records[l].b_offset = plan->layers[l].b_offset;
+    }
+
+    ModelFileChunk chunks[2] = {
+        {MODEL_PLAN_SECTION_LAYERS, records, plan->num_layers * sizeof(ModelPlanLayerRecord)},
+        {MODEL_PLAN_SECTION_WEIGHTS, plan->weights, plan->num_weights * sizeof(double)},
+    };
+    const char ok = model_file_write(path, MODEL_FILE_KIND_SEQUENTIAL_NN, chunks, 2);
+    free(records);
+    return ok;
+};
+
+char sequential_nn_save(Sequential_NN* model, const char* path){
+    ModelPlan* plan = model_plan_compile(model, 1);
+    const char ok = model_plan_save(plan, path);
+    model_plan_destroy(plan);
+    return ok;
+};
+
+// Maps a saved plan, returns NULL if the file cannot be used
+ModelPlan* model_plan_load(const char* path, const size_t max_batch){
+    ModelFile* file = model_file_map(path, MODEL_FILE_KIND_SEQUENTIAL_NN);
+    if (file == NULL) return NULL;
+
+    uint64_t layers_size = 0, weights_size = 0;
+    const ModelPlanLayerRecord* records = (const ModelPlanLayerRecord*)model_file_section(file, MODEL_PLAN_SECTION_LAYERS, &layers_size);
+    const void* weights = model_file_section(file, MODEL_PLAN_SECTION_WEIGHTS, &weights_size);
+    const size_t num_layers = layers_size / sizeof(ModelPlanLayerRecord);
+    if (records == NULL || weights == NULL || num_layers == 0 || layers_size % sizeof(ModelPlanLayerRecord) != 0){
+        printf("Model file %s has no layers.\n", path);
+        model_file_unmap(file);
+        return NULL;
+    }
+
+    size_t* sizes = (size_t*)malloc((num_layers + 1) * sizeof(size_t));
+    sizes[0] = records[0].n_in;
+    char ok = 1;
+    for (size_t l = 0; l < num_layers; l++){
+        sizes[l + 1] = records[l].n_out;
+        ok = ok && records[l].panel_rows == PLAN_MR && records[l].act <= 3;
+        ok = ok && (l == 0 || records[l].n_in == records[l - 1].n_out);
+    }
+    ModelPlan* plan = ok ? model_plan_layout(num_layers, sizes, max_batch) : NULL;
+    free(sizes);
+
+    // The layout is recomputed, the file must agree with it
+    for (size_t l = 0; ok && l < num_layers; l++){
+        plan->layers[l].act = (char)records[l].act;
+        ok = records[l].w_offset == plan->layers[l].w_offset && records[l].b_offset == plan->layers[l].b_offset;
+    }
+    ok = ok && weights_size == plan->num_weights * sizeof(double);
+    if (!ok){
+        printf("Model file %s does not match this build's plan layout.\n", path);
+        model_plan_destroy(plan);
+        model_file_unmap(file);
+        return NULL;
+    }
+
+    plan->weights = (double*)weights;
+    plan->file = file;
+    return plan;
+};
+
+// Rebuilds a trainable Sequential_NN from a saved plan, returns NULL if the file cannot be used
+Sequential_NN* sequential_nn_load(const char* path){
+    ModelPlan* plan = model_plan_load(path, 1);
+    if (plan == NULL) return NULL;
+
+    // Linear layers (saved from a Sequential_NN_) have no in-place Tensor activation
+    for (size_t l = 0; l < plan->num_layers; l++){
+        if (plan->layers[l].act < 1 || plan->layers[l].act > 3){
+            printf("Activation function of layer %lu not supported in sequential_nn_load.\n", l);
+            model_plan_destroy(plan);
+            return NULL;
+        }
+    }
+
+    Sequential_NN* model = init_sequential_nn();
+    for (size_t l = 0; l < plan->num_layers; l++){
+        const ModelPlanLayer* layer = plan->layers + l;
+        void (*act_fn)(Tensor* X) = tensor_tanh_inplace;
+        if (layer->act == 1) act_fn = tensor_relu_inplace;
+        else if (layer->act == 2) act_fn = tensor_sigmoid_inplace;
+        add_feed_forward_layer(model, layer->n_out, layer->n_in, act_fn);
+    }
+
+    for (size_t l = 0; l < plan->num_layers; l++){
+        FeedForwardLayer* ff_layer = model->layers[l]->layer.ff_layer;
+        for (size_t i = 0; i < plan->layers[l].n_out; i++){
+            for (size_t k = 0; k < plan->layers[l].n_in; k++){
+                tensor_set_val(ff_layer->weights, i, k, model_plan_get_weight(plan, l, i, k));
+            }
+            tensor_set_val(ff_layer->biases, i, 0, model_plan_get_bias(plan, l, i));
+        }
+    }
+
+    model_plan_destroy(plan);
+    return model;
+};
+
+#pragma endregion Model Plan Files
+
+#endif
@@ -9,6 +9,7 @@
 #include <assert.h>
 #include "layers.h"
 #include "loss.h"
+#include "thread_pool.h"
 
 
 
@@ -16,6 +17,9 @@ typedef struct Sequential_NN{
     size_t num_layers;
     size_t num_params;
     Layer** layers;
+
+    // Values and grads of all parameters in one buffer (see sequential_nn_flatten_params)
+    ADStorage* params;
 }Sequential_NN;
 
 Sequential_NN* init_sequential_nn(){
@@ -23,9 +27,85 @@ Sequential_NN* init_sequential_nn(){
     model->num_layers = 0;
     model->num_params = 0;
     model->layers = NULL;
+    model->params = NULL;
     return model;
 };
 
+#pragma region Flat Parameters
+/*
+All parameters of a model live in one storage, model->params, layer by layer with the weights
+(row major) before the biases. Each weight and bias tensor owns a view into it, so tensor and
+Matrix access keep working while the whole model is also just two arrays:
+
+    model->params->values    num_params parameters
+    model->params->grads     their gradients
+
+Backward never resets the gradients of trainable nodes, they add up until zeroed. Taking one
+optimizer step over N micro-batches is therefore
+
+    sequential_nn_zero_grad(model);                     // one memset
+    for each micro-batch: forward, loss, backward       // gradients add up in place
+    sequential_nn_scale_grad(model, 1.0 / N);           // mean over the micro-batches
+    optimize_adam(optimizer, model->layers);
+
+with only one micro-batch worth of activations alive at a time.
+*/
+
+// Move a tensor's nodes into range [offset, offset + numel) of the flat buffer
+static size_t sequential_nn_bind_params(Tensor* tensor, ADStorage* params, const size_t offset){
+    const size_t numel = tensor->n_rows * tensor->n_cols;
+    ADStorage* view = ad_storage_view(params, offset, numel);
+
+    for (size_t i = 0; i < tensor->n_rows; i++){
+        for (size_t j = 0; j < tensor->n_cols; j++){
+            const size_t k = i * tensor->n_cols + j;
+            node_set_storage(tensor_get_node(tensor, i, j), view, view->values + k, view->grads + k);
+        }
+    }
+
+    ad_storage_release(tensor->storage);
+    tensor->storage = view;
+    return offset + numel;
+};
+
+// Called whenever a layer is added, rebuilds the buffer for all layers
+void sequential_nn_flatten_params(Sequential_NN* model){
+    ADStorage* params = ad_storage_new(model->num_params, 1);
+
+    size_t offset = 0;
+    for (size_t l = 0; l < model->num_layers; l++){
+        Layer* layer = model->layers[l];
+        switch(layer->type){
+            case FEED_FORWARD:
+                offset = sequential_nn_bind_params(layer->layer.ff_layer->weights, params, offset);
+                offset = sequential_nn_bind_params(layer->layer.ff_layer->biases, params, offset);
+                break;
+            default:
+                printf("Layer type not supported.\n");
+                exit(0);
+        }
+    }
+
+    ad_storage_release(model->params);
+    model->params = params;
+};
+
+void sequential_nn_zero_grad(Sequential_NN* model){
+    memset(model->params->grads, 0, model->num_params * sizeof(double));
+};
+
+void sequential_nn_scale_grad(Sequential_NN* model, const double factor){
+    double* grads = model->params->grads;
+    for (size_t k = 0; k < model->num_params; k++) grads[k] *= factor;
+};
+
+// Add gradients laid out like model->params->grads, e.g. computed by another copy of the model
+void sequential_nn_accumulate_grad(Sequential_NN* model, const double* grads){
+    double* target = model->params->grads;
+    for (size_t k = 0; k < model->num_params; k++) target[k] += grads[k];
+};
+#pragma endregion Flat Parameters
+
 void add_feed_forward_layer(Sequential_NN* model, size_t output_size, size_t input_size, void (*act_fn)(Tensor* X)){
     if (model == NULL){
         printf("Passed model pointer is NULL.\n");
@@ -45,6 +125,8 @@ void add_feed_forward_layer(Sequential_NN* model, size_t output_size, size_t inp
     // Initialize feed forward neural layer
     Layer* layer = init_layer(FEED_FORWARD, output_size, input_size, act_fn);
     *(model->layers + model->num_layers - 1) = layer;
+
+    sequential_nn_flatten_params(model);
 };
 
 void destroy_sequential_nn(Sequential_NN* model){
@@ -58,6 +140,8 @@ void destroy_sequential_nn(Sequential_NN* model){
 
     free(model->layers);
     model->layers = NULL;
+    ad_storage_release(model->params);
+    model->params = NULL;
     free(model);
 
 };
@@ -126,6 +210,45 @@ void forward_sequential_nn(Sequential_NN* model, Tensor* X){
     }
 };
 
+// Forward-mode pass through the model, returns the outputs with their tangents.
+// X is left untouched, no graph is built.
+JVPTensor* forward_sequential_nn_jvp(Sequential_NN* model, JVPTensor* X){
+    JVPTensor* current = X;
+    for (size_t i = 0; i < model->num_layers; i++){
+        Layer* layer = *(model->layers + i);
+        JVPTensor* next = NULL;
+        switch(layer->type){
+            case FEED_FORWARD:
+                next = feed_forward_layer_jvp(layer, current);
+                break;
+            default:
+                printf("Layer type not supported in forward_sequential_nn_jvp.\n");
+                exit(1);
+        }
+        if (current != X) jvp_tensor_destroy(current);
+        current = next;
+    }
+    return current == X ? jvp_tensor_copy(X) : current;
+};
+
+// Lazy pass through the model, the outputs are materialized on the first read.
+// X is left untouched, the expressions live in ctx.
+LazyTensor* forward_sequential_nn_lazy(Sequential_NN* model, LazyContext* ctx, Tensor* X){
+    LazyTensor* current = lazy_tensor(ctx, X);
+    for (size_t i = 0; i < model->num_layers; i++){
+        Layer* layer = *(model->layers + i);
+        switch(layer->type){
+            case FEED_FORWARD:
+                current = feed_forward_layer_lazy(layer, ctx, current);
+                break;
+            default:
+                printf("Layer type not supported in forward_sequential_nn_lazy.\n");
+                exit(1);
+        }
+    }
+    return current;
+};
+
 #pragma region Sequential Neural Network Layerswise 
 
 // Sequential NN
@@ -187,6 +310,27 @@ void destroy_sequential_nn_(Sequential_NN_* model_ptr){
                 free(ff_layer_ptr);
                 ff_layer_ptr = NULL;
                 break;
+            case CONV2D:
+                destroy_conv2d_layer_(layer_ptr->layer.conv_layer);
+                free(layer_ptr->layer.conv_layer);
+                break;
+            case POOL2D:
+                destroy_pool2d_layer_(layer_ptr->layer.pool_layer);
+                free(layer_ptr->layer.pool_layer);
+                break;
+            case EMBEDDING:
+                destroy_embedding_layer_(layer_ptr->layer.embedding_layer);
+                free(layer_ptr->layer.embedding_layer);
+                break;
+            case LSTM:
+            case GRU:
+                destroy_recurrent_layer_(layer_ptr->layer.recurrent_layer);
+                free(layer_ptr->layer.recurrent_layer);
+                break;
+            case ATTENTION:
+                destroy_attention_layer_(layer_ptr->layer.attention_layer);
+                free(layer_ptr->layer.attention_layer);
+                break;
             default:
                 printf("Specified layer type is not supported");
                 break;
@@ -223,6 +367,58 @@ void add_feed_forward_layer_(Sequential_NN_* model_ptr, size_t output_size, size
     init_feed_forward_layer_(&layer_ptr, output_size, input_size, act_fn_mapping);
 };
 
+static Layer_* append_layer_(Sequential_NN_* model_ptr, const LayerType_ type){
+    if (model_ptr == NULL){
+        printf("Passed model pointer is NULL.\n");
+        exit(0);
+    }
+    model_ptr->num_layers++;
+    model_ptr->layers = (Layer_*)realloc(model_ptr->layers, model_ptr->num_layers * sizeof(Layer_));
+    Layer_* layer_ptr = model_ptr->layers + model_ptr->num_layers - 1;
+    layer_ptr->type = type;
+    return layer_ptr;
+};
+
+// Input of channels x height x width per sample, output of out_channels x OH x OW in the same layout
+void add_conv2d_layer_(Sequential_NN_* model_ptr, const size_t in_channels, const size_t height, const size_t width, const size_t out_channels,
+                       const size_t kernel_size, const size_t stride, const size_t padding, const ConvLayout_ layout, const char act_fn_mapping){
+    Layer_* layer_ptr = append_layer_(model_ptr, CONV2D);
+    layer_ptr->layer.conv_layer = create_conv2d_layer(in_channels, height, width, out_channels, kernel_size, stride, padding, layout, act_fn_mapping);
+};
+
+void add_pool2d_layer_(Sequential_NN_* model_ptr, const size_t channels, const size_t height, const size_t width,
+                       const size_t kernel_size, const size_t stride, const PoolMode_ mode, const ConvLayout_ layout){
+    Layer_* layer_ptr = append_layer_(model_ptr, POOL2D);
+    layer_ptr->layer.pool_layer = create_pool2d_layer(channels, height, width, kernel_size, stride, mode, layout);
+};
+
+// num_fields ids per sample in [0, vocab_size), each looked up in a table of dim wide rows
+void add_embedding_layer_(Sequential_NN_* model_ptr, const size_t vocab_size, const size_t dim, const size_t num_fields){
+    if (model_ptr != NULL && model_ptr->num_layers > 0){
+        printf("Embedding layers take ids and have to be the first layer.\n");
+        exit(0);
+    }
+    Layer_* layer_ptr = append_layer_(model_ptr, EMBEDDING);
+    layer_ptr->layer.embedding_layer = create_embedding_layer(vocab_size, dim, num_fields);
+};
+
+// Sequences of seq_len steps of input_size features, bptt_steps = 0 backpropagates through all of them
+void add_lstm_layer_(Sequential_NN_* model_ptr, const size_t input_size, const size_t hidden_size, const size_t seq_len, const char return_sequences, const size_t bptt_steps){
+    Layer_* layer_ptr = append_layer_(model_ptr, LSTM);
+    layer_ptr->layer.recurrent_layer = create_recurrent_layer(LSTM, input_size, hidden_size, seq_len, return_sequences, bptt_steps);
+};
+
+void add_gru_layer_(Sequential_NN_* model_ptr, const size_t input_size, const size_t hidden_size, const size_t seq_len, const char return_sequences, const size_t bptt_steps){
+    Layer_* layer_ptr = append_layer_(model_ptr, GRU);
+    layer_ptr->layer.recurrent_layer = create_recurrent_layer(GRU, input_size, hidden_size, seq_len, return_sequences, bptt_steps);
+};
+
+// Self-attention over seq_len tokens of model_dim features, split into num_heads heads
+void add_attention_layer_(Sequential_NN_* model_ptr, const size_t seq_len, const size_t model_dim, const size_t num_heads){
+    Layer_* layer_ptr = append_layer_(model_ptr, ATTENTION);
+    layer_ptr->layer.attention_layer = create_attention_layer(seq_len, model_dim, num_heads);
+};
+
 void print_sequential_nn_(Sequential_NN_* model_ptr){
     printf("LAYERS:\n");
     for (size_t i = 0; i < model_ptr->num_layers; i++){
@@ -234,6 +430,30 @@ void print_sequential_nn_(Sequential_NN_* model_ptr){
             case FEED_FORWARD:
                 printf("Type: FEED FORWARD, # Neurons: %lu ", layer_ptr->layer.ff_layer->num_neurons);
                 break;
+            case CONV2D:
+                Conv2DLayer_* conv = layer_ptr->layer.conv_layer;
+                printf("Type: CONV2D, %lux%lux%lu -> %lux%lux%lu, Kernel: %lu, Stride: %lu, Padding: %lu ", conv->in_channels, conv->in_height, conv->in_width,
+                       conv->out_channels, conv->out_height, conv->out_width, conv->kernel_size, conv->stride, conv->padding);
+                break;
+            case POOL2D:
+                Pool2DLayer_* pool = layer_ptr->layer.pool_layer;
+                printf("Type: %s POOL2D, %lux%lux%lu -> %lux%lux%lu, Window: %lu, Stride: %lu ", pool->mode == POOL_MAX ? "MAX" : "AVG", pool->channels,
+                       pool->in_height, pool->in_width, pool->channels, pool->out_height, pool->out_width, pool->kernel_size, pool->stride);
+                break;
+            case EMBEDDING:
+                EmbeddingLayer_* embedding = layer_ptr->layer.embedding_layer;
+                printf("Type: EMBEDDING, Vocabulary: %lu, Dim: %lu, Fields: %lu ", embedding->vocab_size, embedding->dim, embedding->num_fields);
+                break;
+            case LSTM:
+            case GRU:
+                RecurrentLayer_* recurrent = layer_ptr->layer.recurrent_layer;
+                printf("Type: %s, Steps: %lu, Input: %lu, Hidden: %lu, BPTT: %lu%s ", layer_ptr->type == LSTM ? "LSTM" : "GRU", recurrent->seq_len,
+                       recurrent->input_size, recurrent->hidden_size, recurrent->bptt_steps, recurrent->return_sequences ? ", Sequences" : "");
+                break;
+            case ATTENTION:
+                AttentionLayer_* attention = layer_ptr->layer.attention_layer;
+                printf("Type: ATTENTION, Tokens: %lu, Dim: %lu, Heads: %lu ", attention->seq_len, attention->model_dim, attention->num_heads);
+                break;
             default:
                 printf("TYPE NOT SUPPORTED.");
                 break;
@@ -243,19 +463,62 @@ void print_sequential_nn_(Sequential_NN_* model_ptr){
     }
 };
 
+// x (input_size x B) is replaced by the output. Layers read the activations of the layer below
+// in place, only the input (kept by the first layer) and the output are copied.
 void forward_sequential_nn_(Sequential_NN_* model_ptr, Matrix* x){
+    const Matrix* a = x;
     for (size_t i = 0; i < model_ptr->num_layers; i++){
         Layer_* layer_ptr = (model_ptr->layers + i);
         switch (layer_ptr->type){
             case FEED_FORWARD:
                 FeedForwardLayer_* ff_layer_ptr = layer_ptr->layer.ff_layer;
-                feed_forward_pass(ff_layer_ptr, x);
+                if (i == 0){
+                    matrix_resize(&ff_layer_ptr->input, x->n_rows, x->n_cols);
+                    memcpy(ff_layer_ptr->input->data, x->data, x->n_rows * x->n_cols * sizeof(double));
+                    a = ff_layer_ptr->input;
+                }
+                a = feed_forward_forward_(ff_layer_ptr, a);
+                break;
+            case CONV2D:
+                Conv2DLayer_* conv_layer_ptr = layer_ptr->layer.conv_layer;
+                if (i == 0){
+                    matrix_resize(&conv_layer_ptr->input, x->n_rows, x->n_cols);
+                    memcpy(conv_layer_ptr->input->data, x->data, x->n_rows * x->n_cols * sizeof(double));
+                    a = conv_layer_ptr->input;
+                }
+                a = conv2d_forward_(conv_layer_ptr, a);
+                break;
+            case POOL2D:
+                Pool2DLayer_* pool_layer_ptr = layer_ptr->layer.pool_layer;
+                if (i == 0){
+                    matrix_resize(&pool_layer_ptr->input, x->n_rows, x->n_cols);
+                    memcpy(pool_layer_ptr->input->data, x->data, x->n_rows * x->n_cols * sizeof(double));
+                    a = pool_layer_ptr->input;
+                }
+                a = pool2d_forward_(pool_layer_ptr, a);
+                break;
+            case EMBEDDING:
+                // The ids are copied by the layer, x is not read again
+                a = embedding_forward_(layer_ptr->layer.embedding_layer, a);
+                break;
+            case LSTM:
+            case GRU:
+                // The steps are copied by the layer, x is not read again
+                a = recurrent_forward_(layer_ptr->layer.recurrent_layer, a);
+                break;
+            case ATTENTION:
+                // The tokens are copied by the layer, x is not read again
+                a = attention_forward_(layer_ptr->layer.attention_layer, a);
                 break;
             default:
                 printf("Layer Type not supported.");
                 break;
         }
     }
+
+    if (a == x) return;
+    matrix_resize(&x, a->n_rows, a->n_cols);
+    memcpy(x->data, a->data, a->n_rows * a->n_cols * sizeof(double));
 };
 
 void backpropagate_sequential_nn_(Sequential_NN_* model, Matrix* a_out, Matrix* y, const char loss_fn){
@@ -282,6 +545,27 @@ void backpropagate_sequential_nn_(Sequential_NN_* model, Matrix* a_out, Matrix*
                 backprop_feed_forward_layer(ff_layer_ptr, delta_grad_next);
                 delta_grad_next = ff_layer_ptr->grad_delta;
 
+                break;
+            case CONV2D:
+                backprop_conv2d_layer_(layer_ptr->layer.conv_layer, delta_grad_next);
+                delta_grad_next = layer_ptr->layer.conv_layer->grad_delta;
+                break;
+            case POOL2D:
+                backprop_pool2d_layer_(layer_ptr->layer.pool_layer, delta_grad_next);
+                delta_grad_next = layer_ptr->layer.pool_layer->grad_delta;
+                break;
+            case EMBEDDING:
+                backprop_embedding_layer_(layer_ptr->layer.embedding_layer, delta_grad_next);
+                delta_grad_next = NULL;
+                break;
+            case LSTM:
+            case GRU:
+                backprop_recurrent_layer_(layer_ptr->layer.recurrent_layer, delta_grad_next);
+                delta_grad_next = layer_ptr->layer.recurrent_layer->grad_delta;
+                break;
+            case ATTENTION:
+                backprop_attention_layer_(layer_ptr->layer.attention_layer, delta_grad_next);
+                delta_grad_next = layer_ptr->layer.attention_layer->grad_delta;
                 break;
             default:
                 printf("Layer type not supported.\n");
@@ -295,4 +579,509 @@ void backpropagate_sequential_nn_(Sequential_NN_* model, Matrix* a_out, Matrix*
 
 #pragma endregion Sequential Neural Network
 
-#endif // __DL_H__
\ No newline at end of file
+#pragma region DAG Neural Network Layerwise
+/*
+Layerwise model over a directed acyclic graph of nodes instead of a chain. Node 0 is the
+input, every other node is one of
+
+    layer    any layerwise layer applied to one node
+    add      element-wise sum of nodes of the same size (residual connections)
+    concat   nodes stacked along the features (branches joining, skip connections)
+
+and any node can be an output (several heads). Nodes are added in order, so they are already
+topologically sorted:
+
+    DAG_NN_* model = dag_nn_create(16);
+    size_t h = dag_nn_feed_forward(model, 0, 16, 1);
+    size_t r = dag_nn_add(model, (size_t[]){0, h}, 2);            // x + f(x)
+    dag_nn_output(model, dag_nn_feed_forward(model, r, 3, 0));
+    dag_nn_forward(model, X);                                     // X stays alive until backward
+    dag_nn_backward(model, (const Matrix*[]){dC_da_out});
+
+dag_nn_plan, run by the first forward pass, groups the nodes into levels by their longest
+distance from the input. Nodes of one level do not depend on each other and, with a thread
+pool set, run concurrently in both passes. Each node only writes its own buffers, and during
+backward it pulls its gradient from its consumers instead of having them push into it.
+
+The plan also places the buffers the graph itself needs: outputs of add and concat nodes and
+gradient sums of nodes with more than one consumer. A node with a single consumer uses that
+consumer's gradient in place (a concat passes a row range, which is contiguous). Every planned
+buffer gets a lifetime in levels, forward values extended to the backward pass of a feed
+forward consumer which reads its input again, and buffers whose lifetimes do not overlap share
+one slot. Slots are sized in features per sample and grow with the batch.
+
+The layers live in one array like in Sequential_NN_, so init_Adam_optimizer_ and
+optimize_adam_ take model->layers and model->num_layers.
+*/
+
+typedef enum {
+    DAG_INPUT,
+    DAG_LAYER,
+    DAG_ADD,
+    DAG_CONCAT,
+}DAGNodeKind_;
+
+#define DAG_NO_SLOT ((size_t)-1)
+
+typedef struct {
+    DAGNodeKind_ kind;
+    size_t layer_idx;       // DAG_LAYER, index into model->layers
+    size_t* inputs;
+    size_t num_inputs;
+    size_t* consumers;      // filled by dag_nn_plan
+    size_t num_consumers;
+    size_t size;            // features per sample of the output
+    size_t level;
+    char is_output;
+    size_t output_idx;
+    size_t value_slot;      // add and concat nodes that are not outputs
+    size_t grad_slot;       // nodes whose gradient is a sum
+    Matrix* own_value;      // add and concat outputs
+    Matrix value;           // output of the last forward pass
+    Matrix grad;            // dC/d(output) of the last backward pass
+    Matrix input_grad;      // DAG_LAYER, dC/d(input) of the last backward pass
+}DAGNode_;
+
+typedef struct DAG_NN_{
+    size_t input_size;
+    size_t num_nodes;
+    DAGNode_* nodes;
+    size_t num_layers;
+    Layer_* layers;
+    size_t num_outputs;
+    size_t* outputs;
+    const Matrix** output_grads;    // of the running backward pass
+
+    // Plan
+    char is_planned;
+    size_t num_levels;
+    size_t* level_start;            // nodes of level l are level_nodes[level_start[l] .. level_start[l + 1]]
+    size_t* level_nodes;
+    size_t num_slots;
+    size_t* slot_size;              // features per sample
+    Matrix** slots;
+    size_t planned_size;            // features per sample of all slots
+    size_t unplanned_size;          // of all planned buffers without sharing
+
+    ThreadPool* pool;               // not owned, NULL runs every level on the calling thread
+}DAG_NN_;
+
+DAG_NN_* dag_nn_create(const size_t input_size){
+    DAG_NN_* model = (DAG_NN_*)calloc(1, sizeof(DAG_NN_));
+    if (model == NULL){
+        printf("Failed to allocate memory for model\n");
+        exit(1);
+    }
+    model->input_size = input_size;
+    model->num_nodes = 1;
+    model->nodes = (DAGNode_*)calloc(1, sizeof(DAGNode_));
+    model->nodes[0].kind = DAG_INPUT;
+    model->nodes[0].size = input_size;
+    return model;
+};
+
+static size_t dag_nn_append_node(DAG_NN_* model, const DAGNodeKind_ kind, const size_t* inputs, const size_t num_inputs, const size_t size){
+    if (model->is_planned){
+        printf("Nodes cannot be added to a planned model.\n");
+        exit(0);
+    }
+    for (size_t i = 0; i < num_inputs; i++){
+        if (inputs[i] >= model->num_nodes){
+            printf("Node %lu does not exist yet.\n", inputs[i]);
+            exit(0);
+        }
+    }
+
+    model->nodes = (DAGNode_*)realloc(model->nodes, (model->num_nodes + 1) * sizeof(DAGNode_));
+    DAGNode_* node = model->nodes + model->num_nodes;
+    memset(node, 0, sizeof(DAGNode_));
+    node->kind = kind;
+    node->inputs = (size_t*)malloc(num_inputs * sizeof(size_t));
+    memcpy(node->inputs, inputs, num_inputs * sizeof(size_t));
+    node->num_inputs = num_inputs;
+    node->size = size;
+    node->value_slot = DAG_NO_SLOT;
+    node->grad_slot = DAG_NO_SLOT;
+    return model->num_nodes++;
+};
+
+// Applies a layer created with create_..._layer to node input, the model takes ownership
+size_t dag_nn_layer(DAG_NN_* model, const size_t input, const LayerType_ type, void* layer){
+    Layer_ layer_ = {type, {.layer = layer}};
+    if (input < model->num_nodes && layer_input_size_(&layer_) != model->nodes[input].size){
+        printf("Layer expects %lu features, node %lu has %lu.\n", layer_input_size_(&layer_), input, model->nodes[input].size);
+        exit(0);
+    }
+    if (type == EMBEDDING && input != 0){
+        printf("Embedding layers take ids and have to read the input node.\n");
+        exit(0);
+    }
+
+    const size_t idx = dag_nn_append_node(model, DAG_LAYER, &input, 1, layer_output_size_(&layer_));
+    model->layers = (Layer_*)realloc(model->layers, (model->num_layers + 1) * sizeof(Layer_));
+    model->layers[model->num_layers] = layer_;
+    model->nodes[idx].layer_idx = model->num_layers++;
+    return idx;
+};
+
+size_t dag_nn_feed_forward(DAG_NN_* model, const size_t input, const size_t output_size, const char act_fn_mapping){
+    if (input >= model->num_nodes){
+        printf("Node %lu does not exist yet.\n", input);
+        exit(0);
+    }
+    FeedForwardLayer_* layer = (FeedForwardLayer_*)calloc(1, sizeof(FeedForwardLayer_));
+    init_feed_forward_layer_(&layer, output_size, model->nodes[input].size, act_fn_mapping);
+    return dag_nn_layer(model, input, FF, layer);
+};
+
+size_t dag_nn_add(DAG_NN_* model, const size_t* inputs, const size_t num_inputs){
+    if (num_inputs < 2){
+        printf("An add node needs at least two inputs.\n");
+        exit(0);
+    }
+    for (size_t i = 0; i < num_inputs; i++){
+        if (inputs[i] < model->num_nodes && model->nodes[inputs[i]].size != model->nodes[inputs[0]].size){
+            printf("Inputs of an add node differ in size.\n");
+            exit(0);
+        }
+    }
+    return dag_nn_append_node(model, DAG_ADD, inputs, num_inputs, inputs[0] < model->num_nodes ? model->nodes[inputs[0]].size : 0);
+};
+
+size_t dag_nn_concat(DAG_NN_* model, const size_t* inputs, const size_t num_inputs){
+    if (num_inputs < 2){
+        printf("A concat node needs at least two inputs.\n");
+        exit(0);
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < num_inputs; i++) size += inputs[i] < model->num_nodes ? model->nodes[inputs[i]].size : 0;
+    return dag_nn_append_node(model, DAG_CONCAT, inputs, num_inputs, size);
+};
+
+// Outputs are numbered in the order they are declared
+void dag_nn_output(DAG_NN_* model, const size_t node){
+    if (node == 0 || node >= model->num_nodes || model->nodes[node].is_output || model->is_planned){
+        printf("Node %lu cannot become an output.\n", node);
+        exit(0);
+    }
+    model->nodes[node].is_output = 1;
+    model->nodes[node].output_idx = model->num_outputs;
+    model->outputs = (size_t*)realloc(model->outputs, (model->num_outputs + 1) * sizeof(size_t));
+    model->outputs[model->num_outputs++] = node;
+};
+
+void dag_nn_set_thread_pool(DAG_NN_* model, ThreadPool* pool){
+    model->pool = pool;
+};
+
+// Buffer that lives from level step begin to level step end, both included
+typedef struct {
+    size_t node;
+    char is_grad;
+    size_t begin;
+    size_t end;
+}DAGBufferLifetime_;
+
+static int dag_nn_compare_lifetimes(const void* a, const void* b){
+    const DAGBufferLifetime_* x = (const DAGBufferLifetime_*)a;
+    const DAGBufferLifetime_* y = (const DAGBufferLifetime_*)b;
+    return (x->begin > y->begin) - (x->begin < y->begin);
+};
+
+void dag_nn_plan(DAG_NN_* model){
+    if (model->is_planned) return;
+    if (model->num_outputs == 0){
+        printf("Model has no outputs.\n");
+        exit(0);
+    }
+    const size_t n = model->num_nodes;
+    DAGNode_* nodes = model->nodes;
+
+    // Consumers and levels
+    for (size_t v = 1; v < n; v++){
+        for (size_t i = 0; i < nodes[v].num_inputs; i++){
+            DAGNode_* input = nodes + nodes[v].inputs[i];
+            input->consumers = (size_t*)realloc(input->consumers, (input->num_consumers + 1) * sizeof(size_t));
+            input->consumers[input->num_consumers++] = v;
+            nodes[v].level = input->level + 1 > nodes[v].level ? input->level + 1 : nodes[v].level;
+        }
+        model->num_levels = nodes[v].level + 1 > model->num_levels ? nodes[v].level + 1 : model->num_levels;
+    }
+    for (size_t v = 1; v < n; v++){
+        if (nodes[v].num_consumers == 0 && !nodes[v].is_output){
+            printf("Node %lu is neither used nor an output.\n", v);
+            exit(0);
+        }
+    }
+
+    model->level_start = (size_t*)calloc(model->num_levels + 1, sizeof(size_t));
+    model->level_nodes = (size_t*)malloc(n * sizeof(size_t));
+    for (size_t v = 0; v < n; v++) model->level_start[nodes[v].level + 1]++;
+    for (size_t l = 0; l < model->num_levels; l++) model->level_start[l + 1] += model->level_start[l];
+    size_t* fill = (size_t*)malloc(model->num_levels * sizeof(size_t));
+    memcpy(fill, model->level_start, model->num_levels * sizeof(size_t));
+    for (size_t v = 0; v < n; v++) model->level_nodes[fill[nodes[v].level]++] = v;
+    free(fill);
+
+    // Lifetimes: level l runs at step l forward and at step 2 L - 1 - l backward
+    const size_t L = model->num_levels;
+    DAGBufferLifetime_* lifetimes = (DAGBufferLifetime_*)malloc(2 * n * sizeof(DAGBufferLifetime_));
+    size_t num_lifetimes = 0;
+    for (size_t v = 1; v < n; v++){
+        DAGNode_* node = nodes + v;
+        if ((node->kind == DAG_ADD || node->kind == DAG_CONCAT) && !node->is_output){
+            size_t end = node->level;
+            for (size_t c = 0; c < node->num_consumers; c++){
+                const DAGNode_* consumer = nodes + node->consumers[c];
+                const char kept = consumer->kind == DAG_LAYER && layer_reads_input_in_backward_(model->layers + consumer->layer_idx);
+                const size_t use = kept ? 2 * L - 1 - consumer->level : consumer->level;
+                end = use > end ? use : end;
+            }
+            lifetimes[num_lifetimes++] = (DAGBufferLifetime_){v, 0, node->level, end};
+        }
+    }
+
+    // A gradient with one part is the part itself, which can be the gradient of an add or concat
+    // consumer, so a summed gradient lives until the last node that reads it through such a chain
+    size_t* grad_home = (size_t*)malloc(n * sizeof(size_t));
+    size_t* grad_end = (size_t*)calloc(n, sizeof(size_t));
+    for (size_t v = n; v-- > 1;){
+        const DAGNode_* node = nodes + v;
+        grad_home[v] = DAG_NO_SLOT;
+        if (node->num_consumers + node->is_output > 1) grad_home[v] = v;
+        else if (node->num_consumers == 1 && nodes[node->consumers[0]].kind != DAG_LAYER) grad_home[v] = grad_home[node->consumers[0]];
+    }
+    for (size_t v = 1; v < n; v++){
+        const DAGNode_* node = nodes + v;
+        if (grad_home[v] == DAG_NO_SLOT) continue;
+        size_t end = 2 * L - 1 - node->level;
+        if (node->kind == DAG_ADD || node->kind == DAG_CONCAT){
+            for (size_t i = 0; i < node->num_inputs; i++){
+                const size_t use = 2 * L - 1 - nodes[node->inputs[i]].level;
+                end = use > end ? use : end;
+            }
+        }
+        grad_end[grad_home[v]] = end > grad_end[grad_home[v]] ? end : grad_end[grad_home[v]];
+    }
+    for (size_t v = 1; v < n; v++){
+        if (grad_home[v] == v) lifetimes[num_lifetimes++] = (DAGBufferLifetime_){v, 1, 2 * L - 1 - nodes[v].level, grad_end[v]};
+    }
+    free(grad_home);
+    free(grad_end);
+
+    // Greedy interval colouring, the smallest free slot that fits or the largest free one grown
+    qsort(lifetimes, num_lifetimes, sizeof(DAGBufferLifetime_), dag_nn_compare_lifetimes);
+    size_t* slot_end = (size_t*)malloc((num_lifetimes ? num_lifetimes : 1) * sizeof(size_t));
+    model->slot_size = (size_t*)malloc((num_lifetimes ? num_lifetimes : 1) * sizeof(size_t));
+    for (size_t k = 0; k < num_lifetimes; k++){
+        const DAGBufferLifetime_* life = lifetimes + k;
+        const size_t size = nodes[life->node].size;
+        model->unplanned_size += size;
+
+        size_t best = DAG_NO_SLOT;
+        for (size_t s = 0; s < model->num_slots; s++){
+            if (slot_end[s] >= life->begin) continue;
+            if (best == DAG_NO_SLOT) best = s;
+            const char fits = model->slot_size[s] >= size, best_fits = model->slot_size[best] >= size;
+            if (fits && (!best_fits || model->slot_size[s] < model->slot_size[best])) best = s;
+            if (!fits && !best_fits && model->slot_size[s] > model->slot_size[best]) best = s;
+        }
+        if (best == DAG_NO_SLOT){
+            best = model->num_slots++;
+            model->slot_size[best] = 0;
+        }
+        slot_end[best] = life->end;
+        model->slot_size[best] = size > model->slot_size[best] ? size : model->slot_size[best];
+        if (life->is_grad) nodes[life->node].grad_slot = best;
+        else nodes[life->node].value_slot = best;
+    }
+    for (size_t s = 0; s < model->num_slots; s++) model->planned_size += model->slot_size[s];
+    model->slots = (Matrix**)calloc(model->num_slots ? model->num_slots : 1, sizeof(Matrix*));
+    free(slot_end);
+    free(lifetimes);
+    model->is_planned = 1;
+};
+
+static void dag_nn_forward_node(DAG_NN_* model, const size_t v, const size_t B){
+    DAGNode_* node = model->nodes + v;
+    const DAGNode_* nodes = model->nodes;
+
+    if (node->kind == DAG_LAYER){
+        const Matrix* a = layer_forward_(model->layers + node->layer_idx, &nodes[node->inputs[0]].value);
+        node->value = *a;
+        return;
+    }
+
+    double* data;
+    if (node->value_slot != DAG_NO_SLOT){
+        data = model->slots[node->value_slot]->data;
+    }else{
+        matrix_resize(&node->own_value, node->size, B);
+        data = node->own_value->data;
+    }
+    node->value = (Matrix){data, node->size, B};
+
+    if (node->kind == DAG_ADD){
+        memcpy(data, nodes[node->inputs[0]].value.data, node->size * B * sizeof(double));
+        for (size_t i = 1; i < node->num_inputs; i++){
+            const double* x = nodes[node->inputs[i]].value.data;
+            for (size_t k = 0; k < node->size * B; k++) data[k] += x[k];
+        }
+    }else{
+        // Features are rows, so every input is one contiguous block of the output
+        size_t offset = 0;
+        for (size_t i = 0; i < node->num_inputs; i++){
+            const Matrix* x = &nodes[node->inputs[i]].value;
+            memcpy(data + offset * B, x->data, x->n_rows * B * sizeof(double));
+            offset += x->n_rows;
+        }
+    }
+};
+
+// Part of dC/d(consumer input) that belongs to the occurrence-th use of node v by the consumer
+static Matrix dag_nn_contribution(const DAG_NN_* model, const size_t consumer, const size_t v, size_t occurrence, const size_t B){
+    const DAGNode_* node = model->nodes + consumer;
+    if (node->kind == DAG_LAYER) return node->input_grad;
+    if (node->kind == DAG_ADD) return node->grad;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < node->num_inputs; i++){
+        if (node->inputs[i] == v && occurrence-- == 0) break;
+        offset += model->nodes[node->inputs[i]].size;
+    }
+    return (Matrix){node->grad.data + offset * B, model->nodes[v].size, B};
+};
+
+static void dag_nn_backward_node(DAG_NN_* model, const size_t v, const size_t B){
+    DAGNode_* node = model->nodes + v;
+    if (v == 0) return;
+
+    // Pull dC/d(output) from the consumers, a single one is used in place
+    const size_t num_parts = node->num_consumers + node->is_output;
+    for (size_t p = 0; p < num_parts; p++){
+        Matrix part;
+        if (p < node->num_consumers){
+            size_t occurrence = 0;
+            for (size_t q = 0; q < p; q++) occurrence += node->consumers[q] == node->consumers[p];
+            part = dag_nn_contribution(model, node->consumers[p], v, occurrence, B);
+        }else{
+            part = *model->output_grads[node->output_idx];
+        }
+        if (num_parts == 1){
+            node->grad = part;
+            break;
+        }
+        if (p == 0){
+            Matrix** slot = model->slots + node->grad_slot;
+            node->grad = (Matrix){(*slot)->data, node->size, B};
+            memcpy(node->grad.data, part.data, node->size * B * sizeof(double));
+        }else{
+            for (size_t k = 0; k < node->size * B; k++) node->grad.data[k] += part.data[k];
+        }
+    }
+
+    if (node->kind == DAG_LAYER){
+        const Matrix* input_grad = layer_backward_(model->layers + node->layer_idx, &node->grad);
+        if (input_grad != NULL) node->input_grad = *input_grad;
+    }
+};
+
+typedef struct {
+    DAG_NN_* model;
+    size_t level;
+    size_t batch_size;
+    char backward;
+    size_t next;
+}DAGLevelJob_;
+
+static void dag_nn_level_worker(void* ctx, const size_t worker){
+    (void)worker;
+    DAGLevelJob_* job = (DAGLevelJob_*)ctx;
+    DAG_NN_* model = job->model;
+    const size_t begin = model->level_start[job->level], count = model->level_start[job->level + 1] - begin;
+
+    for (size_t k = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED); k < count; k = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)){
+        const size_t v = model->level_nodes[begin + k];
+        if (job->backward) dag_nn_backward_node(model, v, job->batch_size);
+        else dag_nn_forward_node(model, v, job->batch_size);
+    }
+};
+
+static void dag_nn_run_level(DAG_NN_* model, const size_t level, const size_t B, const char backward){
+    DAGLevelJob_ job = {model, level, B, backward, 0};
+    const size_t count = model->level_start[level + 1] - model->level_start[level];
+    if (model->pool != NULL && model->pool->num_threads > 1 && count > 1) model->pool->run(model->pool, dag_nn_level_worker, &job);
+    else dag_nn_level_worker(&job, 0);
+};
+
+// X (input_size x B) is read in place and must stay unchanged until dag_nn_backward
+void dag_nn_forward(DAG_NN_* model, const Matrix* X){
+    if (X->n_rows != model->input_size){
+        printf("Input has %lu features, the model expects %lu.\n", X->n_rows, model->input_size);
+        exit(0);
+    }
+    dag_nn_plan(model);
+    const size_t B = X->n_cols;
+    for (size_t s = 0; s < model->num_slots; s++) matrix_resize(model->slots + s, model->slot_size[s], B);
+
+    model->nodes[0].value = *X;
+    for (size_t l = 1; l < model->num_levels; l++) dag_nn_run_level(model, l, B, 0);
+};
+
+const Matrix* dag_nn_output_value(const DAG_NN_* model, const size_t output){
+    return &model->nodes[model->outputs[output]].value;
+};
+
+// One dC/da per output, in the order of dag_nn_output. Parameter gradients are batch means.
+void dag_nn_backward(DAG_NN_* model, const Matrix** output_grads){
+    const size_t B = model->nodes[0].value.n_cols;
+    model->output_grads = output_grads;
+    for (size_t l = model->num_levels; l-- > 1;) dag_nn_run_level(model, l, B, 1);
+    model->output_grads = NULL;
+};
+
+void print_dag_nn_(const DAG_NN_* model){
+    static const char* kinds[4] = {"INPUT", "LAYER", "ADD", "CONCAT"};
+    printf("NODES:\n");
+    for (size_t v = 0; v < model->num_nodes; v++){
+        const DAGNode_* node = model->nodes + v;
+        printf("    Idx: %lu Level: %lu Type: %s, Size: %lu, Inputs:", v, node->level, kinds[node->kind], node->size);
+        for (size_t i = 0; i < node->num_inputs; i++) printf(" %lu", node->inputs[i]);
+        if (node->is_output) printf(", Output %lu", node->output_idx);
+        printf("\n");
+    }
+    if (model->is_planned){
+        printf("    %lu levels, %lu buffer slots of %lu features per sample instead of %lu\n", model->num_levels, model->num_slots,
+               model->planned_size, model->unplanned_size);
+    }
+};
+
+void destroy_dag_nn_(DAG_NN_* model){
+    if (model == NULL) return;
+    Sequential_NN_ layers = {0};
+    layers.num_layers = model->num_layers;
+    layers.layers = model->layers;
+    destroy_sequential_nn_(&layers);
+
+    for (size_t v = 0; v < model->num_nodes; v++){
+        free(model->nodes[v].inputs);
+        free(model->nodes[v].consumers);
+        matrix_destroy(model->nodes[v].own_value);
+        free(model->nodes[v].own_value);
+    }
+    for (size_t s = 0; s < model->num_slots; s++){
+        matrix_destroy(model->slots[s]);
+        free(model->slots[s]);
+    }
+    free(model->nodes);
+    free(model->outputs);
+    free(model->level_start);
+    free(model->level_nodes);
+    free(model->slot_size);
+    free(model->slots);
+    memset(model, 0, sizeof(DAG_NN_));
+};
+
+#pragma endregion DAG Neural Network Layerwise
+
+#endif // __DL_H__
@@ -206,6 +206,7 @@ typedef struct Adam_Optimizer_{
     double beta_2;
     double epsilon;
     size_t num_layers;
+    size_t num_steps;   // optimize_adam_ calls so far, for the bias correction
     Matrix* m_w_ptr;
     Matrix* m_b_ptr;
     Matrix* v_w_ptr;  
@@ -223,6 +224,7 @@ void init_Adam_optimizer_(Adam_Optimizer_** optimizer_dptr, const double lr, con
     (*optimizer_dptr)->beta_2 = beta_2;
     (*optimizer_dptr)->epsilon = epsilon;
     (*optimizer_dptr)->num_layers = num_layers;
+    (*optimizer_dptr)->num_steps = 0;
 
     // Allocate space for gradients for weights and biases in each layer
     (*optimizer_dptr)->m_w_ptr = (Matrix*)malloc(num_layers*sizeof(Matrix));
@@ -234,36 +236,66 @@ void init_Adam_optimizer_(Adam_Optimizer_** optimizer_dptr, const double lr, con
     for (size_t i = 0; i < num_layers; i++){
         Layer_* layer_ptr = layers + i;
 
-        switch(layer_ptr->type){
-            case FEED_FORWARD:
-                FeedForwardLayer_* ff_layer_ptr = layer_ptr->layer.ff_layer;
-                
-                //set rows and cols
-                ((*optimizer_dptr)->m_w_ptr + i)->data = (double*)calloc(ff_layer_ptr->grad_W->n_rows * ff_layer_ptr->grad_W->n_cols, sizeof(double));
-                ((*optimizer_dptr)->m_w_ptr + i)->n_rows = ff_layer_ptr->grad_W->n_rows; 
-                ((*optimizer_dptr)->m_w_ptr + i)->n_cols = ff_layer_ptr->grad_W->n_cols;
-                                
-                ((*optimizer_dptr)->v_w_ptr + i)->data = (double*)calloc(ff_layer_ptr->grad_W->n_rows * ff_layer_ptr->grad_W->n_cols, sizeof(double));
-                ((*optimizer_dptr)->v_w_ptr + i)->n_rows = ff_layer_ptr->grad_W->n_rows;
-                ((*optimizer_dptr)->v_w_ptr + i)->n_cols = ff_layer_ptr->grad_W->n_cols;
+        Matrix *weights, *biases, *grad_W, *grad_b;
+        if (layer_ptr->type == EMBEDDING){
+            // Moments for every row of the table, biases stay empty
+            Matrix* table = layer_ptr->layer.embedding_layer->weights;
+            Matrix empty = {NULL, 0, 0};
+            Matrix moments = {NULL, table->n_rows, table->n_cols};
+            moments.data = (double*)calloc(table->n_rows * table->n_cols, sizeof(double));
+            (*optimizer_dptr)->m_w_ptr[i] = moments;
+            moments.data = (double*)calloc(table->n_rows * table->n_cols, sizeof(double));
+            (*optimizer_dptr)->v_w_ptr[i] = moments;
+            (*optimizer_dptr)->m_b_ptr[i] = (*optimizer_dptr)->v_b_ptr[i] = empty;
+            continue;
+        }
+        if (!layer_params_(layer_ptr, &weights, &biases, &grad_W, &grad_b)){
+            // Layers without parameters keep empty moments
+            Matrix empty = {NULL, 0, 0};
+            (*optimizer_dptr)->m_w_ptr[i] = (*optimizer_dptr)->v_w_ptr[i] = empty;
+            (*optimizer_dptr)->m_b_ptr[i] = (*optimizer_dptr)->v_b_ptr[i] = empty;
+            continue;
+        }
 
-                ((*optimizer_dptr)->m_b_ptr + i)->data = (double*)calloc(ff_layer_ptr->grad_b->n_rows * ff_layer_ptr->grad_b->n_cols, sizeof(double));
-                ((*optimizer_dptr)->m_b_ptr + i)->n_rows = ff_layer_ptr->grad_b->n_rows;
-                ((*optimizer_dptr)->m_b_ptr + i)->n_cols = ff_layer_ptr->grad_b->n_cols;   
+        //set rows and cols
+        ((*optimizer_dptr)->m_w_ptr + i)->data = (double*)calloc(grad_W->n_rows * grad_W->n_cols, sizeof(double));
+        ((*optimizer_dptr)->m_w_ptr + i)->n_rows = grad_W->n_rows; 
+        ((*optimizer_dptr)->m_w_ptr + i)->n_cols = grad_W->n_cols;
+                        
+        ((*optimizer_dptr)->v_w_ptr + i)->data = (double*)calloc(grad_W->n_rows * grad_W->n_cols, sizeof(double));
+        ((*optimizer_dptr)->v_w_ptr + i)->n_rows = grad_W->n_rows;
+        ((*optimizer_dptr)->v_w_ptr + i)->n_cols = grad_W->n_cols;
 
-                ((*optimizer_dptr)->v_b_ptr + i)->data = (double*)calloc(ff_layer_ptr->grad_b->n_rows * ff_layer_ptr->grad_b->n_cols, sizeof(double));
-                ((*optimizer_dptr)->v_b_ptr + i)->n_rows = ff_layer_ptr->grad_b->n_rows;
-                ((*optimizer_dptr)->v_b_ptr + i)->n_cols = ff_layer_ptr->grad_b->n_cols;
+        ((*optimizer_dptr)->m_b_ptr + i)->data = (double*)calloc(grad_b->n_rows * grad_b->n_cols, sizeof(double));
+        ((*optimizer_dptr)->m_b_ptr + i)->n_rows = grad_b->n_rows;
+        ((*optimizer_dptr)->m_b_ptr + i)->n_cols = grad_b->n_cols;   
 
-                break;
+        ((*optimizer_dptr)->v_b_ptr + i)->data = (double*)calloc(grad_b->n_rows * grad_b->n_cols, sizeof(double));
+        ((*optimizer_dptr)->v_b_ptr + i)->n_rows = grad_b->n_rows;
+        ((*optimizer_dptr)->v_b_ptr + i)->n_cols = grad_b->n_cols;
+    }
 
-            default:
-                printf("Provided layer type not supported.\n");
-                exit(0);     
+};
 
-        }   
+// Lazy Adam: only the rows touched by the last batch and their moments are updated,
+// rows that were not looked up keep their moments until they are
+void optimize_adam_rows_(Adam_Optimizer_* optimizer, const size_t i, EmbeddingLayer_* layer){
+    const size_t dim = layer->dim;
+    const double correction_1 = 1.0 - pow(optimizer->beta_1, (double)optimizer->num_steps);
+    const double correction_2 = 1.0 - pow(optimizer->beta_2, (double)optimizer->num_steps);
+
+    for (size_t k = 0; k < layer->num_touched; k++){
+        const size_t offset = layer->touched[k] * dim;
+        const double* grad = layer->grad_rows->data + k * dim;
+        double* w = layer->weights->data + offset;
+        double* m = optimizer->m_w_ptr[i].data + offset;
+        double* v = optimizer->v_w_ptr[i].data + offset;
+        for (size_t d = 0; d < dim; d++){
+            m[d] = optimizer->beta_1 * m[d] + (1 - optimizer->beta_1) * grad[d];
+            v[d] = optimizer->beta_2 * v[d] + (1 - optimizer->beta_2) * grad[d] * grad[d];
+            w[d] -= (m[d] / correction_1) * (optimizer->alpha / sqrt(v[d] / correction_2 + optimizer->epsilon));
+        }
     }
-
 };
 
 void optimize_adam_(Adam_Optimizer_* optimizer, Layer_* layers){
@@ -272,68 +304,72 @@ void optimize_adam_(Adam_Optimizer_* optimizer, Layer_* layers){
     double grad_W_j_k_t, w_j_k_opt, v_dach_t, w_j_k_t;
     double grad_b_j_t, b_j_opt, b_j_t;
 
+    optimizer->num_steps++;
     for (size_t i = 0; i < optimizer->num_layers; i++){
         Layer_* layer_ptr = layers + i;
-        switch(layer_ptr->type){
-            case 0:
-                FeedForwardLayer_* ff_layer_ptr = layer_ptr->layer.ff_layer;
-                for (size_t j = 0; j < ff_layer_ptr->grad_W->n_rows; j++){
-                    for (size_t k = 0; k < ff_layer_ptr->grad_W->n_cols; k++){
-                        // Weights                       
-                            grad_W_j_k_t = matrix_get(ff_layer_ptr->grad_W, j, k);
-                            
-                            // m_W
-                                m_t_prev = matrix_get(optimizer->m_w_ptr + i, j, k);
-                            
-                            
-                                // Calculate value of m_t+1 and update m_t
-                                m_t = optimizer->beta_1 * m_t_prev + (1 - optimizer->beta_1) * grad_W_j_k_t; // delta_W[j][k]
-                                matrix_set(optimizer->m_w_ptr + i, j, k, m_t); 
-                                
-                                m_dach_t = m_t/(1 - pow(optimizer->beta_1, i));
+        if (layer_ptr->type == EMBEDDING){
+            optimize_adam_rows_(optimizer, i, layer_ptr->layer.embedding_layer);
+            continue;
+        }
+        Matrix *weights, *biases, *grad_W, *grad_b;
+        if (!layer_params_(layer_ptr, &weights, &biases, &grad_W, &grad_b)) continue;
+
+        for (size_t j = 0; j < grad_W->n_rows; j++){
+            for (size_t k = 0; k < grad_W->n_cols; k++){
+                // Weights                       
+                    grad_W_j_k_t = matrix_get(grad_W, j, k);
+                    
+                    // m_W
+                        m_t_prev = matrix_get(optimizer->m_w_ptr + i, j, k);
+                    
+                    
+                        // Calculate value of m_t+1 and update m_t
+                        m_t = optimizer->beta_1 * m_t_prev + (1 - optimizer->beta_1) * grad_W_j_k_t; // delta_W[j][k]
+                        matrix_set(optimizer->m_w_ptr + i, j, k, m_t); 
+                        
+                        m_dach_t = m_t/(1 - pow(optimizer->beta_1, optimizer->num_steps));
     
-                            // v_W
-                                v_t_prev = matrix_get(optimizer->v_w_ptr, j, k);
-                                
-                                // Calculate value of v_t+1 and update v_t
-                                v_t = optimizer->beta_2 * v_t_prev + (1- optimizer->beta_2) * pow(grad_W_j_k_t, 2); // [delta_W[i][t]]^2
-                                matrix_set(optimizer->v_w_ptr + i, j, k, v_t);
+                    // v_W
+                        v_t_prev = matrix_get(optimizer->v_w_ptr + i, j, k);
+                        
+                        // Calculate value of v_t+1 and update v_t
+                        v_t = optimizer->beta_2 * v_t_prev + (1- optimizer->beta_2) * pow(grad_W_j_k_t, 2); // [delta_W[i][t]]^2
+                        matrix_set(optimizer->v_w_ptr + i, j, k, v_t);
 
-                                v_dach_t = v_t/(1 - pow(optimizer->beta_2, i));
+                        v_dach_t = v_t/(1 - pow(optimizer->beta_2, optimizer->num_steps));
 
-                        // update the corresponding weight W[j][k] of the Layer i of the model
-                            w_j_k_t = matrix_get(ff_layer_ptr->weights, j, k);
-                            w_j_k_opt = w_j_k_t - m_dach_t * (optimizer->alpha / sqrt(v_dach_t + optimizer->epsilon));
-                            matrix_set(ff_layer_ptr->weights, j, k, w_j_k_opt);
+                // update the corresponding weight W[j][k] of the Layer i of the model
+                    w_j_k_t = matrix_get(weights, j, k);
+                    w_j_k_opt = w_j_k_t - m_dach_t * (optimizer->alpha / sqrt(v_dach_t + optimizer->epsilon));
+                    matrix_set(weights, j, k, w_j_k_opt);
 
-                    }
-                        // Biases                        
-                            grad_b_j_t = matrix_get(ff_layer_ptr->grad_b, j, 0);
-                            
-                            // m_b
-                                m_t_prev = matrix_get(optimizer->m_b_ptr + i, j, 0);
-                            
-                            
-                                // Calculate value of m_t+1 and update m_t
-                                m_t = optimizer->beta_1 * m_t_prev + (1 - optimizer->beta_1) * grad_b_j_t; // delta_W[j][k]
-                                matrix_set(optimizer->m_b_ptr + i, j, 0, m_t); 
-                                
-                                m_dach_t = m_t/(1 - pow(optimizer->beta_1, i));
+            }
+                // Biases                        
+                    grad_b_j_t = matrix_get(grad_b, j, 0);
+                    
+                    // m_b
+                        m_t_prev = matrix_get(optimizer->m_b_ptr + i, j, 0);
+                    
+                    
+                        // Calculate value of m_t+1 and update m_t
+                        m_t = optimizer->beta_1 * m_t_prev + (1 - optimizer->beta_1) * grad_b_j_t; // delta_W[j][k]
+                        matrix_set(optimizer->m_b_ptr + i, j, 0, m_t); 
+                        
+                        m_dach_t = m_t/(1 - pow(optimizer->beta_1, optimizer->num_steps));
     
-                            // v_b
-                                v_t_prev = matrix_get(optimizer->v_b_ptr, j, 0);
-                                
-                                // Calculate value of v_t+1 and update v_t
-                                v_t = optimizer->beta_2 * v_t_prev + (1 - optimizer->beta_2) * pow(grad_b_j_t, 2); // [delta_W[i][t]]^2
-                                matrix_set(optimizer->v_b_ptr + i, j, 0, v_t);
+                    // v_b
+                        v_t_prev = matrix_get(optimizer->v_b_ptr + i, j, 0);
+                        
+                        // Calculate value of v_t+1 and update v_t
+                        v_t = optimizer->beta_2 * v_t_prev + (1 - optimizer->beta_2) * pow(grad_b_j_t, 2); // [delta_W[i][t]]^2
+                        matrix_set(optimizer->v_b_ptr + i, j, 0, v_t);
 
-                                v_dach_t = v_t/(1 - pow(optimizer->beta_2, i));
+                        v_dach_t = v_t/(1 - pow(optimizer->beta_2, optimizer->num_steps));
 
-                        // update the corresponding weight b[j] of the Layer i of the model
-                            b_j_t = matrix_get(ff_layer_ptr->biases, j, 0);
-                            b_j_opt = b_j_t - m_dach_t * (optimizer->alpha / sqrt(v_dach_t + optimizer->epsilon));
-                            matrix_set(ff_layer_ptr->biases, j, 0, b_j_opt);
-                }
+                // update the corresponding weight b[j] of the Layer i of the model
+                    b_j_t = matrix_get(biases, j, 0);
+                    b_j_opt = b_j_t - m_dach_t * (optimizer->alpha / sqrt(v_dach_t + optimizer->epsilon));
+                    matrix_set(biases, j, 0, b_j_opt);
         }
     }   
 }
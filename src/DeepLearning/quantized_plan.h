@@ -0,0 +1,380 @@
+#ifndef __QUANTIZED_PLAN_H__
+#define __QUANTIZED_PLAN_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "dataset.h"
+#include "model_plan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define QUANT_X86 1
+#endif
+
+#pragma region Quantized Plan
+/*
+Int8 post-training quantization of a model plan (see model_plan.h):
+
+    ModelPlan* plan = model_plan_compile(model, 32);
+    QuantizedPlan* qplan = quantized_plan_new(plan, 32);          // plan must outlive qplan
+    QuantizedReport report;
+    quantized_plan_calibrate(qplan, calibration_set, 0.05, &report);
+    quantized_plan_print_report(qplan, &report);
+    quantized_plan_predict(qplan, x, y);
+
+Weights are quantized once, symmetric per output channel: W[i][k] ~ scale[i] * q[i][k] with
+q in [-127, 127]. Activations are quantized dynamically, every sample entering a layer gets
+its own scale from its largest magnitude. The dot products run on int8 with int32
+accumulation, then acc * scale_x * scale[i] + b[i] goes through the activation in double.
+
+The dot kernel is picked at runtime from what the CPU supports: AVX-VNNI (vpdpbusd), AVX2
+(vpmaddubsw + vpmaddwd) or portable C. CML_INT8_KERNEL=vnni|avx2|scalar overrides it.
+Both SIMD kernels multiply |x| (unsigned) by w carrying the sign of x, which is exact since
+neither operand is -128, so all kernels give identical results.
+
+Calibration runs the dataset through both plans. Each layer is fed the double input, its
+relative output error is recorded and layers above the tolerance fall back to the double
+plan. The report then gives the end-to-end error and how often the top output agrees.
+Like ModelPlan, a quantized plan owns scratch buffers and is used by one thread at a time.
+*/
+
+#define QUANT_K_ALIGN 32   // rows are zero padded to whole SIMD registers
+#define QUANT_MAX 127
+
+typedef struct {
+    size_t n_in;
+    size_t n_out;
+    size_t k_pad;          // n_in rounded up to QUANT_K_ALIGN
+    char act;
+    int8_t* weights;       // n_out x k_pad, inside the plan's int8 buffer
+    double* scales;        // per output channel
+    double* biases;
+    char use_double;       // set by calibration, runs the reference layer instead
+    double calibration_error;
+}QuantizedLayer;
+
+typedef struct QuantizedPlan{
+    const ModelPlan* reference;
+    size_t num_layers;
+    size_t input_size;
+    size_t output_size;
+    size_t max_batch;
+    QuantizedLayer* layers;
+    int8_t* weights;
+    double* buffers[2];    // sample-major activations between layers
+    int8_t* x_q;           // quantized inputs of the current layer, max_batch x k_pad
+    double* x_scales;
+    int32_t (*dot)(const int8_t* w, const int8_t* x, const size_t k);
+    const char* kernel;
+}QuantizedPlan;
+
+typedef struct {
+    size_t num_samples;
+    size_t num_double_layers;
+    double max_abs_error;      // largest |y_int8 - y_double| over all outputs
+    double mean_abs_error;
+    double top1_agreement;     // fraction of samples with the same largest output
+}QuantizedReport;
+
+#pragma region Int8 Kernels
+
+static int32_t quant_dot_scalar(const int8_t* w, const int8_t* x, const size_t k){
+    int32_t acc = 0;
+    for (size_t i = 0; i < k; i++) acc += (int32_t)w[i] * (int32_t)x[i];
+    return acc;
+};
+
+#ifdef QUANT_X86
+__attribute__((target("avx2")))
+static int32_t quant_hsum_avx2(const __m256i v){
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+};
+
+// k is a multiple of QUANT_K_ALIGN
+__attribute__((target("avx2")))
+static int32_t quant_dot_avx2(const int8_t* w, const int8_t* x, const size_t k){
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < k; i += 32){
+        const __m256i xv = _mm256_loadu_si256((const __m256i*)(x + i));
+        const __m256i wv = _mm256_loadu_si256((const __m256i*)(w + i));
+        // |x| * sign(x) w in pairs, at most 2 * 127 * 127 so the int16 sums never saturate
+        const __m256i pairs = _mm256_maddubs_epi16(_mm256_abs_epi8(xv), _mm256_sign_epi8(wv, xv));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, ones));
+    }
+    return quant_hsum_avx2(acc);
+};
+
+__attribute__((target("avx2,avxvnni")))
+static int32_t quant_dot_vnni(const int8_t* w, const int8_t* x, const size_t k){
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t i = 0; i < k; i += 32){
+        const __m256i xv = _mm256_loadu_si256((const __m256i*)(x + i));
+        const __m256i wv = _mm256_loadu_si256((const __m256i*)(w + i));
+        acc = _mm256_dpbusd_avx_epi32(acc, _mm256_abs_epi8(xv), _mm256_sign_epi8(wv, xv));
+    }
+    return quant_hsum_avx2(acc);
+};
+#endif
+
+static void quant_select_kernel(QuantizedPlan* self){
+    const char* forced = getenv("CML_INT8_KERNEL");
+    self->dot = quant_dot_scalar;
+    self->kernel = "scalar";
+    if (forced && strcmp(forced, "scalar") == 0) return;
+
+#ifdef QUANT_X86
+    __builtin_cpu_init();
+    const char has_avx2 = __builtin_cpu_supports("avx2") != 0;
+    const char has_vnni = has_avx2 && __builtin_cpu_supports("avxvnni") != 0;
+    if (has_vnni && !(forced && strcmp(forced, "avx2") == 0)){
+        self->dot = quant_dot_vnni;
+        self->kernel = "avx-vnni";
+    }
+    else if (has_avx2){
+        self->dot = quant_dot_avx2;
+        self->kernel = "avx2";
+    }
+#endif
+};
+
+#pragma endregion Int8 Kernels
+
+static size_t quant_padded(const size_t n){
+    return (n + QUANT_K_ALIGN - 1) / QUANT_K_ALIGN * QUANT_K_ALIGN;
+};
+
+static int8_t quant_round(const double v){
+    const double r = nearbyint(v);
+    return (int8_t)(r > QUANT_MAX ? QUANT_MAX : (r < -QUANT_MAX ? -QUANT_MAX : r));
+};
+
+QuantizedPlan* quantized_plan_new(const ModelPlan* plan, const size_t max_batch){
+    if (plan == NULL || max_batch == 0){
+        printf("A quantized plan needs a model plan and a batch size in quantized_plan_new.\n");
+        exit(1);
+    }
+
+    QuantizedPlan* self = (QuantizedPlan*)malloc(sizeof(QuantizedPlan));
+    self->reference = plan;
+    self->num_layers = plan->num_layers;
+    self->input_size = plan->input_size;
+    self->output_size = plan->output_size;
+    self->max_batch = max_batch;
+    self->layers = (QuantizedLayer*)calloc(plan->num_layers, sizeof(QuantizedLayer));
+    quant_select_kernel(self);
+
+    size_t num_weights = 0, max_k = 0;
+    for (size_t l = 0; l < plan->num_layers; l++){
+        const size_t k_pad = quant_padded(plan->layers[l].n_in);
+        num_weights += plan->layers[l].n_out * k_pad;
+        if (k_pad > max_k) max_k = k_pad;
+    }
+    void* weights = NULL;
+    if (posix_memalign(&weights, PLAN_ALIGNMENT, num_weights ? num_weights : 1) != 0){
+        printf("Failed to allocate the weights in quantized_plan_new.\n");
+        exit(1);
+    }
+    memset(weights, 0, num_weights);
+    self->weights = (int8_t*)weights;
+
+    size_t offset = 0;
+    for (size_t l = 0; l < plan->num_layers; l++){
+        QuantizedLayer* layer = self->layers + l;
+        layer->n_in = plan->layers[l].n_in;
+        layer->n_out = plan->layers[l].n_out;
+        layer->k_pad = quant_padded(layer->n_in);
+        layer->act = plan->layers[l].act;
+        layer->weights = self->weights + offset;
+        layer->scales = (double*)malloc(layer->n_out * sizeof(double));
+        layer->biases = (double*)malloc(layer->n_out * sizeof(double));
+        offset += layer->n_out * layer->k_pad;
+
+        for (size_t i = 0; i < layer->n_out; i++){
+            double max_abs = 0.0;
+            for (size_t k = 0; k < layer->n_in; k++) max_abs = fmax(max_abs, fabs(model_plan_get_weight(plan, l, i, k)));
+            layer->scales[i] = max_abs > 0.0 ? max_abs / QUANT_MAX : 1.0;
+            for (size_t k = 0; k < layer->n_in; k++){
+                layer->weights[i * layer->k_pad + k] = quant_round(model_plan_get_weight(plan, l, i, k) / layer->scales[i]);
+            }
+            layer->biases[i] = model_plan_get_bias(plan, l, i);
+        }
+    }
+
+    const size_t width = plan->max_width ? plan->max_width : 1;
+    self->buffers[0] = (double*)malloc(max_batch * width * sizeof(double));
+    self->buffers[1] = (double*)malloc(max_batch * width * sizeof(double));
+    void* x_q = NULL;
+    if (posix_memalign(&x_q, PLAN_ALIGNMENT, max_batch * max_k) != 0){
+        printf("Failed to allocate the buffers in quantized_plan_new.\n");
+        exit(1);
+    }
+    memset(x_q, 0, max_batch * max_k);
+    self->x_q = (int8_t*)x_q;
+    self->x_scales = (double*)malloc(max_batch * sizeof(double));
+    return self;
+};
+
+void quantized_plan_destroy(QuantizedPlan* self){
+    if (self == NULL) return;
+    for (size_t l = 0; l < self->num_layers; l++){
+        free(self->layers[l].scales);
+        free(self->layers[l].biases);
+    }
+    free(self->layers);
+    free(self->weights);
+    free(self->buffers[0]);
+    free(self->buffers[1]);
+    free(self->x_q);
+    free(self->x_scales);
+    free(self);
+};
+
+// One layer over n samples in int8, x is n x n_in and y is n x n_out
+static void quantized_plan_layer(QuantizedPlan* self, const size_t l, const double* x, const size_t n, double* y){
+    const QuantizedLayer* layer = self->layers + l;
+    if (layer->use_double){
+        model_plan_layer(self->reference, self->reference->layers + l, x, n, y);
+        return;
+    }
+
+    // Dynamic per-sample activation scales, the padding stays zero
+    for (size_t s = 0; s < n; s++){
+        const double* xs = x + s * layer->n_in;
+        int8_t* q = self->x_q + s * layer->k_pad;
+        double max_abs = 0.0;
+        for (size_t k = 0; k < layer->n_in; k++) max_abs = fmax(max_abs, fabs(xs[k]));
+        const double scale = max_abs > 0.0 ? max_abs / QUANT_MAX : 1.0;
+        for (size_t k = 0; k < layer->n_in; k++) q[k] = quant_round(xs[k] / scale);
+        memset(q + layer->n_in, 0, layer->k_pad - layer->n_in);
+        self->x_scales[s] = scale;
+    }
+
+    // Rows outer, each weight row is streamed once per batch
+    for (size_t i = 0; i < layer->n_out; i++){
+        const int8_t* w = layer->weights + i * layer->k_pad;
+        for (size_t s = 0; s < n; s++){
+            const int32_t acc = self->dot(w, self->x_q + s * layer->k_pad, layer->k_pad);
+            const double z = (double)acc * self->x_scales[s] * layer->scales[i] + layer->biases[i];
+            y[s * layer->n_out + i] = model_plan_activate(layer->act, z);
+        }
+    }
+};
+
+void quantized_plan_predict_batch(QuantizedPlan* self, const double* X, const size_t n, double* Y){
+    for (size_t start = 0; start < n; start += self->max_batch){
+        const size_t count = n - start < self->max_batch ? n - start : self->max_batch;
+        const double* in = X + start * self->input_size;
+        double* y = Y + start * self->output_size;
+
+        for (size_t l = 0; l < self->num_layers; l++){
+            double* out = l + 1 == self->num_layers ? y : self->buffers[l % 2];
+            quantized_plan_layer(self, l, in, count, out);
+            in = out;
+        }
+    }
+};
+
+void quantized_plan_predict(QuantizedPlan* self, const double* x, double* y){
+    quantized_plan_predict_batch(self, x, 1, y);
+};
+
+static size_t quant_argmax(const double* y, const size_t n){
+    size_t best = 0;
+    for (size_t i = 1; i < n; i++) if (y[i] > y[best]) best = i;
+    return best;
+};
+
+/*
+Calibrates on the samples of a Dataset_, sample i being the first input_size values of
+dataset->data[i] (trailing values, e.g. a label column, are ignored). Layers whose relative
+L2 output error exceeds tolerance run in double from then on, pass 0 to quantize every layer
+regardless. Fills report with the end-to-end accuracy delta.
+*/
+void quantized_plan_calibrate(QuantizedPlan* self, const Dataset_* dataset, const double tolerance, QuantizedReport* report){
+    if (dataset == NULL || dataset->N == 0){
+        printf("Calibration needs a non-empty dataset in quantized_plan_calibrate.\n");
+        exit(1);
+    }
+
+    size_t width = self->input_size;
+    for (size_t l = 0; l < self->num_layers; l++) if (self->layers[l].n_out > width) width = self->layers[l].n_out;
+    double* in = (double*)malloc(width * sizeof(double));
+    double* ref = (double*)malloc(width * sizeof(double));
+    double* quant = (double*)malloc(width * sizeof(double));
+    double* err = (double*)calloc(self->num_layers, sizeof(double));
+    double* norm = (double*)calloc(self->num_layers, sizeof(double));
+
+    for (size_t l = 0; l < self->num_layers; l++) self->layers[l].use_double = 0;
+
+    for (size_t s = 0; s < dataset->N; s++){
+        const Matrix* sample = dataset->data + s;
+        if (sample->n_rows * sample->n_cols < self->input_size){
+            printf("Sample %lu has fewer than %lu values in quantized_plan_calibrate.\n", s, self->input_size);
+            exit(1);
+        }
+        memcpy(in, sample->data, self->input_size * sizeof(double));
+
+        // Every layer sees the double input, so errors do not compound across layers
+        for (size_t l = 0; l < self->num_layers; l++){
+            const size_t n_out = self->layers[l].n_out;
+            model_plan_layer(self->reference, self->reference->layers + l, in, 1, ref);
+            quantized_plan_layer(self, l, in, 1, quant);
+            for (size_t i = 0; i < n_out; i++){
+                err[l] += (quant[i] - ref[i]) * (quant[i] - ref[i]);
+                norm[l] += ref[i] * ref[i];
+            }
+            memcpy(in, ref, n_out * sizeof(double));
+        }
+    }
+
+    memset(report, 0, sizeof(QuantizedReport));
+    for (size_t l = 0; l < self->num_layers; l++){
+        self->layers[l].calibration_error = sqrt(err[l] / (norm[l] > 0.0 ? norm[l] : 1.0));
+        self->layers[l].use_double = tolerance > 0.0 && self->layers[l].calibration_error > tolerance;
+        report->num_double_layers += self->layers[l].use_double;
+    }
+
+    // End to end with the chosen layers
+    size_t agree = 0;
+    for (size_t s = 0; s < dataset->N; s++){
+        memcpy(in, dataset->data[s].data, self->input_size * sizeof(double));
+        model_plan_predict(self->reference, in, ref);
+        quantized_plan_predict(self, in, quant);
+        for (size_t i = 0; i < self->output_size; i++){
+            const double delta = fabs(quant[i] - ref[i]);
+            report->max_abs_error = fmax(report->max_abs_error, delta);
+            report->mean_abs_error += delta;
+        }
+        agree += quant_argmax(ref, self->output_size) == quant_argmax(quant, self->output_size);
+    }
+    report->num_samples = dataset->N;
+    report->mean_abs_error /= (double)(dataset->N * self->output_size);
+    report->top1_agreement = (double)agree / (double)dataset->N;
+
+    free(in);
+    free(ref);
+    free(quant);
+    free(err);
+    free(norm);
+};
+
+void quantized_plan_print_report(const QuantizedPlan* self, const QuantizedReport* report){
+    printf("Int8 calibration over %lu samples, kernel %s\n", report->num_samples, self->kernel);
+    for (size_t l = 0; l < self->num_layers; l++){
+        printf("    Layer %lu (%lu -> %lu): relative error %.5f%s\n", l, self->layers[l].n_in, self->layers[l].n_out,
+               self->layers[l].calibration_error, self->layers[l].use_double ? ", kept in double" : "");
+    }
+    printf("    Outputs: max |delta| %.6f, mean |delta| %.6f, top-1 agreement %.2f%%\n",
+           report->max_abs_error, report->mean_abs_error, 100.0 * report->top1_agreement);
+};
+
+#pragma endregion Quantized Plan
+
+#endif
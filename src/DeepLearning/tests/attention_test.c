@@ -0,0 +1,192 @@
+#include "matrix.h"
+#include "layers.h"
+#include "models.h"
+#include "loss.h"
+#include "test_utils.h"
+
+// Attention of sample b written out with plain loops and a full N x N score matrix
+void naive_attention_sample(const AttentionLayer_* layer, const Matrix* X, const size_t b, double* out){
+    const size_t N = layer->seq_len, D = layer->model_dim, dh = layer->head_dim, B = X->n_cols;
+    double* qkv = (double*)malloc(N * 3 * D * sizeof(double));
+    double* o = (double*)calloc(N * D, sizeof(double));
+    double* scores = (double*)malloc(N * N * sizeof(double));
+
+    for (size_t n = 0; n < N; n++){
+        for (size_t r = 0; r < 3 * D; r++){
+            double sum = layer->biases->data[r];
+            for (size_t d = 0; d < D; d++) sum += layer->W_qkv.data[r * D + d] * X->data[(n * D + d) * B + b];
+            qkv[n * 3 * D + r] = sum;
+        }
+    }
+    for (size_t h = 0; h < layer->num_heads; h++){
+        for (size_t i = 0; i < N; i++){
+            double max = -INFINITY, sum = 0.0;
+            for (size_t j = 0; j < N; j++){
+                double s = 0.0;
+                for (size_t k = 0; k < dh; k++) s += qkv[i * 3 * D + h * dh + k] * qkv[j * 3 * D + D + h * dh + k];
+                scores[i * N + j] = s / sqrt((double)dh);
+                max = fmax(max, scores[i * N + j]);
+            }
+            for (size_t j = 0; j < N; j++) sum += (scores[i * N + j] = exp(scores[i * N + j] - max));
+            for (size_t j = 0; j < N; j++){
+                for (size_t k = 0; k < dh; k++) o[i * D + h * dh + k] += scores[i * N + j] / sum * qkv[j * 3 * D + 2 * D + h * dh + k];
+            }
+        }
+    }
+    for (size_t n = 0; n < N; n++){
+        for (size_t d = 0; d < D; d++){
+            double sum = layer->biases->data[3 * D + d];
+            for (size_t k = 0; k < D; k++) sum += layer->W_o.data[d * D + k] * o[n * D + k];
+            out[n * D + d] = sum;
+        }
+    }
+    free(qkv);
+    free(o);
+    free(scores);
+};
+
+// Tiled online softmax matches the full softmax, with a partial last tile
+void test_forward(void){
+    printf("Attention forward\n");
+    const size_t N = ATTENTION_TILE_ROWS + 7, D = 8, B = 2;
+    AttentionLayer_* layer = create_attention_layer(N, D, 2);
+    fill_random(layer->biases);
+    Matrix* X = NULL;
+    matrix_create(&X, N * D, B);
+    for (size_t k = 0; k < N * D * B; k++) X->data[k] = 4.0 * ((double)rand() / (double)RAND_MAX - 0.5);
+
+    const Matrix* a = attention_forward_(layer, X);
+    double* expected = (double*)malloc(N * D * sizeof(double));
+    for (size_t b = 0; b < B; b++){
+        naive_attention_sample(layer, X, b, expected);
+        for (size_t k = 0; k < N * D; k++) check_close("attention", expected[k], a->data[k * B + b], 1e-11);
+    }
+
+    free(expected);
+    matrix_destroy(X);
+    free(X);
+    destroy_attention_layer_(layer);
+    free(layer);
+};
+
+// Backward with recomputed tiles against central differences, more tokens than one tile
+void test_gradients(void){
+    printf("Attention gradients\n");
+    const size_t N = ATTENTION_TILE_COLS + 3, D = 4, B = 2;
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, N * D, N * D, 2);
+    add_attention_layer_(model, N, D, 2);
+    add_feed_forward_layer_(model, 2, N * D, 0);
+    fill_random(model->layers[1].layer.ff_layer->weights);
+    AttentionLayer_* layer = model->layers[0].layer.attention_layer;
+    fill_random(layer->biases);
+
+    Matrix *X = NULL, *y = NULL, *a = NULL;
+    matrix_create(&X, N * D, B);
+    matrix_create(&y, 2, B);
+    for (size_t k = 0; k < N * D * B; k++) X->data[k] = 3.0 * ((double)rand() / (double)RAND_MAX - 0.5);
+    fill_random(y);
+    matrix_create(&a, N * D, B);
+    memcpy(a->data, X->data, N * D * B * sizeof(double));
+    forward_sequential_nn_(model, a);
+    backpropagate_sequential_nn_(model, a, y, 0);
+
+    for (size_t k = 0; k < 4 * D * D; k += 3){
+        check_numeric_gradient(k < 3 * D * D ? "W_qkv" : "W_o", model, X, y, layer->params->data + k, layer->grad_params->data[k]);
+    }
+    for (size_t k = 0; k < 4 * D; k += 3) check_numeric_gradient("biases", model, X, y, layer->biases->data + k, layer->grad_b->data[k]);
+    for (size_t k = 0; k < N * D * B; k += 37) check_numeric_gradient("input", model, X, y, X->data + k, layer->grad_delta->data[k] / (double)B);
+
+    Matrix* matrices[3] = {X, y, a};
+    for (size_t i = 0; i < 3; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+// Every head through a full N x N GEMM and softmax, keeping the probabilities a naive backward reads
+double naive_heads_forward(AttentionLayer_* layer, const size_t B, double* O, Matrix* P){
+    const size_t N = layer->seq_len, H = layer->num_heads, dh = layer->head_dim;
+    const double scale = 1.0 / sqrt((double)dh);
+    const double begin = wall_time();
+    for (size_t b = 0; b < B; b++){
+        for (size_t h = 0; h < H; h++){
+            const Matrix Q = {attention_head(layer, layer->heads, 0, B, b, h), N, dh};
+            const Matrix K = {attention_head(layer, layer->heads, 1, B, b, h), N, dh};
+            const Matrix V = {attention_head(layer, layer->heads, 2, B, b, h), N, dh};
+            Matrix S = {P->data + (b * H + h) * N * N, N, N};
+            Matrix O_h = {O + (b * H + h) * N * dh, N, dh};
+            matrix_gemm_with_panel(0, 1, scale, &Q, &K, 0.0, &S, layer->panel);
+            for (size_t i = 0; i < N; i++){
+                double* s = S.data + i * N;
+                double max = -INFINITY, sum = 0.0;
+                for (size_t j = 0; j < N; j++) max = fmax(max, s[j]);
+                for (size_t j = 0; j < N; j++) sum += (s[j] = exp(s[j] - max));
+                for (size_t j = 0; j < N; j++) s[j] /= sum;
+            }
+            matrix_gemm_with_panel(0, 0, 1.0, &S, &V, 0.0, &O_h, layer->panel);
+        }
+    }
+    return wall_time() - begin;
+};
+
+// Time and attention activation memory of the tiled heads against the naive ones
+void test_benchmark(void){
+    printf("Attention benchmark\n");
+    const size_t D = 32, H = 4, B = 2;
+    const size_t lengths[3] = {128, 256, 512};
+
+    for (size_t t = 0; t < 3; t++){
+        const size_t N = lengths[t];
+        AttentionLayer_* layer = create_attention_layer(N, D, H);
+        Matrix *X = NULL, *P = NULL;
+        matrix_create(&X, N * D, B);
+        fill_random(X);
+        attention_forward_(layer, X);
+
+        double begin = wall_time();
+        for (size_t b = 0; b < B; b++){
+            for (size_t h = 0; h < H; h++){
+                const size_t block = (b * H + h) * N;
+                attention_head_forward(layer, attention_head(layer, layer->heads, 0, B, b, h), attention_head(layer, layer->heads, 1, B, b, h),
+                                       attention_head(layer, layer->heads, 2, B, b, h), layer->o_heads->data + block * layer->head_dim, layer->lse->data + block);
+            }
+        }
+        const double tiled = wall_time() - begin;
+
+        matrix_create(&P, B * H * N, N);
+        double* O = (double*)malloc(B * H * N * layer->head_dim * sizeof(double));
+        const double naive = naive_heads_forward(layer, B, O, P);
+        for (size_t k = 0; k < B * H * N * layer->head_dim; k += 97) check_close("naive heads", O[k], layer->o_heads->data[k], 1e-12);
+
+        // What each keeps between forward and backward besides Q, K, V and O
+        const double tiled_bytes = (double)(B * H * N) * sizeof(double);
+        const double naive_bytes = (double)(B * H * N) * (double)N * sizeof(double);
+        printf("    N=%4lu  tiled %8.2fms %9.1fKB   naive %8.2fms %9.1fKB\n", N, 1e3 * tiled, tiled_bytes / 1024.0, 1e3 * naive, naive_bytes / 1024.0);
+
+        free(O);
+        matrix_destroy(P);
+        free(P);
+        matrix_destroy(X);
+        free(X);
+        destroy_attention_layer_(layer);
+        free(layer);
+    }
+};
+
+int main(void){
+    srand(19);
+
+    test_forward();
+    test_gradients();
+    test_benchmark();
+
+    if (failures){
+        printf("attention_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("attention_test: OK\n");
+    return 0;
+};
@@ -0,0 +1,566 @@
+#include "tensor.h"
+#include "layers.h"
+#include "compute_graph.h"
+#include "models.h"
+#include "loss.h"
+#include "test_utils.h"
+
+#define TOL 1e-9
+
+void collect_param_grads(Sequential_NN* model, double* grads){
+    size_t idx = 0;
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        for (size_t i = 0; i < ff->weights->n_rows; i++){
+            for (size_t j = 0; j < ff->weights->n_cols; j++) grads[idx++] = tensor_get_grad(ff->weights, i, j);
+            grads[idx++] = tensor_get_grad(ff->biases, i, 0);
+        }
+    }
+};
+
+// Reference: build a fresh eager graph for the same weights and input
+double eager_loss_and_grads(Sequential_NN* model, const double (*x)[1], const double (*y)[1], double* grads){
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* Y = tensor_create_from_array(1, 1, y);
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, Y);
+
+    // Weights are shared with the captured graph, start from clean gradients
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        for (size_t i = 0; i < ff->weights->n_rows; i++){
+            for (size_t j = 0; j < ff->weights->n_cols; j++) tensor_set_grad(ff->weights, i, j, 0.0);
+            tensor_set_grad(ff->biases, i, 0, 0.0);
+        }
+    }
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+    graph_replay_backward(graph);
+
+    collect_param_grads(model, grads);
+    const double value = tensor_get_val(loss, 0, 0);
+
+    // Release the eager nodes but keep the shared weights
+    graph_prune(graph);
+    free(graph->nodes);
+    free(graph);
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    return value;
+};
+
+// Optimized graph must produce the same loss and parameter gradients
+void test_graph_optimize(void){
+    printf("Graph optimization\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 4, 3, tensor_relu_inplace);
+    add_feed_forward_layer(model, 2, 4, tensor_relu_inplace);
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[2][1] = {{0.25}, {1.0}};
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* inputs = tensor_shallow_copy(X);
+    Tensor* Y = tensor_create_from_array(2, 1, y);
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, Y);
+
+    // Foldable constants, a duplicated subexpression and a branch without parameters
+    ADNode* in0 = tensor_get_node(inputs, 0, 0);
+    ADNode* a1 = node_sigmoid(in0);
+    ADNode* a2 = node_sigmoid(in0);
+    ADNode* c = node_multiply(node_new_constant(3.0), node_new_constant(2.0));
+    ADNode* e = node_add(node_add(a1, a2), c);
+    ADNode* head = node_add(tensor_get_node(loss, 0, 0), e);
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, head);
+    const size_t num_before = graph->num_nodes;
+
+    double samples[2][3] = {{1.5, 0.25, -0.75}, {-2.0, 3.0, 1.0}};
+    double before[2][4 * 3 + 4 + 2 * 4 + 2];
+    double before_loss[2];
+    for (size_t s = 0; s < 2; s++){
+        graph_rebind_tensor(graph, inputs, samples[s]);
+        graph_replay_forward(graph);
+        graph_zero_grad(graph);
+        graph_replay_backward(graph);
+        collect_param_grads(model, before[s]);
+        before_loss[s] = *graph->head->value;
+    }
+
+    graph->optimize(graph);
+    printf("Nodes: %lu -> %lu\n", num_before, graph->num_nodes);
+    if (graph->num_nodes >= num_before){
+        printf("    FAILED optimization did not remove nodes\n");
+        failures++;
+    }
+
+    double after[4 * 3 + 4 + 2 * 4 + 2];
+    for (size_t s = 0; s < 2; s++){
+        graph_rebind_tensor(graph, inputs, samples[s]);
+        graph_replay_forward(graph);
+        graph_zero_grad(graph);
+        graph_replay_backward(graph);
+        collect_param_grads(model, after);
+        check_close("optimized loss", before_loss[s], *graph->head->value, TOL);
+        for (size_t k = 0; k < sizeof(after) / sizeof(double); k++) check_close("optimized grad", before[s][k], after[k], TOL);
+    }
+
+    tensor_detach(inputs);
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    destroy_sequential_nn(model);
+    graph_destroy(graph);
+};
+
+// Replaying a captured graph must match rebuilding it for every new input
+void test_graph_capture(void){
+    printf("Graph capture\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 4, 3, tensor_relu_inplace);
+    add_feed_forward_layer(model, 1, 4, tensor_relu_inplace);
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[1][1] = {{0.25}};
+
+    // Capture once
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* inputs = tensor_shallow_copy(X);
+    Tensor* Y = tensor_create_from_array(1, 1, y);
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, Y);
+
+    ComputeGraph* graph = compute_graph_new();
+    graph->capture(graph, tensor_get_node(loss, 0, 0));
+    printf("Captured %lu nodes, forward schedule %lu, backward schedule %lu\n", graph->num_nodes, graph->forward_len, graph->backward_len);
+
+    double replay_grads[4 * 3 + 4 + 1 * 4 + 1];
+    double eager_grads[4 * 3 + 4 + 1 * 4 + 1];
+
+    double samples[3][3] = {{0.5, -1.0, 2.0}, {1.5, 0.25, -0.75}, {-2.0, 3.0, 1.0}};
+    for (size_t s = 0; s < 3; s++){
+        graph_rebind_tensor(graph, inputs, samples[s]);
+        graph->replay_forward(graph);
+        graph->zero_grad(graph);
+        graph->replay_backward(graph);
+        collect_param_grads(model, replay_grads);
+        const double replay_loss = *graph->head->value;
+
+        double x_s[3][1] = {{samples[s][0]}, {samples[s][1]}, {samples[s][2]}};
+        const double eager_loss = eager_loss_and_grads(model, x_s, y, eager_grads);
+
+        printf("Sample %lu: replay loss %f, eager loss %f\n", s, replay_loss, eager_loss);
+        check_close("loss", eager_loss, replay_loss, TOL);
+        for (size_t k = 0; k < sizeof(replay_grads) / sizeof(double); k++) check_close("grad", eager_grads[k], replay_grads[k], TOL);
+    }
+
+    tensor_detach(inputs);
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    destroy_sequential_nn(model);
+    graph_destroy(graph);
+};
+
+// Replaying out of the planned slab must match the unplanned replay
+void test_memory_plan(void){
+    printf("Memory plan\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 8, 3, tensor_relu_inplace);
+    add_feed_forward_layer(model, 4, 8, tensor_relu_inplace);
+    add_feed_forward_layer(model, 2, 4, tensor_relu_inplace);
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[2][1] = {{0.25}, {1.0}};
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* inputs = tensor_shallow_copy(X);
+    Tensor* Y = tensor_create_from_array(2, 1, y);
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, Y);
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+
+    double samples[2][3] = {{1.5, 0.25, -0.75}, {-2.0, 3.0, 1.0}};
+    double before[2][8 * 3 + 8 + 4 * 8 + 4 + 2 * 4 + 2];
+    double before_loss[2];
+    for (size_t s = 0; s < 2; s++){
+        graph_rebind_tensor(graph, inputs, samples[s]);
+        graph_replay_forward(graph);
+        graph_zero_grad(graph);
+        graph_replay_backward(graph);
+        collect_param_grads(model, before[s]);
+        before_loss[s] = *graph->head->value;
+    }
+
+    // Plan the raw graph first, then the optimized one
+    double after[8 * 3 + 8 + 4 * 8 + 4 + 2 * 4 + 2];
+    for (size_t round = 0; round < 2; round++){
+        if (round == 1) graph->optimize(graph);
+        graph->plan_memory(graph);
+        if (graph->planned_bytes >= graph->unplanned_bytes){
+            printf("    FAILED plan did not reuse memory\n");
+            failures++;
+        }
+
+        // Two passes per sample: the second one starts from a dirty slab
+        for (size_t s = 0; s < 2; s++){
+            for (size_t pass = 0; pass < 2; pass++){
+                graph_rebind_tensor(graph, inputs, samples[s]);
+                graph_replay_forward(graph);
+                graph_zero_grad(graph);
+                graph_replay_backward(graph);
+            }
+            collect_param_grads(model, after);
+            check_close("planned loss", before_loss[s], *graph->head->value, TOL);
+            for (size_t k = 0; k < sizeof(after) / sizeof(double); k++) check_close("planned grad", before[s][k], after[k], TOL);
+        }
+    }
+
+    tensor_detach(inputs);
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    destroy_sequential_nn(model);
+    graph_destroy(graph);
+};
+
+// Parallel backward must match the sequential schedule
+void test_parallel_backward(void){
+    printf("Parallel backward\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 32, 16, tensor_relu_inplace);
+    add_feed_forward_layer(model, 8, 32, tensor_relu_inplace);
+
+    double x[16][1];
+    double y[8][1];
+    for (size_t i = 0; i < 16; i++) x[i][0] = (double)i / 8.0 - 1.0;
+    for (size_t i = 0; i < 8; i++) y[i][0] = (double)i / 4.0;
+
+    Tensor* X = tensor_create_from_array(16, 1, x);
+    Tensor* Y = tensor_create_from_array(8, 1, y);
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, Y);
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+    graph_replay_forward(graph);
+
+    const size_t num_params = 32 * 16 + 32 + 8 * 32 + 8;
+    double* sequential = (double*)malloc(num_params * sizeof(double));
+    double* parallel = (double*)malloc(num_params * sizeof(double));
+
+    graph_zero_grad(graph);
+    graph_replay_backward(graph);
+    collect_param_grads(model, sequential);
+
+    ThreadPool* pool = thread_pool_new(4);
+    for (size_t run = 0; run < 3; run++){
+        graph_zero_grad(graph);
+        graph_replay_backward_parallel(graph, pool);
+        collect_param_grads(model, parallel);
+        for (size_t k = 0; k < num_params; k++) check_close("parallel grad", sequential[k], parallel[k], TOL);
+    }
+
+    double begin = wall_time();
+    for (size_t run = 0; run < 20; run++) graph_replay_backward(graph);
+    const double t_sequential = wall_time() - begin;
+    begin = wall_time();
+    for (size_t run = 0; run < 20; run++) graph_replay_backward_parallel(graph, pool);
+    const double t_parallel = wall_time() - begin;
+    printf("%lu backward nodes, 20 runs: sequential %.4fs, %lu threads %.4fs\n", graph->backward_len, t_sequential, pool->num_threads, t_parallel);
+
+    pool->destroy(pool);
+    free(sequential);
+    free(parallel);
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    destroy_sequential_nn(model);
+    graph_destroy(graph);
+};
+
+// Eager release frees the intermediates during backward and keeps the gradients
+void test_eager_release(void){
+    printf("Eager release\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 16, 3, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 1, 16, tensor_sigmoid_inplace);
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[1][1] = {{0.25}};
+    const size_t num_params = 16 * 3 + 16 + 16 + 1;
+    double reference[16 * 3 + 16 + 16 + 1];
+    double grads[16 * 3 + 16 + 16 + 1];
+    const double reference_loss = eager_loss_and_grads(model, x, y, reference);
+
+    ThreadPool* pool = thread_pool_new(4);
+    for (size_t threads = 1; threads <= 4; threads += 3){
+        Tensor* X = tensor_create_from_array(3, 1, x);
+        Tensor* Y = tensor_create_from_array(1, 1, y);
+        forward_sequential_nn(model, X);
+        Tensor* loss = L2_loss_tensor(X, Y);
+
+        ComputeGraph* graph = compute_graph_new();
+        graph_capture(graph, tensor_get_node(loss, 0, 0));
+        const size_t captured = graph->num_nodes;
+
+        graph->eager_release = 1;
+        graph_zero_grad(graph);
+        if (threads == 1) graph_replay_backward(graph);
+        else graph_replay_backward_parallel(graph, pool);
+        printf("%lu threads: released %lu of %lu nodes, %lu bytes\n", threads, graph->released_nodes, captured, graph->released_bytes);
+
+        if (graph->released_nodes == 0 || graph->num_nodes + graph->released_nodes != captured || graph->is_captured){
+            printf("    FAILED eager release did not consume the graph\n");
+            failures++;
+        }
+        collect_param_grads(model, grads);
+        check_close("eager release loss", reference_loss, *graph->head->value, TOL);
+        for (size_t k = 0; k < num_params; k++) check_close("eager release grad", reference[k], grads[k], TOL);
+
+        tensor_detach(X);
+        tensor_detach(Y);
+        tensor_detach(loss);
+        graph_prune(graph);
+        graph_destroy(graph);
+    }
+
+    pool->destroy(pool);
+    destroy_sequential_nn(model);
+};
+
+// Nodes dead node elimination unscheduled hold no gradient work, eager release must free them too
+void test_eager_release_dead_nodes(void){
+    printf("Eager release after dead node elimination\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 4, 3, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 1, 4, tensor_sigmoid_inplace);
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[1][1] = {{0.25}};
+    double reference[4 * 3 + 4 + 4 + 1];
+    double grads[4 * 3 + 4 + 4 + 1];
+    const double reference_loss = eager_loss_and_grads(model, x, y, reference);
+
+    // The scaled target has no trainable ancestor, its nodes leave the backward schedule
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* Y = tensor_create_from_array(1, 1, y);
+    Tensor* target = tensor_scalar_product(Y, 1.0);
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, target);
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+    graph->optimize(graph);
+
+    graph->eager_release = 1;
+    graph_zero_grad(graph);
+    graph_replay_backward(graph);
+
+    for (size_t i = 0; i < graph->num_nodes; i++){
+        if (graph->nodes[i] != graph->head && graph_node_is_owned(graph->nodes[i])){
+            printf("    FAILED node %lu survived eager release\n", i);
+            failures++;
+        }
+    }
+    collect_param_grads(model, grads);
+    check_close("eager release loss", reference_loss, *graph->head->value, TOL);
+    for (size_t k = 0; k < sizeof(grads) / sizeof(double); k++) check_close("eager release grad", reference[k], grads[k], TOL);
+
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(target);
+    tensor_detach(loss);
+    graph_prune(graph);
+    graph_destroy(graph);
+    destroy_sequential_nn(model);
+};
+
+// Compiled replay must match the interpreter, raw, optimized and planned
+void test_jit(void){
+    printf("JIT\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 8, 3, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 2, 8, tensor_sigmoid_inplace);
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[2][1] = {{0.25}, {0.75}};
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* inputs = tensor_shallow_copy(X);
+    Tensor* Y = tensor_create_from_array(2, 1, y);
+    forward_sequential_nn(model, X);
+
+    // Softmax is a custom op, the compiled code calls its kernels through the node
+    Tensor* S = tensor_softmax(X);
+    Tensor* loss = L2_loss_tensor(S, Y);
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+
+    double samples[2][3] = {{1.5, 0.25, -0.75}, {-2.0, 3.0, 1.0}};
+    double before[2][8 * 3 + 8 + 2 * 8 + 2];
+    double before_loss[2];
+    for (size_t s = 0; s < 2; s++){
+        graph_rebind_tensor(graph, inputs, samples[s]);
+        graph_replay_forward(graph);
+        graph_zero_grad(graph);
+        graph_replay_backward(graph);
+        collect_param_grads(model, before[s]);
+        before_loss[s] = *graph->head->value;
+    }
+
+    double after[8 * 3 + 8 + 2 * 8 + 2];
+    for (size_t round = 0; round < 3; round++){
+        if (round == 1) graph->optimize(graph);
+        if (round == 2){
+            graph->plan_memory(graph);
+            if (graph->jit){
+                printf("    FAILED memory plan kept the compiled code\n");
+                failures++;
+            }
+        }
+
+        if (!graph_jit_compile(graph) || graph->jit->num_fallbacks == 0){
+            printf("    FAILED graph was not compiled with fallbacks\n");
+            failures++;
+            break;
+        }
+
+        for (size_t s = 0; s < 2; s++){
+            graph_rebind_tensor(graph, inputs, samples[s]);
+            graph_replay_forward(graph);
+            graph_zero_grad(graph);
+            graph_replay_backward(graph);
+            collect_param_grads(model, after);
+            check_close("jit loss", before_loss[s], *graph->head->value, TOL);
+            for (size_t k = 0; k < sizeof(after) / sizeof(double); k++) check_close("jit grad", before[s][k], after[k], TOL);
+        }
+    }
+
+    // Same graph again comes out of the cache
+    const uint64_t hash = graph->jit ? graph->jit->hash : 0;
+    if (!graph_jit_compile(graph) || !graph->jit->from_cache || graph->jit->hash != hash){
+        printf("    FAILED recompiling did not hit the cache\n");
+        failures++;
+    }
+
+    const size_t runs = 2000;
+    double begin = wall_time();
+    for (size_t run = 0; run < runs; run++){
+        graph_replay_forward(graph);
+        graph_replay_backward(graph);
+    }
+    const double t_jit = wall_time() - begin;
+    graph_release_jit(graph);
+    begin = wall_time();
+    for (size_t run = 0; run < runs; run++){
+        graph_replay_forward(graph);
+        graph_replay_backward(graph);
+    }
+    const double t_interpreted = wall_time() - begin;
+    printf("%lu nodes, %lu steps: interpreted %.4fs, compiled %.4fs\n", graph->num_nodes, runs, t_interpreted, t_jit);
+
+    tensor_detach(inputs);
+    tensor_detach(X);
+    tensor_detach(S);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    destroy_sequential_nn(model);
+    graph_destroy(graph);
+};
+
+// Micro-batches accumulated in the flat buffer must give the mean of the per-sample gradients
+void test_grad_accumulation(void){
+    printf("Gradient accumulation\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 4, 3, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 1, 4, tensor_sigmoid_inplace);
+
+    // Layer by layer, weights before biases, tensors stay contiguous views of the buffer
+    size_t offset = 0;
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        if (tensor_values_matrix(ff->weights).data != model->params->values + offset ||
+            tensor_grads_matrix(ff->biases).data != model->params->grads + offset + tensor_numel(ff->weights)){
+            printf("    FAILED parameters of layer %lu are not in the flat buffer\n", l);
+            failures++;
+        }
+        offset += tensor_numel(ff->weights) + tensor_numel(ff->biases);
+    }
+    if (offset != model->num_params){
+        printf("    FAILED flat buffer holds %lu of %lu parameters\n", offset, model->num_params);
+        failures++;
+    }
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[1][1] = {{0.25}};
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* inputs = tensor_shallow_copy(X);
+    Tensor* Y = tensor_create_from_array(1, 1, y);
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, Y);
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+
+    const size_t num_micro = 4;
+    double samples[4][3] = {{0.5, -1.0, 2.0}, {1.5, 0.25, -0.75}, {-2.0, 3.0, 1.0}, {0.1, 0.2, 0.3}};
+    double mean[4 * 3 + 4 + 4 + 1] = {0};
+    for (size_t s = 0; s < num_micro; s++){
+        graph_rebind_tensor(graph, inputs, samples[s]);
+        graph_replay_forward(graph);
+        sequential_nn_zero_grad(model);
+        graph_replay_backward(graph);
+        for (size_t k = 0; k < model->num_params; k++) mean[k] += model->params->grads[k] / (double)num_micro;
+    }
+
+    sequential_nn_zero_grad(model);
+    for (size_t s = 0; s < num_micro; s++){
+        graph_rebind_tensor(graph, inputs, samples[s]);
+        graph_replay_forward(graph);
+        graph_replay_backward(graph);
+    }
+    sequential_nn_scale_grad(model, 1.0 / (double)num_micro);
+    for (size_t k = 0; k < model->num_params; k++) check_close("accumulated grad", mean[k], model->params->grads[k], TOL);
+
+    // Adding another model's gradients
+    sequential_nn_accumulate_grad(model, mean);
+    for (size_t k = 0; k < model->num_params; k++) check_close("added grad", 2 * mean[k], model->params->grads[k], TOL);
+
+    sequential_nn_zero_grad(model);
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        for (size_t i = 0; i < ff->weights->n_rows; i++) check_close("zeroed grad", 0.0, tensor_get_grad(ff->biases, i, 0), TOL);
+    }
+
+    tensor_detach(inputs);
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    destroy_sequential_nn(model);
+    graph_destroy(graph);
+};
+
+int main(void){
+    srand(7);
+
+    test_graph_capture();
+    test_graph_optimize();
+    test_memory_plan();
+    test_parallel_backward();
+    test_eager_release();
+    test_eager_release_dead_nodes();
+    test_jit();
+    test_grad_accumulation();
+
+    if (failures){
+        printf("compute_graph_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("compute_graph_test: OK\n");
+    return 0;
+};
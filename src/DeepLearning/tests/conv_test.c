@@ -0,0 +1,218 @@
+#include "matrix.h"
+#include "layers.h"
+#include "models.h"
+#include "loss.h"
+#include "test_utils.h"
+
+// Same images in the other layout
+Matrix* permute_layout(const Matrix* X, const ConvLayout_ from, const size_t C, const size_t H, const size_t W){
+    const ConvLayout_ to = from == CONV_NCHW ? CONV_NHWC : CONV_NCHW;
+    Matrix* Y = NULL;
+    matrix_create(&Y, X->n_rows, X->n_cols);
+    for (size_t c = 0; c < C; c++){
+        for (size_t h = 0; h < H; h++){
+            for (size_t w = 0; w < W; w++){
+                memcpy(Y->data + conv_feature_index(to, C, H, W, c, h, w) * X->n_cols,
+                       X->data + conv_feature_index(from, C, H, W, c, h, w) * X->n_cols, X->n_cols * sizeof(double));
+            }
+        }
+    }
+    return Y;
+};
+
+// Direct convolution of sample b at output (f, oh, ow)
+double naive_conv(const Conv2DLayer_* layer, const Matrix* X, const size_t b, const size_t f, const size_t oh, const size_t ow){
+    const size_t C = layer->in_channels, H = layer->in_height, W = layer->in_width, K = layer->kernel_size;
+    double z = layer->biases->data[f];
+    for (size_t c = 0; c < C; c++){
+        for (size_t i = 0; i < K; i++){
+            for (size_t j = 0; j < K; j++){
+                const long h = (long)(oh * layer->stride + i) - (long)layer->padding;
+                const long w = (long)(ow * layer->stride + j) - (long)layer->padding;
+                if (h < 0 || w < 0 || h >= (long)H || w >= (long)W) continue;
+                const double x = X->data[conv_feature_index(layer->layout, C, H, W, c, (size_t)h, (size_t)w) * X->n_cols + b];
+                z += layer->weights->data[f * C * K * K + (c * K + i) * K + j] * x;
+            }
+        }
+    }
+    return z;
+};
+
+// im2col + GEMM matches the direct convolution, with stride, padding and both layouts
+void test_conv_forward(void){
+    printf("Conv2D forward\n");
+    const size_t C = 3, H = 7, W = 6, F = 4, B = 5;
+
+    for (int layout = CONV_NCHW; layout <= CONV_NHWC; layout++){
+        Conv2DLayer_* layer = create_conv2d_layer(C, H, W, F, 3, 2, 1, (ConvLayout_)layout, 3);
+        fill_random(layer->biases);
+        Matrix* X = NULL;
+        matrix_create(&X, C * H * W, B);
+        fill_random(X);
+
+        const Matrix* a = conv2d_forward_(layer, X);
+        check_close("output height", 4, layer->out_height, 0.0);
+        check_close("output width", 3, layer->out_width, 0.0);
+        for (size_t f = 0; f < F; f++){
+            for (size_t oh = 0; oh < layer->out_height; oh++){
+                for (size_t ow = 0; ow < layer->out_width; ow++){
+                    const size_t row = conv_feature_index(layer->layout, F, layer->out_height, layer->out_width, f, oh, ow);
+                    for (size_t b = 0; b < B; b++) check_close("conv", tanh(naive_conv(layer, X, b, f, oh, ow)), a->data[row * B + b], 1e-12);
+                }
+            }
+        }
+
+        matrix_destroy(X);
+        free(X);
+        destroy_conv2d_layer_(layer);
+        free(layer);
+    }
+};
+
+// Both pooling modes give the same results in either layout, forward and backward
+void test_pool(void){
+    printf("Pool2D\n");
+    const size_t C = 2, H = 6, W = 5, B = 3;
+
+    for (int mode = POOL_MAX; mode <= POOL_AVG; mode++){
+        Pool2DLayer_* nchw = create_pool2d_layer(C, H, W, 2, 2, (PoolMode_)mode, CONV_NCHW);
+        Pool2DLayer_* nhwc = create_pool2d_layer(C, H, W, 2, 2, (PoolMode_)mode, CONV_NHWC);
+        Matrix *X = NULL, *delta = NULL;
+        matrix_create(&X, C * H * W, B);
+        fill_random(X);
+        Matrix* X_nhwc = permute_layout(X, CONV_NCHW, C, H, W);
+
+        const Matrix* a = pool2d_forward_(nchw, X);
+        const Matrix* a_nhwc = pool2d_forward_(nhwc, X_nhwc);
+        Matrix* a_permuted = permute_layout(a_nhwc, CONV_NHWC, C, nchw->out_height, nchw->out_width);
+        for (size_t k = 0; k < a->n_rows * B; k++) check_close("pool layouts", a->data[k], a_permuted->data[k], 0.0);
+
+        // First window of the first channel
+        double expected = mode == POOL_MAX ? -1.0 : 0.0;
+        for (size_t i = 0; i < 2; i++){
+            for (size_t j = 0; j < 2; j++){
+                const double x = X->data[(i * W + j) * B];
+                expected = mode == POOL_MAX ? fmax(expected, x) : expected + 0.25 * x;
+            }
+        }
+        check_close("pool window", expected, a->data[0], 1e-12);
+
+        matrix_create(&delta, a->n_rows, B);
+        fill_random(delta);
+        Matrix* delta_nhwc = permute_layout(delta, CONV_NCHW, C, nchw->out_height, nchw->out_width);
+        backprop_pool2d_layer_(nchw, delta);
+        backprop_pool2d_layer_(nhwc, delta_nhwc);
+        Matrix* grad_permuted = permute_layout(nhwc->grad_delta, CONV_NHWC, C, H, W);
+        double sum_in = 0.0, sum_out = 0.0;
+        for (size_t k = 0; k < C * H * W * B; k++){
+            check_close("pool gradient layouts", nchw->grad_delta->data[k], grad_permuted->data[k], 0.0);
+            sum_in += nchw->grad_delta->data[k];
+        }
+        for (size_t k = 0; k < delta->n_rows * B; k++) sum_out += delta->data[k];
+        check_close("pool gradient is routed, not lost", sum_out, sum_in, 1e-12);
+
+        Matrix* matrices[6] = {X, delta, X_nhwc, a_permuted, delta_nhwc, grad_permuted};
+        for (size_t i = 0; i < 6; i++){
+            matrix_destroy(matrices[i]);
+            free(matrices[i]);
+        }
+        destroy_pool2d_layer_(nchw);
+        destroy_pool2d_layer_(nhwc);
+        free(nchw);
+        free(nhwc);
+    }
+};
+
+// Gradients of conv -> pool -> feed forward against central differences
+void test_gradients(void){
+    printf("Conv2D gradients\n");
+    const size_t C = 2, H = 6, W = 6, F = 3, B = 4;
+
+    for (int layout = CONV_NCHW; layout <= CONV_NHWC; layout++){
+        Sequential_NN_* model = NULL;
+        init_sequential_nn_(&model, C * H * W, F * 3 * 3, 2);
+        add_conv2d_layer_(model, C, H, W, F, 3, 1, 1, (ConvLayout_)layout, 3);
+        add_pool2d_layer_(model, F, H, W, 2, 2, POOL_MAX, (ConvLayout_)layout);
+        add_feed_forward_layer_(model, 2, F * 3 * 3, 0);
+        FeedForwardLayer_* ff = model->layers[2].layer.ff_layer;
+        fill_random(ff->weights);
+        Conv2DLayer_* conv = model->layers[0].layer.conv_layer;
+        fill_random(conv->biases);
+
+        Matrix *X = NULL, *y = NULL;
+        matrix_create(&X, C * H * W, B);
+        matrix_create(&y, 2, B);
+        fill_random(X);
+        fill_random(y);
+
+        Matrix* a = matrix_copy(X);
+        forward_sequential_nn_(model, a);
+        backpropagate_sequential_nn_(model, a, y, 0);
+
+        for (size_t k = 0; k < conv->weights->n_rows * conv->weights->n_cols; k += 7){
+            check_numeric_gradient("conv weights", model, X, y, conv->weights->data + k, conv->grad_W->data[k]);
+        }
+        for (size_t f = 0; f < F; f++) check_numeric_gradient("conv biases", model, X, y, conv->biases->data + f, conv->grad_b->data[f]);
+        for (size_t k = 0; k < ff->weights->n_rows * ff->weights->n_cols; k += 5){
+            check_numeric_gradient("feed forward weights", model, X, y, ff->weights->data + k, ff->grad_W->data[k]);
+        }
+
+        // grad_delta is per sample, the loss is the batch mean
+        for (size_t k = 0; k < X->n_rows * B; k += 11){
+            check_numeric_gradient("conv input", model, X, y, X->data + k, conv->grad_delta->data[k] / (double)B);
+        }
+
+        matrix_destroy(a);
+        free(a);
+        matrix_destroy(X);
+        free(X);
+        matrix_destroy(y);
+        free(y);
+        destroy_sequential_nn_(model);
+        free(model);
+    }
+};
+
+// Parameters and flops of a 3x3 convolution against the dense layer with the same shapes
+void test_cost(void){
+    printf("Conv2D cost\n");
+    const size_t C = 3, H = 32, W = 32, F = 16, B = 32;
+    Conv2DLayer_* layer = create_conv2d_layer(C, H, W, F, 3, 1, 1, CONV_NCHW, 1);
+    const size_t P = layer->out_height * layer->out_width;
+
+    const double conv_params = (double)(F * (C * 9 + 1)), dense_params = (double)(F * P) * (double)(C * H * W + 1);
+    const double conv_flops = 2.0 * F * C * 9 * P, dense_flops = 2.0 * (double)(F * P) * (double)(C * H * W);
+    printf("    params  conv %10.0f  dense %14.0f  (%.0fx)\n", conv_params, dense_params, dense_params / conv_params);
+    printf("    flops   conv %10.0f  dense %14.0f  (%.0fx) per sample\n", conv_flops, dense_flops, dense_flops / conv_flops);
+
+    Matrix* X = NULL;
+    matrix_create(&X, C * H * W, B);
+    fill_random(X);
+    conv2d_forward_(layer, X);
+    const size_t runs = 5;
+    const double begin = wall_time();
+    for (size_t run = 0; run < runs; run++) conv2d_forward_(layer, X);
+    const double elapsed = (wall_time() - begin) / (double)runs;
+    printf("    forward of %lu samples %.2fms, %.2f GFLOP/s\n", B, 1e3 * elapsed, 1e-9 * conv_flops * B / elapsed);
+
+    matrix_destroy(X);
+    free(X);
+    destroy_conv2d_layer_(layer);
+    free(layer);
+};
+
+int main(void){
+    srand(11);
+
+    test_conv_forward();
+    test_pool();
+    test_gradients();
+    test_cost();
+
+    if (failures){
+        printf("conv_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("conv_test: OK\n");
+    return 0;
+};
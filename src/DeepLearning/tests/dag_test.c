@@ -0,0 +1,318 @@
+#include "matrix.h"
+#include "layers.h"
+#include "models.h"
+#include "loss.h"
+#include "thread_pool.h"
+#include "test_utils.h"
+
+FeedForwardLayer_* dag_ff(DAG_NN_* model, const size_t node){
+    return model->layers[model->nodes[node].layer_idx].layer.ff_layer;
+};
+
+// act(W x + b) of one sample with plain loops
+void naive_dense(const FeedForwardLayer_* layer, const double* x, double* out){
+    for (size_t r = 0; r < layer->weights->n_rows; r++){
+        double z = layer->biases->data[r];
+        for (size_t c = 0; c < layer->weights->n_cols; c++) z += layer->weights->data[r * layer->weights->n_cols + c] * x[c];
+        switch(layer->act_fn_mapping){
+            case 1: out[r] = z > 0.0 ? z : 0.0; break;
+            case 2: out[r] = 1.0 / (1.0 + exp(-z)); break;
+            case 3: out[r] = tanh(z); break;
+            default: out[r] = z;
+        }
+    }
+};
+
+// x -> residual block -> two branches joined by concat -> head 0, plus head 1 off the residual
+typedef struct {
+    DAG_NN_* model;
+    size_t hidden, residual, left, right, concat, head0, head1;
+}ResidualConcatModel;
+
+ResidualConcatModel residual_concat_model(const size_t F){
+    ResidualConcatModel m;
+    m.model = dag_nn_create(F);
+    m.hidden = dag_nn_feed_forward(m.model, 0, F, 3);
+    m.residual = dag_nn_add(m.model, (size_t[]){0, m.hidden}, 2);
+    m.left = dag_nn_feed_forward(m.model, m.residual, 4, 3);
+    m.right = dag_nn_feed_forward(m.model, m.residual, 3, 2);
+    m.concat = dag_nn_concat(m.model, (size_t[]){m.left, m.right, 0}, 3);
+    m.head0 = dag_nn_feed_forward(m.model, m.concat, 2, 0);
+    m.head1 = dag_nn_feed_forward(m.model, m.residual, 1, 3);
+    dag_nn_output(m.model, m.head0);
+    dag_nn_output(m.model, m.head1);
+    for (size_t i = 0; i < m.model->num_layers; i++) fill_random(m.model->layers[i].layer.ff_layer->biases);
+    return m;
+};
+
+// Both heads against the graph written out per sample
+void test_forward(void){
+    printf("DAG forward\n");
+    const size_t F = 5, B = 4;
+    ResidualConcatModel m = residual_concat_model(F);
+    Matrix* X = NULL;
+    matrix_create(&X, F, B);
+    fill_random(X);
+    dag_nn_forward(m.model, X);
+    check_close("levels", 6.0, (double)m.model->num_levels, 0.0);
+
+    for (size_t b = 0; b < B; b++){
+        double x[5], h[5], r[5], c[12], y0[2], y1[1];
+        for (size_t f = 0; f < F; f++) x[f] = X->data[f * B + b];
+        naive_dense(dag_ff(m.model, m.hidden), x, h);
+        for (size_t f = 0; f < F; f++) r[f] = x[f] + h[f];
+        naive_dense(dag_ff(m.model, m.left), r, c);
+        naive_dense(dag_ff(m.model, m.right), r, c + 4);
+        memcpy(c + 7, x, F * sizeof(double));
+        naive_dense(dag_ff(m.model, m.head0), c, y0);
+        naive_dense(dag_ff(m.model, m.head1), r, y1);
+
+        for (size_t k = 0; k < 2; k++) check_close("head 0", y0[k], dag_nn_output_value(m.model, 0)->data[k * B + b], 1e-12);
+        check_close("head 1", y1[0], dag_nn_output_value(m.model, 1)->data[b], 1e-12);
+    }
+
+    matrix_destroy(X);
+    free(X);
+    destroy_dag_nn_(m.model);
+    free(m.model);
+};
+
+// Sum of the mean L2 losses of all heads, dC/da of every head into grads
+double dag_loss(DAG_NN_* model, const Matrix* X, Matrix** y, Matrix** grads){
+    dag_nn_forward(model, X);
+    double loss = 0.0;
+    for (size_t o = 0; o < model->num_outputs; o++){
+        const Matrix* a = dag_nn_output_value(model, o);
+        for (size_t k = 0; k < a->n_rows * a->n_cols; k++){
+            loss += (a->data[k] - y[o]->data[k]) * (a->data[k] - y[o]->data[k]);
+            if (grads != NULL) grads[o]->data[k] = 2.0 * (a->data[k] - y[o]->data[k]);
+        }
+    }
+    return loss / (double)X->n_cols;
+};
+
+void check_dag_gradient(const char* what, DAG_NN_* model, const Matrix* X, Matrix** y, double* param, const double analytic){
+    const double eps = 1e-5, saved = *param;
+    *param = saved + eps;
+    const double plus = dag_loss(model, X, y, NULL);
+    *param = saved - eps;
+    const double minus = dag_loss(model, X, y, NULL);
+    *param = saved;
+    check_close(what, (plus - minus) / (2.0 * eps), analytic, 1e-6);
+};
+
+// Gradients summed over residual, concat and both heads against central differences
+void test_gradients(void){
+    printf("DAG gradients\n");
+    const size_t F = 5, B = 3;
+    ResidualConcatModel m = residual_concat_model(F);
+    Matrix *X = NULL, *y[2] = {NULL, NULL}, *grads[2] = {NULL, NULL};
+    matrix_create(&X, F, B);
+    fill_random(X);
+    const size_t out_sizes[2] = {2, 1};
+    for (size_t o = 0; o < 2; o++){
+        matrix_create(y + o, out_sizes[o], B);
+        matrix_create(grads + o, out_sizes[o], B);
+        fill_random(y[o]);
+    }
+
+    dag_loss(m.model, X, y, grads);
+    dag_nn_backward(m.model, (const Matrix*[]){grads[0], grads[1]});
+
+    for (size_t i = 0; i < m.model->num_layers; i++){
+        FeedForwardLayer_* layer = m.model->layers[i].layer.ff_layer;
+        const size_t num_weights = layer->weights->n_rows * layer->weights->n_cols;
+        for (size_t k = 0; k < num_weights; k += 3) check_dag_gradient("weights", m.model, X, y, layer->weights->data + k, layer->grad_W->data[k]);
+        for (size_t k = 0; k < layer->biases->n_rows; k++) check_dag_gradient("biases", m.model, X, y, layer->biases->data + k, layer->grad_b->data[k]);
+    }
+
+    for (size_t o = 0; o < 2; o++){
+        matrix_destroy(y[o]);
+        free(y[o]);
+        matrix_destroy(grads[o]);
+        free(grads[o]);
+    }
+    matrix_destroy(X);
+    free(X);
+    destroy_dag_nn_(m.model);
+    free(m.model);
+};
+
+// A chain is a Sequential_NN_, same activations and gradients
+void test_chain(void){
+    printf("DAG chain against Sequential_NN_\n");
+    const size_t F = 6, B = 5;
+    const size_t sizes[4] = {F, 8, 7, 3};
+    const char acts[3] = {1, 3, 0};
+    DAG_NN_* model = dag_nn_create(F);
+    Sequential_NN_* sequential = NULL;
+    init_sequential_nn_(&sequential, F, 8, 3);
+    size_t node = 0;
+    for (size_t i = 0; i < 3; i++){
+        node = dag_nn_feed_forward(model, node, sizes[i + 1], acts[i]);
+        add_feed_forward_layer_(sequential, sizes[i + 1], sizes[i], acts[i]);
+        FeedForwardLayer_* dag_layer = model->layers[i].layer.ff_layer;
+        FeedForwardLayer_* seq_layer = sequential->layers[i].layer.ff_layer;
+        fill_random(dag_layer->biases);
+        memcpy(seq_layer->weights->data, dag_layer->weights->data, sizes[i + 1] * sizes[i] * sizeof(double));
+        memcpy(seq_layer->biases->data, dag_layer->biases->data, sizes[i + 1] * sizeof(double));
+    }
+    dag_nn_output(model, node);
+
+    Matrix *X = NULL, *y = NULL, *grad = NULL;
+    matrix_create(&X, F, B);
+    matrix_create(&y, 3, B);
+    matrix_create(&grad, 3, B);
+    fill_random(X);
+    fill_random(y);
+    Matrix* a = matrix_copy(X);
+    forward_sequential_nn_(sequential, a);
+    backpropagate_sequential_nn_(sequential, a, y, 0);
+    dag_loss(model, X, &y, &grad);
+    dag_nn_backward(model, (const Matrix*[]){grad});
+
+    for (size_t k = 0; k < 3 * B; k++) check_close("output", a->data[k], dag_nn_output_value(model, 0)->data[k], 1e-12);
+    for (size_t i = 0; i < 3; i++){
+        const FeedForwardLayer_* dag_layer = model->layers[i].layer.ff_layer;
+        const FeedForwardLayer_* seq_layer = sequential->layers[i].layer.ff_layer;
+        for (size_t k = 0; k < sizes[i + 1] * sizes[i]; k++) check_close("grad_W", seq_layer->grad_W->data[k], dag_layer->grad_W->data[k], 1e-12);
+        for (size_t k = 0; k < sizes[i + 1]; k++) check_close("grad_b", seq_layer->grad_b->data[k], dag_layer->grad_b->data[k], 1e-12);
+    }
+    check_close("a chain plans no buffers", 0.0, (double)model->num_slots, 0.0);
+
+    Matrix* matrices[4] = {X, y, grad, a};
+    for (size_t i = 0; i < 4; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    destroy_sequential_nn_(sequential);
+    free(sequential);
+    destroy_dag_nn_(model);
+    free(model);
+};
+
+// num_blocks residual blocks x + f(g(x)), each block with the two extra heads f(x) and g(x)
+DAG_NN_* residual_tower(const size_t F, const size_t num_blocks){
+    DAG_NN_* model = dag_nn_create(F);
+    size_t x = 0;
+    for (size_t i = 0; i < num_blocks; i++){
+        const size_t g = dag_nn_feed_forward(model, x, F, 3);
+        const size_t f = dag_nn_feed_forward(model, g, F, 3);
+        x = dag_nn_add(model, (size_t[]){x, f}, 2);
+    }
+    dag_nn_output(model, dag_nn_feed_forward(model, x, 1, 0));
+    return model;
+};
+
+// Deep residual tower: summed gradients through reused slots still match central differences
+void test_plan(void){
+    printf("DAG buffer plan\n");
+    const size_t F = 4, B = 3, num_blocks = 6;
+    DAG_NN_* model = residual_tower(F, num_blocks);
+    Matrix *X = NULL, *y = NULL, *grad = NULL;
+    matrix_create(&X, F, B);
+    matrix_create(&y, 1, B);
+    matrix_create(&grad, 1, B);
+    fill_random(X);
+    fill_random(y);
+
+    dag_loss(model, X, &y, &grad);
+    dag_nn_backward(model, (const Matrix*[]){grad});
+    print_dag_nn_(model);
+    check_close("slots are shared", 1.0, model->planned_size < model->unplanned_size, 0.0);
+
+    for (size_t i = 0; i < model->num_layers; i += 2){
+        FeedForwardLayer_* layer = model->layers[i].layer.ff_layer;
+        for (size_t k = 0; k < layer->weights->n_rows * layer->weights->n_cols; k += 5){
+            check_dag_gradient("tower weights", model, X, &y, layer->weights->data + k, layer->grad_W->data[k]);
+        }
+    }
+
+    Matrix* matrices[3] = {X, y, grad};
+    for (size_t i = 0; i < 3; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    destroy_dag_nn_(model);
+    free(model);
+};
+
+// num_branches wide branches of the input joined by add
+DAG_NN_* wide_model(const size_t F, const size_t H, const size_t num_branches){
+    DAG_NN_* model = dag_nn_create(F);
+    size_t* branches = (size_t*)malloc(num_branches * sizeof(size_t));
+    for (size_t i = 0; i < num_branches; i++){
+        const size_t hidden = dag_nn_feed_forward(model, 0, H, 1);
+        branches[i] = dag_nn_feed_forward(model, hidden, F, 3);
+    }
+    dag_nn_output(model, dag_nn_add(model, branches, num_branches));
+    free(branches);
+    return model;
+};
+
+// Branches on a thread pool give the same bits as on one thread, and run faster
+void test_parallel(void){
+    printf("DAG parallel branches\n");
+    const size_t F = 128, H = 256, B = 64, num_branches = 4, steps = 3;
+    srand(5);
+    DAG_NN_* serial = wide_model(F, H, num_branches);
+    srand(5);
+    DAG_NN_* parallel = wide_model(F, H, num_branches);
+    ThreadPool* pool = thread_pool_new(num_branches);
+    dag_nn_set_thread_pool(parallel, pool);
+
+    Matrix *X = NULL, *grad = NULL;
+    matrix_create(&X, F, B);
+    matrix_create(&grad, F, B);
+    fill_random(X);
+    fill_random(grad);
+
+    double elapsed[2];
+    DAG_NN_* models[2] = {serial, parallel};
+    for (size_t i = 0; i < 2; i++){
+        dag_nn_forward(models[i], X);
+        dag_nn_backward(models[i], (const Matrix*[]){grad});
+        const double begin = wall_time();
+        for (size_t step = 0; step < steps; step++){
+            dag_nn_forward(models[i], X);
+            dag_nn_backward(models[i], (const Matrix*[]){grad});
+        }
+        elapsed[i] = (wall_time() - begin) / (double)steps;
+    }
+
+    for (size_t k = 0; k < F * B; k += 7) check_close("parallel output", dag_nn_output_value(serial, 0)->data[k], dag_nn_output_value(parallel, 0)->data[k], 0.0);
+    for (size_t i = 0; i < serial->num_layers; i++){
+        const Matrix* expected = serial->layers[i].layer.ff_layer->grad_W;
+        const Matrix* actual = parallel->layers[i].layer.ff_layer->grad_W;
+        for (size_t k = 0; k < expected->n_rows * expected->n_cols; k += 101) check_close("parallel grad_W", expected->data[k], actual->data[k], 0.0);
+    }
+    printf("    %lu branches, %lu threads: serial %.2fms, parallel %.2fms per step (%.2fx)\n",
+           num_branches, pool->num_threads, 1e3 * elapsed[0], 1e3 * elapsed[1], elapsed[0] / elapsed[1]);
+
+    matrix_destroy(X);
+    free(X);
+    matrix_destroy(grad);
+    free(grad);
+    thread_pool_destroy(pool);
+    for (size_t i = 0; i < 2; i++){
+        destroy_dag_nn_(models[i]);
+        free(models[i]);
+    }
+};
+
+int main(void){
+    srand(23);
+
+    test_forward();
+    test_gradients();
+    test_chain();
+    test_plan();
+    test_parallel();
+
+    if (failures){
+        printf("dag_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("dag_test: OK\n");
+    return 0;
+};
@@ -0,0 +1,207 @@
+#include "matrix.h"
+#include "layers.h"
+#include "models.h"
+#include "loss.h"
+#include "optimizer.h"
+#include "test_utils.h"
+
+// num_fields x B ids, sample 0 and 1 share their ids so rows are hit more than once
+Matrix* random_ids(const size_t num_fields, const size_t B, const size_t vocab_size){
+    Matrix* X = NULL;
+    matrix_create(&X, num_fields, B);
+    for (size_t f = 0; f < num_fields; f++){
+        for (size_t b = 0; b < B; b++) X->data[f * B + b] = (double)(rand() % vocab_size);
+        X->data[f * B + 1] = X->data[f * B];
+    }
+    return X;
+};
+
+// Every field of every sample is the row of its id
+void test_lookup(void){
+    printf("Embedding lookup\n");
+    const size_t vocab_size = 50, dim = 4, num_fields = 3, B = 6;
+    EmbeddingLayer_* layer = create_embedding_layer(vocab_size, dim, num_fields);
+    Matrix* X = random_ids(num_fields, B, vocab_size);
+
+    const Matrix* a = embedding_forward_(layer, X);
+    check_close("rows", (double)(num_fields * dim), (double)a->n_rows, 0.0);
+    for (size_t f = 0; f < num_fields; f++){
+        for (size_t b = 0; b < B; b++){
+            const size_t id = (size_t)X->data[f * B + b];
+            for (size_t d = 0; d < dim; d++) check_close("lookup", layer->weights->data[id * dim + d], a->data[(f * dim + d) * B + b], 0.0);
+        }
+    }
+
+    matrix_destroy(X);
+    free(X);
+    destroy_embedding_layer_(layer);
+    free(layer);
+};
+
+// Sparse row gradients of embedding -> feed forward against central differences
+void test_gradients(void){
+    printf("Embedding gradients\n");
+    const size_t vocab_size = 40, dim = 3, num_fields = 2, B = 5;
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, num_fields, num_fields * dim, 2);
+    add_embedding_layer_(model, vocab_size, dim, num_fields);
+    add_feed_forward_layer_(model, 2, num_fields * dim, 3);
+    fill_random(model->layers[1].layer.ff_layer->weights);
+    EmbeddingLayer_* layer = model->layers[0].layer.embedding_layer;
+
+    Matrix *X = random_ids(num_fields, B, vocab_size), *y = NULL;
+    matrix_create(&y, 2, B);
+    fill_random(y);
+    Matrix* a = NULL;
+    matrix_create(&a, num_fields, B);
+    memcpy(a->data, X->data, num_fields * B * sizeof(double));
+    forward_sequential_nn_(model, a);
+    backpropagate_sequential_nn_(model, a, y, 0);
+
+    check_close("distinct ids", 1.0, layer->num_touched <= num_fields * (B - 1), 0.0);
+    for (size_t k = 0; k < layer->num_touched; k++){
+        for (size_t d = 0; d < dim; d++){
+            double* w = layer->weights->data + layer->touched[k] * dim + d;
+            const double eps = 1e-5, saved = *w;
+            *w = saved + eps;
+            const double plus = model_loss(model, X, y);
+            *w = saved - eps;
+            const double minus = model_loss(model, X, y);
+            *w = saved;
+            check_close("row gradient", (plus - minus) / (2.0 * eps), layer->grad_rows->data[k * dim + d], 1e-6);
+        }
+    }
+    for (size_t id = 0; id < vocab_size; id++) check_close("slots are reset", 1.0, layer->row_slot[id] == EMBEDDING_NO_SLOT, 0.0);
+
+    Matrix* matrices[3] = {X, y, a};
+    for (size_t i = 0; i < 3; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+// Lazy Adam moves the looked up rows by the Adam step and leaves all others untouched
+void test_lazy_adam(void){
+    printf("Lazy Adam\n");
+    const size_t vocab_size = 30, dim = 4, B = 3;
+    const double alpha = 0.01, epsilon = 1e-8;
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, 1, dim, 1);
+    add_embedding_layer_(model, vocab_size, dim, 1);
+    add_feed_forward_layer_(model, 1, dim, 0);
+    EmbeddingLayer_* layer = model->layers[0].layer.embedding_layer;
+    Adam_Optimizer_* optimizer = NULL;
+    init_Adam_optimizer_(&optimizer, alpha, alpha, 0.9, 0.999, epsilon, model->layers, model->num_layers);
+
+    Matrix *X = random_ids(1, B, vocab_size), *y = NULL, *a = NULL;
+    matrix_create(&y, 1, B);
+    fill_random(y);
+    matrix_create(&a, 1, B);
+    memcpy(a->data, X->data, B * sizeof(double));
+    forward_sequential_nn_(model, a);
+    backpropagate_sequential_nn_(model, a, y, 0);
+
+    Matrix* before = matrix_copy(layer->weights);
+    optimize_adam_(optimizer, model->layers);
+
+    // First step: m_hat = g, v_hat = g^2
+    char* touched = (char*)calloc(vocab_size, 1);
+    for (size_t k = 0; k < layer->num_touched; k++){
+        const size_t id = layer->touched[k];
+        touched[id] = 1;
+        for (size_t d = 0; d < dim; d++){
+            const double g = layer->grad_rows->data[k * dim + d];
+            check_close("touched row", before->data[id * dim + d] - g * alpha / sqrt(g * g + epsilon), layer->weights->data[id * dim + d], 1e-12);
+        }
+    }
+    for (size_t id = 0; id < vocab_size; id++){
+        if (touched[id]) continue;
+        for (size_t d = 0; d < dim; d++){
+            check_close("untouched row", before->data[id * dim + d], layer->weights->data[id * dim + d], 0.0);
+            check_close("untouched moments", 0.0, optimizer->m_w_ptr[0].data[id * dim + d] + optimizer->v_w_ptr[0].data[id * dim + d], 0.0);
+        }
+    }
+
+    free(touched);
+    Matrix* matrices[4] = {X, y, a, before};
+    for (size_t i = 0; i < 4; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    destroy_adam_optimizer_(optimizer);
+    free(optimizer);
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+// One training step on a large vocabulary, the lazy update against a sweep over the table
+void test_large_vocabulary(void){
+    printf("Large vocabulary\n");
+    const size_t vocab_size = 1 << 20, dim = 16, num_fields = 4, B = 64, steps = 20;
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, num_fields, num_fields * dim, 1);
+    add_embedding_layer_(model, vocab_size, dim, num_fields);
+    add_feed_forward_layer_(model, 1, num_fields * dim, 2);
+    Adam_Optimizer_* optimizer = NULL;
+    init_Adam_optimizer_(&optimizer, 0.01, 0.01, 0.9, 0.999, 1e-8, model->layers, model->num_layers);
+
+    Matrix *y = NULL, *a = NULL;
+    matrix_create(&y, 1, B);
+    matrix_create(&a, num_fields, B);
+    double elapsed = 0.0;
+    for (size_t step = 0; step < steps; step++){
+        Matrix* X = random_ids(num_fields, B, vocab_size);
+        fill_random(y);
+        const double begin = wall_time();
+        matrix_resize(&a, num_fields, B);
+        memcpy(a->data, X->data, num_fields * B * sizeof(double));
+        forward_sequential_nn_(model, a);
+        backpropagate_sequential_nn_(model, a, y, 0);
+        optimize_adam_(optimizer, model->layers);
+        elapsed += wall_time() - begin;
+        matrix_destroy(X);
+        free(X);
+    }
+
+    // What a dense update would at least cost: one pass over the table and its moments
+    double* table = model->layers[0].layer.embedding_layer->weights->data;
+    double* m = optimizer->m_w_ptr[0].data;
+    double* v = optimizer->v_w_ptr[0].data;
+    const double begin = wall_time();
+    for (size_t k = 0; k < vocab_size * dim; k++){
+        m[k] *= 0.9;
+        v[k] *= 0.999;
+        table[k] -= 1e-3 * m[k] / sqrt(v[k] + 1e-8);
+    }
+    const double dense = wall_time() - begin;
+    printf("    %lu ids x %lu dims: lazy step %.3fms, dense table sweep %.3fms (%.0fx)\n",
+           vocab_size, dim, 1e3 * elapsed / (double)steps, 1e3 * dense, dense / (elapsed / (double)steps));
+    check_close("lazy step is cheaper than a table sweep", 1.0, elapsed / (double)steps < dense, 0.0);
+
+    matrix_destroy(y);
+    free(y);
+    matrix_destroy(a);
+    free(a);
+    destroy_adam_optimizer_(optimizer);
+    free(optimizer);
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+int main(void){
+    srand(13);
+
+    test_lookup();
+    test_gradients();
+    test_lazy_adam();
+    test_large_vocabulary();
+
+    if (failures){
+        printf("embedding_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("embedding_test: OK\n");
+    return 0;
+};
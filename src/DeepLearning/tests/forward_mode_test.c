@@ -0,0 +1,112 @@
+#include "tensor.h"
+#include "layers.h"
+#include "models.h"
+#include "forward_mode.h"
+#include "test_utils.h"
+
+// Output values of the model for x, via the forward-mode pass without tangents
+void model_values(Sequential_NN* model, const double* x, const size_t n_inputs, double* out, const size_t n_outputs){
+    JVPTensor* X = jvp_tensor_new(n_inputs, 1);
+    memcpy(X->values, x, n_inputs * sizeof(double));
+    JVPTensor* Y = forward_sequential_nn_jvp(model, X);
+    memcpy(out, Y->values, n_outputs * sizeof(double));
+    jvp_tensor_destroy(X);
+    jvp_tensor_destroy(Y);
+};
+
+// Tangent lanes must match central differences, values must match the Tensor forward pass
+void test_sequential_jvp(void){
+    printf("Sequential JVP\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 6, 3, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 5, 6, tensor_sigmoid_inplace);
+    add_feed_forward_layer(model, 4, 5, tensor_relu_inplace);
+
+    double x[3][1] = {{0.3}, {-0.2}, {0.1}};
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    JVPTensor* X_jvp = jvp_tensor_from_tensor(X);
+
+    // Lanes 0-2: unit directions, lane 3: all inputs together
+    for (size_t k = 0; k < 3; k++){
+        jvp_tensor_seed(X_jvp, k, 0, k, 1.0);
+        if (JVP_LANES > 3) jvp_tensor_seed(X_jvp, k, 0, 3, 1.0);
+    }
+    JVPTensor* Y_jvp = forward_sequential_nn_jvp(model, X_jvp);
+
+    forward_sequential_nn(model, X);
+    for (size_t i = 0; i < 4; i++) check_close("value", tensor_get_val(X, i, 0), jvp_tensor_get_val(Y_jvp, i, 0), 1e-12);
+
+    const double h = 1e-6;
+    const double base[3] = {0.3, -0.2, 0.1};
+    for (size_t lane = 0; lane < JVP_LANES && lane < 4; lane++){
+        double plus[3], minus[3], y_plus[4], y_minus[4];
+        for (size_t k = 0; k < 3; k++){
+            const double direction = lane < 3 ? (double)(k == lane) : 1.0;
+            plus[k] = base[k] + h * direction;
+            minus[k] = base[k] - h * direction;
+        }
+        model_values(model, plus, 3, y_plus, 4);
+        model_values(model, minus, 3, y_minus, 4);
+
+        for (size_t i = 0; i < 4; i++){
+            const double fd = (y_plus[i] - y_minus[i]) / (2.0 * h);
+            check_close("tangent", fd, jvp_tensor_get_tangent(Y_jvp, i, 0, lane), 1e-6);
+        }
+    }
+
+    jvp_tensor_print(Y_jvp);
+
+    jvp_tensor_destroy(X_jvp);
+    jvp_tensor_destroy(Y_jvp);
+    tensor_destroy(X);
+    destroy_sequential_nn(model);
+};
+
+// Product rule through the general dot product and the elementwise ops
+void test_tensor_ops_jvp(void){
+    printf("Tensor ops JVP\n");
+    JVPTensor* A = jvp_tensor_new(2, 2);
+    JVPTensor* B = jvp_tensor_new(2, 1);
+    const double a[4] = {1.0, 2.0, -0.5, 0.25};
+    const double b[2] = {0.75, 1.5};
+    memcpy(A->values, a, sizeof(a));
+    memcpy(B->values, b, sizeof(b));
+
+    // Lane 0: d/dA[0][1], lane 1: d/dB[1]
+    jvp_tensor_seed(A, 0, 1, 0, 1.0);
+    jvp_tensor_seed(B, 1, 0, 1, 1.0);
+
+    JVPTensor* C = jvp_tensor_dot_product(A, B);
+    jvp_tensor_exp_inplace(C);
+
+    // C = exp(A B): dC0/dA01 = C0 * B1, dC0/dB1 = C0 * A01, dC1/dB1 = C1 * A11
+    const double c0 = exp(a[0] * b[0] + a[1] * b[1]);
+    const double c1 = exp(a[2] * b[0] + a[3] * b[1]);
+    check_close("exp(AB) value", c0, jvp_tensor_get_val(C, 0, 0), 1e-12);
+    check_close("d/dA01", c0 * b[1], jvp_tensor_get_tangent(C, 0, 0, 0), 1e-12);
+    check_close("d/dA01 other row", 0.0, jvp_tensor_get_tangent(C, 1, 0, 0), 1e-12);
+    check_close("d/dB1", c0 * a[1], jvp_tensor_get_tangent(C, 0, 0, 1), 1e-12);
+    check_close("d/dB1 other row", c1 * a[3], jvp_tensor_get_tangent(C, 1, 0, 1), 1e-12);
+
+    const Dual dual = jvp_tensor_get_dual(C, 0, 0, 1);
+    check_close("dual value", c0, dual.value, 1e-12);
+    check_close("dual grad", c0 * a[1], dual.grad, 1e-12);
+
+    jvp_tensor_destroy(A);
+    jvp_tensor_destroy(B);
+    jvp_tensor_destroy(C);
+};
+
+int main(void){
+    srand(11);
+
+    test_tensor_ops_jvp();
+    test_sequential_jvp();
+
+    if (failures){
+        printf("forward_mode_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("forward_mode_test: OK\n");
+    return 0;
+};
@@ -0,0 +1,197 @@
+#include "matrix.h"
+#include "layers.h"
+#include "models.h"
+#include "loss.h"
+#include "test_utils.h"
+
+#define TOL 1e-9
+
+// Every transpose combination, with sizes crossing the panel blocks
+void test_gemm(void){
+    printf("GEMM\n");
+    const size_t m = 5, k = 300, n = 270;
+
+    for (int trans = 0; trans < 4; trans++){
+        const char trans_a = trans & 1, trans_b = (trans >> 1) & 1;
+        Matrix *A = NULL, *B = NULL, *C = NULL, *A_op = NULL, *B_op = NULL, *expected = NULL;
+        matrix_create(&A, trans_a ? k : m, trans_a ? m : k);
+        matrix_create(&B, trans_b ? n : k, trans_b ? k : n);
+        matrix_create(&C, m, n);
+        fill_random(A);
+        fill_random(B);
+        fill_random(C);
+
+        A_op = trans_a ? matrix_transpose(A) : matrix_copy(A);
+        B_op = trans_b ? matrix_transpose(B) : matrix_copy(B);
+        matrix_multiply(A_op, B_op, &expected, 0);
+        for (size_t x = 0; x < m * n; x++) expected->data[x] = 0.5 * expected->data[x] + 2.0 * C->data[x];
+
+        matrix_gemm(trans_a, trans_b, 0.5, A, B, 2.0, C);
+        for (size_t x = 0; x < m * n; x++) check_close("gemm", expected->data[x], C->data[x], TOL);
+
+        Matrix* mats[6] = {A, B, C, A_op, B_op, expected};
+        for (size_t i = 0; i < 6; i++){
+            matrix_destroy(mats[i]);
+            free(mats[i]);
+        }
+    }
+};
+
+// act(W*X + b) and da/dz of the fused kernel against the unfused reference, for every activation
+void test_fused_kernel(void){
+    printf("Fused linear + bias + activation\n");
+    const size_t n_in = 300, n_out = 7, batch_size = 5;
+
+    for (char mapping = 0; mapping < 4; mapping++){
+        FeedForwardLayer_* layer = create_feed_forward_layer(n_out, n_in, mapping);
+        fill_random(layer->weights);
+        fill_random(layer->biases);
+
+        Matrix* X = NULL;
+        matrix_create(&X, n_in, batch_size);
+        fill_random(X);
+
+        Matrix* Z = NULL;
+        matrix_multiply(layer->weights, X, &Z, 0);
+        const Matrix* a = feed_forward_forward_(layer, X);
+        const double* a_data = a->data;
+
+        for (size_t i = 0; i < n_out; i++){
+            for (size_t b = 0; b < batch_size; b++){
+                const double z = Z->data[i * batch_size + b] + layer->biases->data[i];
+                double expected = z, derivative = 1.0;
+                if (mapping == 1){ expected = z > 0 ? z : 0.0; derivative = z > 0 ? 1.0 : 0.0; }
+                if (mapping == 2){ expected = 1/(1 + exp(-z)); derivative = expected * (1 - expected); }
+                if (mapping == 3){ expected = tanh(z); derivative = 1 - expected * expected; }
+                check_close("fused activation", expected, a->data[i * batch_size + b], TOL);
+                check_close("fused da_dz", derivative, layer->da_dz->data[i * batch_size + b], TOL);
+            }
+        }
+
+        // Same batch size again: same buffers, nothing reallocated
+        if (feed_forward_forward_(layer, X)->data != a_data){
+            printf("    FAILED activations were reallocated\n");
+            failures++;
+        }
+
+        matrix_destroy(X);
+        free(X);
+        matrix_destroy(Z);
+        free(Z);
+        destroy_feed_forward_layer_(layer);
+        free(layer);
+    }
+};
+
+// C = mean over the batch of ||a - y||^2, the loss backward_L2_loss differentiates per sample
+double batch_loss(Sequential_NN_* model, const Matrix* X, const Matrix* Y){
+    Matrix* A = matrix_copy((Matrix*)X);
+    forward_sequential_nn_(model, A);
+
+    double loss = 0.0;
+    for (size_t k = 0; k < A->n_rows * A->n_cols; k++){
+        const double d = A->data[k] - Y->data[k];
+        loss += d * d;
+    }
+
+    matrix_destroy(A);
+    free(A);
+    return loss / (double)X->n_cols;
+};
+
+Matrix* column(const Matrix* X, const size_t b){
+    Matrix* col = NULL;
+    matrix_create(&col, X->n_rows, 1);
+    for (size_t i = 0; i < X->n_rows; i++) col->data[i] = X->data[i * X->n_cols + b];
+    return col;
+};
+
+// One batched call matches per-sample calls and the numerical gradient of the batch loss
+void test_batch(void){
+    printf("Mini-batch forward and backward\n");
+    const size_t batch_size = 4;
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, 3, 5, 2);
+    add_feed_forward_layer_(model, 5, 3, 3);
+    add_feed_forward_layer_(model, 5, 5, 1);
+    add_feed_forward_layer_(model, 2, 5, 2);
+    for (size_t l = 0; l < model->num_layers; l++){
+        fill_random(model->layers[l].layer.ff_layer->weights);
+        fill_random(model->layers[l].layer.ff_layer->biases);
+    }
+
+    Matrix *X = NULL, *Y = NULL;
+    matrix_create(&X, 3, batch_size);
+    matrix_create(&Y, 2, batch_size);
+    fill_random(X);
+    fill_random(Y);
+
+    // Per-sample reference: outputs and the mean of the per-sample gradients
+    FeedForwardLayer_* first = model->layers[0].layer.ff_layer;
+    double outputs[2][4];
+    double grad_W[5 * 3] = {0}, grad_b[5] = {0};
+    for (size_t b = 0; b < batch_size; b++){
+        Matrix* x = column(X, b);
+        Matrix* y = column(Y, b);
+        forward_sequential_nn_(model, x);
+        for (size_t i = 0; i < 2; i++) outputs[i][b] = x->data[i];
+        backpropagate_sequential_nn_(model, x, y, 0);
+        for (size_t k = 0; k < 5 * 3; k++) grad_W[k] += first->grad_W->data[k] / (double)batch_size;
+        for (size_t k = 0; k < 5; k++) grad_b[k] += first->grad_b->data[k] / (double)batch_size;
+
+        matrix_destroy(x);
+        free(x);
+        matrix_destroy(y);
+        free(y);
+    }
+
+    Matrix* A = matrix_copy(X);
+    forward_sequential_nn_(model, A);
+    for (size_t i = 0; i < 2; i++){
+        for (size_t b = 0; b < batch_size; b++) check_close("batch output", outputs[i][b], A->data[i * batch_size + b], TOL);
+    }
+    backpropagate_sequential_nn_(model, A, Y, 0);
+    for (size_t k = 0; k < 5 * 3; k++) check_close("batch grad_W", grad_W[k], first->grad_W->data[k], TOL);
+    for (size_t k = 0; k < 5; k++) check_close("batch grad_b", grad_b[k], first->grad_b->data[k], TOL);
+
+    // Central differences on the first layer
+    const double h = 1e-6;
+    for (size_t k = 0; k < 5 * 3; k++){
+        const double w = first->weights->data[k];
+        first->weights->data[k] = w + h;
+        const double up = batch_loss(model, X, Y);
+        first->weights->data[k] = w - h;
+        const double down = batch_loss(model, X, Y);
+        first->weights->data[k] = w;
+
+        const double numerical = (up - down) / (2.0 * h);
+        if (fabs(numerical - grad_W[k]) > 1e-6){
+            printf("    FAILED numerical grad_W[%lu]: expected %f, got %f\n", k, numerical, grad_W[k]);
+            failures++;
+        }
+    }
+
+    matrix_destroy(A);
+    free(A);
+    matrix_destroy(X);
+    free(X);
+    matrix_destroy(Y);
+    free(Y);
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+int main(void){
+    srand(11);
+
+    test_gemm();
+    test_fused_kernel();
+    test_batch();
+
+    if (failures){
+        printf("layerwise_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("layerwise_test: OK\n");
+    return 0;
+};
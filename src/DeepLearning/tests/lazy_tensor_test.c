@@ -0,0 +1,186 @@
+#include "tensor.h"
+#include "lazy_tensor.h"
+#include "compute_graph.h"
+#include "models.h"
+#include "loss.h"
+#include "test_utils.h"
+
+#define TOL 1e-9
+
+// y = tanh(a * b + 2 relu(a - c))
+double expression(const double a, const double b, const double c){
+    const double d = a - c;
+    return tanh(a * b + 2.0 * (d > 0 ? d : 0.0));
+};
+
+// A broadcast chain evaluates in one op node and matches the scalar formula and its derivatives
+void test_fused_chain(void){
+    printf("Fused chain\n");
+    const double a[2 * 2 * 3] = {0.5, -1.0, 2.0, 1.5, 0.25, -0.75, -0.5, 1.0, 0.3, -1.5, 0.75, 0.1};
+    const double b[2 * 3] = {1.0, -0.5, 0.25, 2.0, 0.1, -1.0};
+    const double c[3] = {0.0, 0.5, -1.0};
+    Tensor* A = tensor_create_from_batch(2, 2, 3, a);
+    Tensor* B = tensor_create_from_batch(1, 2, 3, b);
+    Tensor* C = tensor_create_from_batch(1, 1, 3, c);
+
+    LazyContext* ctx = lazy_context_new();
+    LazyTensor* la = lazy_tensor(ctx, A);
+    LazyTensor* diff = lazy_relu(ctx, lazy_subtract(ctx, la, lazy_tensor(ctx, C)));
+    LazyTensor* Y = lazy_tanh(ctx, lazy_add(ctx, lazy_multiply(ctx, la, lazy_tensor(ctx, B)), lazy_scale(ctx, diff, 2.0)));
+    check("lazy ops compute nothing", Y->tensor == NULL);
+    check("broadcast shape", Y->n_batch == 2 && Y->n_rows == 2 && Y->n_cols == 3);
+
+    ADNode* sum = node_new(0.0, 12, 0);
+    for (size_t k = 0; k < 12; k++){
+        ADNode* y = tensor_get_node_at(lazy_eval(Y), k / 6, (k / 3) % 2, k % 3);
+        sum->set_parent(sum, y, k);
+        *sum->value += *y->value;
+    }
+    sum->forward = forward_add;
+    sum->backward = backward_add;
+
+    // Inputs, one op node, its outputs and the sum
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, sum);
+    check("one fused node", graph->num_nodes == 12 + 6 + 3 + 1 + 12 + 1);
+    graph_replay_backward(graph);
+
+    const double h = 1e-6;
+    for (size_t k = 0; k < 12; k++){
+        const size_t bk = k % 6, ck = k % 3;
+        check_close("fused value", expression(a[k], b[bk], c[ck]), lazy_get_val_at(Y, k / 6, (k / 3) % 2, k % 3), TOL);
+        const double da = (expression(a[k] + h, b[bk], c[ck]) - expression(a[k] - h, b[bk], c[ck])) / (2 * h);
+        if (fabs(a[k] - c[ck]) > 1e-3) check_close("fused grad", da, tensor_get_grad_at(A, k / 6, (k / 3) % 2, k % 3), TOL);
+    }
+
+    // Broadcast sources sum the gradients of every element they were repeated to
+    double db = 0.0;
+    for (size_t bb = 0; bb < 2; bb++){
+        const size_t k = bb * 6 + 4;
+        db += (expression(a[k], b[4] + h, c[1]) - expression(a[k], b[4] - h, c[1])) / (2 * h);
+    }
+    check_close("broadcast grad", db, tensor_get_grad_at(B, 0, 1, 1), TOL);
+
+    graph_prune(graph);
+    graph_destroy(graph);
+    lazy_context_destroy(ctx);
+    tensor_detach(A);
+    tensor_detach(B);
+    tensor_detach(C);
+};
+
+// A chain read both through a product barrier and directly, the barrier compiles a nested chain
+// whose slots must not leak into the outer one (s sits in slot 1 of both, after X and after b)
+void test_nested_chain(void){
+    printf("Nested chain\n");
+    double x[2][1] = {{0.5}, {-1.0}};
+    double b[2][1] = {{0.25}, {-2.0}};
+    Tensor* X = tensor_create_from_array(2, 1, x);
+    Tensor* B = tensor_create_from_array(2, 1, b);
+    Tensor* W = tensor_create_identity(2);
+
+    LazyContext* ctx = lazy_context_new();
+    LazyTensor* s = lazy_sigmoid(ctx, lazy_tensor(ctx, X));
+    LazyTensor* Ws = lazy_add(ctx, lazy_matmul(ctx, lazy_tensor(ctx, W), s), lazy_tensor(ctx, B));
+    LazyTensor* Y = lazy_add(ctx, Ws, s);
+    for (size_t i = 0; i < 2; i++){
+        check_close("nested chain value", 2.0 / (1.0 + exp(-x[i][0])) + b[i][0], lazy_get_val_at(Y, 0, i, 0), TOL);
+    }
+
+    lazy_context_destroy(ctx);
+    tensor_detach(X);
+    tensor_detach(B);
+    tensor_detach(W);
+};
+
+// More sources than the compiler starts with, every wrap of X is a source of its own. The chain
+// nests to the right, so all sources are compiled before the first add
+void test_wide_chain(void){
+    printf("Wide chain\n");
+    double x[2][1] = {{0.5}, {-1.0}};
+    Tensor* X = tensor_create_from_array(2, 1, x);
+
+    LazyContext* ctx = lazy_context_new();
+    LazyTensor* Y = lazy_tensor(ctx, X);
+    for (size_t k = 1; k < 40; k++) Y = lazy_add(ctx, lazy_tensor(ctx, X), Y);
+    for (size_t i = 0; i < 2; i++) check_close("wide chain value", 40.0 * x[i][0], lazy_get_val_at(Y, 0, i, 0), TOL);
+
+    lazy_context_destroy(ctx);
+    tensor_detach(X);
+};
+
+// Loss and parameter gradients of one step, eager or lazy forward
+double step(Sequential_NN* model, const double (*x)[1], const double (*y)[1], const char lazy, double* grads){
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* Y = tensor_create_from_array(2, 1, y);
+    LazyContext* ctx = lazy_context_new();
+
+    Tensor* prediction = X;
+    if (lazy) prediction = lazy_eval(forward_sequential_nn_lazy(model, ctx, X));
+    else forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(prediction, Y);
+
+    size_t idx = 0;
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        tensor_zero_grad(ff->weights);
+        tensor_zero_grad(ff->biases);
+    }
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+    graph_replay_backward(graph);
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        for (size_t i = 0; i < ff->weights->n_rows; i++){
+            for (size_t j = 0; j < ff->weights->n_cols; j++) grads[idx++] = tensor_get_grad(ff->weights, i, j);
+            grads[idx++] = tensor_get_grad(ff->biases, i, 0);
+        }
+    }
+    const double value = tensor_get_val(loss, 0, 0);
+
+    graph_prune(graph);
+    free(graph->nodes);
+    free(graph);
+    lazy_context_destroy(ctx);
+    tensor_detach(X);
+    tensor_detach(Y);
+    tensor_detach(loss);
+    return value;
+};
+
+// The lazy forward pass of a model trains exactly like the eager one
+void test_lazy_model(void){
+    printf("Lazy model\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 8, 3, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 2, 8, tensor_sigmoid_inplace);
+
+    double x[3][1] = {{0.5}, {-1.0}, {2.0}};
+    double y[2][1] = {{0.25}, {1.0}};
+    double eager[8 * 3 + 8 + 2 * 8 + 2];
+    double lazy[8 * 3 + 8 + 2 * 8 + 2];
+
+    const double eager_loss = step(model, x, y, 0, eager);
+    const double lazy_loss = step(model, x, y, 1, lazy);
+    check_close("lazy loss", eager_loss, lazy_loss, TOL);
+    for (size_t k = 0; k < sizeof(lazy) / sizeof(double); k++) check_close("lazy grad", eager[k], lazy[k], TOL);
+
+    destroy_sequential_nn(model);
+};
+
+int main(void){
+    srand(11);
+
+    test_fused_chain();
+    test_nested_chain();
+    test_wide_chain();
+    test_lazy_model();
+
+    if (failures){
+        printf("lazy_tensor_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("lazy_tensor_test: OK\n");
+    return 0;
+};
@@ -0,0 +1,223 @@
+#include "tensor.h"
+#include "layers.h"
+#include "compute_graph.h"
+#include "models.h"
+#include "model_plan.h"
+#include "KNN.h"
+#include "dt.h"
+#include "test_utils.h"
+
+void temp_path(char* path, const char* name){
+    const char* dir = getenv("TMPDIR");
+    snprintf(path, 4096, "%s/cml_%s_%d.cml", dir && *dir ? dir : "/tmp", name, (int)getpid());
+};
+
+// n points in [0, 10)^dim, the class is the quadrant of the first two features
+Vector* random_points(const unsigned short n, const unsigned char dim){
+    Vector* vec = vector_create(n);
+    for (unsigned short i = 0; i < n; i++){
+        Point p;
+        p.dim = dim;
+        p.color = NULL;
+        p.point = (float*)malloc(dim * sizeof(float));
+        for (unsigned char d = 0; d < dim; d++) p.point[d] = 10.0f * (float)rand() / (float)RAND_MAX;
+        p.class = (unsigned char)((p.point[0] > 5.0f) + 2 * (p.point[1] > 5.0f));
+        vector_push_back(vec, &p);
+    }
+    return vec;
+};
+
+// Saved and mapped plans predict bit for bit what the compiled plan predicts
+void test_sequential_nn_file(void){
+    printf("Sequential_NN files\n");
+    char path[4096];
+    temp_path(path, "mlp");
+
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 13, 6, tensor_relu_inplace);
+    add_feed_forward_layer(model, 7, 13, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 3, 7, tensor_sigmoid_inplace);
+    ModelPlan* compiled = model_plan_compile(model, 8);
+    check("save", sequential_nn_save(model, path));
+
+    const double begin = wall_time();
+    ModelPlan* mapped = model_plan_load(path, 8);
+    printf("    load %.1fus\n", 1e6 * (wall_time() - begin));
+    check("load", mapped != NULL);
+    if (mapped == NULL) return;
+    check("weights are used in place", (const char*)mapped->weights > (const char*)mapped->file->data
+                                       && (const char*)mapped->weights < (const char*)mapped->file->data + mapped->file->size);
+    check("weights are aligned", (uintptr_t)mapped->weights % MODEL_FILE_ALIGNMENT == 0);
+
+    double X[10 * 6], expected[10 * 3], Y[10 * 3];
+    for (size_t k = 0; k < 10 * 6; k++) X[k] = 2.0 * random_value();
+    model_plan_predict_batch(compiled, X, 10, expected);
+    model_plan_predict_batch(mapped, X, 10, Y);
+    check("mapped predictions", memcmp(expected, Y, sizeof(Y)) == 0);
+
+    // Trainable copy, compiled again it gives the same plan
+    Sequential_NN* loaded = sequential_nn_load(path);
+    check("trainable load", loaded != NULL && loaded->num_layers == 3 && loaded->num_params == model->num_params);
+    ModelPlan* recompiled = model_plan_compile(loaded, 8);
+    model_plan_predict_batch(recompiled, X, 10, Y);
+    check("reloaded predictions", memcmp(expected, Y, sizeof(Y)) == 0);
+    check("reloaded activations", loaded->layers[1]->layer.ff_layer->act_fn == tensor_tanh_inplace);
+
+    model_plan_destroy(recompiled);
+    destroy_sequential_nn(loaded);
+    model_plan_destroy(mapped);
+    model_plan_destroy(compiled);
+    destroy_sequential_nn(model);
+
+    // A linear layer saved from a Sequential_NN_ cannot become a trainable Sequential_NN
+    Sequential_NN_* linear = NULL;
+    init_sequential_nn_(&linear, 6, 4, 4);
+    add_feed_forward_layer_(linear, 4, 6, 0);
+    ModelPlan* linear_plan = model_plan_compile_(linear, 4);
+    check("save linear", model_plan_save(linear_plan, path));
+    check("linear layers are refused", sequential_nn_load(path) == NULL);
+    model_plan_destroy(linear_plan);
+    destroy_sequential_nn_(linear);
+    free(linear);
+    remove(path);
+};
+
+// The mapped k-d tree finds the same neighbours as the built one
+void test_knn_file(void){
+    printf("KNN files\n");
+    char path[4096];
+    temp_path(path, "knn");
+
+    Vector* train = random_points(200, 3);
+    KNN* knn = KNN_create();
+    KNN_set_K(knn, 5);
+    knn->root_node = k_d_tree_build(train, 0);
+    check("save", KNN_save(knn, path));
+
+    KNN* loaded = KNN_load(path);
+    check("load", loaded != NULL);
+    if (loaded == NULL) return;
+    check("K", loaded->K == 5);
+    check("nodes", loaded->flat.num_nodes == 200);
+
+    Vector* queries = random_points(100, 3);
+    for (unsigned short i = 0; i < queries->size; i++){
+        Point* q = vector_at(queries, i);
+        check("mapped prediction", KNN_predict(knn, q) == KNN_predict(loaded, q));
+    }
+    Point* short_point = vector_at(queries, 0);
+    short_point->dim = 2;
+    check("short point", KNN_predict(loaded, short_point) == -1);
+
+    for (unsigned short i = 0; i < queries->size; i++) free(vector_at(queries, i)->point);
+    vector_destroy(&queries);
+    KNN_destroy(&loaded);
+    k_d_tree_node_destroy(&knn->root_node);
+    vector_destroy(&train);
+    free(knn);
+    remove(path);
+};
+
+// The mapped decision tree walks to the same leaves as the built one
+void test_dt_file(void){
+    printf("DT_Classifier files\n");
+    char path[4096];
+    temp_path(path, "dt");
+
+    Vector* train = random_points(120, 2);
+    DT_Classifier* classifier = dt_classifier_create();
+    classifier->num_classes = 4;
+    classifier->root = dt_node_create();
+    dt_classifier_fit(classifier->root, train, classifier->num_classes);
+    check("save", dt_classifier_save(classifier, path));
+
+    DT_Classifier* loaded = dt_classifier_load(path);
+    check("load", loaded != NULL);
+    if (loaded == NULL) return;
+    check("classes", loaded->num_classes == 4);
+
+    Vector* queries = random_points(100, 2);
+    for (unsigned short i = 0; i < queries->size; i++){
+        Point* q = vector_at(queries, i);
+        const unsigned char predicted = dt_classifier_predict_flat(loaded, q);
+        check("mapped prediction", dt_classifier_predict(classifier->root, q) == predicted);
+    }
+    check("features", loaded->num_features == 2);
+
+    // The tree splits on both features, a point with one of them has no class
+    Point* short_point = vector_at(queries, 0);
+    short_point->dim = 1;
+    check("short point", dt_classifier_predict_flat(loaded, short_point) == 255);
+
+    for (unsigned short i = 0; i < queries->size; i++) free(vector_at(queries, i)->point);
+    vector_destroy(&queries);
+    dt_classifier_destroy(&loaded);
+    dt_node_destroy(&classifier->root, 0);
+    vector_destroy(&train);
+    free(classifier);
+    remove(path);
+};
+
+// Files of another kind, version or size are refused
+void test_invalid_files(void){
+    printf("Invalid files\n");
+    char path[4096];
+    temp_path(path, "invalid");
+
+    const double weights[4] = {1.0, 2.0, 3.0, 4.0};
+    ModelFileChunk chunk = {MODEL_PLAN_SECTION_WEIGHTS, weights, sizeof(weights)};
+    check("write", model_file_write(path, MODEL_FILE_KIND_SEQUENTIAL_NN, &chunk, 1));
+    check("missing layers", model_plan_load(path, 1) == NULL);
+    check("other kind", KNN_load(path) == NULL);
+    check("other kind", dt_classifier_load(path) == NULL);
+
+    ModelFile* file = model_file_map(path, MODEL_FILE_KIND_SEQUENTIAL_NN);
+    uint64_t size = 0;
+    check("section", file != NULL && memcmp(model_file_section(file, MODEL_PLAN_SECTION_WEIGHTS, &size), weights, sizeof(weights)) == 0);
+    check("section size", size == sizeof(weights));
+    const size_t file_size = file ? file->size : 0;
+    model_file_unmap(file);
+
+    // Newer format version
+    FILE* f = fopen(path, "r+b");
+    const uint32_t version = MODEL_FILE_VERSION + 1;
+    fseek(f, offsetof(ModelFileHeader, version), SEEK_SET);
+    fwrite(&version, sizeof(version), 1, f);
+    fclose(f);
+    check("newer version", model_file_map(path, MODEL_FILE_KIND_SEQUENTIAL_NN) == NULL);
+
+    // Cut short
+    check("write", model_file_write(path, MODEL_FILE_KIND_SEQUENTIAL_NN, &chunk, 1));
+    check("truncate", truncate(path, (off_t)(file_size - 8)) == 0);
+    check("truncated", model_file_map(path, MODEL_FILE_KIND_SEQUENTIAL_NN) == NULL);
+
+    // Decision trees with no nodes or a leaf class beyond num_classes
+    DTFileMeta meta = {1, 2, 1, {0, 0}};
+    DT_FlatNode leaf = {0.0f, DT_FLAT_NULL, DT_FLAT_NULL, 0, 1, 2, 0};
+    ModelFileChunk dt_chunks[2] = {{DT_SECTION_META, &meta, sizeof(meta)}, {DT_SECTION_NODES, &leaf, sizeof(leaf)}};
+    check("write", model_file_write(path, MODEL_FILE_KIND_DT_CLASSIFIER, dt_chunks, 2));
+    check("leaf class", dt_classifier_load(path) == NULL);
+    meta.num_nodes = 0;
+    dt_chunks[1].size = 0;
+    check("write", model_file_write(path, MODEL_FILE_KIND_DT_CLASSIFIER, dt_chunks, 2));
+    check("no nodes", dt_classifier_load(path) == NULL);
+
+    check("missing file", model_file_map("/nonexistent/model.cml", MODEL_FILE_KIND_SEQUENTIAL_NN) == NULL);
+    remove(path);
+};
+
+int main(void){
+    srand(3);
+
+    test_sequential_nn_file();
+    test_knn_file();
+    test_dt_file();
+    test_invalid_files();
+
+    if (failures){
+        printf("model_file_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("model_file_test: OK\n");
+    return 0;
+};
@@ -0,0 +1,324 @@
+#include "matrix.h"
+#include "layers.h"
+#include "models.h"
+#include "optimizer.h"
+#include "model_fit.h"
+#include "test_utils.h"
+
+// in -> hidden (tanh) -> out (linear), the same weights for the same seed
+Sequential_NN_* small_model(const size_t in, const size_t hidden, const size_t out, const unsigned int seed){
+    srand(seed);
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, in, hidden, out);
+    add_feed_forward_layer_(model, hidden, in, 3);
+    add_feed_forward_layer_(model, out, hidden, 0);
+    return model;
+};
+
+// y = A x with a fixed random A, one sample per column
+void linear_dataset(const size_t in, const size_t out, const size_t N, Matrix** X, Matrix** y){
+    Matrix* A = NULL;
+    matrix_create(&A, out, in);
+    fill_random(A);
+    matrix_create(X, in, N);
+    matrix_create(y, out, N);
+    fill_random(*X);
+    for (size_t o = 0; o < out; o++){
+        for (size_t n = 0; n < N; n++){
+            double sum = 0.0;
+            for (size_t i = 0; i < in; i++) sum += A->data[o * in + i] * (*X)->data[i * N + n];
+            (*y)->data[o * N + n] = sum;
+        }
+    }
+    matrix_destroy(A);
+    free(A);
+};
+
+void destroy_model(Sequential_NN_* model, Adam_Optimizer_* optimizer){
+    destroy_adam_optimizer_(optimizer);
+    free(optimizer);
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+// The loader thread gives the batches of a plain loop over the same shuffles, bit for bit
+void test_batches(void){
+    printf("Model fit batches\n");
+    const size_t in = 5, hidden = 7, out = 2, N = 50, epochs = 3;
+    Matrix *X = NULL, *y = NULL;
+    linear_dataset(in, out, N, &X, &y);
+    ModelFitConfig_ config = model_fit_default_config();
+    config.epochs = epochs;
+    config.batch_size = 16;         // the last batch of every epoch has 2 samples
+    config.seed = 9;
+
+    Sequential_NN_* fitted = small_model(in, hidden, out, 3);
+    Sequential_NN_* manual = small_model(in, hidden, out, 3);
+    Adam_Optimizer_ *fit_optimizer = NULL, *manual_optimizer = NULL;
+    init_Adam_optimizer_(&fit_optimizer, 0.01, 0.01, 0.9, 0.999, 1e-8, fitted->layers, fitted->num_layers);
+    init_Adam_optimizer_(&manual_optimizer, 0.01, 0.01, 0.9, 0.999, 1e-8, manual->layers, manual->num_layers);
+
+    ModelFitEpoch_* history = model_fit_(fitted, fit_optimizer, X, y, &config);
+
+    size_t* perm = (size_t*)malloc(N * sizeof(size_t));
+    for (size_t i = 0; i < N; i++) perm[i] = i;
+    unsigned int seed = config.seed;
+    Matrix *a = NULL, *y_batch = NULL;
+    for (size_t epoch = 0; epoch < epochs; epoch++){
+        model_fit_shuffle(perm, N, &seed);
+        double loss = 0.0;
+        for (size_t begin = 0; begin < N; begin += config.batch_size){
+            const size_t count = begin + config.batch_size <= N ? config.batch_size : N - begin;
+            matrix_resize(&a, in, count);
+            matrix_resize(&y_batch, out, count);
+            model_fit_gather(X, perm, begin, count, a->data);
+            model_fit_gather(y, perm, begin, count, y_batch->data);
+            forward_sequential_nn_(manual, a);
+            for (size_t k = 0; k < out * count; k++) loss += (a->data[k] - y_batch->data[k]) * (a->data[k] - y_batch->data[k]);
+            backpropagate_sequential_nn_(manual, a, y_batch, 0);
+            optimize_adam_(manual_optimizer, manual->layers);
+        }
+        check_close("epoch loss", loss / (double)N, history[epoch].loss, 1e-12);
+        check_close("throughput reported", 1.0, history[epoch].samples_per_sec > 0.0, 0.0);
+        check_close("stall within the epoch", 1.0, history[epoch].stall_seconds <= history[epoch].seconds, 0.0);
+    }
+    for (size_t i = 0; i < 2; i++){
+        const Matrix* expected = manual->layers[i].layer.ff_layer->weights;
+        const Matrix* actual = fitted->layers[i].layer.ff_layer->weights;
+        for (size_t k = 0; k < expected->n_rows * expected->n_cols; k++) check_close("weights", expected->data[k], actual->data[k], 0.0);
+    }
+
+    free(history);
+    free(perm);
+    Matrix* matrices[4] = {X, y, a, y_batch};
+    for (size_t i = 0; i < 4; i++){
+        matrix_destroy(matrices[i]);
+        free(matrices[i]);
+    }
+    destroy_model(fitted, fit_optimizer);
+    destroy_model(manual, manual_optimizer);
+};
+
+// Fitting a linear map drives the loss down
+void test_convergence(void){
+    printf("Model fit convergence\n");
+    const size_t in = 4, out = 2, N = 256;
+    Matrix *X = NULL, *y = NULL;
+    linear_dataset(in, out, N, &X, &y);
+    ModelFitConfig_ config = model_fit_default_config();
+    config.epochs = 40;
+    config.batch_size = 32;
+
+    Sequential_NN_* model = small_model(in, 16, out, 5);
+    Adam_Optimizer_* optimizer = NULL;
+    init_Adam_optimizer_(&optimizer, 0.01, 0.01, 0.9, 0.999, 1e-8, model->layers, model->num_layers);
+    ModelFitEpoch_* history = model_fit_(model, optimizer, X, y, &config);
+    printf("    loss %.6f after 1 epoch, %.6f after %lu\n", history[0].loss, history[config.epochs - 1].loss, config.epochs);
+    check_close("loss falls tenfold", 1.0, history[config.epochs - 1].loss < 0.1 * history[0].loss, 0.0);
+
+    free(history);
+    matrix_destroy(X);
+    free(X);
+    matrix_destroy(y);
+    free(y);
+    destroy_model(model, optimizer);
+};
+
+typedef struct {
+    size_t calls;
+    size_t samples;
+    long sleep_ns;
+}PrepareCounter;
+
+// Stands in for decoding or augmentation: takes wall time on the loader thread
+void slow_prepare(Matrix* X_batch, Matrix* y_batch, void* ctx){
+    PrepareCounter* counter = (PrepareCounter*)ctx;
+    counter->calls++;
+    counter->samples += X_batch->n_cols;
+    if (y_batch->n_cols != X_batch->n_cols) counter->samples = 0;
+    struct timespec ts = {0, counter->sleep_ns};
+    nanosleep(&ts, NULL);
+};
+
+// A prepare step slower than the training step stalls, one that is faster is hidden
+void test_prefetch(void){
+    printf("Model fit prefetch\n");
+    const size_t in = 64, out = 8, N = 2048, B = 64;
+    Matrix *X = NULL, *y = NULL;
+    linear_dataset(in, out, N, &X, &y);
+    Sequential_NN_* model = small_model(in, 128, out, 7);
+    Adam_Optimizer_* optimizer = NULL;
+    init_Adam_optimizer_(&optimizer, 0.001, 0.001, 0.9, 0.999, 1e-8, model->layers, model->num_layers);
+
+    ModelFitConfig_ config = model_fit_default_config();
+    config.epochs = 1;
+    config.batch_size = B;
+    ModelFitEpoch_* history = model_fit_(model, optimizer, X, y, &config);
+    const double step = history[0].seconds / (double)(N / B);
+    free(history);
+
+    const double factors[2] = {0.25, 4.0};
+    for (size_t i = 0; i < 2; i++){
+        PrepareCounter counter = {0, 0, (long)(factors[i] * step * 1e9)};
+        config.prepare = slow_prepare;
+        config.prepare_ctx = &counter;
+        history = model_fit_(model, optimizer, X, y, &config);
+        printf("    prepare %.2fms per batch, training %.2fms: %.0f samples/s, data stall %.1f%%\n",
+               1e3 * factors[i] * step, 1e3 * step, history[0].samples_per_sec, history[0].stall_percent);
+        check_close("prepare runs once per batch", (double)(N / B), (double)counter.calls, 0.0);
+        check_close("prepare sees every sample", (double)N, (double)counter.samples, 0.0);
+        if (factors[i] > 1.0) check_close("slow loader stalls", 1.0, history[0].stall_percent > 25.0, 0.0);
+        free(history);
+    }
+
+    matrix_destroy(X);
+    free(X);
+    matrix_destroy(y);
+    free(y);
+    destroy_model(model, optimizer);
+};
+
+// Fill slot with the first n samples of X and y, as the loader would without shuffling
+ModelFitSlot_ first_samples(const Matrix* X, const Matrix* y, const size_t n, size_t* perm){
+    ModelFitSlot_ slot = {{(double*)malloc(X->n_rows * n * sizeof(double)), X->n_rows, n}, {(double*)malloc(y->n_rows * n * sizeof(double)), y->n_rows, n}, 1};
+    for (size_t i = 0; i < n; i++) perm[i] = i;
+    model_fit_gather(X, perm, 0, n, slot.X.data);
+    model_fit_gather(y, perm, 0, n, slot.y.data);
+    return slot;
+};
+
+// Reduced gradients of N replicas against the gradients of the whole batch on one model
+void check_parallel_gradients(const char* what, Sequential_NN_* (*build)(void), const Matrix* X, const Matrix* y, const size_t n, const size_t num_workers){
+    Sequential_NN_* reference = build();
+    Sequential_NN_* model = build();
+    size_t* perm = (size_t*)malloc(n * sizeof(size_t));
+    ModelFitSlot_ slot = first_samples(X, y, n, perm);
+
+    Matrix* a = NULL;
+    model_fit_columns(&slot.X, 0, n, &a);
+    forward_sequential_nn_(reference, a);
+    const double loss = model_fit_batch_loss(a, &slot.y, 0);
+    backpropagate_sequential_nn_(reference, a, &slot.y, 0);
+
+    ModelFitParallel_* parallel = model_fit_parallel_create(model, num_workers, 0);
+    check_close(what, loss, model_fit_parallel_step(parallel, &slot), 1e-12);
+    for (size_t i = 0; i < model->num_layers; i++){
+        Matrix *weights, *biases, *grad_W, *grad_b, *expected_W, *expected_b;
+        if (!layer_params_(model->layers + i, &weights, &biases, &grad_W, &grad_b)) continue;
+        layer_params_(reference->layers + i, &weights, &biases, &expected_W, &expected_b);
+        for (size_t k = 0; k < grad_W->n_rows * grad_W->n_cols; k++) check_close(what, expected_W->data[k], grad_W->data[k], 1e-10);
+        for (size_t k = 0; k < grad_b->n_rows * grad_b->n_cols; k++) check_close(what, expected_b->data[k], grad_b->data[k], 1e-10);
+    }
+
+    model_fit_parallel_destroy(parallel);
+    matrix_destroy(a);
+    free(a);
+    free(slot.X.data);
+    free(slot.y.data);
+    free(perm);
+    Sequential_NN_* models[2] = {reference, model};
+    for (size_t i = 0; i < 2; i++){
+        destroy_sequential_nn_(models[i]);
+        free(models[i]);
+    }
+};
+
+Sequential_NN_* dense_model(void){
+    return small_model(6, 9, 3, 31);
+};
+
+// 2 channels of 4 x 3 -> conv 3x3 -> max pool -> feed forward
+Sequential_NN_* conv_model(void){
+    srand(37);
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, 24, 12, 3);
+    add_conv2d_layer_(model, 2, 4, 3, 3, 3, 1, 1, CONV_NCHW, 3);
+    add_pool2d_layer_(model, 3, 4, 3, 2, 2, POOL_MAX, CONV_NCHW);
+    add_feed_forward_layer_(model, 3, 6, 0);
+    return model;
+};
+
+// 4 steps of 6 / 4 features -> LSTM -> feed forward
+Sequential_NN_* lstm_model(void){
+    srand(41);
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, 24, 5, 3);
+    add_lstm_layer_(model, 6, 5, 4, 0, 0);
+    add_feed_forward_layer_(model, 3, 5, 0);
+    return model;
+};
+
+// Split, train and tree-reduce: the step of the whole batch, with fewer samples than workers too
+void test_parallel_gradients(void){
+    printf("Data parallel gradients\n");
+    Matrix *X = NULL, *y = NULL;
+    linear_dataset(24, 3, 64, &X, &y);
+    Matrix X6 = {X->data, 6, X->n_cols};
+
+    const size_t workers[3] = {2, 3, 8};
+    for (size_t i = 0; i < 3; i++){
+        check_parallel_gradients("dense gradients", dense_model, &X6, y, 29, workers[i]);
+        check_parallel_gradients("conv gradients", conv_model, X, y, 29, workers[i]);
+        check_parallel_gradients("lstm gradients", lstm_model, X, y, 29, workers[i]);
+    }
+    check_parallel_gradients("more workers than samples", dense_model, &X6, y, 5, 8);
+
+    matrix_destroy(X);
+    free(X);
+    matrix_destroy(y);
+    free(y);
+};
+
+// Whole fits agree with one thread up to rounding, samples/s for 1 and N workers
+void test_parallel_fit(void){
+    printf("Data parallel fit\n");
+    const size_t in = 64, hidden = 256, out = 8, N = 4096;
+    Matrix *X = NULL, *y = NULL;
+    linear_dataset(in, out, N, &X, &y);
+    ModelFitConfig_ config = model_fit_default_config();
+    config.epochs = 2;
+    config.batch_size = 250;        // partial last batch of 96 samples
+
+    const size_t workers[2] = {1, 4};
+    Sequential_NN_* models[2];
+    Adam_Optimizer_* optimizers[2] = {NULL, NULL};
+    double samples_per_sec[2];
+    for (size_t i = 0; i < 2; i++){
+        models[i] = small_model(in, hidden, out, 43);
+        init_Adam_optimizer_(optimizers + i, 0.001, 0.001, 0.9, 0.999, 1e-8, models[i]->layers, models[i]->num_layers);
+        config.num_workers = workers[i];
+        ModelFitEpoch_* history = model_fit_(models[i], optimizers[i], X, y, &config);
+        samples_per_sec[i] = history[config.epochs - 1].samples_per_sec;
+        free(history);
+    }
+    for (size_t l = 0; l < 2; l++){
+        const Matrix* expected = models[0]->layers[l].layer.ff_layer->weights;
+        const Matrix* actual = models[1]->layers[l].layer.ff_layer->weights;
+        for (size_t k = 0; k < expected->n_rows * expected->n_cols; k += 17) check_close("parallel weights", expected->data[k], actual->data[k], 1e-8);
+    }
+    printf("    1 worker %.0f samples/s, %lu workers %.0f samples/s (%.2fx) on %lu cores\n",
+           samples_per_sec[0], workers[1], samples_per_sec[1], samples_per_sec[1] / samples_per_sec[0], thread_pool_default_threads());
+
+    for (size_t i = 0; i < 2; i++) destroy_model(models[i], optimizers[i]);
+    matrix_destroy(X);
+    free(X);
+    matrix_destroy(y);
+    free(y);
+};
+
+int main(void){
+    srand(29);
+
+    test_batches();
+    test_convergence();
+    test_prefetch();
+    test_parallel_gradients();
+    test_parallel_fit();
+
+    if (failures){
+        printf("model_fit_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("model_fit_test: OK\n");
+    return 0;
+};
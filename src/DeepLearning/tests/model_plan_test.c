@@ -0,0 +1,178 @@
+#include "tensor.h"
+#include "layers.h"
+#include "compute_graph.h"
+#include "models.h"
+#include "model_plan.h"
+#include "test_utils.h"
+
+#define TOL 1e-9
+
+// One sample through forward_sequential_nn, the eager nodes are released afterwards
+void tensor_predict(Sequential_NN* model, const double* x, const size_t n_in, double* y){
+    Tensor* X = tensor_new_init(n_in, 1, 0.0);
+    for (size_t i = 0; i < n_in; i++) tensor_set_val(X, i, 0, x[i]);
+    forward_sequential_nn(model, X);
+
+    ADNode* head = tensor_get_node(X, 0, 0);
+    for (size_t i = 0; i < X->n_rows; i++) y[i] = tensor_get_val(X, i, 0);
+    for (size_t i = 1; i < X->n_rows; i++) head = node_add(head, tensor_get_node(X, i, 0));
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, head);
+    graph_prune(graph);
+    free(graph->nodes);
+    free(graph);
+    tensor_detach(X);
+};
+
+// The plan matches forward_sequential_nn, single samples and batches with a tail
+void test_plan_tensor_model(void){
+    printf("Plan of Sequential_NN\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 9, 6, tensor_relu_inplace);
+    add_feed_forward_layer(model, 5, 9, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 3, 5, tensor_sigmoid_inplace);
+    ModelPlan* plan = model_plan_compile(model, 4);
+
+    const size_t n = 11;
+    double X[11 * 6], expected[11 * 3], Y[11 * 3], y[3];
+    for (size_t k = 0; k < n * 6; k++) X[k] = 2.0 * random_value();
+
+    for (size_t s = 0; s < n; s++){
+        tensor_predict(model, X + s * 6, 6, expected + s * 3);
+        model_plan_predict(plan, X + s * 6, y);
+        for (size_t i = 0; i < 3; i++) check_close("single sample", expected[s * 3 + i], y[i], TOL);
+    }
+
+    // More samples than max_batch, the last chunk has a tail shorter than the micro-kernel
+    model_plan_predict_batch(plan, X, n, Y);
+    for (size_t k = 0; k < n * 3; k++) check_close("batch", expected[k], Y[k], TOL);
+
+    // The plan is frozen, changing the model afterwards does not change it
+    tensor_set_val(model->layers[0]->layer.ff_layer->weights, 0, 0, 100.0);
+    model_plan_predict(plan, X, y);
+    for (size_t i = 0; i < 3; i++) check_close("frozen parameters", expected[i], y[i], TOL);
+
+    model_plan_destroy(plan);
+    destroy_sequential_nn(model);
+};
+
+// The plan matches forward_sequential_nn_ for every activation mapping
+void test_plan_layerwise_model(void){
+    printf("Plan of Sequential_NN_\n");
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, 7, 6, 5);
+    add_feed_forward_layer_(model, 6, 7, 0);
+    add_feed_forward_layer_(model, 6, 6, 1);
+    add_feed_forward_layer_(model, 6, 6, 2);
+    add_feed_forward_layer_(model, 5, 6, 3);
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer_* ff_layer = model->layers[l].layer.ff_layer;
+        for (size_t k = 0; k < ff_layer->weights->n_rows * ff_layer->weights->n_cols; k++) ff_layer->weights->data[k] = random_value();
+        for (size_t k = 0; k < ff_layer->biases->n_rows; k++) ff_layer->biases->data[k] = random_value();
+    }
+    ModelPlan* plan = model_plan_compile_(model, 8);
+
+    // Sample-major for the plan, one sample per column for the layerwise model
+    const size_t n = 6;
+    double X[6 * 7], Y[6 * 5];
+    for (size_t k = 0; k < n * 7; k++) X[k] = random_value();
+    Matrix* A = NULL;
+    matrix_create(&A, 7, n);
+    for (size_t s = 0; s < n; s++){
+        for (size_t i = 0; i < 7; i++) A->data[i * n + s] = X[s * 7 + i];
+    }
+
+    forward_sequential_nn_(model, A);
+    model_plan_predict_batch(plan, X, n, Y);
+    for (size_t s = 0; s < n; s++){
+        for (size_t i = 0; i < 5; i++) check_close("layerwise batch", A->data[i * n + s], Y[s * 5 + i], TOL);
+    }
+
+    matrix_destroy(A);
+    free(A);
+    model_plan_destroy(plan);
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+int compare_doubles(const void* a, const void* b){
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+};
+
+void report_latency(const char* what, double* latencies, const size_t runs){
+    qsort(latencies, runs, sizeof(double), compare_doubles);
+    printf("    %-22s p50 %8.2fus  p99 %8.2fus\n", what, 1e6 * latencies[runs / 2], 1e6 * latencies[runs * 99 / 100]);
+};
+
+// Single-sample latency of the three inference paths on the same weights
+void test_latency(void){
+    printf("Single-sample latency\n");
+    const size_t n_in = 32, hidden = 64, n_out = 10, runs = 500;
+
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, hidden, n_in, tensor_relu_inplace);
+    add_feed_forward_layer(model, hidden, hidden, tensor_relu_inplace);
+    add_feed_forward_layer(model, n_out, hidden, tensor_sigmoid_inplace);
+
+    Sequential_NN_* model_ = NULL;
+    init_sequential_nn_(&model_, n_in, hidden, n_out);
+    add_feed_forward_layer_(model_, hidden, n_in, 1);
+    add_feed_forward_layer_(model_, hidden, hidden, 1);
+    add_feed_forward_layer_(model_, n_out, hidden, 2);
+
+    ModelPlan* plan = model_plan_compile(model, 1);
+    double* latencies = (double*)malloc(runs * sizeof(double));
+    double x[32], y[10], reference[10];
+    for (size_t i = 0; i < n_in; i++) x[i] = random_value();
+
+    for (size_t run = 0; run < runs; run++){
+        const double begin = wall_time();
+        tensor_predict(model, x, n_in, reference);
+        latencies[run] = wall_time() - begin;
+    }
+    report_latency("forward_sequential_nn", latencies, runs);
+
+    Matrix* A = NULL;
+    matrix_create(&A, n_in, 1);
+    for (size_t run = 0; run < runs; run++){
+        const double begin = wall_time();
+        matrix_resize(&A, n_in, 1);
+        memcpy(A->data, x, n_in * sizeof(double));
+        forward_sequential_nn_(model_, A);
+        latencies[run] = wall_time() - begin;
+    }
+    report_latency("forward_sequential_nn_", latencies, runs);
+
+    for (size_t run = 0; run < runs; run++){
+        const double begin = wall_time();
+        model_plan_predict(plan, x, y);
+        latencies[run] = wall_time() - begin;
+    }
+    report_latency("model_plan_predict", latencies, runs);
+    for (size_t i = 0; i < n_out; i++) check_close("benchmark output", reference[i], y[i], TOL);
+
+    free(latencies);
+    matrix_destroy(A);
+    free(A);
+    model_plan_destroy(plan);
+    destroy_sequential_nn(model);
+    destroy_sequential_nn_(model_);
+    free(model_);
+};
+
+int main(void){
+    srand(5);
+
+    test_plan_tensor_model();
+    test_plan_layerwise_model();
+    test_latency();
+
+    if (failures){
+        printf("model_plan_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("model_plan_test: OK\n");
+    return 0;
+};
@@ -0,0 +1,138 @@
+#include "models.h"
+#include "model_plan.h"
+#include "quantized_plan.h"
+#include "test_utils.h"
+
+Sequential_NN_* random_model(const size_t* sizes, const size_t num_layers, const char* acts){
+    Sequential_NN_* model = NULL;
+    init_sequential_nn_(&model, sizes[0], sizes[1], sizes[num_layers]);
+    for (size_t l = 0; l < num_layers; l++){
+        add_feed_forward_layer_(model, sizes[l + 1], sizes[l], acts[l]);
+        FeedForwardLayer_* ff_layer = model->layers[l].layer.ff_layer;
+        const double range = 2.0 / sqrt((double)sizes[l]);
+        for (size_t k = 0; k < sizes[l + 1] * sizes[l]; k++) ff_layer->weights->data[k] = range * random_value();
+        for (size_t k = 0; k < sizes[l + 1]; k++) ff_layer->biases->data[k] = 0.1 * random_value();
+    }
+    return model;
+};
+
+// Every available kernel gives the exact int32 dot product
+void test_kernels(void){
+    printf("Int8 kernels\n");
+    const size_t k = 4 * QUANT_K_ALIGN;
+    int8_t w[4 * QUANT_K_ALIGN], x[4 * QUANT_K_ALIGN];
+    for (size_t i = 0; i < k; i++){
+        w[i] = (int8_t)(rand() % 255 - 127);
+        x[i] = (int8_t)(rand() % 255 - 127);
+    }
+    // Extremes, the pairwise int16 sums of the AVX2 kernel must not saturate
+    for (size_t i = 0; i < 8; i++){
+        w[i] = (i & 1) ? -127 : 127;
+        x[i] = (i & 2) ? -127 : 127;
+    }
+
+    const int32_t expected = quant_dot_scalar(w, x, k);
+#ifdef QUANT_X86
+    if (__builtin_cpu_supports("avx2")) check("avx2 dot", quant_dot_avx2(w, x, k) == expected);
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("avxvnni")) check("avx-vnni dot", quant_dot_vnni(w, x, k) == expected);
+#endif
+    int32_t reference = 0;
+    for (size_t i = 0; i < k; i++) reference += w[i] * x[i];
+    check("scalar dot", expected == reference);
+};
+
+// Calibration report, the double fallback and batch against single-sample predictions
+void test_calibration(void){
+    printf("Calibration\n");
+    const size_t sizes[4] = {20, 48, 33, 5};
+    const char acts[3] = {1, 3, 0};
+    Sequential_NN_* model = random_model(sizes, 3, acts);
+    ModelPlan* plan = model_plan_compile_(model, 8);
+    QuantizedPlan* qplan = quantized_plan_new(plan, 8);
+
+    // 64 samples with a label column after the features, which calibration ignores
+    Dataset_* dataset = Dataset_New();
+    dataset_initialize_(dataset, 64);
+    for (size_t s = 0; s < dataset->N; s++){
+        dataset->data[s].n_rows = 1;
+        dataset->data[s].n_cols = sizes[0] + 1;
+        dataset->data[s].data = (double*)malloc((sizes[0] + 1) * sizeof(double));
+        for (size_t i = 0; i < sizes[0] + 1; i++) dataset->data[s].data[i] = 4.0 * random_value();
+    }
+
+    QuantizedReport report;
+    quantized_plan_calibrate(qplan, dataset, 0.0, &report);
+    quantized_plan_print_report(qplan, &report);
+    check("samples", report.num_samples == 64);
+    check("every layer quantized", report.num_double_layers == 0);
+    check("layer error", qplan->layers[0].calibration_error > 0.0 && qplan->layers[0].calibration_error < 0.02);
+    check("output error", report.max_abs_error > 0.0 && report.max_abs_error < 0.05);
+    check("top-1 agreement", report.top1_agreement >= 0.9);
+
+    // Batches give what single samples give
+    double X[11 * 20], Y[11 * 5], y[5];
+    for (size_t k = 0; k < 11 * 20; k++) X[k] = 4.0 * random_value();
+    quantized_plan_predict_batch(qplan, X, 11, Y);
+    for (size_t s = 0; s < 11; s++){
+        quantized_plan_predict(qplan, X + s * 20, y);
+        check("batch", memcmp(y, Y + s * 5, sizeof(y)) == 0);
+    }
+
+    // A tolerance below every layer's error keeps the whole model in double
+    quantized_plan_calibrate(qplan, dataset, 1e-12, &report);
+    check("all layers in double", report.num_double_layers == 3);
+    check("no error in double", report.max_abs_error == 0.0 && report.top1_agreement == 1.0);
+
+    for (size_t s = 0; s < dataset->N; s++) matrix_destroy(dataset->data + s);
+    free(dataset->data);
+    free(dataset);
+    quantized_plan_destroy(qplan);
+    model_plan_destroy(plan);
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+// Single-sample throughput of a layer too large for the caches, double against int8
+void test_throughput(void){
+    printf("Throughput\n");
+    const size_t sizes[2] = {2048, 2048};
+    const char acts[1] = {1};
+    Sequential_NN_* model = random_model(sizes, 1, acts);
+    ModelPlan* plan = model_plan_compile_(model, 1);
+    QuantizedPlan* qplan = quantized_plan_new(plan, 1);
+
+    double* x = (double*)malloc(sizes[0] * sizeof(double));
+    double* y = (double*)malloc(sizes[1] * sizeof(double));
+    for (size_t i = 0; i < sizes[0]; i++) x[i] = random_value();
+
+    const size_t runs = 20;
+    double begin = wall_time();
+    for (size_t run = 0; run < runs; run++) model_plan_predict(plan, x, y);
+    const double t_double = wall_time() - begin;
+    begin = wall_time();
+    for (size_t run = 0; run < runs; run++) quantized_plan_predict(qplan, x, y);
+    const double t_int8 = wall_time() - begin;
+    printf("    %lux%lu, %lu runs: double %.4fs, int8 (%s) %.4fs, %.2fx\n", sizes[1], sizes[0], runs, t_double, qplan->kernel, t_int8, t_double / t_int8);
+
+    free(x);
+    free(y);
+    quantized_plan_destroy(qplan);
+    model_plan_destroy(plan);
+    destroy_sequential_nn_(model);
+    free(model);
+};
+
+int main(void){
+    srand(7);
+
+    test_kernels();
+    test_calibration();
+    test_throughput();
+
+    if (failures){
+        printf("quantized_plan_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("quantized_plan_test: OK\n");
+    return 0;
+};
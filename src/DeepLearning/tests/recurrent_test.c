@@ -0,0 +1,209 @@
+#include "matrix.h"
+#include "layers.h"
+#include "models.h"
+#include "loss.h"
+#include "test_utils.h"
+
+double sigmoid(const double x){
+    return 1.0 / (1.0 + exp(-x));
+};
+
+// One sample through the cell equations, hidden states of every step into hs (T x H)
+void naive_recurrent(const RecurrentLayer_* layer, const Matrix* X, const size_t b, double* hs){
+    const size_t I = layer->input_size, H = layer->hidden_size, T = layer->seq_len, B = X->n_cols;
+    double h[64] = {0.0}, c[64] = {0.0}, pre[256];
+
+    for (size_t t = 0; t < T; t++){
+        // pre[r] = W_x x_t + b, hh[r] = W_h h_t-1
+        double hh[256];
+        for (size_t r = 0; r < layer->num_gates * H; r++){
+            pre[r] = layer->biases->data[r];
+            hh[r] = 0.0;
+            for (size_t i = 0; i < I; i++) pre[r] += layer->W_x.data[r * I + i] * X->data[(t * I + i) * B + b];
+            for (size_t u = 0; u < H; u++) hh[r] += layer->W_h.data[r * H + u] * h[u];
+        }
+        for (size_t u = 0; u < H; u++){
+            if (layer->cell == LSTM){
+                const double i_g = sigmoid(pre[u] + hh[u]), f_g = sigmoid(pre[H + u] + hh[H + u]);
+                const double g_g = tanh(pre[2 * H + u] + hh[2 * H + u]), o_g = sigmoid(pre[3 * H + u] + hh[3 * H + u]);
+                c[u] = f_g * c[u] + i_g * g_g;
+                hs[t * H + u] = o_g * tanh(c[u]);
+            }else{
+                const double r_g = sigmoid(pre[u] + hh[u]), z_g = sigmoid(pre[H + u] + hh[H + u]);
+                const double n_g = tanh(pre[2 * H + u] + r_g * hh[2 * H + u]);
+                hs[t * H + u] = (1.0 - z_g) * n_g + z_g * h[u];
+            }
+        }
+        memcpy(h, hs + t * H, H * sizeof(double));
+    }
+};
+
+// Stacked GEMMs and fused gates match the cell equations step by step
+void test_forward(void){
+    printf("Recurrent forward\n");
+    const size_t I = 3, H = 5, T = 6, B = 4;
+
+    for (int cell = LSTM; cell <= GRU; cell++){
+        RecurrentLayer_* layer = create_recurrent_layer((LayerType_)cell, I, H, T, 1, 0);
+        fill_random(layer->biases);
+        Matrix* X = NULL;
+        matrix_create(&X, T * I, B);
+        fill_random(X);
+
+        const Matrix* a = recurrent_forward_(layer, X);
+        double hs[6 * 5];
+        for (size_t b = 0; b < B; b++){
+            naive_recurrent(layer, X, b, hs);
+            for (size_t k = 0; k < T * H; k++) check_close(cell == LSTM ? "lstm" : "gru", hs[k], a->data[k * B + b], 1e-12);
+        }
+
+        matrix_destroy(X);
+        free(X);
+        destroy_recurrent_layer_(layer);
+        free(layer);
+    }
+};
+
+// Recurrent layer followed by a feed forward head, trained on the forward pass of X
+Sequential_NN_* recurrent_model(const LayerType_ cell, const size_t I, const size_t H, const size_t T, const char return_sequences, const size_t bptt_steps){
+    Sequential_NN_* model = NULL;
+    const size_t out = return_sequences ? T * H : H;
+    init_sequential_nn_(&model, T * I, out, 2);
+    if (cell == LSTM) add_lstm_layer_(model, I, H, T, return_sequences, bptt_steps);
+    else add_gru_layer_(model, I, H, T, return_sequences, bptt_steps);
+    add_feed_forward_layer_(model, 2, out, 0);
+    fill_random(model->layers[1].layer.ff_layer->weights);
+    fill_random(model->layers[0].layer.recurrent_layer->biases);
+    return model;
+};
+
+void train_step(Sequential_NN_* model, const Matrix* X, Matrix* y){
+    Matrix* a = NULL;
+    matrix_create(&a, X->n_rows, X->n_cols);
+    memcpy(a->data, X->data, X->n_rows * X->n_cols * sizeof(double));
+    forward_sequential_nn_(model, a);
+    backpropagate_sequential_nn_(model, a, y, 0);
+    matrix_destroy(a);
+    free(a);
+};
+
+// Full BPTT against central differences, both cells, last state and whole sequence outputs
+void test_gradients(void){
+    printf("Recurrent gradients\n");
+    const size_t I = 3, H = 4, T = 5, B = 3;
+
+    for (int cell = LSTM; cell <= GRU; cell++){
+        for (char return_sequences = 0; return_sequences <= 1; return_sequences++){
+            Sequential_NN_* model = recurrent_model((LayerType_)cell, I, H, T, return_sequences, 0);
+            RecurrentLayer_* layer = model->layers[0].layer.recurrent_layer;
+            Matrix *X = NULL, *y = NULL;
+            matrix_create(&X, T * I, B);
+            matrix_create(&y, 2, B);
+            fill_random(X);
+            fill_random(y);
+            train_step(model, X, y);
+
+            const size_t num_params = layer->params->n_rows * layer->params->n_cols;
+            for (size_t k = 0; k < num_params; k += 5){
+                check_numeric_gradient(k < layer->W_x.n_rows * layer->W_x.n_cols ? "W_x" : "W_h", model, X, y, layer->params->data + k, layer->grad_params->data[k]);
+            }
+            for (size_t k = 0; k < layer->biases->n_rows; k += 2) check_numeric_gradient("biases", model, X, y, layer->biases->data + k, layer->grad_b->data[k]);
+            for (size_t k = 0; k < T * I * B; k += 4) check_numeric_gradient("input", model, X, y, X->data + k, layer->grad_delta->data[k] / (double)B);
+
+            matrix_destroy(X);
+            free(X);
+            matrix_destroy(y);
+            free(y);
+            destroy_sequential_nn_(model);
+            free(model);
+        }
+    }
+};
+
+// Truncated BPTT of the last state: exact for the last bptt_steps inputs, nothing before them
+void test_truncation(void){
+    printf("Truncated BPTT\n");
+    const size_t I = 2, H = 3, T = 8, B = 2, k_cut = 3;
+
+    for (int cell = LSTM; cell <= GRU; cell++){
+        srand(17);
+        Sequential_NN_* full = recurrent_model((LayerType_)cell, I, H, T, 0, 0);
+        srand(17);
+        Sequential_NN_* truncated = recurrent_model((LayerType_)cell, I, H, T, 0, k_cut);
+        srand(17);
+        Sequential_NN_* long_window = recurrent_model((LayerType_)cell, I, H, T, 0, T);
+
+        Matrix *X = NULL, *y = NULL;
+        matrix_create(&X, T * I, B);
+        matrix_create(&y, 2, B);
+        fill_random(X);
+        fill_random(y);
+        train_step(full, X, y);
+        train_step(truncated, X, y);
+        train_step(long_window, X, y);
+
+        const Matrix* grad_full = full->layers[0].layer.recurrent_layer->grad_delta;
+        const Matrix* grad_truncated = truncated->layers[0].layer.recurrent_layer->grad_delta;
+        const Matrix* grad_long = long_window->layers[0].layer.recurrent_layer->grad_delta;
+        for (size_t t = 0; t < T; t++){
+            for (size_t k = t * I * B; k < (t + 1) * I * B; k++){
+                check_close("window as long as the sequence", grad_full->data[k], grad_long->data[k], 0.0);
+                check_close("truncated input gradient", t >= T - k_cut ? grad_full->data[k] : 0.0, grad_truncated->data[k], 1e-12);
+            }
+        }
+
+        matrix_destroy(X);
+        free(X);
+        matrix_destroy(y);
+        free(y);
+        Sequential_NN_* models[3] = {full, truncated, long_window};
+        for (size_t i = 0; i < 3; i++){
+            destroy_sequential_nn_(models[i]);
+            free(models[i]);
+        }
+    }
+};
+
+// Training steps per second of a sequence-to-one model
+void test_throughput(void){
+    printf("Recurrent throughput\n");
+    const size_t I = 16, H = 64, T = 32, B = 32, steps = 3;
+
+    for (int cell = LSTM; cell <= GRU; cell++){
+        Sequential_NN_* model = recurrent_model((LayerType_)cell, I, H, T, 0, 0);
+        Matrix *X = NULL, *y = NULL;
+        matrix_create(&X, T * I, B);
+        matrix_create(&y, 2, B);
+        fill_random(X);
+        fill_random(y);
+
+        train_step(model, X, y);
+        const double begin = wall_time();
+        for (size_t step = 0; step < steps; step++) train_step(model, X, y);
+        const double elapsed = (wall_time() - begin) / (double)steps;
+        printf("    %s T=%lu I=%lu H=%lu B=%lu: %.2fms per step, %.0f sequences/s\n", cell == LSTM ? "LSTM" : "GRU ", T, I, H, B, 1e3 * elapsed, (double)B / elapsed);
+
+        matrix_destroy(X);
+        free(X);
+        matrix_destroy(y);
+        free(y);
+        destroy_sequential_nn_(model);
+        free(model);
+    }
+};
+
+int main(void){
+    srand(7);
+
+    test_forward();
+    test_gradients();
+    test_truncation();
+    test_throughput();
+
+    if (failures){
+        printf("recurrent_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("recurrent_test: OK\n");
+    return 0;
+};
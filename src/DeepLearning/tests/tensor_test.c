@@ -0,0 +1,422 @@
+#include "tensor.h"
+#include "matrix.h"
+#include "compute_graph.h"
+#include "models.h"
+#include "loss.h"
+#include "test_utils.h"
+
+#define TOL 1e-12
+
+// Matrix views alias the node values and grads of a tensor
+void test_matrix_views(void){
+    printf("Matrix views\n");
+    double a[2][3] = {{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}};
+    double b[3][2] = {{0.5, -1.0}, {1.5, 2.0}, {-0.5, 0.25}};
+    Tensor* A = tensor_create_from_array(2, 3, a);
+    Tensor* B = tensor_create_from_array(3, 2, b);
+    check("new tensor is contiguous", tensor_is_contiguous(A));
+
+    // Writes through the view are seen by the nodes
+    Matrix A_view = tensor_values_matrix(A);
+    A_view.data[4] = 7.0;
+    check_close("write through view", 7.0, tensor_get_val(A, 1, 1), TOL);
+
+    // Matrix kernels on autograd data match the Tensor op
+    Matrix B_view = tensor_values_matrix(B);
+    Matrix* C_mat = NULL;
+    matrix_multiply(&A_view, &B_view, &C_mat, 0);
+    Tensor* C = tensor_dot_product(A, B);
+    check("op result is contiguous", tensor_is_contiguous(C));
+    for (size_t i = 0; i < 2; i++){
+        for (size_t j = 0; j < 2; j++) check_close("matrix_multiply on views", tensor_get_val(C, i, j), matrix_get(C_mat, i, j), TOL);
+    }
+
+    // Gradients land in the grad view: d(sum C)/dB_kj = sum_i A_ik
+    ADNode* sum = node_add(node_add(tensor_get_node(C, 0, 0), tensor_get_node(C, 0, 1)),
+                           node_add(tensor_get_node(C, 1, 0), tensor_get_node(C, 1, 1)));
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, sum);
+    graph_replay_backward(graph);
+    Matrix dB = tensor_grads_matrix(B);
+    for (size_t k = 0; k < 3; k++){
+        const double expected = tensor_get_val(A, 0, k) + tensor_get_val(A, 1, k);
+        check_close("grad view", expected, dB.data[k * 2], TOL);
+        check_close("grad view", expected, dB.data[k * 2 + 1], TOL);
+    }
+
+    // Shared nodes are not contiguous until asked for a view
+    Tensor* At = tensor_transpose(A);
+    check("transpose is not contiguous", !tensor_is_contiguous(At));
+    Matrix At_view = tensor_values_matrix(At);
+    check_close("transposed view", 7.0, At_view.data[1 * 2 + 1], TOL);
+    check_close("transposed view", 3.0, At_view.data[2 * 2 + 0], TOL);
+
+    matrix_destroy(C_mat);
+    free(C_mat);
+    tensor_detach(At);
+    graph_prune(graph);
+    free(graph->nodes);
+    free(graph);
+    tensor_detach(A);
+    tensor_detach(B);
+    tensor_detach(C);
+};
+
+// In-place ops must not overwrite the values of the nodes they replace
+void test_inplace_storage(void){
+    printf("In-place storage\n");
+    double x[3][1] = {{-1.0}, {2.0}, {0.5}};
+    Tensor* X = tensor_create_from_array(3, 1, x);
+    Tensor* inputs = tensor_shallow_copy(X);
+
+    tensor_exp_inplace(X);
+    tensor_sqrt_inplace(X);
+    check("in-place result is contiguous", tensor_is_contiguous(X));
+    for (size_t i = 0; i < 3; i++){
+        check_close("input survives in-place ops", x[i][0], tensor_get_val(inputs, i, 0), TOL);
+        check_close("in-place value", sqrt(exp(x[i][0])), tensor_get_val(X, i, 0), TOL);
+    }
+
+    // d/dx sqrt(exp(x)) = 0.5 sqrt(exp(x))
+    ADNode* sum = node_add(node_add(tensor_get_node(X, 0, 0), tensor_get_node(X, 1, 0)), tensor_get_node(X, 2, 0));
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, sum);
+    graph_replay_backward(graph);
+    check_close("in-place grad", 0.5 * sqrt(exp(x[1][0])), tensor_get_grad(inputs, 1, 0), TOL);
+
+    // Loaders write straight into the input storage
+    const double batch[3] = {0.0, 1.0, -2.0};
+    tensor_load_values(inputs, batch);
+    graph_replay_forward(graph);
+    check_close("loaded input", sqrt(exp(1.0)), tensor_get_val(X, 1, 0), TOL);
+
+    graph_prune(graph);
+    free(graph->nodes);
+    free(graph);
+    tensor_detach(inputs);
+    tensor_detach(X);
+};
+
+// Binary ops repeat dimensions of size one
+void test_broadcasting(void){
+    printf("Broadcasting\n");
+    const double a[2 * 2 * 3] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    const double row[3] = {0.5, -1.0, 2.0};
+    const double col[2] = {10.0, 20.0};
+    Tensor* A = tensor_create_from_batch(2, 2, 3, a);
+    Tensor* R = tensor_create_from_batch(1, 1, 3, row);
+    Tensor* C = tensor_create_from_batch(1, 2, 1, col);
+
+    Tensor* AR = tensor_add(A, R);
+    Tensor* CA = tensor_subtract(C, A);
+    check("broadcast shape", AR->n_batch == 2 && AR->n_rows == 2 && AR->n_cols == 3);
+    check("broadcast shape", CA->n_batch == 2 && CA->n_rows == 2 && CA->n_cols == 3);
+    for (size_t b = 0; b < 2; b++){
+        for (size_t i = 0; i < 2; i++){
+            for (size_t j = 0; j < 3; j++){
+                const double x = a[(b * 2 + i) * 3 + j];
+                check_close("row broadcast", x + row[j], tensor_get_val_at(AR, b, i, j), TOL);
+                check_close("column broadcast", col[i] - x, tensor_get_val_at(CA, b, i, j), TOL);
+            }
+        }
+    }
+
+    // Batched product with a shared left operand: W (1, 2, 3) . A^T (2, 3, 2)
+    Tensor* W = tensor_create_from_batch(1, 2, 3, a);
+    Tensor* At = tensor_transpose(A);
+    Tensor* P = tensor_dot_product(W, At);
+    check("batched product shape", P->n_batch == 2 && P->n_rows == 2 && P->n_cols == 2);
+    double expected = 0.0;
+    for (size_t k = 0; k < 3; k++) expected += a[k] * a[(1 * 2 + 1) * 3 + k];
+    check_close("batched product", expected, tensor_get_val_at(P, 1, 0, 1), TOL);
+
+    tensor_destroy(P);
+    tensor_detach(At);
+    tensor_destroy(W);
+    tensor_destroy(AR);
+    tensor_destroy(CA);
+    tensor_destroy(A);
+    tensor_destroy(R);
+    tensor_destroy(C);
+};
+
+// Transpose, slices and reshapes share the nodes of their base
+void test_views(void){
+    printf("Views\n");
+    const double a[2 * 3 * 4] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24};
+    Tensor* A = tensor_create_from_batch(2, 3, 4, a);
+
+    Tensor* At = tensor_transpose(A);
+    check("transpose shape", At->n_batch == 2 && At->n_rows == 4 && At->n_cols == 3);
+    check("transpose shares nodes", tensor_get_node_at(At, 1, 3, 2) == tensor_get_node_at(A, 1, 2, 3));
+
+    Tensor* S = tensor_slice(A, 1, 3, 1, 3);
+    check("slice shape", S->n_batch == 2 && S->n_rows == 2 && S->n_cols == 2);
+    check_close("slice value", a[(1 * 3 + 2) * 4 + 1], tensor_get_val_at(S, 1, 1, 0), TOL);
+
+    // Views of views compose their strides
+    Tensor* St = tensor_transpose(S);
+    Tensor* B1 = tensor_slice_batch(St, 1, 2);
+    check("view of view refers to the root", B1->base == A);
+    check_close("view of view value", a[(1 * 3 + 1) * 4 + 2], tensor_get_val(B1, 1, 0), TOL);
+
+    Tensor* R = tensor_reshape(A, 1, 6, 4);
+    check_close("reshape value", a[5 * 4 + 3], tensor_get_val(R, 5, 3), TOL);
+
+    // Ops read views like dense tensors: A^T A per sample
+    Tensor* P = tensor_dot_product(At, A);
+    double expected = 0.0;
+    for (size_t k = 0; k < 3; k++) expected += a[(1 * 3 + k) * 4 + 1] * a[(1 * 3 + k) * 4 + 2];
+    check_close("product of views", expected, tensor_get_val_at(P, 1, 1, 2), TOL);
+
+    // Gradients reach the base nodes: d(sum S)/dA is one on the slice, zero elsewhere
+    Tensor* T = tensor_scalar_product(S, 2.0);
+    ADNode* sum = node_new(0.0, 8, 0);
+    for (size_t k = 0; k < 8; k++) sum->set_parent(sum, tensor_get_node(T, k / 2, k % 2), k);
+    sum->forward = forward_add;
+    sum->backward = backward_add;
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, sum);
+    graph_replay_forward(graph);
+    graph_replay_backward(graph);
+    check_close("slice grad", 2.0, tensor_get_grad_at(A, 1, 2, 2), TOL);
+    check_close("grad outside slice", 0.0, tensor_get_grad_at(A, 0, 0, 1), TOL);
+
+    // A contiguous copy of a view follows the view order, the base keeps its values
+    Matrix St_vals = tensor_values_matrix(St);
+    check_close("contiguous view", a[(0 * 3 + 2) * 4 + 1], St_vals.data[1], TOL);
+    check_close("base after contiguous view", a[(0 * 3 + 2) * 4 + 1], tensor_get_val_at(A, 0, 2, 1), TOL);
+
+    // In-place transpose swaps strides, new nodes land where the transposed layout puts them
+    Tensor* C = tensor_create_from_batch(1, 3, 4, a);
+    tensor_transpose_inplace(C);
+    tensor_exp_inplace(C);
+    check_close("in-place transpose then op", exp(a[1 * 4 + 3]), tensor_get_val(C, 3, 1), TOL);
+    Matrix C_vals = tensor_values_matrix(C);
+    check_close("contiguous after in-place transpose", exp(a[2 * 4 + 0]), C_vals.data[0 * 3 + 2], TOL);
+    tensor_sqrt_inplace(C);
+    check_close("op after contiguous", sqrt(exp(a[2 * 4 + 3])), tensor_get_val(C, 3, 2), TOL);
+
+    graph_prune(graph);
+    free(graph->nodes);
+    free(graph);
+    tensor_detach(B1);
+    tensor_detach(St);
+    tensor_detach(R);
+    tensor_detach(S);
+    tensor_detach(At);
+    tensor_detach(T);
+    tensor_destroy(P);
+    tensor_detach(C);
+    tensor_detach(A);
+};
+
+// out_i = scale * sum_{k <= i} in_k
+static void cumsum_forward(const void* params, const double* in, const size_t n_in, double* out, const size_t n_out){
+    const double scale = *(const double*)params;
+    (void)n_in;
+    double sum = 0.0;
+    for (size_t i = 0; i < n_out; i++){
+        sum += in[i];
+        out[i] = scale * sum;
+    }
+};
+
+static void cumsum_backward(const void* params, const double* in, const size_t n_in, const double* out,
+                            const double* grad_out, const size_t n_out, double* grad_in){
+    const double scale = *(const double*)params;
+    (void)in;
+    (void)n_in;
+    (void)out;
+    double sum = 0.0;
+    for (size_t i = n_out; i-- > 0;){
+        sum += grad_out[i];
+        grad_in[i] = scale * sum;
+    }
+};
+
+// Registered ops are one graph node per instance and replay like any other node
+void test_custom_ops(void){
+    printf("Custom ops\n");
+    static const ADOpDef cumsum = {"cumsum", cumsum_forward, cumsum_backward};
+    const size_t op = ad_op_register(&cumsum);
+    check("register returns the existing op", ad_op_register(&cumsum) == op && ad_op_lookup("cumsum") == op);
+
+    const double x[2 * 3] = {0.5, -1.0, 2.0, 1.5, 0.25, -0.75};
+    const double w[3] = {1.0, -2.0, 0.5};
+    const double scale = 2.0;
+    Tensor* X = tensor_create_from_batch(2, 3, 1, x);
+    for (size_t k = 0; k < 6; k++) tensor_get_node_at(X, k / 3, k % 3, 0)->is_trainable = 1;
+    Tensor* S = tensor_softmax(X);
+    Tensor* C = tensor_apply_op(S, op, &scale, sizeof(scale), 3, 1);
+
+    // loss = sum_b sum_i w_i C_bi
+    ADNode* loss = node_new(0.0, 6, 0);
+    for (size_t k = 0; k < 6; k++){
+        loss->set_parent(loss, node_multiply(tensor_get_node_at(C, k / 3, k % 3, 0), node_new_constant(w[k % 3])), k);
+    }
+    loss->forward = forward_add;
+    loss->backward = backward_add;
+
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, loss);
+    check("one op node per instance", graph->num_nodes == 6 + 2 + 6 + 2 + 6 + 6 + 6 + 1);
+
+    for (size_t round = 0; round < 3; round++){
+        if (round == 1) graph->optimize(graph);
+        if (round == 2) graph->plan_memory(graph);
+
+        const double shift = (double)round;
+        for (size_t k = 0; k < 6; k++) tensor_set_val_at(X, k / 3, k % 3, 0, x[k] + shift * (k % 2));
+        graph_replay_forward(graph);
+        graph_zero_grad(graph);
+        graph_replay_backward(graph);
+
+        for (size_t b = 0; b < 2; b++){
+            double e[3], sum = 0.0;
+            for (size_t i = 0; i < 3; i++){
+                e[i] = exp(x[b * 3 + i] + shift * ((b * 3 + i) % 2));
+                sum += e[i];
+            }
+
+            // dloss/ds_i = scale * sum_{k >= i} w_k, softmax backward on top
+            double g[3], dot = 0.0;
+            for (size_t i = 3; i-- > 0;) g[i] = scale * w[i] + (i < 2 ? g[i + 1] : 0.0);
+            for (size_t i = 0; i < 3; i++) dot += e[i] / sum * g[i];
+            for (size_t i = 0; i < 3; i++){
+                if (round == 0) check_close("softmax value", e[i] / sum, tensor_get_val_at(S, b, i, 0), TOL);
+                check_close("custom op grad", e[i] / sum * (g[i] - dot), tensor_get_grad_at(X, b, i, 0), TOL);
+            }
+        }
+    }
+
+    // A pass that reaches only the first output of each op, nothing of the passes before leaks in
+    ADNode* first = node_new(0.0, 2, 0);
+    for (size_t b = 0; b < 2; b++){
+        first->set_parent(first, node_multiply(tensor_get_node_at(C, b, 0, 0), node_new_constant(w[0])), b);
+    }
+    first->forward = forward_add;
+    first->backward = backward_add;
+    for (size_t k = 0; k < 6; k++) tensor_set_val_at(X, k / 3, k % 3, 0, x[k]);
+    graph_capture(graph, first);
+    graph_replay_forward(graph);
+    graph_zero_grad(graph);
+    graph_replay_backward(graph);
+    for (size_t b = 0; b < 2; b++){
+        double e[3], sum = 0.0;
+        for (size_t i = 0; i < 3; i++){
+            e[i] = exp(x[b * 3 + i]);
+            sum += e[i];
+        }
+        const double g[3] = {scale * w[0], 0.0, 0.0};
+        double dot = 0.0;
+        for (size_t i = 0; i < 3; i++) dot += e[i] / sum * g[i];
+        for (size_t i = 0; i < 3; i++) check_close("custom op grad of the first output", e[i] / sum * (g[i] - dot), tensor_get_grad_at(X, b, i, 0), TOL);
+    }
+
+    // One head over both losses, so that graph_destroy frees every node
+    ADNode* both = node_new(0.0, 2, 0);
+    both->set_parent(both, loss, 0);
+    both->set_parent(both, first, 1);
+    both->forward = forward_add;
+    both->backward = backward_add;
+    graph_capture(graph, both);
+
+    graph_destroy(graph);
+    tensor_detach(C);
+    tensor_detach(S);
+    tensor_detach(X);
+};
+
+void collect_param_grads(Sequential_NN* model, double* grads){
+    size_t idx = 0;
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        for (size_t i = 0; i < ff->weights->n_rows; i++){
+            for (size_t j = 0; j < ff->weights->n_cols; j++) grads[idx++] = tensor_get_grad(ff->weights, i, j);
+            grads[idx++] = tensor_get_grad(ff->biases, i, 0);
+        }
+    }
+};
+
+void zero_param_grads(Sequential_NN* model){
+    for (size_t l = 0; l < model->num_layers; l++){
+        FeedForwardLayer* ff = model->layers[l]->layer.ff_layer;
+        tensor_zero_grad(ff->weights);
+        tensor_zero_grad(ff->biases);
+    }
+};
+
+// Loss and gradients of the training step for one (batched) input
+double train_step_grads(Sequential_NN* model, Tensor* X, Tensor* Y, double* grads){
+    forward_sequential_nn(model, X);
+    Tensor* loss = L2_loss_tensor(X, Y);
+
+    zero_param_grads(model);
+    ComputeGraph* graph = compute_graph_new();
+    graph_capture(graph, tensor_get_node(loss, 0, 0));
+    graph_replay_backward(graph);
+    collect_param_grads(model, grads);
+    const double value = tensor_get_val(loss, 0, 0);
+
+    graph_prune(graph);
+    free(graph->nodes);
+    free(graph);
+    tensor_detach(loss);
+    return value;
+};
+
+// One batched step equals the mean of the per-sample steps
+void test_batched_training_step(void){
+    printf("Batched training step\n");
+    Sequential_NN* model = init_sequential_nn();
+    add_feed_forward_layer(model, 4, 3, tensor_tanh_inplace);
+    add_feed_forward_layer(model, 2, 4, tensor_sigmoid_inplace);
+
+    const double x[3 * 3] = {0.5, -1.0, 2.0, 1.5, 0.25, -0.75, -2.0, 3.0, 1.0};
+    const double y[3 * 2] = {0.25, 1.0, 0.0, 0.5, 1.0, 0.75};
+    const size_t num_params = 4 * 3 + 4 + 2 * 4 + 2;
+    double batch_grads[4 * 3 + 4 + 2 * 4 + 2];
+    double sample_grads[4 * 3 + 4 + 2 * 4 + 2];
+    double mean_grads[4 * 3 + 4 + 2 * 4 + 2] = {0};
+
+    Tensor* X = tensor_create_from_batch(3, 3, 1, x);
+    Tensor* Y = tensor_create_from_batch(3, 2, 1, y);
+    const double batch_loss = train_step_grads(model, X, Y, batch_grads);
+    check("batched output shape", X->n_batch == 3 && X->n_rows == 2 && X->n_cols == 1);
+
+    double mean_loss = 0.0;
+    for (size_t b = 0; b < 3; b++){
+        Tensor* X_b = tensor_create_from_batch(1, 3, 1, x + 3 * b);
+        Tensor* Y_b = tensor_create_from_batch(1, 2, 1, y + 2 * b);
+        mean_loss += train_step_grads(model, X_b, Y_b, sample_grads) / 3.0;
+        for (size_t k = 0; k < num_params; k++) mean_grads[k] += sample_grads[k] / 3.0;
+        tensor_detach(X_b);
+        tensor_detach(Y_b);
+    }
+
+    printf("Batch loss %f, mean sample loss %f\n", batch_loss, mean_loss);
+    check_close("batch loss", mean_loss, batch_loss, TOL);
+    for (size_t k = 0; k < num_params; k++) check_close("batch grad", mean_grads[k], batch_grads[k], TOL);
+
+    tensor_detach(X);
+    tensor_detach(Y);
+    destroy_sequential_nn(model);
+};
+
+int main(void){
+    test_matrix_views();
+    test_inplace_storage();
+    test_broadcasting();
+    test_views();
+    test_custom_ops();
+    test_batched_training_step();
+
+    if (failures){
+        printf("tensor_test: %d checks FAILED\n", failures);
+        return 1;
+    }
+    printf("tensor_test: OK\n");
+    return 0;
+};
@@ -0,0 +1,69 @@
+#ifndef __TEST_UTILS_H__
+#define __TEST_UTILS_H__
+
+#include "matrix.h"
+#include "models.h"
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+Fixtures shared by the tests. Every test is one translation unit, failures counts the checks
+that failed in it.
+*/
+
+static int failures = 0;
+
+void check_close(const char* what, const double expected, const double actual, const double tolerance){
+    if (fabs(expected - actual) > tolerance * (1.0 + fabs(expected))){
+        printf("    FAILED %s: expected %.10f, got %.10f\n", what, expected, actual);
+        failures++;
+    }
+};
+
+void check(const char* what, const int condition){
+    if (!condition){
+        printf("    FAILED %s\n", what);
+        failures++;
+    }
+};
+
+double random_value(void){
+    return (double)rand() / (double)RAND_MAX - 0.5;
+};
+
+void fill_random(Matrix* mat){
+    for (size_t k = 0; k < mat->n_rows * mat->n_cols; k++) mat->data[k] = random_value();
+};
+
+double wall_time(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+};
+
+// Mean L2 loss over the batch, what backward_L2_loss differentiates
+double model_loss(Sequential_NN_* model, const Matrix* X, const Matrix* y){
+    Matrix* a = NULL;
+    matrix_create(&a, X->n_rows, X->n_cols);
+    memcpy(a->data, X->data, X->n_rows * X->n_cols * sizeof(double));
+    forward_sequential_nn_(model, a);
+    double loss = 0.0;
+    for (size_t k = 0; k < a->n_rows * a->n_cols; k++) loss += (a->data[k] - y->data[k]) * (a->data[k] - y->data[k]);
+    matrix_destroy(a);
+    free(a);
+    return loss / (double)X->n_cols;
+};
+
+// Central difference of model_loss in *param against the analytic gradient
+void check_numeric_gradient(const char* what, Sequential_NN_* model, const Matrix* X, const Matrix* y, double* param, const double analytic){
+    const double eps = 1e-5, saved = *param;
+    *param = saved + eps;
+    const double plus = model_loss(model, X, y);
+    *param = saved - eps;
+    const double minus = model_loss(model, X, y);
+    *param = saved;
+    check_close(what, (plus - minus) / (2.0 * eps), analytic, 1e-6);
+};
+
+#endif
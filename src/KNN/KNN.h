@@ -3,9 +3,11 @@
 
 #include "dataset.h"
 #include "k_d_tree.h"
+#include "model_file.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 typedef struct{
 	Dataset* total_dataset;
@@ -13,6 +15,10 @@ typedef struct{
 	Dataset* test_dataset;
 	KDTreeNode* root_node;
 	unsigned char K;
+
+	// Tree searched in place when loaded from a file, see KNN_load
+	KDTreeFlat flat;
+	ModelFile* file;
 }KNN;
 
 KNN* KNN_create(){
@@ -21,6 +27,9 @@ KNN* KNN_create(){
 	knn->train_dataset = NULL;
 	knn->test_dataset = NULL;
 	knn->root_node = NULL;
+	knn->K = 0;
+	memset(&knn->flat, 0, sizeof(KDTreeFlat));
+	knn->file = NULL;
 	return knn;
 };
 
@@ -53,11 +62,16 @@ void KNN_fit(KNN* knn){
 	
 };
 
+// Majority class of the K nearest neighbours, -1 if there is none for p
 int KNN_predict(KNN* knn, Point* p){
-	if (knn->root_node == NULL){
+	if (knn->root_node == NULL && knn->file == NULL){
 		printf("Root node does not exist.\n");
 		exit(1);
 	}
+	if (knn->root_node == NULL && p->dim != knn->flat.dim){
+		printf("Point of dimension %hhu does not match the k-d tree of dimension %hhu.\n", p->dim, knn->flat.dim);
+		return -1;
+	}
 
 	MaxHeap heap;
 	heap.nodes = (HeapNode*) malloc(((unsigned long)knn->K) * sizeof(HeapNode));
@@ -65,7 +79,8 @@ int KNN_predict(KNN* knn, Point* p){
 	heap.capacity = (unsigned short int)(knn->K);
 
 	// Get the K nearest neighbors
-	k_d_tree_get_nns(knn->root_node, p, (unsigned short int)knn->K, &heap, 0);
+	if (knn->root_node != NULL) k_d_tree_get_nns(knn->root_node, p, (unsigned short int)knn->K, &heap, 0);
+	else k_d_tree_flat_get_nns(&knn->flat, 0, p, (unsigned short int)knn->K, &heap, 0);
 	
 	int majority_class = 0;
 	int max_count = 0;
@@ -78,7 +93,12 @@ int KNN_predict(KNN* knn, Point* p){
 	// Count the classes
 	for (unsigned short int i = 0; i < heap.size; i++){
 		// Get the class of the node
-		classes[i] = (int)heap.nodes[i].node->p->class;
+		if (heap.nodes[i].node != NULL) classes[i] = (int)heap.nodes[i].node->p->class;
+		else {
+			// Point classes are unsigned char, anything above comes from a damaged file
+			const uint32_t class = knn->flat.nodes[heap.nodes[i].idx].class;
+			classes[i] = class <= UCHAR_MAX ? (int)class : -1;
+		}
 		ht_increment(ht, (void*)(classes + i));
 	}
 
@@ -107,13 +127,16 @@ void KNN_destroy(KNN** knn){
 	dataset_destroy(&(*knn)->total_dataset);
 	dataset_destroy(&(*knn)->train_dataset);
 
-	for (unsigned short int i = 0; i < (*knn)->test_dataset->vec->size; i++){
-		Point* p = vector_at((*knn)->test_dataset->vec, i);
-		free(p->point);
-		p->point = NULL;
+	if ((*knn)->test_dataset != NULL){
+		for (unsigned short int i = 0; i < (*knn)->test_dataset->vec->size; i++){
+			Point* p = vector_at((*knn)->test_dataset->vec, i);
+			free(p->point);
+			p->point = NULL;
+		}
 	}
 	dataset_destroy(&(*knn)->test_dataset);
 	k_d_tree_node_destroy(&(*knn)->root_node);
+	model_file_unmap((*knn)->file);
 	free(*knn);
 	*knn = NULL;
 };
@@ -134,6 +157,8 @@ Metrics* KNN_evaluate(KNN* knn){
         Point* p = vector_at(knn->test_dataset->vec, i);
 	
         int predicted_class = KNN_predict(knn, p);
+        // -1 or a class the test set does not have, counted as a miss
+        if (predicted_class < 0 || predicted_class >= num_classes) continue;
         if (predicted_class == p->class){
             correct[predicted_class]++;
             true_positives[predicted_class]++;
@@ -157,6 +182,83 @@ Metrics* KNN_evaluate(KNN* knn){
     return metrics;
 };
 
+#pragma region KNN Files
+/*
+A fitted KNN is saved as its flattened k-d tree (see KDTreeFlat) plus K. KNN_load maps the
+file and KNN_predict searches the mapped tree in place, the datasets are not saved.
+*/
+
+#define KNN_SECTION_META 1
+#define KNN_SECTION_NODES 2
+#define KNN_SECTION_POINTS 3
+
+typedef struct {
+	uint32_t num_nodes;
+	uint8_t dim;
+	uint8_t K;
+	uint8_t reserved[2];
+}KNNFileMeta;
+
+char KNN_save(KNN* knn, const char* path){
+	if (knn->root_node == NULL){
+		printf("Root node does not exist.\n");
+		return 0;
+	}
+
+	KNNFileMeta meta;
+	memset(&meta, 0, sizeof(meta));
+	meta.num_nodes = k_d_tree_count(knn->root_node);
+	meta.dim = knn->root_node->p->dim;
+	meta.K = knn->K;
+
+	KDTreeFlatNode* nodes = (KDTreeFlatNode*)malloc(meta.num_nodes * sizeof(KDTreeFlatNode));
+	float* points = (float*)malloc((size_t)meta.num_nodes * meta.dim * sizeof(float));
+	uint32_t next = 0;
+	k_d_tree_flatten(knn->root_node, nodes, points, &next);
+
+	ModelFileChunk chunks[3] = {
+		{KNN_SECTION_META, &meta, sizeof(meta)},
+		{KNN_SECTION_NODES, nodes, meta.num_nodes * sizeof(KDTreeFlatNode)},
+		{KNN_SECTION_POINTS, points, (uint64_t)meta.num_nodes * meta.dim * sizeof(float)},
+	};
+	const char ok = model_file_write(path, MODEL_FILE_KIND_KNN, chunks, 3);
+	free(nodes);
+	free(points);
+	return ok;
+};
+
+// Maps a saved KNN, returns NULL if the file cannot be used
+KNN* KNN_load(const char* path){
+	ModelFile* file = model_file_map(path, MODEL_FILE_KIND_KNN);
+	if (file == NULL) return NULL;
+
+	uint64_t meta_size = 0, nodes_size = 0, points_size = 0;
+	const KNNFileMeta* meta = (const KNNFileMeta*)model_file_section(file, KNN_SECTION_META, &meta_size);
+	const KDTreeFlatNode* nodes = (const KDTreeFlatNode*)model_file_section(file, KNN_SECTION_NODES, &nodes_size);
+	const float* points = (const float*)model_file_section(file, KNN_SECTION_POINTS, &points_size);
+
+	char ok = meta != NULL && nodes != NULL && points != NULL && meta_size == sizeof(KNNFileMeta);
+	ok = ok && meta->num_nodes > 0 && meta->dim > 0;
+	ok = ok && nodes_size == meta->num_nodes * sizeof(KDTreeFlatNode);
+	ok = ok && points_size == (uint64_t)meta->num_nodes * meta->dim * sizeof(float);
+	if (!ok){
+		printf("Model file %s has no valid k-d tree.\n", path);
+		model_file_unmap(file);
+		return NULL;
+	}
+
+	KNN* knn = KNN_create();
+	knn->K = meta->K;
+	knn->flat.num_nodes = meta->num_nodes;
+	knn->flat.dim = meta->dim;
+	knn->flat.nodes = nodes;
+	knn->flat.points = points;
+	knn->file = file;
+	return knn;
+};
+
+#pragma endregion KNN Files
+
 void KNN_run(KNN* knn, KNN_Config* config){
 	// Load configs
 	unsigned char k = config->k;
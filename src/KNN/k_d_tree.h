@@ -5,6 +5,7 @@
 #include "utils.h"
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -207,7 +208,7 @@ void k_d_tree_get_nns(KDTreeNode* root, Point* target, unsigned short int k, Max
     if (root == NULL) return;
 
     float dist = point_calc_dist(root->p, target);
-    HeapNode hn = { dist, root};
+    HeapNode hn = {dist, root, 0};
     insert_max_heap(heap, &hn);
 
     unsigned char axis = depth % root->p->dim;
@@ -252,4 +253,81 @@ void k_d_tree_assign_classes_uniform(KDTreeNode* root, unsigned char c){
     k_d_tree_assign_classes_uniform(root->right, c);
 };
 
-#endif
\ No newline at end of file
+#pragma region Flat K-D Tree
+/*
+A k-d tree flattened into arrays, the form it has in a model file (see KNN_save):
+nodes in preorder with the indices of their children, and the coordinates of node i at
+points[i * dim]. Nothing in it is a pointer, so a mapped file is searched in place. Child
+indices are bounds checked during the search rather than on load, loading never reads the tree.
+*/
+
+#define KD_TREE_FLAT_NULL UINT32_MAX
+
+typedef struct {
+    uint32_t left;
+    uint32_t right;
+    uint32_t class;
+}KDTreeFlatNode;
+
+typedef struct {
+    uint32_t num_nodes;
+    unsigned char dim;
+    const KDTreeFlatNode* nodes;
+    const float* points;
+}KDTreeFlat;
+
+uint32_t k_d_tree_count(KDTreeNode* node){
+    if (node == NULL) return 0;
+    return 1 + k_d_tree_count(node->left) + k_d_tree_count(node->right);
+};
+
+// Writes node and its subtrees from index *next on, returns the index of node
+uint32_t k_d_tree_flatten(KDTreeNode* node, KDTreeFlatNode* nodes, float* points, uint32_t* next){
+    if (node == NULL) return KD_TREE_FLAT_NULL;
+
+    const uint32_t idx = (*next)++;
+    memcpy(points + (size_t)idx * node->p->dim, node->p->point, node->p->dim * sizeof(float));
+    nodes[idx].class = node->p->class;
+    nodes[idx].left = k_d_tree_flatten(node->left, nodes, points, next);
+    nodes[idx].right = k_d_tree_flatten(node->right, nodes, points, next);
+    return idx;
+};
+
+// Same distance as point_calc_dist
+float k_d_tree_flat_dist(const float* point, Point* target, const unsigned char dim){
+    float total = 0.0f;
+    for (unsigned char i = 0; i < dim; i++){
+        total += powf(point[i] - target->point[i], 2.0f);
+    }
+    return sqrtf(total);
+};
+
+// k_d_tree_get_nns on the flat tree, the heap holds node indices
+void k_d_tree_flat_get_nns(const KDTreeFlat* tree, const uint32_t idx, Point* target, unsigned short int k, MaxHeap* heap, unsigned char depth){
+    // Also stops at child indices a damaged file points past the end with
+    if (idx >= tree->num_nodes) return;
+
+    const float* point = tree->points + (size_t)idx * tree->dim;
+    float dist = k_d_tree_flat_dist(point, target, tree->dim);
+    HeapNode hn = {dist, NULL, idx};
+    insert_max_heap(heap, &hn);
+
+    unsigned char axis = depth % tree->dim;
+    uint32_t nextBranch = tree->nodes[idx].right;
+    uint32_t otherBranch = tree->nodes[idx].left;
+    if (target->point[axis] < point[axis]) {
+        nextBranch = tree->nodes[idx].left;
+        otherBranch = tree->nodes[idx].right;
+    }
+
+    // Preorder, children always come after their parent
+    if (nextBranch > idx) k_d_tree_flat_get_nns(tree, nextBranch, target, k, heap, depth + 1);
+
+    if (otherBranch > idx && (heap->size < k || fabsf(point[axis] - target->point[axis]) < heap->nodes[0].dist)) {
+        k_d_tree_flat_get_nns(tree, otherBranch, target, k, heap, depth + 1);
+    }
+};
+
+#pragma endregion Flat K-D Tree
+
+#endif
@@ -12,18 +12,104 @@ typedef struct {
     double grad;
 } Dual;
 
+// Reference counted buffer backing the values and gradients of many nodes.
+// Nodes bound to a storage keep it alive; it is freed with its last reference.
+// Storages created without gradients (grads == NULL) hold a single slab of doubles.
+// A view (see ad_storage_view) covers a range of its parent and keeps the parent alive.
+typedef struct ADStorage{
+    double* values;
+    double* grads;
+    size_t size;
+    size_t ref_count;
+    struct ADStorage* parent;
+}ADStorage;
+
+ADStorage* ad_storage_new(const size_t size, const char with_grads){
+    ADStorage* storage = (ADStorage*)malloc(sizeof(ADStorage));
+    if (storage == NULL){
+        printf("Failed to allocate memory for AD Storage.\n");
+        exit(1);
+    }
+
+    storage->values = (double*)calloc(size ? size : 1, sizeof(double));
+    storage->grads = with_grads ? (double*)calloc(size ? size : 1, sizeof(double)) : NULL;
+    if (storage->values == NULL || (with_grads && storage->grads == NULL)){
+        printf("Failed to allocate memory for AD Storage buffers.\n");
+        exit(1);
+    }
+
+    storage->size = size;
+    storage->ref_count = 1;
+    storage->parent = NULL;
+    return storage;
+};
+
+// size values (and grads) of parent starting at offset, e.g. one tensor in a flat parameter buffer
+ADStorage* ad_storage_view(ADStorage* parent, const size_t offset, const size_t size){
+    if (parent == NULL || offset + size > parent->size){
+        printf("Storage view [%lu, %lu) is out of range.\n", offset, offset + size);
+        exit(1);
+    }
+
+    ADStorage* storage = (ADStorage*)malloc(sizeof(ADStorage));
+    if (storage == NULL){
+        printf("Failed to allocate memory for AD Storage.\n");
+        exit(1);
+    }
+
+    storage->values = parent->values + offset;
+    storage->grads = parent->grads ? parent->grads + offset : NULL;
+    storage->size = size;
+    storage->ref_count = 1;
+    storage->parent = parent;
+    parent->ref_count++;
+    return storage;
+};
+
+void ad_storage_retain(ADStorage* storage){
+    if (storage) storage->ref_count++;
+};
+
+// Atomic: backward workers may release nodes of the same storage concurrently
+void ad_storage_release(ADStorage* storage){
+    if (storage == NULL) return;
+    if (__atomic_sub_fetch(&storage->ref_count, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+    if (storage->parent){
+        ad_storage_release(storage->parent);
+        free(storage);
+        return;
+    }
+
+    free(storage->values);
+    free(storage->grads);
+    free(storage);
+};
+
 // Node in the computational graph
 typedef struct ADNode {
     struct ADNode* self;
     struct ADNode** parents;
+
+    // value and grad point either to the inline data or into a storage
     Dual data;
+    double* value;
+    double* grad;
+    ADStorage* storage;
+
     size_t num_parents;
     size_t topology_idx;
     char visited;
     char is_trainable;
+    char is_constant;
     int depth;
 
+    // Kernel specific data (e.g. fused kernels), owned by the node
+    void* ctx;
+    size_t ctx_size;
+
     // Methods
+        void (*forward)(struct ADNode* self);
         void (*backward)(struct ADNode* self);
         void (*destroy)(struct ADNode* self);
         void (*set_val)(struct ADNode* self, const double val);
@@ -51,6 +137,9 @@ ADNode* node_new(const double value, const size_t num_parents, char is_trainable
     ADNode* node = (ADNode*)malloc(sizeof(ADNode));
     node->data.value = value;
     node->data.grad = 0.0;
+    node->value = &node->data.value;
+    node->grad = &node->data.grad;
+    node->storage = NULL;
     node->num_parents = num_parents;
     
     if (num_parents > 0) {
@@ -61,6 +150,10 @@ ADNode* node_new(const double value, const size_t num_parents, char is_trainable
 
     //Set Methods
     node->is_trainable = is_trainable;
+    node->is_constant = 0;
+    node->ctx = NULL;
+    node->ctx_size = 0;
+    node->forward = NULL;
     node->backward = NULL;
     node->visited = 0;
     node->init = node_init;
@@ -68,13 +161,20 @@ ADNode* node_new(const double value, const size_t num_parents, char is_trainable
     return node;
 };
 
+// Leaf holding a value that never changes between steps (scalars, masks, ...)
+ADNode* node_new_constant(const double value){
+    ADNode* node = node_new(value, 0, 0);
+    node->is_constant = 1;
+    return node;
+};
+
 ADNode* node_copy(ADNode* self){
     if (self == NULL){
         printf("Node to be copied is pointing to NULL.\n");
         return NULL;
     }
 
-    ADNode* node = node_new(self->data.value, self->num_parents, self->is_trainable); 
+    ADNode* node = node_new(*self->value, self->num_parents, self->is_trainable); 
     
     if (node == NULL){
         printf("Failed to allocate memory for AD Node.\n");
@@ -86,9 +186,17 @@ ADNode* node_copy(ADNode* self){
     node->visited = self->visited;
     
     // Data
-    node->data.grad = self->data.grad;
+    *node->grad = *self->grad;
+    node->is_constant = self->is_constant;
+
+    if (self->ctx){
+        node->ctx = malloc(self->ctx_size);
+        memcpy(node->ctx, self->ctx, self->ctx_size);
+        node->ctx_size = self->ctx_size;
+    }
     
     // Methods
+    node->forward = self->forward;
     node->backward = self->backward;
     node->init(node);
     
@@ -103,62 +211,449 @@ ADNode* node_copy(ADNode* self){
     return node;
 };
 
+// Move value and grad of a node to new locations inside storage (NULL: inline data).
+// The current value and gradient are carried over.
+void node_set_storage(ADNode* self, ADStorage* storage, double* value, double* grad){
+    const double current_value = *self->value;
+    const double current_grad = *self->grad;
+
+    ad_storage_retain(storage);
+    ADStorage* previous = self->storage;
+
+    self->storage = storage;
+    self->value = storage ? value : &self->data.value;
+    self->grad = storage ? grad : &self->data.grad;
+    *self->value = current_value;
+    *self->grad = current_grad;
+
+    ad_storage_release(previous);
+};
+
 void node_destroy(ADNode* self){
     if (self){
+        ad_storage_release(self->storage);
+        self->storage = NULL;
+
         if (self->parents){
             free(self->parents);
             self->parents = NULL;
         }
 
+        if (self->ctx){
+            free(self->ctx);
+            self->ctx = NULL;
+        }
+
         free(self);
     }
 };
 
+// Basic forward operations
+// Recompute the value of a node from the current values of its parents.
+// Used when a captured graph is replayed without rebuilding its nodes.
+void forward_add(ADNode* node){
+    double sum = 0.0;
+    for (size_t i = 0; i < node->num_parents; i++){
+        sum += *node->parents[i]->value;
+    }
+    *node->value = sum;
+};
+
+void forward_multiply(ADNode* node){
+    double prod = 1.0;
+    for (size_t i = 0; i < node->num_parents; i++){
+        prod *= *node->parents[i]->value;
+    }
+    *node->value = prod;
+};
+
+void forward_subtract(ADNode* node){
+    *node->value = *node->parents[0]->value - *node->parents[1]->value;
+};
+
+void forward_sqrt(ADNode* node){
+    *node->value = sqrt(*node->parents[0]->value);
+};
+
+void forward_exp(ADNode* node){
+    *node->value = exp(*node->parents[0]->value);
+};
+
+void forward_log(ADNode* node){
+    *node->value = log(*node->parents[0]->value);
+};
+
+void forward_sigmoid(ADNode* node){
+    *node->value = 1/(1 + exp(-(*node->parents[0]->value)));
+};
+
+void forward_tanh(ADNode* node){
+    *node->value = tanh(*node->parents[0]->value);
+};
+
+void forward_relu(ADNode* node){
+    const double x = *node->parents[0]->value;
+    *node->value = x > 0 ? x : 0.0;
+};
+
+void forward_abs(ADNode* node){
+    *node->value = fabs(*node->parents[0]->value);
+};
+
+// Gradient accumulation used by all backward kernels.
+// The parallel backward executor (compute_graph.h) points these at the per-thread partial
+// gradients of its worker; nodes receiving gradients from several consumers are then summed
+// per thread and reduced once all consumers are done. Outside of it they stay NULL.
+static __thread double* ad_grad_partials = NULL;
+static __thread const char* ad_grad_fan_in = NULL;
+
+static inline void node_accumulate_grad(ADNode* node, const double delta){
+    if (ad_grad_partials && ad_grad_fan_in[node->topology_idx]) ad_grad_partials[node->topology_idx] += delta;
+    else *node->grad += delta;
+};
+
 // Basic backward operations
 void backward_add(ADNode* node){
     for (size_t i = 0; i < node->num_parents; i++){
-        node->parents[i]->data.grad += node->data.grad;
+        node_accumulate_grad(node->parents[i], *node->grad);
     }
 };
 
 void backward_sqrt(ADNode* node){
-    const double da_dzi = 0.5 * (1.0 / sqrt(node->get_grad(node)));
-    node->parents[0]->data.grad += node->get_grad(node) * da_dzi;
+    const double da_dzi = 0.5 / node->get_val(node);
+    node_accumulate_grad(node->parents[0], node->get_grad(node) * da_dzi);
 };
 
 void backward_multiply(ADNode* node){
+    // d(prod)/dz_i is the product of all other factors; dividing the
+    // output by z_i breaks down as soon as one factor is zero
     for (size_t i = 0; i < node->num_parents; i++){
-        const double da_dzi = node->get_val(node) / node->parents[i]->data.value;
-        node->parents[i]->data.grad += node->get_grad(node) * da_dzi;
+        double da_dzi = 1.0;
+        for (size_t k = 0; k < node->num_parents; k++){
+            if (k == i) continue;
+            da_dzi *= *node->parents[k]->value;
+        }
+        node_accumulate_grad(node->parents[i], node->get_grad(node) * da_dzi);
     }
 
 };
 
 void backward_exp(ADNode* node){
-    const double da_dzi = exp(node->get_val(node));
-    node->parents[0]->data.grad += da_dzi;
+    const double da_dzi = node->get_val(node);
+    node_accumulate_grad(node->parents[0], node->get_grad(node) * da_dzi);
 };
 
 void backward_log(ADNode* node){
-    const double da_dzi = 1.0 / node->get_val(node);
-    node->parents[0]->data.grad += node->get_grad(node) * da_dzi;
+    const double da_dzi = 1.0 / (*node->parents[0]->value);
+    node_accumulate_grad(node->parents[0], node->get_grad(node) * da_dzi);
 };
 
 void backward_subtract(ADNode* node){
-    node->parents[0]->data.grad += node->get_grad(node);
-    node->parents[1]->data.grad -= node->get_grad(node);
+    node_accumulate_grad(node->parents[0], node->get_grad(node));
+    node_accumulate_grad(node->parents[1], -node->get_grad(node));
 };
 
 void backward_sigmoid(ADNode* node){
     const double da_dzi = node->get_val(node) * (1 - node->get_val(node));
-    node->parents[0]->data.grad += node->get_grad(node) * da_dzi;
+    node_accumulate_grad(node->parents[0], node->get_grad(node) * da_dzi);
 };
 
 void backward_tanh(ADNode* self){
-    const double da_dzi = 1 - pow(tanh(self->get_val(self)), 2);
-    self->parents[0]->data.grad += self->get_grad(self) * da_dzi;
+    const double da_dzi = 1 - pow(self->get_val(self), 2);
+    node_accumulate_grad(self->parents[0], self->get_grad(self) * da_dzi);
 }
 
+void backward_relu(ADNode* node){
+    if (node->get_val(node) <= 0) return;
+    node_accumulate_grad(node->parents[0], node->get_grad(node));
+};
+
+void backward_abs(ADNode* node){
+    const double da_dzi = *node->parents[0]->value < 0 ? -1.0 : 1.0;
+    node_accumulate_grad(node->parents[0], node->get_grad(node) * da_dzi);
+};
+
+
+#pragma region Fused Kernels
+/*
+Fused elementwise kernel produced by graph_optimize.
+
+A fused node evaluates
+
+    a = op_k( ... op_1( sum_p w_p * x_p + sum_a addend_a ) ... )
+
+in one sweep. Its parents are laid out as [w_0, x_0, ..., w_{P-1}, x_{P-1}, addend_0, ...].
+This covers matmul -> bias add -> activation chains as well as plain chains of unary ops
+(zero pairs, one addend). Intermediate values of the op chain are recomputed on backward.
+*/
+#define FUSED_MAX_OPS 8
+
+typedef enum {
+    FUSED_RELU,
+    FUSED_SIGMOID,
+    FUSED_TANH,
+    FUSED_EXP,
+    FUSED_LOG,
+    FUSED_SQRT,
+    FUSED_ABS,
+}FusedOp;
+
+typedef struct {
+    size_t num_pairs;
+    size_t num_addends;
+    size_t num_ops;
+    FusedOp ops[FUSED_MAX_OPS];
+}FusedCtx;
+
+static double fused_apply(const FusedOp op, const double x){
+    switch(op){
+        case FUSED_RELU: return x > 0 ? x : 0.0;
+        case FUSED_SIGMOID: return 1/(1 + exp(-x));
+        case FUSED_TANH: return tanh(x);
+        case FUSED_EXP: return exp(x);
+        case FUSED_LOG: return log(x);
+        case FUSED_SQRT: return sqrt(x);
+        case FUSED_ABS: return fabs(x);
+    }
+    return x;
+};
+
+// Derivative of op at input x with output y
+static double fused_derivative(const FusedOp op, const double x, const double y){
+    switch(op){
+        case FUSED_RELU: return y > 0 ? 1.0 : 0.0;
+        case FUSED_SIGMOID: return y * (1 - y);
+        case FUSED_TANH: return 1 - y * y;
+        case FUSED_EXP: return y;
+        case FUSED_LOG: return 1.0 / x;
+        case FUSED_SQRT: return 0.5 / y;
+        case FUSED_ABS: return x < 0 ? -1.0 : 1.0;
+    }
+    return 1.0;
+};
+
+static double fused_pre_activation(ADNode* node, const FusedCtx* ctx){
+    double z = 0.0;
+    for (size_t p = 0; p < ctx->num_pairs; p++){
+        z += *node->parents[2 * p]->value * (*node->parents[2 * p + 1]->value);
+    }
+    for (size_t a = 0; a < ctx->num_addends; a++){
+        z += *node->parents[2 * ctx->num_pairs + a]->value;
+    }
+    return z;
+};
+
+void forward_fused(ADNode* node){
+    const FusedCtx* ctx = (const FusedCtx*)node->ctx;
+    double z = fused_pre_activation(node, ctx);
+    for (size_t k = 0; k < ctx->num_ops; k++){
+        z = fused_apply(ctx->ops[k], z);
+    }
+    *node->value = z;
+};
+
+void backward_fused(ADNode* node){
+    const FusedCtx* ctx = (const FusedCtx*)node->ctx;
+    double chain[FUSED_MAX_OPS + 1];
+
+    chain[0] = fused_pre_activation(node, ctx);
+    for (size_t k = 0; k < ctx->num_ops; k++){
+        chain[k + 1] = fused_apply(ctx->ops[k], chain[k]);
+    }
+
+    double g = *node->grad;
+    for (size_t k = ctx->num_ops; k-- > 0;){
+        g *= fused_derivative(ctx->ops[k], chain[k], chain[k + 1]);
+    }
+
+    for (size_t p = 0; p < ctx->num_pairs; p++){
+        ADNode* w = node->parents[2 * p];
+        ADNode* x = node->parents[2 * p + 1];
+        node_accumulate_grad(w, g * (*x->value));
+        node_accumulate_grad(x, g * (*w->value));
+    }
+    for (size_t a = 0; a < ctx->num_addends; a++){
+        node_accumulate_grad(node->parents[2 * ctx->num_pairs + a], g);
+    }
+};
+#pragma endregion Fused Kernels
+
+#pragma region Custom Ops
+/*
+Registered ops working on whole buffers
+
+The kernels above cost one node per scalar. A registered op instead runs a vectorized forward
+and backward over all of its inputs in one graph node. One light output node per result hands
+the values on to the regular kernels:
+
+    static const ADOpDef def = {"softmax", softmax_forward, softmax_backward};
+    const size_t op = ad_op_register(&def);
+    node_apply_op(op, inputs, n, outputs, n, &params, sizeof(params));
+
+    forward   out[0..n_out) = f(params, in[0..n_in))
+    backward  grad_in[0..n_in) = J^T grad_out, grad_in is zeroed before the call
+
+The op node keeps the inputs of its last forward in its own buffer and collects the gradients
+of its outputs there, so neither its backward nor the output nodes read other node values. Its
+backward clears the collected gradients again.
+Registering a name again returns the existing op.
+*/
+#define AD_MAX_OPS 64
+
+typedef void (*ADOpForward)(const void* params, const double* in, const size_t n_in, double* out, const size_t n_out);
+typedef void (*ADOpBackward)(const void* params, const double* in, const size_t n_in, const double* out,
+                             const double* grad_out, const size_t n_out, double* grad_in);
+
+typedef struct {
+    const char* name;
+    ADOpForward forward;
+    ADOpBackward backward;
+}ADOpDef;
+
+static ADOpDef ad_op_registry[AD_MAX_OPS];
+static size_t ad_num_ops = 0;
+
+// Index of the op registered under name, AD_MAX_OPS if there is none
+size_t ad_op_lookup(const char* name){
+    for (size_t i = 0; i < ad_num_ops; i++){
+        if (strcmp(ad_op_registry[i].name, name) == 0) return i;
+    }
+    return AD_MAX_OPS;
+};
+
+size_t ad_op_register(const ADOpDef* def){
+    if (def == NULL || def->name == NULL || def->forward == NULL || def->backward == NULL){
+        printf("Op definitions need a name, a forward and a backward kernel.\n");
+        exit(0);
+    }
+
+    const size_t existing = ad_op_lookup(def->name);
+    if (existing != AD_MAX_OPS) return existing;
+
+    if (ad_num_ops == AD_MAX_OPS){
+        printf("Cannot register op %s, the registry holds %d ops.\n", def->name, AD_MAX_OPS);
+        exit(1);
+    }
+    ad_op_registry[ad_num_ops] = *def;
+    return ad_num_ops++;
+};
+
+// ctx of an op node, followed by the params (padded to doubles) and the buffers
+// in[n_in], out[n_out], grad_out[n_out], grad_in[n_in]
+typedef struct {
+    size_t op;
+    size_t n_in;
+    size_t n_out;
+    size_t params_size;
+}ADOpCtx;
+
+// ctx of an output node
+typedef struct {
+    size_t index;
+}ADOpOutputCtx;
+
+static void* ad_op_params(ADOpCtx* ctx){
+    return (char*)ctx + sizeof(ADOpCtx);
+};
+
+static double* ad_op_in(ADOpCtx* ctx){
+    return (double*)((char*)ad_op_params(ctx) + ctx->params_size);
+};
+
+static double* ad_op_out(ADOpCtx* ctx){
+    return ad_op_in(ctx) + ctx->n_in;
+};
+
+static double* ad_op_grad_out(ADOpCtx* ctx){
+    return ad_op_out(ctx) + ctx->n_out;
+};
+
+static double* ad_op_grad_in(ADOpCtx* ctx){
+    return ad_op_grad_out(ctx) + ctx->n_out;
+};
+
+void forward_op(ADNode* node){
+    ADOpCtx* ctx = (ADOpCtx*)node->ctx;
+    double* in = ad_op_in(ctx);
+    for (size_t k = 0; k < ctx->n_in; k++){
+        in[k] = *node->parents[k]->value;
+    }
+    ad_op_registry[ctx->op].forward(ad_op_params(ctx), in, ctx->n_in, ad_op_out(ctx), ctx->n_out);
+};
+
+void backward_op(ADNode* node){
+    ADOpCtx* ctx = (ADOpCtx*)node->ctx;
+    double* grad_in = ad_op_grad_in(ctx);
+    memset(grad_in, 0, ctx->n_in * sizeof(double));
+    ad_op_registry[ctx->op].backward(ad_op_params(ctx), ad_op_in(ctx), ctx->n_in, ad_op_out(ctx),
+                                     ad_op_grad_out(ctx), ctx->n_out, grad_in);
+    // Outputs the next pass does not reach contribute nothing to it
+    memset(ad_op_grad_out(ctx), 0, ctx->n_out * sizeof(double));
+
+    for (size_t k = 0; k < ctx->n_in; k++){
+        node_accumulate_grad(node->parents[k], grad_in[k]);
+    }
+};
+
+void forward_op_output(ADNode* node){
+    ADOpCtx* op = (ADOpCtx*)node->parents[0]->ctx;
+    *node->value = ad_op_out(op)[((ADOpOutputCtx*)node->ctx)->index];
+};
+
+// Every output runs before the op node in the backward schedule
+void backward_op_output(ADNode* node){
+    ADOpCtx* op = (ADOpCtx*)node->parents[0]->ctx;
+    ad_op_grad_out(op)[((ADOpOutputCtx*)node->ctx)->index] = *node->grad;
+};
+
+// One op node over inputs[0..n_in), outputs receives its n_out output nodes.
+// params are copied into the node.
+ADNode* node_apply_op(const size_t op, ADNode** inputs, const size_t n_in, ADNode** outputs, const size_t n_out,
+                      const void* params, const size_t params_size){
+    if (op >= ad_num_ops){
+        printf("Op %lu is not registered.\n", op);
+        exit(0);
+    }
+
+    const size_t padded = (params_size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+    const size_t ctx_size = sizeof(ADOpCtx) + padded + 2 * (n_in + n_out) * sizeof(double);
+    ADOpCtx* ctx = (ADOpCtx*)calloc(1, ctx_size);
+    if (ctx == NULL){
+        printf("Failed to allocate memory for op %s.\n", ad_op_registry[op].name);
+        exit(1);
+    }
+    ctx->op = op;
+    ctx->n_in = n_in;
+    ctx->n_out = n_out;
+    ctx->params_size = padded;
+    if (params_size) memcpy(ad_op_params(ctx), params, params_size);
+
+    ADNode* node = node_new(0.0, n_in, 0);
+    memcpy(node->parents, inputs, n_in * sizeof(ADNode*));
+    node->ctx = ctx;
+    node->ctx_size = ctx_size;
+    node->forward = forward_op;
+    node->backward = backward_op;
+    forward_op(node);
+
+    for (size_t i = 0; i < n_out; i++){
+        ADNode* output = node_new(ad_op_out(ctx)[i], 1, 0);
+        output->parents[0] = node;
+        output->ctx = malloc(sizeof(ADOpOutputCtx));
+        if (output->ctx == NULL){
+            printf("Failed to allocate memory for op %s.\n", ad_op_registry[op].name);
+            exit(1);
+        }
+        ((ADOpOutputCtx*)output->ctx)->index = i;
+        output->ctx_size = sizeof(ADOpOutputCtx);
+        output->forward = forward_op_output;
+        output->backward = backward_op_output;
+        outputs[i] = output;
+    }
+    return node;
+};
+#pragma endregion Custom Ops
+
 // ... (other operations will be added here)
 
 // Function prototypes
@@ -183,19 +678,19 @@ void node_set_parent(ADNode* self, ADNode* parent, const size_t parent_idx){
 };
 
 void node_set_val(ADNode* self, const double val){
-    self->data.value = val;
+    *self->value = val;
 };
 
 void node_set_grad(ADNode* self, const double grad){
-    self->data.grad = grad;
+    *self->grad = grad;
 };
 
 double node_get_val(ADNode* self){
-    return self->data.value;
+    return *self->value;
 };
 
 static double node_get_grad(ADNode* self){
-    return self->data.grad;
+    return *self->grad;
 }
 
 ADNode* node_add(ADNode* self, ADNode* node){
@@ -204,6 +699,7 @@ ADNode* node_add(ADNode* self, ADNode* node){
 
     result->parents[0] = self;
     result->parents[1] = node;
+    result->forward = forward_add;
     result->backward = backward_add;
     return result;
 };
@@ -213,6 +709,7 @@ ADNode* node_multiply(ADNode* self, ADNode* node){
 
     result->parents[0] = self;
     result->parents[1] = node;
+    result->forward = forward_multiply;
     result->backward = backward_multiply;
     return result;
 };
@@ -220,6 +717,7 @@ ADNode* node_multiply(ADNode* self, ADNode* node){
 ADNode* node_sqrt(ADNode* self){
     ADNode* result = node_new(sqrt(self->get_val(self)), 1, 0);
     result->parents[0] = self;
+    result->forward = forward_sqrt;
     result->backward = backward_sqrt;
     return result;
 };
@@ -227,6 +725,7 @@ ADNode* node_sqrt(ADNode* self){
 ADNode* node_exp(ADNode* self){
     ADNode* result = node_new(exp(self->get_val(self)), 1, 0);
     result->parents[0] = self;
+    result->forward = forward_exp;
     result->backward = backward_exp;
     return result;
 };
@@ -234,6 +733,7 @@ ADNode* node_exp(ADNode* self){
 ADNode* node_log(ADNode* self){
     ADNode* result = node_new(log(self->get_val(self)), 1, 0);
     result->parents[0] = self;
+    result->forward = forward_log;
     result->backward = backward_log;
     return result;
 };
@@ -241,6 +741,7 @@ ADNode* node_log(ADNode* self){
 ADNode* node_sigmoid(ADNode* self){
     ADNode* result = node_new(1/(1 + exp(-self->get_val(self))), 1, 0);
     result->parents[0] = self;
+    result->forward = forward_sigmoid;
     result->backward = backward_sigmoid;
     return result;
 };
@@ -248,6 +749,7 @@ ADNode* node_sigmoid(ADNode* self){
 ADNode* node_tanh(ADNode* self){
     ADNode* result = node_new(tanh(self->get_val(self)), 1, 0);
     result->parents[0] = self;
+    result->forward = forward_tanh;
     result->backward = backward_tanh;
     return result;
 };
@@ -256,10 +758,27 @@ ADNode* node_subtract(ADNode* self, ADNode* node){
     ADNode* result = node_new(self->get_val(self) - node->get_val(node), 2, 0);
     result->parents[0] = self;
     result->parents[1] = node;
+    result->forward = forward_subtract;
     result->backward = backward_subtract;
     return result;
 };
 
+ADNode* node_relu(ADNode* self){
+    ADNode* result = node_new(self->get_val(self) > 0 ? self->get_val(self) : 0.0, 1, 0);
+    result->parents[0] = self;
+    result->forward = forward_relu;
+    result->backward = backward_relu;
+    return result;
+};
+
+ADNode* node_abs(ADNode* self){
+    ADNode* result = node_new(fabs(self->get_val(self)), 1, 0);
+    result->parents[0] = self;
+    result->forward = forward_abs;
+    result->backward = backward_abs;
+    return result;
+};
+
 void node_init(ADNode* self){
     self->destroy = node_destroy;
     self->set_val = node_set_val;
@@ -269,6 +788,11 @@ void node_init(ADNode* self){
     self->get_grad = node_get_grad;
 
     self->copy = node_copy;
+    self->sqrt = node_sqrt;
+    self->exp = node_exp;
+    self->log = node_log;
+    self->sigmoid = node_sigmoid;
+    self->tanh = node_tanh;
 };
 
 #pragma region Computation Graph
@@ -3,6 +3,17 @@
 
 #include "autodifferentation.h"
 #include "optimizer.h"
+#include "memory_planner.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 // ADNODE GRAPH IMPLEMENTATION
 // Graph Structure
@@ -14,6 +25,33 @@ typedef struct ComputeGraph{
     size_t capacity;
     Adam_Optimizer* optimizer;
 
+    // Captured schedules (see graph_capture)
+    ADNode** forward_schedule;
+    size_t forward_len;
+    ADNode** backward_schedule;
+    size_t backward_len;
+    char is_captured;
+
+    // Static memory plan (see graph_plan_memory)
+    ADStorage* slab;
+    struct NodeBinding* plan_bindings;  // locations of the planned nodes before planning
+    size_t num_plan_bindings;
+    ADNode** zero_list;       // gradients reset right before each backward step
+    size_t* zero_begin;       // zero_list offsets per backward step, backward_len + 1 entries
+    size_t planned_bytes;
+    size_t unplanned_bytes;
+
+    // Parallel backward state, built on first use (see graph_replay_backward_parallel)
+    struct ParallelBackward* parallel;
+
+    // Free intermediates during backward (see graph_replay_backward_eager)
+    char eager_release;
+    size_t released_nodes;
+    size_t released_bytes;
+
+    // Compiled replay, NULL while interpreted (see graph_jit_compile)
+    struct GraphJIT* jit;
+
     void (*add_node)(struct ComputeGraph* self, ADNode* node);
     void (*destroy)(struct ComputeGraph* self);
     void (*sort)(struct ComputeGraph* self);
@@ -21,10 +59,22 @@ typedef struct ComputeGraph{
     void (*prune)(struct ComputeGraph* self);
     void (*optimize)(struct ComputeGraph* self);
     void (*build)(struct ComputeGraph* self, ADNode* output);
+    void (*capture)(struct ComputeGraph* self, ADNode* output);
+    void (*replay_forward)(struct ComputeGraph* self);
+    void (*replay_backward)(struct ComputeGraph* self);
+    void (*zero_grad)(struct ComputeGraph* self);
+    void (*plan_memory)(struct ComputeGraph* self);
 
 }ComputeGraph;  
 
 
+void graph_release_plan(ComputeGraph* self);
+void graph_release_parallel(ComputeGraph* self);
+void graph_release_jit(ComputeGraph* self);
+static void graph_jit_replay(ComputeGraph* self, const char backward);
+static char graph_node_is_owned(ADNode* node);
+static size_t graph_node_bytes(ADNode* node);
+
 // Graph Operations
 void add_node_to_graph(ComputeGraph* self, ADNode* node){
     if (self->num_nodes == self->capacity){
@@ -36,17 +86,30 @@ void add_node_to_graph(ComputeGraph* self, ADNode* node){
 
 void graph_prune(ComputeGraph* self){
     if (self){
+        graph_release_plan(self);
         for (size_t i = 0; i < self->num_nodes; i++){
             ADNode* node = self->nodes[i];
             if (node->is_trainable) continue;
             node->destroy(node);
         }
-        free(self->nodes);
+        // Keep the node buffer for the next build
+        self->num_nodes = 0;
+
+        // Schedules point to destroyed nodes
+        graph_release_parallel(self);
+        free(self->forward_schedule);
+        self->forward_schedule = NULL;
+        self->forward_len = 0;
+        free(self->backward_schedule);
+        self->backward_schedule = NULL;
+        self->backward_len = 0;
+        self->is_captured = 0;
     }
 };
 
 void graph_destroy(ComputeGraph* self){
     if (self){
+        graph_release_plan(self);
         for (size_t i = 0; i < self->num_nodes; i++){
             ADNode* node = self->nodes[i];
             node->destroy(node);
@@ -54,8 +117,13 @@ void graph_destroy(ComputeGraph* self){
 
         }
         
+        graph_release_parallel(self);
         free(self->nodes);
         self->nodes = NULL;
+        free(self->forward_schedule);
+        self->forward_schedule = NULL;
+        free(self->backward_schedule);
+        self->backward_schedule = NULL;
         free(self);
     }
 };
@@ -212,7 +280,7 @@ void graph_propagate_back(ComputeGraph* self){
     // DFS more memory-efficient for balanced tree
     // runtime complexity same for both O(V + E)
     // Set gradient of the output Node to 1
-    self->head->data.grad = 1.0;
+    *self->head->grad = 1.0;
 
     // Set all nodes to unvisited
     for (size_t i = 0; i < self->num_nodes; i++){
@@ -224,10 +292,6 @@ void graph_propagate_back(ComputeGraph* self){
     
 };
 
-void graph_optimize(ComputeGraph* self){
-    return;
-};
-
 void graph_build(ComputeGraph* graph, ADNode* output){ 
     if (graph == NULL){
         printf("Graph is NULL\n");
@@ -248,12 +312,1755 @@ void graph_build(ComputeGraph* graph, ADNode* output){
 
 };      
 
-ComputeGraph* compute_graph_new(){
-    ComputeGraph* graph = (ComputeGraph*)malloc(sizeof(ComputeGraph));
-    graph->capacity = 10; // start with space for 10 Nodes
-    graph->nodes = (ADNode**)malloc(graph->capacity * sizeof(ComputeGraph*));
-    graph->num_nodes = 0;
-    graph->self = graph;
+#pragma region Graph Capture
+/*
+Static graph capture
+
+The topology of a model does not change between training steps, only the values flowing
+through it. graph_capture records the graph hanging below the output node once:
+
+    nodes              all reachable nodes in topological order (parents before consumers)
+    forward_schedule   nodes with a forward kernel, in topological order
+    backward_schedule  nodes with a backward kernel, in reverse topological order
+
+Afterwards a step only rebinds new values into the input leaves (tensor_set_val or
+graph_rebind_tensor), calls graph_replay_forward and graph_replay_backward. No node is
+allocated and the graph is not traversed again.
+
+Gradients of non-trainable nodes are reset by every backward replay; gradients of trainable
+nodes accumulate until graph_zero_grad is called.
+*/
+
+void graph_release_schedules(ComputeGraph* self){
+    graph_release_parallel(self);
+    graph_release_jit(self);
+
+    free(self->forward_schedule);
+    self->forward_schedule = NULL;
+    self->forward_len = 0;
+
+    free(self->backward_schedule);
+    self->backward_schedule = NULL;
+    self->backward_len = 0;
+
+    self->is_captured = 0;
+};
+
+// Iterative post-order DFS: deep chains of in-place ops would overflow the call stack
+void graph_collect_topological(ComputeGraph* self, ADNode* output){
+    size_t stack_capacity = 64;
+    ADNode** stack = (ADNode**)malloc(stack_capacity * sizeof(ADNode*));
+    size_t* next_parent = (size_t*)malloc(stack_capacity * sizeof(size_t));
+    size_t top = 0;
+
+    if (stack == NULL || next_parent == NULL){
+        printf("Failed to allocate memory for the capture stack.\n");
+        exit(1);
+    }
+
+    // visited == 2 marks nodes seen by this capture, reset to 0 once the order is known
+    stack[top] = output;
+    next_parent[top++] = 0;
+    output->visited = 2;
+
+    while (top > 0){
+        ADNode* current = stack[top - 1];
+
+        if (next_parent[top - 1] < current->num_parents){
+            ADNode* parent = current->parents[next_parent[top - 1]++];
+            if (parent == NULL || parent->visited == 2) continue;
+
+            if (top == stack_capacity){
+                stack_capacity *= 2;
+                stack = (ADNode**)realloc(stack, stack_capacity * sizeof(ADNode*));
+                next_parent = (size_t*)realloc(next_parent, stack_capacity * sizeof(size_t));
+            }
+
+            parent->visited = 2;
+            stack[top] = parent;
+            next_parent[top++] = 0;
+            continue;
+        }
+
+        // All parents are placed, the node itself comes next
+        top--;
+        current->topology_idx = self->num_nodes;
+        add_node_to_graph(self, current);
+    }
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        self->nodes[i]->visited = 0;
+    }
+
+    free(stack);
+    free(next_parent);
+};
+
+void graph_capture(ComputeGraph* self, ADNode* output){
+    if (self == NULL){
+        printf("Graph is NULL\n");
+        return;
+    }
+
+    if (output == NULL){
+        printf("Output Node is NULL\n");
+        return;
+    }
+
+    graph_release_plan(self);
+    graph_release_schedules(self);
+
+    self->head = output;
+    self->num_nodes = 0;
+    graph_collect_topological(self, output);
+
+    size_t num_forward = 0, num_backward = 0;
+    for (size_t i = 0; i < self->num_nodes; i++){
+        if (self->nodes[i]->forward) num_forward++;
+        if (self->nodes[i]->backward) num_backward++;
+    }
+
+    self->forward_schedule = (ADNode**)malloc((num_forward ? num_forward : 1) * sizeof(ADNode*));
+    self->backward_schedule = (ADNode**)malloc((num_backward ? num_backward : 1) * sizeof(ADNode*));
+
+    if (self->forward_schedule == NULL || self->backward_schedule == NULL){
+        printf("Failed to allocate memory for the graph schedules.\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        if (node->forward) self->forward_schedule[self->forward_len++] = node;
+    }
+
+    for (size_t i = self->num_nodes; i-- > 0;){
+        ADNode* node = self->nodes[i];
+        if (node->backward) self->backward_schedule[self->backward_len++] = node;
+    }
+
+    self->is_captured = 1;
+};
+
+void graph_rebind_tensor(ComputeGraph* self, Tensor* input, const double* values){
+    if (self == NULL || input == NULL || values == NULL){
+        printf("Graph, input tensor or values point to NULL in graph_rebind_tensor.\n");
+        return;
+    }
+
+    for (size_t i = 0; i < input->n_batch * input->n_rows; i++){
+        for (size_t j = 0; j < input->n_cols; j++){
+            ADNode* node = input->get_node(input, i, j);
+            *node->value = values[i * input->n_cols + j];
+        }
+    }
+};
+
+void graph_replay_forward(ComputeGraph* self){
+    if (!self->is_captured){
+        printf("Graph has not been captured, call graph_capture first.\n");
+        return;
+    }
+
+    if (self->jit){
+        graph_jit_replay(self, 0);
+        return;
+    }
+
+    for (size_t i = 0; i < self->forward_len; i++){
+        ADNode* node = self->forward_schedule[i];
+        node->forward(node);
+    }
+};
+
+// Planned variant: gradients live in the slab and are reset right before their first writer
+static void graph_replay_backward_planned(ComputeGraph* self){
+    *self->head->grad = 1.0;
+
+    for (size_t i = 0; i < self->backward_len; i++){
+        for (size_t z = self->zero_begin[i]; z < self->zero_begin[i + 1]; z++){
+            *self->zero_list[z]->grad = 0.0;
+        }
+
+        ADNode* node = self->backward_schedule[i];
+        node->backward(node);
+    }
+};
+
+#pragma region Eager Release
+/*
+Eager release
+
+With eager_release set, a backward replay frees every intermediate node and constant as soon
+as no backward kernel still to run reads it. That is once its own backward has run and so has
+the backward of each of its consumers, counted per edge like the dependencies of the parallel
+executor. Instead of holding the whole graph until graph_prune, the graph then shrinks with
+the frontier of nodes still waiting for their gradient.
+
+The replay consumes the graph: released nodes leave graph->nodes, the schedules and a memory
+plan are dropped, and the next step captures again. Tensors holding released nodes, like the
+prediction of a model, may only be detached afterwards. The head, inputs and parameters are
+kept. released_nodes and released_bytes report the last replay.
+*/
+
+// Backward kernels still to run that read node idx, per edge, and which nodes are scheduled
+static size_t* graph_count_consumers(ComputeGraph* self, char** scheduled){
+    const size_t n = self->num_nodes ? self->num_nodes : 1;
+    size_t* pending = (size_t*)calloc(n, sizeof(size_t));
+    *scheduled = (char*)calloc(n, sizeof(char));
+    if (pending == NULL || *scheduled == NULL){
+        printf("Failed to allocate memory for the consumer counts.\n");
+        exit(1);
+    }
+
+    for (size_t b = 0; b < self->backward_len; b++){
+        ADNode* node = self->backward_schedule[b];
+        (*scheduled)[node->topology_idx] = 1;
+        for (size_t p = 0; p < node->num_parents; p++){
+            pending[node->parents[p]->topology_idx]++;
+        }
+    }
+    return pending;
+};
+
+static void graph_release_node(ComputeGraph* self, const size_t idx){
+    ADNode* node = self->nodes[idx];
+    if (node == NULL || node == self->head || !graph_node_is_owned(node)) return;
+
+    __atomic_add_fetch(&self->released_nodes, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&self->released_bytes, graph_node_bytes(node), __ATOMIC_RELAXED);
+    self->nodes[idx] = NULL;
+    node->destroy(node);
+};
+
+// Node idx lost one consumer: release it once nothing reads it anymore. A scheduled node
+// is released after its own backward instead, whatever its kernel pointer says
+static void graph_release_consumed(ComputeGraph* self, size_t* pending, const char* scheduled, const size_t idx){
+    if (--pending[idx] != 0) return;
+    if (!scheduled[idx]) graph_release_node(self, idx);
+};
+
+// Drop the released nodes from the node list, the schedules refer to them
+static void graph_finish_eager(ComputeGraph* self){
+    size_t kept = 0;
+    for (size_t i = 0; i < self->num_nodes; i++){
+        if (self->nodes[i] == NULL) continue;
+        self->nodes[i]->topology_idx = kept;
+        self->nodes[kept++] = self->nodes[i];
+    }
+    self->num_nodes = kept;
+    graph_release_schedules(self);
+};
+
+static void graph_replay_backward_eager(ComputeGraph* self){
+    // Released nodes may be bound into the slab, give them their own memory back first
+    graph_release_plan(self);
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        node->topology_idx = i;
+        if (!node->is_trainable) *node->grad = 0.0;
+    }
+    *self->head->grad = 1.0;
+
+    char* scheduled;
+    size_t* pending = graph_count_consumers(self, &scheduled);
+    self->released_nodes = 0;
+    self->released_bytes = 0;
+
+    // Nodes no backward kernel reads, like those dead node elimination unscheduled, go first
+    for (size_t i = 0; i < self->num_nodes; i++){
+        if (!scheduled[i] && pending[i] == 0) graph_release_node(self, i);
+    }
+
+    for (size_t b = 0; b < self->backward_len; b++){
+        ADNode* node = self->backward_schedule[b];
+        node->backward(node);
+
+        for (size_t p = 0; p < node->num_parents; p++){
+            graph_release_consumed(self, pending, scheduled, node->parents[p]->topology_idx);
+        }
+
+        // Consumers come first in the schedule, nothing reads this node anymore
+        graph_release_node(self, node->topology_idx);
+    }
+
+    free(pending);
+    free(scheduled);
+    graph_finish_eager(self);
+};
+#pragma endregion Eager Release
+
+void graph_replay_backward(ComputeGraph* self){
+    if (!self->is_captured){
+        printf("Graph has not been captured, call graph_capture first.\n");
+        return;
+    }
+
+    if (self->eager_release){
+        graph_replay_backward_eager(self);
+        return;
+    }
+
+    if (self->jit){
+        graph_jit_replay(self, 1);
+        return;
+    }
+
+    if (self->slab){
+        graph_replay_backward_planned(self);
+        return;
+    }
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        if (!node->is_trainable) *node->grad = 0.0;
+    }
+
+    *self->head->grad = 1.0;
+
+    for (size_t i = 0; i < self->backward_len; i++){
+        ADNode* node = self->backward_schedule[i];
+        node->backward(node);
+    }
+};
+
+void graph_zero_grad(ComputeGraph* self){
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        if (node->is_trainable) *node->grad = 0.0;
+    }
+};
+
+#pragma endregion Graph Capture
+
+#pragma region Graph Optimization
+/*
+Optimization passes over a captured graph
+
+graph_optimize runs, in order:
+
+    constant folding   nodes whose parents are all constants are evaluated once and become constants
+    CSE                nodes computing the same op on the same parents (and equal constants) are merged
+    fusion             matmul -> bias add -> activation and unary chains collapse into one fused node
+    dead nodes         nodes that do not reach a trainable parameter are dropped from the backward schedule
+
+Nodes removed by a pass are destroyed. Dead node elimination is the exception: the nodes stay
+in the graph for the forward pass and it reports the backward kernels it skipped instead. Only the head, trainable parameters and input leaves are
+guaranteed to survive, so read results through graph->head or the input/parameter tensors.
+*/
+
+typedef struct {
+    const char* name;
+    size_t nodes_removed;
+    size_t bytes_removed;
+    char keeps_nodes;           // dead node elimination, it only skips backward kernels
+    size_t backward_skipped;
+    size_t schedule_bytes;      // of the backward schedule entries dropped
+}GraphPassStats;
+
+static size_t graph_node_bytes(ADNode* node){
+    return sizeof(ADNode) + node->num_parents * sizeof(ADNode*) + node->ctx_size;
+};
+
+// Inputs and parameters are owned by their tensors, only intermediates and constants are released
+static char graph_node_is_owned(ADNode* node){
+    return node->num_parents > 0 || node->is_constant;
+};
+
+// Recapture from the head and destroy every owned node that is no longer reachable
+static void graph_sweep(ComputeGraph* self, GraphPassStats* stats){
+    const size_t old_num = self->num_nodes;
+    ADNode** old_nodes = (ADNode**)malloc((old_num ? old_num : 1) * sizeof(ADNode*));
+    memcpy(old_nodes, self->nodes, old_num * sizeof(ADNode*));
+
+    graph_capture(self, self->head);
+
+    for (size_t i = 0; i < old_num; i++){
+        ADNode* node = old_nodes[i];
+        const size_t idx = node->topology_idx;
+        if (idx < self->num_nodes && self->nodes[idx] == node) continue;
+        if (!graph_node_is_owned(node)) continue;
+
+        stats->nodes_removed++;
+        stats->bytes_removed += graph_node_bytes(node);
+        node->destroy(node);
+    }
+
+    free(old_nodes);
+};
+
+static void graph_set_parents(ADNode* node, ADNode** parents, const size_t num_parents){
+    free(node->parents);
+    node->parents = (ADNode**)malloc((num_parents ? num_parents : 1) * sizeof(ADNode*));
+    memcpy(node->parents, parents, num_parents * sizeof(ADNode*));
+    node->num_parents = num_parents;
+};
+
+GraphPassStats graph_pass_constant_folding(ComputeGraph* self){
+    GraphPassStats stats = {"constant folding", 0, 0, 0, 0, 0};
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        if (node->forward == NULL || node->num_parents == 0) continue;
+
+        // The outputs of a registered op read its buffers, the op node keeps them
+        if (node->forward == forward_op) continue;
+
+        char all_constant = 1;
+        for (size_t k = 0; k < node->num_parents && all_constant; k++){
+            all_constant = node->parents[k]->is_constant;
+        }
+        if (!all_constant) continue;
+
+        node->forward(node);
+
+        free(node->parents);
+        node->parents = NULL;
+        node->num_parents = 0;
+        free(node->ctx);
+        node->ctx = NULL;
+        node->ctx_size = 0;
+        node->forward = NULL;
+        node->backward = NULL;
+        node->is_constant = 1;
+    }
+
+    graph_sweep(self, &stats);
+    return stats;
+};
+
+static char graph_is_commutative(ADNode* node){
+    return node->forward == forward_add || node->forward == forward_multiply;
+};
+
+static int graph_ptr_cmp(const void* a, const void* b){
+    const uintptr_t x = (uintptr_t)(*(ADNode* const*)a);
+    const uintptr_t y = (uintptr_t)(*(ADNode* const*)b);
+    return (x > y) - (x < y);
+};
+
+static uint64_t graph_mix(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+};
+
+static uint64_t graph_cse_hash(ADNode* node){
+    if (node->num_parents == 0){
+        uint64_t bits;
+        memcpy(&bits, node->value, sizeof(bits));
+        return graph_mix(bits ^ 0x9e3779b97f4a7c15ULL);
+    }
+
+    uint64_t h = graph_mix((uint64_t)(uintptr_t)node->forward) ^ node->num_parents;
+    for (size_t k = 0; k < node->num_parents; k++){
+        const uint64_t ph = graph_mix((uint64_t)(uintptr_t)node->parents[k]);
+        // Order independent for commutative ops
+        h = graph_is_commutative(node) ? h + ph : graph_mix(h ^ ph) + k;
+    }
+    return h;
+};
+
+static char graph_cse_equal(ADNode* a, ADNode* b){
+    if (a->num_parents != b->num_parents) return 0;
+
+    if (a->num_parents == 0){
+        return a->is_constant && b->is_constant && *a->value == *b->value;
+    }
+
+    if (a->forward != b->forward || a->ctx || b->ctx) return 0;
+
+    if (!graph_is_commutative(a)){
+        for (size_t k = 0; k < a->num_parents; k++){
+            if (a->parents[k] != b->parents[k]) return 0;
+        }
+        return 1;
+    }
+
+    ADNode** pa = (ADNode**)malloc(a->num_parents * sizeof(ADNode*));
+    ADNode** pb = (ADNode**)malloc(b->num_parents * sizeof(ADNode*));
+    memcpy(pa, a->parents, a->num_parents * sizeof(ADNode*));
+    memcpy(pb, b->parents, b->num_parents * sizeof(ADNode*));
+    qsort(pa, a->num_parents, sizeof(ADNode*), graph_ptr_cmp);
+    qsort(pb, b->num_parents, sizeof(ADNode*), graph_ptr_cmp);
+    const char equal = memcmp(pa, pb, a->num_parents * sizeof(ADNode*)) == 0;
+    free(pa);
+    free(pb);
+    return equal;
+};
+
+GraphPassStats graph_pass_cse(ComputeGraph* self){
+    GraphPassStats stats = {"common subexpression elimination", 0, 0, 0, 0, 0};
+
+    size_t capacity = 16;
+    while (capacity < 2 * self->num_nodes) capacity <<= 1;
+
+    ADNode** table = (ADNode**)calloc(capacity, sizeof(ADNode*));
+    ADNode** canonical = (ADNode**)malloc((self->num_nodes ? self->num_nodes : 1) * sizeof(ADNode*));
+
+    if (table == NULL || canonical == NULL){
+        printf("Failed to allocate memory for CSE.\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        canonical[i] = node;
+
+        // Parents come first in topological order and are already canonical
+        for (size_t k = 0; k < node->num_parents; k++){
+            node->parents[k] = canonical[node->parents[k]->topology_idx];
+        }
+
+        // Only constants and plain ops are candidates, inputs and parameters are unique
+        const char candidate = node->num_parents == 0 ? node->is_constant : (node->forward != NULL && node->ctx == NULL);
+        if (!candidate) continue;
+
+        size_t slot = graph_cse_hash(node) & (capacity - 1);
+        while (table[slot] != NULL){
+            if (graph_cse_equal(table[slot], node)){
+                canonical[i] = table[slot];
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == NULL) table[slot] = node;
+    }
+
+    self->head = canonical[self->head->topology_idx];
+
+    free(table);
+    free(canonical);
+
+    graph_sweep(self, &stats);
+    return stats;
+};
+
+// Unary op of a node in terms of the fused kernel
+static char graph_fusable_op(ADNode* node, FusedOp* op){
+    if (node->num_parents != 1) return 0;
+    if (node->forward == forward_relu) { *op = FUSED_RELU; return 1; }
+    if (node->forward == forward_sigmoid) { *op = FUSED_SIGMOID; return 1; }
+    if (node->forward == forward_tanh) { *op = FUSED_TANH; return 1; }
+    if (node->forward == forward_exp) { *op = FUSED_EXP; return 1; }
+    if (node->forward == forward_log) { *op = FUSED_LOG; return 1; }
+    if (node->forward == forward_sqrt) { *op = FUSED_SQRT; return 1; }
+    if (node->forward == forward_abs) { *op = FUSED_ABS; return 1; }
+    return 0;
+};
+
+static void graph_make_fused(ADNode* node, ADNode** parents, const FusedCtx* ctx){
+    graph_set_parents(node, parents, 2 * ctx->num_pairs + ctx->num_addends);
+
+    free(node->ctx);
+    node->ctx = malloc(sizeof(FusedCtx));
+    memcpy(node->ctx, ctx, sizeof(FusedCtx));
+    node->ctx_size = sizeof(FusedCtx);
+
+    node->forward = forward_fused;
+    node->backward = backward_fused;
+};
+
+GraphPassStats graph_pass_fusion(ComputeGraph* self){
+    GraphPassStats stats = {"elementwise fusion", 0, 0, 0, 0, 0};
+
+    // Number of consumers per node, the head has one external consumer
+    size_t* consumers = (size_t*)calloc(self->num_nodes ? self->num_nodes : 1, sizeof(size_t));
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        for (size_t k = 0; k < node->num_parents; k++) consumers[node->parents[k]->topology_idx]++;
+    }
+    consumers[self->head->topology_idx]++;
+
+    size_t parents_capacity = 16;
+    ADNode** parents = (ADNode**)malloc(parents_capacity * sizeof(ADNode*));
+    ADNode** addends = (ADNode**)malloc(parents_capacity * sizeof(ADNode*));
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        FusedCtx ctx = {0, 0, 0, {0}};
+        FusedOp op;
+
+        if (node->forward == forward_add){
+            // sum of products (+ bias) -> one fused node
+            size_t needed = 0;
+            for (size_t k = 0; k < node->num_parents; k++){
+                ADNode* p = node->parents[k];
+                if (p->forward == forward_fused) needed += 2 * ((FusedCtx*)p->ctx)->num_pairs + ((FusedCtx*)p->ctx)->num_addends;
+                else needed += 2;
+            }
+            if (needed > parents_capacity){
+                parents_capacity = needed;
+                parents = (ADNode**)realloc(parents, parents_capacity * sizeof(ADNode*));
+                addends = (ADNode**)realloc(addends, parents_capacity * sizeof(ADNode*));
+            }
+
+            char absorbed = 0;
+            for (size_t k = 0; k < node->num_parents; k++){
+                ADNode* p = node->parents[k];
+                const char single_use = consumers[p->topology_idx] == 1;
+
+                if (single_use && p->forward == forward_multiply && p->num_parents == 2){
+                    parents[2 * ctx.num_pairs] = p->parents[0];
+                    parents[2 * ctx.num_pairs + 1] = p->parents[1];
+                    ctx.num_pairs++;
+                    absorbed = 1;
+                }
+                else if (single_use && p->forward == forward_fused && ((FusedCtx*)p->ctx)->num_ops == 0){
+                    const FusedCtx* pctx = (const FusedCtx*)p->ctx;
+                    for (size_t q = 0; q < pctx->num_pairs; q++){
+                        parents[2 * ctx.num_pairs] = p->parents[2 * q];
+                        parents[2 * ctx.num_pairs + 1] = p->parents[2 * q + 1];
+                        ctx.num_pairs++;
+                    }
+                    for (size_t a = 0; a < pctx->num_addends; a++){
+                        addends[ctx.num_addends++] = p->parents[2 * pctx->num_pairs + a];
+                    }
+                    absorbed = 1;
+                }
+                else {
+                    addends[ctx.num_addends++] = p;
+                }
+            }
+            if (!absorbed) continue;
+
+            memcpy(parents + 2 * ctx.num_pairs, addends, ctx.num_addends * sizeof(ADNode*));
+            graph_make_fused(node, parents, &ctx);
+        }
+        else if (graph_fusable_op(node, &op)){
+            // activation on top of a fused node or of another unary op -> extend the chain
+            ADNode* p = node->parents[0];
+            if (consumers[p->topology_idx] != 1) continue;
+
+            FusedOp p_op;
+            if (p->forward == forward_fused){
+                const FusedCtx* pctx = (const FusedCtx*)p->ctx;
+                if (pctx->num_ops == FUSED_MAX_OPS) continue;
+
+                ctx = *pctx;
+                const size_t n = 2 * pctx->num_pairs + pctx->num_addends;
+                if (n > parents_capacity){
+                    parents_capacity = n;
+                    parents = (ADNode**)realloc(parents, parents_capacity * sizeof(ADNode*));
+                    addends = (ADNode**)realloc(addends, parents_capacity * sizeof(ADNode*));
+                }
+                memcpy(parents, p->parents, n * sizeof(ADNode*));
+            }
+            else if (graph_fusable_op(p, &p_op)){
+                ctx.num_addends = 1;
+                ctx.ops[ctx.num_ops++] = p_op;
+                parents[0] = p->parents[0];
+            }
+            else continue;
+
+            ctx.ops[ctx.num_ops++] = op;
+            graph_make_fused(node, parents, &ctx);
+        }
+    }
+
+    free(parents);
+    free(addends);
+    free(consumers);
+
+    graph_sweep(self, &stats);
+    return stats;
+};
+
+GraphPassStats graph_pass_dead_nodes(ComputeGraph* self){
+    GraphPassStats stats = {"dead node elimination", 0, 0, 1, 0, 0};
+
+    // A node needs a backward only if a trainable parameter is among its ancestors
+    char* requires_grad = (char*)calloc(self->num_nodes ? self->num_nodes : 1, sizeof(char));
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        requires_grad[i] = node->is_trainable;
+        for (size_t k = 0; k < node->num_parents && !requires_grad[i]; k++){
+            requires_grad[i] = requires_grad[node->parents[k]->topology_idx];
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < self->backward_len; i++){
+        ADNode* node = self->backward_schedule[i];
+        if (requires_grad[node->topology_idx]){
+            self->backward_schedule[kept++] = node;
+            continue;
+        }
+        stats.backward_skipped++;
+        stats.schedule_bytes += sizeof(ADNode*);
+    }
+    self->backward_len = kept;
+
+    free(requires_grad);
+    return stats;
+};
+
+void graph_print_pass_stats(const GraphPassStats* stats){
+    if (stats->keeps_nodes){
+        printf("    %-34s skipped %lu backward kernels, %lu schedule bytes\n", stats->name, stats->backward_skipped, stats->schedule_bytes);
+        return;
+    }
+    printf("    %-34s removed %lu nodes, %lu bytes\n", stats->name, stats->nodes_removed, stats->bytes_removed);
+};
+
+void graph_optimize(ComputeGraph* self){
+    if (self == NULL || !self->is_captured){
+        printf("Graph has not been captured, call graph_capture before graph_optimize.\n");
+        return;
+    }
+
+    // Passes rewrite kernels and schedules, a plan made before is stale
+    graph_release_plan(self);
+    graph_release_parallel(self);
+
+    GraphPassStats stats[4];
+    stats[0] = graph_pass_constant_folding(self);
+    stats[1] = graph_pass_cse(self);
+    stats[2] = graph_pass_fusion(self);
+    stats[3] = graph_pass_dead_nodes(self);
+
+    printf("Graph optimization (%lu nodes left):\n", self->num_nodes);
+    for (size_t i = 0; i < 4; i++){
+        graph_print_pass_stats(stats + i);
+    }
+};
+
+#pragma endregion Graph Optimization
+
+#pragma region Memory Planning
+/*
+Static memory plan for a captured graph
+
+Every intermediate node (forward kernel, not trainable) gets its value
+and its gradient assigned to offsets inside one slab. Lifetimes are measured on the replay
+timeline of one training step:
+
+    t = i               forward kernel of nodes[i]
+    t = N               head gradient is seeded
+    t = N + 1 + b       backward_schedule[b]
+
+A value lives from its forward kernel until the last forward consumer, or the last backward
+kernel that reads it. A gradient lives from the first backward kernel that accumulates into it
+until the last one reading it. memory_plan_best_fit then packs the intervals so that buffers
+with disjoint lifetimes share memory.
+
+Because gradients share memory with dead values, graph_replay_backward resets every gradient
+right before its first writer instead of clearing all of them up front. After a planned replay
+only the head, the leaves and the trainable nodes hold meaningful values; intermediate values
+are valid between graph_replay_forward and graph_replay_backward.
+
+The plan is released by graph_capture, graph_optimize, graph_prune and graph_destroy, which
+moves the planned nodes back to where they lived before (e.g. their tensor storage).
+*/
+
+#define GRAPH_NO_STEP ((size_t)-1)
+
+typedef struct NodeBinding{
+    ADNode* node;
+    ADStorage* storage;     // retained while the node lives in the slab
+    double* value;
+    double* grad;
+}NodeBinding;
+
+// Kernels whose backward only moves gradients read no values, registered ops keep their own copies
+static char graph_backward_reads_parents(ADNode* node){
+    return !(node->backward == backward_add || node->backward == backward_subtract ||
+             node->backward == backward_sqrt || node->backward == backward_exp ||
+             node->backward == backward_sigmoid || node->backward == backward_tanh ||
+             node->backward == backward_relu || node->backward == backward_op ||
+             node->backward == backward_op_output);
+};
+
+static char graph_backward_reads_self(ADNode* node){
+    return !(node->backward == backward_add || node->backward == backward_subtract ||
+             node->backward == backward_multiply || node->backward == backward_log ||
+             node->backward == backward_abs || node->backward == backward_fused ||
+             node->backward == backward_op || node->backward == backward_op_output);
+};
+
+static char graph_node_is_plannable(ADNode* node){
+    return node->forward != NULL && node->num_parents > 0 && !node->is_trainable;
+};
+
+void graph_release_plan(ComputeGraph* self){
+    // Compiled code has the zero lists of the plan baked in
+    graph_release_jit(self);
+
+    if (self->slab){
+        for (size_t i = 0; i < self->num_plan_bindings; i++){
+            NodeBinding* binding = self->plan_bindings + i;
+            if (binding->node->storage == self->slab){
+                node_set_storage(binding->node, binding->storage, binding->value, binding->grad);
+            }
+            ad_storage_release(binding->storage);
+        }
+        ad_storage_release(self->slab);
+        self->slab = NULL;
+    }
+
+    free(self->plan_bindings);
+    self->plan_bindings = NULL;
+    self->num_plan_bindings = 0;
+
+    free(self->zero_list);
+    self->zero_list = NULL;
+    free(self->zero_begin);
+    self->zero_begin = NULL;
+    self->planned_bytes = 0;
+    self->unplanned_bytes = 0;
+};
+
+void graph_plan_memory(ComputeGraph* self){
+    if (self == NULL || !self->is_captured){
+        printf("Graph has not been captured, call graph_capture before graph_plan_memory.\n");
+        return;
+    }
+
+    graph_release_plan(self);
+
+    const size_t n = self->num_nodes;
+    size_t* backward_step = (size_t*)malloc(n * sizeof(size_t));
+    size_t* value_end = (size_t*)malloc(n * sizeof(size_t));
+    size_t* grad_start = (size_t*)malloc(n * sizeof(size_t));
+    size_t* grad_end = (size_t*)malloc(n * sizeof(size_t));
+    size_t* value_slot = (size_t*)malloc(n * sizeof(size_t));
+    size_t* grad_slot = (size_t*)malloc(n * sizeof(size_t));
+    BufferInterval* intervals = (BufferInterval*)malloc(2 * n * sizeof(BufferInterval));
+    self->zero_begin = (size_t*)calloc(self->backward_len + 1, sizeof(size_t));
+
+    if (backward_step == NULL || value_end == NULL || grad_start == NULL || grad_end == NULL ||
+        value_slot == NULL || grad_slot == NULL || intervals == NULL || self->zero_begin == NULL){
+        printf("Failed to allocate memory for the memory plan.\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n; i++){
+        self->nodes[i]->topology_idx = i;
+        backward_step[i] = GRAPH_NO_STEP;
+        value_end[i] = i;
+        grad_start[i] = GRAPH_NO_STEP;
+        grad_end[i] = 0;
+    }
+    for (size_t b = 0; b < self->backward_len; b++){
+        backward_step[self->backward_schedule[b]->topology_idx] = n + 1 + b;
+    }
+
+    // Liveness
+    for (size_t i = 0; i < n; i++){
+        ADNode* node = self->nodes[i];
+        const size_t t_back = backward_step[i];
+
+        if (t_back != GRAPH_NO_STEP){
+            if (graph_backward_reads_self(node) && t_back > value_end[i]) value_end[i] = t_back;
+            if (t_back < grad_start[i]) grad_start[i] = t_back;
+            if (t_back > grad_end[i]) grad_end[i] = t_back;
+        }
+
+        for (size_t p = 0; p < node->num_parents; p++){
+            if (node->parents[p] == NULL) continue;
+            const size_t k = node->parents[p]->topology_idx;
+
+            if (i > value_end[k]) value_end[k] = i;
+            if (t_back == GRAPH_NO_STEP) continue;
+
+            if (graph_backward_reads_parents(node) && t_back > value_end[k]) value_end[k] = t_back;
+            if (t_back < grad_start[k]) grad_start[k] = t_back;
+            if (t_back > grad_end[k]) grad_end[k] = t_back;
+        }
+    }
+
+    // The head outlives the step: its value is the result, its gradient is seeded at t = N
+    const size_t h = self->head->topology_idx;
+    value_end[h] = n + 1 + self->backward_len;
+    if (grad_start[h] == GRAPH_NO_STEP || grad_start[h] > n) grad_start[h] = n;
+    if (grad_end[h] < n) grad_end[h] = n;
+
+    size_t num_intervals = 0;
+    for (size_t i = 0; i < n; i++){
+        value_slot[i] = GRAPH_NO_STEP;
+        grad_slot[i] = GRAPH_NO_STEP;
+        if (!graph_node_is_plannable(self->nodes[i])) continue;
+
+        intervals[num_intervals] = (BufferInterval){sizeof(double), i, value_end[i], 0};
+        value_slot[i] = num_intervals++;
+
+        if (grad_start[i] != GRAPH_NO_STEP){
+            intervals[num_intervals] = (BufferInterval){sizeof(double), grad_start[i], grad_end[i], 0};
+            grad_slot[i] = num_intervals++;
+        }
+    }
+
+    self->unplanned_bytes = num_intervals * sizeof(double);
+    self->planned_bytes = memory_plan_best_fit(intervals, num_intervals, sizeof(double));
+
+    // Gradient resets, grouped by the backward step of their first writer
+    size_t num_zero = 0;
+    for (size_t i = 0; i < n; i++){
+        if (i == h || self->nodes[i]->is_trainable || grad_start[i] == GRAPH_NO_STEP) continue;
+        self->zero_begin[grad_start[i] - n]++;
+        num_zero++;
+    }
+    for (size_t b = 0; b < self->backward_len; b++){
+        self->zero_begin[b + 1] += self->zero_begin[b];
+    }
+
+    self->zero_list = (ADNode**)malloc((num_zero ? num_zero : 1) * sizeof(ADNode*));
+    if (self->zero_list == NULL){
+        printf("Failed to allocate memory for the gradient reset lists.\n");
+        exit(1);
+    }
+
+    // zero_begin[b] counts the resets before step b, filling it moves it to the end of the range
+    for (size_t i = 0; i < n; i++){
+        if (i == h || self->nodes[i]->is_trainable || grad_start[i] == GRAPH_NO_STEP) continue;
+        const size_t b = grad_start[i] - n - 1;
+        self->zero_list[self->zero_begin[b]++] = self->nodes[i];
+    }
+    for (size_t b = self->backward_len; b > 0; b--){
+        self->zero_begin[b] = self->zero_begin[b - 1];
+    }
+    self->zero_begin[0] = 0;
+
+    // Bind the planned nodes to the slab, remembering where they came from
+    self->slab = ad_storage_new(self->planned_bytes / sizeof(double), 0);
+    self->plan_bindings = (NodeBinding*)malloc((n ? n : 1) * sizeof(NodeBinding));
+    if (self->plan_bindings == NULL){
+        printf("Failed to allocate memory for the memory plan bindings.\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n; i++){
+        if (value_slot[i] == GRAPH_NO_STEP) continue;
+        ADNode* node = self->nodes[i];
+
+        NodeBinding* binding = self->plan_bindings + self->num_plan_bindings++;
+        binding->node = node;
+        binding->storage = node->storage;
+        binding->value = node->value;
+        binding->grad = node->grad;
+        ad_storage_retain(node->storage);
+
+        double* value = self->slab->values + intervals[value_slot[i]].offset / sizeof(double);
+        double* grad = grad_slot[i] == GRAPH_NO_STEP ? node->grad
+                     : self->slab->values + intervals[grad_slot[i]].offset / sizeof(double);
+        node_set_storage(node, self->slab, value, grad);
+    }
+
+    printf("Memory plan: %lu buffers, %lu bytes -> %lu bytes slab\n", num_intervals, self->unplanned_bytes, self->planned_bytes);
+
+    free(backward_step);
+    free(value_end);
+    free(grad_start);
+    free(grad_end);
+    free(value_slot);
+    free(grad_slot);
+    free(intervals);
+};
+
+#pragma endregion Memory Planning
+
+#pragma region Parallel Backward
+/*
+Parallel backward over a captured graph
+
+A node may run its backward kernel once every consumer that runs a backward kernel has
+finished, because only then its gradient is complete. graph_replay_backward_parallel counts
+these dependencies per node and seeds the per-worker deques with the nodes that have none
+(the head). A worker pops its own deque, steals from the others when it runs dry, and
+pushes every parent whose count drops to zero onto its own deque.
+
+Nodes with more than one consumer would receive concurrent gradient updates. Their updates
+go to per-worker partial gradients instead (see node_accumulate_grad) and the worker
+completing the last consumer sums the partials into the node's gradient.
+
+Graphs with a memory plan share gradient memory in the order of the sequential schedule and
+always replay sequentially.
+*/
+
+typedef struct ParallelBackward{
+    size_t num_workers;
+    size_t num_nodes;
+    size_t num_tasks;
+    size_t* dependencies;   // consumers with a backward kernel, per node
+    size_t* pending;        // dependencies left in the current run
+    char* is_task;          // node is in the backward schedule
+    char* fan_in;           // node has several consumers, accumulate per worker
+    double* partials;       // num_workers x num_nodes partial gradients
+    WorkDeque* deques;
+    size_t remaining;       // tasks left in the current run
+    char eager;             // release nodes as their pending count drops to zero
+    ComputeGraph* graph;
+}ParallelBackward;
+
+void graph_release_parallel(ComputeGraph* self){
+    ParallelBackward* pb = self->parallel;
+    if (pb == NULL) return;
+
+    for (size_t w = 0; w < pb->num_workers; w++){
+        work_deque_destroy(pb->deques + w);
+    }
+    free(pb->deques);
+    free(pb->dependencies);
+    free(pb->pending);
+    free(pb->is_task);
+    free(pb->fan_in);
+    free(pb->partials);
+    free(pb);
+    self->parallel = NULL;
+};
+
+static void graph_build_parallel(ComputeGraph* self, const size_t num_workers){
+    graph_release_parallel(self);
+
+    const size_t n = self->num_nodes;
+    ParallelBackward* pb = (ParallelBackward*)malloc(sizeof(ParallelBackward));
+    if (pb == NULL){
+        printf("Failed to allocate memory for the parallel backward state.\n");
+        exit(1);
+    }
+
+    pb->num_workers = num_workers;
+    pb->num_nodes = n;
+    pb->num_tasks = self->backward_len;
+    pb->dependencies = (size_t*)calloc(n ? n : 1, sizeof(size_t));
+    pb->pending = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+    pb->is_task = (char*)calloc(n ? n : 1, sizeof(char));
+    pb->fan_in = (char*)calloc(n ? n : 1, sizeof(char));
+    pb->partials = (double*)calloc(num_workers * n + 1, sizeof(double));
+    pb->deques = (WorkDeque*)malloc(num_workers * sizeof(WorkDeque));
+    pb->remaining = 0;
+    pb->eager = 0;
+    pb->graph = self;
+
+    if (pb->dependencies == NULL || pb->pending == NULL || pb->is_task == NULL ||
+        pb->fan_in == NULL || pb->partials == NULL || pb->deques == NULL){
+        printf("Failed to allocate memory for the parallel backward state.\n");
+        exit(1);
+    }
+
+    // Nodes may be shared with other graphs, make the indices refer to this one
+    for (size_t i = 0; i < n; i++){
+        self->nodes[i]->topology_idx = i;
+    }
+
+    for (size_t b = 0; b < self->backward_len; b++){
+        ADNode* node = self->backward_schedule[b];
+        pb->is_task[node->topology_idx] = 1;
+        for (size_t p = 0; p < node->num_parents; p++){
+            pb->dependencies[node->parents[p]->topology_idx]++;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++){
+        pb->fan_in[i] = pb->dependencies[i] > 1;
+    }
+
+    for (size_t w = 0; w < num_workers; w++){
+        work_deque_init(pb->deques + w, pb->num_tasks);
+    }
+
+    self->parallel = pb;
+};
+
+// All consumers of node idx are done: fold the partial gradients of every worker into it
+static void graph_reduce_partials(ParallelBackward* pb, const size_t idx){
+    double sum = 0.0;
+    for (size_t w = 0; w < pb->num_workers; w++){
+        double* partial = pb->partials + w * pb->num_nodes + idx;
+        sum += *partial;
+        *partial = 0.0;
+    }
+    *pb->graph->nodes[idx]->grad += sum;
+};
+
+static void graph_backward_worker(void* ctx, const size_t worker){
+    ParallelBackward* pb = (ParallelBackward*)ctx;
+    ADNode** nodes = pb->graph->nodes;
+    WorkDeque* own = pb->deques + worker;
+
+    ad_grad_partials = pb->partials + worker * pb->num_nodes;
+    ad_grad_fan_in = pb->fan_in;
+
+    while (__atomic_load_n(&pb->remaining, __ATOMIC_ACQUIRE) > 0){
+        size_t task;
+        char found = work_deque_pop(own, &task);
+        for (size_t k = 1; !found && k < pb->num_workers; k++){
+            found = work_deque_steal(pb->deques + (worker + k) % pb->num_workers, &task);
+        }
+
+        if (!found){
+            sched_yield();
+            continue;
+        }
+
+        ADNode* node = nodes[task];
+        node->backward(node);
+
+        for (size_t p = 0; p < node->num_parents; p++){
+            const size_t idx = node->parents[p]->topology_idx;
+            if (__atomic_sub_fetch(&pb->pending[idx], 1, __ATOMIC_ACQ_REL) != 0) continue;
+
+            if (pb->fan_in[idx]) graph_reduce_partials(pb, idx);
+            if (pb->is_task[idx]) work_deque_push(own, idx);
+            else if (pb->eager) graph_release_node(pb->graph, idx);
+        }
+
+        if (pb->eager) graph_release_node(pb->graph, task);
+
+        __atomic_sub_fetch(&pb->remaining, 1, __ATOMIC_RELEASE);
+    }
+
+    ad_grad_partials = NULL;
+    ad_grad_fan_in = NULL;
+};
+
+void graph_replay_backward_parallel(ComputeGraph* self, ThreadPool* pool){
+    if (!self->is_captured){
+        printf("Graph has not been captured, call graph_capture first.\n");
+        return;
+    }
+
+    if (self->slab || pool == NULL || pool->num_threads == 1){
+        graph_replay_backward(self);
+        return;
+    }
+
+    if (self->parallel == NULL || self->parallel->num_workers != pool->num_threads){
+        graph_build_parallel(self, pool->num_threads);
+    }
+    ParallelBackward* pb = self->parallel;
+
+    for (size_t i = 0; i < self->num_nodes; i++){
+        ADNode* node = self->nodes[i];
+        node->topology_idx = i;
+        if (!node->is_trainable) *node->grad = 0.0;
+    }
+    *self->head->grad = 1.0;
+
+    memcpy(pb->pending, pb->dependencies, self->num_nodes * sizeof(size_t));
+    pb->remaining = pb->num_tasks;
+
+    size_t next = 0;
+    for (size_t w = 0; w < pb->num_workers; w++){
+        work_deque_reset(pb->deques + w);
+    }
+    for (size_t b = 0; b < self->backward_len; b++){
+        const size_t idx = self->backward_schedule[b]->topology_idx;
+        if (pb->dependencies[idx] == 0) work_deque_push(pb->deques + (next++ % pb->num_workers), idx);
+    }
+
+    // The pending counts are the consumer counts eager release waits for
+    pb->eager = self->eager_release;
+    self->released_nodes = 0;
+    self->released_bytes = 0;
+    for (size_t i = 0; pb->eager && i < self->num_nodes; i++){
+        if (!pb->is_task[i] && pb->dependencies[i] == 0) graph_release_node(self, i);
+    }
+
+    pool->run(pool, graph_backward_worker, pb);
+
+    if (pb->eager) graph_finish_eager(self);
+};
+
+#pragma endregion Parallel Backward
+
+#pragma region JIT
+/*
+JIT compilation of captured graphs
+
+graph_jit_compile emits straight-line C for the schedules of a captured graph, builds it with the
+system compiler into a shared object and replaces the interpreted replay with it:
+
+    forward    one statement per node in schedule order, constants inlined as literals
+    backward   gradient resets (or the zero lists of a memory plan), the seed and every backward kernel
+    fallback   kernels the emitter does not know (custom ops) are called through the node
+
+The generated code reaches values and gradients through the nodes of graph->nodes, so storage
+moving underneath (tensor_make_contiguous) needs no recompile. Anything replacing the node list
+or the zero lists does: capture, optimize, prune, plan_memory and eager release drop the compiled
+code and the graph is interpreted again until the next graph_jit_compile. Parallel and eager
+backward always run interpreted.
+
+Objects are cached by the hash of their source in CML_JIT_CACHE_DIR (default $XDG_CACHE_HOME/cml_jit
+or ~/.cache/cml_jit), a graph with the same topology and constants is compiled once per user. The
+directory and the cached files must belong to the user and be writable by nobody else, and a cached
+object is only loaded if the source kept next to it equals the emitted one. CML_JIT_CC names the
+compiler (default cc), it is run directly without a shell. The code is built without fast-math and
+fp contraction, it follows the kernels operation by operation and gives the same results as the
+interpreter.
+*/
+#define GRAPH_JIT_CHUNK 256     // nodes per generated function, keeps huge graphs cheap to compile
+
+typedef void (*GraphJITKernel)(void* const* nodes);
+
+typedef struct GraphJIT{
+    void* handle;
+    GraphJITKernel forward;
+    GraphJITKernel backward;
+    uint64_t hash;
+    size_t num_fallbacks;   // kernels called through the node
+    char from_cache;
+}GraphJIT;
+
+typedef struct {
+    char* text;
+    size_t len;
+    size_t capacity;
+}JITSource;
+
+static void jit_emit(JITSource* src, const char* fmt, ...){
+    for (;;){
+        va_list args;
+        va_start(args, fmt);
+        const int n = vsnprintf(src->text + src->len, src->capacity - src->len, fmt, args);
+        va_end(args);
+
+        if (n < 0){
+            printf("Failed to format the JIT source.\n");
+            exit(1);
+        }
+        if (src->len + (size_t)n < src->capacity){
+            src->len += (size_t)n;
+            return;
+        }
+
+        src->capacity = 2 * src->capacity + (size_t)n + 1;
+        src->text = (char*)realloc(src->text, src->capacity);
+        if (src->text == NULL){
+            printf("Failed to allocate memory for the JIT source.\n");
+            exit(1);
+        }
+    }
+};
+
+void graph_release_jit(ComputeGraph* self){
+    if (self->jit == NULL) return;
+    if (self->jit->handle) dlclose(self->jit->handle);
+    free(self->jit);
+    self->jit = NULL;
+};
+
+static void graph_jit_replay(ComputeGraph* self, const char backward){
+    GraphJITKernel kernel = backward ? self->jit->backward : self->jit->forward;
+    kernel((void* const*)self->nodes);
+};
+
+// Value of a parent: constants become literals, everything else is read through the node
+static void jit_operand(JITSource* src, ADNode* node){
+    if (!node->is_constant){
+        jit_emit(src, "V(%lu)", node->topology_idx);
+        return;
+    }
+
+    const double value = *node->value;
+    if (isnan(value)) jit_emit(src, "NAN");
+    else if (isinf(value)) jit_emit(src, value > 0 ? "HUGE_VAL" : "(-HUGE_VAL)");
+    else jit_emit(src, "(%a)", value);
+};
+
+// Gradients of constants are never read, the kernels accumulating into them are skipped
+static char jit_accumulate(JITSource* src, ADNode* parent){
+    if (parent->is_constant) return 0;
+    jit_emit(src, "G(%lu) += ", parent->topology_idx);
+    return 1;
+};
+
+static void jit_fused_apply(JITSource* src, const FusedOp op, const char* out, const char* in){
+    switch(op){
+        case FUSED_RELU: jit_emit(src, "%s = %s > 0 ? %s : 0.0;", out, in, in); return;
+        case FUSED_SIGMOID: jit_emit(src, "%s = 1/(1 + exp(-%s));", out, in); return;
+        case FUSED_TANH: jit_emit(src, "%s = tanh(%s);", out, in); return;
+        case FUSED_EXP: jit_emit(src, "%s = exp(%s);", out, in); return;
+        case FUSED_LOG: jit_emit(src, "%s = log(%s);", out, in); return;
+        case FUSED_SQRT: jit_emit(src, "%s = sqrt(%s);", out, in); return;
+        case FUSED_ABS: jit_emit(src, "%s = fabs(%s);", out, in); return;
+    }
+};
+
+static void jit_fused_derivative(JITSource* src, const FusedOp op, const size_t k){
+    switch(op){
+        case FUSED_RELU: jit_emit(src, " g *= c%lu > 0 ? 1.0 : 0.0;", k + 1); return;
+        case FUSED_SIGMOID: jit_emit(src, " g *= c%lu * (1 - c%lu);", k + 1, k + 1); return;
+        case FUSED_TANH: jit_emit(src, " g *= 1 - c%lu * c%lu;", k + 1, k + 1); return;
+        case FUSED_EXP: jit_emit(src, " g *= c%lu;", k + 1); return;
+        case FUSED_LOG: jit_emit(src, " g *= 1.0 / c%lu;", k); return;
+        case FUSED_SQRT: jit_emit(src, " g *= 0.5 / c%lu;", k + 1); return;
+        case FUSED_ABS: jit_emit(src, " g *= c%lu < 0 ? -1.0 : 1.0;", k); return;
+    }
+};
+
+// Pre-activation of a fused node into the local c0, as fused_pre_activation
+static void jit_fused_pre_activation(JITSource* src, ADNode* node, const FusedCtx* ctx){
+    jit_emit(src, "double c0 = 0.0;");
+    for (size_t p = 0; p < ctx->num_pairs; p++){
+        jit_emit(src, " c0 += ");
+        jit_operand(src, node->parents[2 * p]);
+        jit_emit(src, " * ");
+        jit_operand(src, node->parents[2 * p + 1]);
+        jit_emit(src, ";");
+    }
+    for (size_t a = 0; a < ctx->num_addends; a++){
+        jit_emit(src, " c0 += ");
+        jit_operand(src, node->parents[2 * ctx->num_pairs + a]);
+        jit_emit(src, ";");
+    }
+    for (size_t k = 0; k < ctx->num_ops; k++){
+        char out[32], in[32];
+        snprintf(out, sizeof(out), " double c%lu", k + 1);
+        snprintf(in, sizeof(in), "c%lu", k);
+        jit_fused_apply(src, ctx->ops[k], out, in);
+    }
+};
+
+static const char* jit_unary_forward(ADNode* node){
+    if (node->forward == forward_sqrt) return "sqrt";
+    if (node->forward == forward_exp) return "exp";
+    if (node->forward == forward_log) return "log";
+    if (node->forward == forward_tanh) return "tanh";
+    if (node->forward == forward_abs) return "fabs";
+    return NULL;
+};
+
+static void jit_emit_forward_node(JITSource* src, ADNode* node, size_t* num_fallbacks){
+    const size_t i = node->topology_idx;
+    const char* unary = jit_unary_forward(node);
+
+    if (node->forward == forward_add || node->forward == forward_multiply){
+        const char add = node->forward == forward_add;
+        jit_emit(src, "V(%lu) = %s", i, add ? "0.0" : "1.0");
+        for (size_t p = 0; p < node->num_parents; p++){
+            jit_emit(src, add ? " + " : " * ");
+            jit_operand(src, node->parents[p]);
+        }
+        jit_emit(src, ";\n");
+    }
+    else if (node->forward == forward_subtract){
+        jit_emit(src, "V(%lu) = ", i);
+        jit_operand(src, node->parents[0]);
+        jit_emit(src, " - ");
+        jit_operand(src, node->parents[1]);
+        jit_emit(src, ";\n");
+    }
+    else if (unary){
+        jit_emit(src, "V(%lu) = %s(", i, unary);
+        jit_operand(src, node->parents[0]);
+        jit_emit(src, ");\n");
+    }
+    else if (node->forward == forward_sigmoid){
+        jit_emit(src, "V(%lu) = 1/(1 + exp(-(", i);
+        jit_operand(src, node->parents[0]);
+        jit_emit(src, ")));\n");
+    }
+    else if (node->forward == forward_relu){
+        jit_emit(src, "{ const double x = ");
+        jit_operand(src, node->parents[0]);
+        jit_emit(src, "; V(%lu) = x > 0 ? x : 0.0; }\n", i);
+    }
+    else if (node->forward == forward_fused){
+        const FusedCtx* ctx = (const FusedCtx*)node->ctx;
+        jit_emit(src, "{ ");
+        jit_fused_pre_activation(src, node, ctx);
+        jit_emit(src, " V(%lu) = c%lu; }\n", i, ctx->num_ops);
+    }
+    else {
+        jit_emit(src, "K(%lu, FORWARD);\n", i);
+        (*num_fallbacks)++;
+    }
+};
+
+// Accumulate G(i) * <factor> into the single parent of a unary node
+static void jit_unary_backward(JITSource* src, ADNode* node, const char* open, const char* close){
+    if (!jit_accumulate(src, node->parents[0])) return;
+    jit_emit(src, "G(%lu) * (%s", node->topology_idx, open);
+    if (close){
+        jit_operand(src, node->parents[0]);
+        jit_emit(src, "%s", close);
+    }
+    jit_emit(src, ");\n");
+};
+
+static void jit_emit_backward_node(JITSource* src, ADNode* node, size_t* num_fallbacks){
+    const size_t i = node->topology_idx;
+    char self[64];
+
+    if (node->backward == backward_add){
+        for (size_t p = 0; p < node->num_parents; p++){
+            if (jit_accumulate(src, node->parents[p])) jit_emit(src, "G(%lu);\n", i);
+        }
+    }
+    else if (node->backward == backward_multiply){
+        for (size_t p = 0; p < node->num_parents; p++){
+            if (!jit_accumulate(src, node->parents[p])) continue;
+            jit_emit(src, "G(%lu) * (1.0", i);
+            for (size_t k = 0; k < node->num_parents; k++){
+                if (k == p) continue;
+                jit_emit(src, " * ");
+                jit_operand(src, node->parents[k]);
+            }
+            jit_emit(src, ");\n");
+        }
+    }
+    else if (node->backward == backward_subtract){
+        if (jit_accumulate(src, node->parents[0])) jit_emit(src, "G(%lu);\n", i);
+        if (jit_accumulate(src, node->parents[1])) jit_emit(src, "-G(%lu);\n", i);
+    }
+    else if (node->backward == backward_sqrt){
+        snprintf(self, sizeof(self), "0.5 / V(%lu)", i);
+        jit_unary_backward(src, node, self, NULL);
+    }
+    else if (node->backward == backward_exp){
+        snprintf(self, sizeof(self), "V(%lu)", i);
+        jit_unary_backward(src, node, self, NULL);
+    }
+    else if (node->backward == backward_log){
+        jit_unary_backward(src, node, "1.0 / ", "");
+    }
+    else if (node->backward == backward_sigmoid){
+        snprintf(self, sizeof(self), "V(%lu) * (1 - V(%lu))", i, i);
+        jit_unary_backward(src, node, self, NULL);
+    }
+    else if (node->backward == backward_tanh){
+        snprintf(self, sizeof(self), "1 - pow(V(%lu), 2)", i);
+        jit_unary_backward(src, node, self, NULL);
+    }
+    else if (node->backward == backward_abs){
+        jit_unary_backward(src, node, "", " < 0 ? -1.0 : 1.0");
+    }
+    else if (node->backward == backward_relu){
+        if (node->parents[0]->is_constant) return;
+        jit_emit(src, "if (!(V(%lu) <= 0)) G(%lu) += G(%lu);\n", i, node->parents[0]->topology_idx, i);
+    }
+    else if (node->backward == backward_fused){
+        const FusedCtx* ctx = (const FusedCtx*)node->ctx;
+        jit_emit(src, "{ ");
+        jit_fused_pre_activation(src, node, ctx);
+        jit_emit(src, " double g = G(%lu);", i);
+        for (size_t k = ctx->num_ops; k-- > 0;){
+            jit_fused_derivative(src, ctx->ops[k], k);
+        }
+        for (size_t p = 0; p < ctx->num_pairs; p++){
+            ADNode* w = node->parents[2 * p];
+            ADNode* x = node->parents[2 * p + 1];
+            if (!w->is_constant){
+                jit_emit(src, " G(%lu) += g * ", w->topology_idx);
+                jit_operand(src, x);
+                jit_emit(src, ";");
+            }
+            if (!x->is_constant){
+                jit_emit(src, " G(%lu) += g * ", x->topology_idx);
+                jit_operand(src, w);
+                jit_emit(src, ";");
+            }
+        }
+        for (size_t a = 0; a < ctx->num_addends; a++){
+            ADNode* addend = node->parents[2 * ctx->num_pairs + a];
+            if (!addend->is_constant) jit_emit(src, " G(%lu) += g;", addend->topology_idx);
+        }
+        jit_emit(src, " }\n");
+    }
+    else {
+        jit_emit(src, "K(%lu, BACKWARD);\n", i);
+        (*num_fallbacks)++;
+    }
+};
+
+static void jit_emit_reset(JITSource* src, ADNode* node){
+    if (!node->is_constant) jit_emit(src, "G(%lu) = 0.0;\n", node->topology_idx);
+};
+
+// Opens chunk function c of a kernel once every GRAPH_JIT_CHUNK nodes
+static void jit_chunk(JITSource* src, const char* kernel, const size_t step, size_t* num_chunks){
+    if (step % GRAPH_JIT_CHUNK) return;
+    if (step) jit_emit(src, "}\n");
+    jit_emit(src, "static void %s_%lu(void* const* N){\n", kernel, (*num_chunks)++);
+};
+
+static void jit_entry(JITSource* src, const char* kernel, const size_t num_chunks){
+    if (num_chunks) jit_emit(src, "}\n");
+    jit_emit(src, "void cml_%s(void* const* N){\n", kernel);
+    for (size_t c = 0; c < num_chunks; c++) jit_emit(src, "    %s_%lu(N);\n", kernel, c);
+    jit_emit(src, "}\n\n");
+};
+
+static void jit_emit_graph(ComputeGraph* self, JITSource* src, size_t* num_fallbacks){
+    jit_emit(src, "/* Generated by graph_jit_compile: %lu nodes, %lu forward, %lu backward */\n", self->num_nodes, self->forward_len, self->backward_len);
+    jit_emit(src, "#include <math.h>\n");
+    jit_emit(src, "#define V(i) (**(double* const*)((const char*)N[i] + %lu))\n", offsetof(ADNode, value));
+    jit_emit(src, "#define G(i) (**(double* const*)((const char*)N[i] + %lu))\n", offsetof(ADNode, grad));
+    jit_emit(src, "#define FORWARD %lu\n", offsetof(ADNode, forward));
+    jit_emit(src, "#define BACKWARD %lu\n", offsetof(ADNode, backward));
+    jit_emit(src, "#define K(i, kernel) ((*(void (* const*)(void*))((const char*)N[i] + kernel))(N[i]))\n\n");
+
+    size_t num_chunks = 0;
+    for (size_t s = 0; s < self->forward_len; s++){
+        jit_chunk(src, "forward", s, &num_chunks);
+        jit_emit_forward_node(src, self->forward_schedule[s], num_fallbacks);
+    }
+    jit_entry(src, "forward", num_chunks);
+
+    // Resets ahead of the first chunk, as graph_replay_backward(_planned)
+    num_chunks = 0;
+    jit_chunk(src, "backward", 0, &num_chunks);
+    if (!self->slab){
+        for (size_t i = 0; i < self->num_nodes; i++){
+            if (!self->nodes[i]->is_trainable) jit_emit_reset(src, self->nodes[i]);
+        }
+    }
+    jit_emit(src, "G(%lu) = 1.0;\n", self->head->topology_idx);
+
+    for (size_t s = 0; s < self->backward_len; s++){
+        if (s) jit_chunk(src, "backward", s, &num_chunks);
+        if (self->slab){
+            for (size_t z = self->zero_begin[s]; z < self->zero_begin[s + 1]; z++) jit_emit_reset(src, self->zero_list[z]);
+        }
+        jit_emit_backward_node(src, self->backward_schedule[s], num_fallbacks);
+    }
+    jit_entry(src, "backward", num_chunks);
+};
+
+// FNV-1a
+static uint64_t jit_hash(const char* text, const size_t len){
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++){
+        h ^= (unsigned char)text[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+};
+
+// snprintf into a path buffer, 0 if the path does not fit
+static char jit_path(char* path, const size_t size, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    const int len = vsnprintf(path, size, format, args);
+    va_end(args);
+    if (len < 0 || (size_t)len >= size){
+        printf("JIT: path too long for the cache.\n");
+        return 0;
+    }
+    return 1;
+};
+
+// Regular file or directory of this user that nobody else can write, symlinks are refused
+static char jit_is_private(const char* path, const char is_dir){
+    struct stat st;
+    if (lstat(path, &st) != 0) return 0;
+    if (is_dir ? !S_ISDIR(st.st_mode) : !S_ISREG(st.st_mode)) return 0;
+    return st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+};
+
+// Per-user cache directory, created 0700 if missing, 0 if there is no private one
+static char jit_cache_dir(char* dir, const size_t size){
+    const char* env = getenv("CML_JIT_CACHE_DIR");
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    if (env && *env){
+        if (!jit_path(dir, size, "%s", env)) return 0;
+    }
+    else if (xdg && *xdg){
+        if (!jit_path(dir, size, "%s/cml_jit", xdg)) return 0;
+    }
+    else if (home && *home){
+        if (!jit_path(dir, size, "%s/.cache", home)) return 0;
+        mkdir(dir, 0700);
+        if (!jit_path(dir, size, "%s/.cache/cml_jit", home)) return 0;
+    }
+    else {
+        printf("JIT: no cache directory, set CML_JIT_CACHE_DIR or HOME.\n");
+        return 0;
+    }
+
+    mkdir(dir, 0700);
+    if (!jit_is_private(dir, 1)){
+        printf("JIT: cache directory %s is not a private directory of this user.\n", dir);
+        return 0;
+    }
+    return 1;
+};
+
+// Cached source equal to src byte for byte
+static char jit_same_source(const char* c_path, const JITSource* src){
+    FILE* file = fopen(c_path, "rb");
+    if (file == NULL) return 0;
+
+    char buffer[4096];
+    size_t offset = 0;
+    char same = 1;
+    while (same){
+        const size_t len = fread(buffer, 1, sizeof(buffer), file);
+        if (len == 0) break;
+        same = offset + len <= src->len && memcmp(buffer, src->text + offset, len) == 0;
+        offset += len;
+    }
+    fclose(file);
+    return same && offset == src->len;
+};
+
+// Runs the compiler directly, no shell sees the paths
+static char jit_run_compiler(const char* so_path, const char* c_path){
+    const char* cc = getenv("CML_JIT_CC");
+    char* const argv[] = {
+        (char*)(cc && *cc ? cc : "cc"), "-O2", "-fPIC", "-shared", "-fno-fast-math", "-ffp-contract=off",
+        "-o", (char*)so_path, (char*)c_path, "-lm", NULL
+    };
+
+    fflush(stdout);
+    const pid_t child = fork();
+    if (child < 0) return 0;
+    if (child == 0){
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(child, &status, 0) < 0){
+        if (errno != EINTR) return 0;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+};
+
+static char jit_build(const JITSource* src, const char* c_path, const char* so_path){
+    char tmp_c[4096], tmp_so[4096];
+    const int pid = (int)getpid();
+    if (!jit_path(tmp_c, sizeof(tmp_c), "%s.%d.tmp.c", c_path, pid) ||
+        !jit_path(tmp_so, sizeof(tmp_so), "%s.%d.tmp", so_path, pid)) return 0;
+
+    const int fd = open(tmp_c, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    FILE* file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (file == NULL){
+        printf("JIT: cannot write %s.\n", tmp_c);
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    const size_t written = fwrite(src->text, 1, src->len, file);
+    if (fclose(file) != 0 || written != src->len){
+        printf("JIT: cannot write %s.\n", tmp_c);
+        remove(tmp_c);
+        return 0;
+    }
+
+    if (!jit_run_compiler(tmp_so, tmp_c)){
+        printf("JIT: compiling %s failed.\n", tmp_c);
+        remove(tmp_c);
+        remove(tmp_so);
+        return 0;
+    }
+    chmod(tmp_so, 0700);
+
+    // Concurrent builds of the same graph race for the same names, rename is atomic
+    if (rename(tmp_c, c_path) != 0){
+        printf("JIT: cannot move %s into the cache.\n", tmp_c);
+        remove(tmp_c);
+        remove(tmp_so);
+        return 0;
+    }
+    if (rename(tmp_so, so_path) != 0){
+        printf("JIT: cannot move %s into the cache.\n", tmp_so);
+        remove(tmp_so);
+        return 0;
+    }
+    return 1;
+};
+
+// Compiles the captured graph, returns 0 (and keeps interpreting) if that is not possible
+char graph_jit_compile(ComputeGraph* self){
+    if (self == NULL || !self->is_captured){
+        printf("Graph has not been captured, call graph_capture before graph_jit_compile.\n");
+        return 0;
+    }
+
+    graph_release_jit(self);
+    for (size_t i = 0; i < self->num_nodes; i++){
+        self->nodes[i]->topology_idx = i;
+    }
+
+    JITSource src = {NULL, 0, 0};
+    size_t num_fallbacks = 0;
+    jit_emit_graph(self, &src, &num_fallbacks);
+    const uint64_t hash = jit_hash(src.text, src.len);
+
+    char dir[4096];
+    if (!jit_cache_dir(dir, sizeof(dir))){
+        free(src.text);
+        return 0;
+    }
+
+    // A cached object is trusted only next to the exact source it was built from
+    char so_path[4096], c_path[4096];
+    if (!jit_path(so_path, sizeof(so_path), "%s/cml_jit_%016llx.so", dir, (unsigned long long)hash) ||
+        !jit_path(c_path, sizeof(c_path), "%s/cml_jit_%016llx.c", dir, (unsigned long long)hash)){
+        free(src.text);
+        return 0;
+    }
+    const char from_cache = jit_is_private(so_path, 0) && jit_is_private(c_path, 0) && jit_same_source(c_path, &src);
+    if (!from_cache && !jit_build(&src, c_path, so_path)){
+        free(src.text);
+        return 0;
+    }
+    free(src.text);
+
+    void* handle = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+    GraphJITKernel forward = NULL, backward = NULL;
+    if (handle){
+        // POSIX way to turn the symbol into a function pointer
+        *(void**)(&forward) = dlsym(handle, "cml_forward");
+        *(void**)(&backward) = dlsym(handle, "cml_backward");
+    }
+    if (forward == NULL || backward == NULL){
+        const char* error = dlerror();
+        printf("JIT: cannot load %s: %s\n", so_path, error ? error : "missing kernels");
+        if (handle) dlclose(handle);
+        return 0;
+    }
+
+    GraphJIT* jit = (GraphJIT*)malloc(sizeof(GraphJIT));
+    if (jit == NULL){
+        printf("Failed to allocate memory for the JIT state.\n");
+        exit(1);
+    }
+    jit->handle = handle;
+    jit->forward = forward;
+    jit->backward = backward;
+    jit->hash = hash;
+    jit->num_fallbacks = num_fallbacks;
+    jit->from_cache = from_cache;
+    self->jit = jit;
+
+    printf("JIT: %lu forward, %lu backward kernels, %lu called through the node -> %s (%s)\n",
+           self->forward_len, self->backward_len, num_fallbacks, so_path, from_cache ? "cached" : "compiled");
+    return 1;
+};
+#pragma endregion JIT
+
+ComputeGraph* compute_graph_new(){
+    ComputeGraph* graph = (ComputeGraph*)malloc(sizeof(ComputeGraph));
+    graph->capacity = 10; // start with space for 10 Nodes
+    graph->nodes = (ADNode**)malloc(graph->capacity * sizeof(ComputeGraph*));
+    graph->num_nodes = 0;
+    graph->self = graph;
+    graph->head = NULL;
+    graph->optimizer = NULL;
+
+    graph->forward_schedule = NULL;
+    graph->forward_len = 0;
+    graph->backward_schedule = NULL;
+    graph->backward_len = 0;
+    graph->is_captured = 0;
+
+    graph->slab = NULL;
+    graph->plan_bindings = NULL;
+    graph->num_plan_bindings = 0;
+    graph->zero_list = NULL;
+    graph->zero_begin = NULL;
+    graph->planned_bytes = 0;
+    graph->unplanned_bytes = 0;
+    graph->parallel = NULL;
+    graph->eager_release = 0;
+    graph->released_nodes = 0;
+    graph->released_bytes = 0;
+    graph->jit = NULL;
 
     // Set methods
     graph->add_node = add_node_to_graph;
@@ -263,6 +2070,11 @@ ComputeGraph* compute_graph_new(){
     graph->prune = graph_prune;
     graph->build = graph_build;
     graph->optimize = graph_optimize;
+    graph->capture = graph_capture;
+    graph->replay_forward = graph_replay_forward;
+    graph->replay_backward = graph_replay_backward;
+    graph->zero_grad = graph_zero_grad;
+    graph->plan_memory = graph_plan_memory;
 
     return graph; 
 };
@@ -0,0 +1,333 @@
+#ifndef __FORWARD_MODE_H__
+#define __FORWARD_MODE_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tensor.h"
+
+/*
+Forward-mode autodiff (Jacobian-vector products)
+
+Every value carries JVP_LANES tangents, i.e. the directional derivatives along JVP_LANES seed
+directions, which are propagated together with the value in a single forward pass. This is the
+multi-lane form of Dual {value, grad}: lane k of an element is the Dual of the same computation
+seeded with direction k.
+
+The tangent lanes are GCC vector types, the per-element derivative rules therefore compile to
+SIMD instructions (JVP_LANES 4 = one AVX register, 2 = one SSE register). No ADNode is created
+and nothing is recorded; a pass costs about JVP_LANES + 1 evaluations of the function and
+yields JVP_LANES columns of its Jacobian. For many outputs and few inputs (e.g. sensitivity of
+all predictions to a handful of feature columns) this beats one reverse pass per output.
+
+    JVPTensor* x = jvp_tensor_from_tensor(X);
+    jvp_tensor_seed(x, 2, 0, 0, 1.0);            // lane 0: d/dx_2
+    JVPTensor* y = forward_sequential_nn_jvp(model, x);
+    jvp_tensor_get_tangent(y, i, 0, 0);           // dy_i/dx_2
+*/
+
+#ifndef JVP_LANES
+#define JVP_LANES 4
+#endif
+
+typedef double JVPLanes __attribute__((vector_size(JVP_LANES * sizeof(double))));
+
+typedef struct JVPTensor{
+    size_t n_rows;
+    size_t n_cols;
+    double* values;         // row major
+    JVPLanes* tangents;     // JVP_LANES tangents per element, row major
+
+    void (*destroy)(struct JVPTensor* self);
+    void (*print)(struct JVPTensor* self);
+}JVPTensor;
+
+void jvp_tensor_destroy(JVPTensor* self){
+    if (self == NULL) return;
+    free(self->values);
+    free(self->tangents);
+    free(self);
+};
+
+void jvp_tensor_print(JVPTensor* self){
+    for (size_t i = 0; i < self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            const size_t idx = i * self->n_cols + j;
+            printf("%f [", self->values[idx]);
+            for (size_t k = 0; k < JVP_LANES; k++) printf(k ? " %f" : "%f", self->tangents[idx][k]);
+            printf("] ");
+        }
+        printf("\n");
+    }
+};
+
+JVPTensor* jvp_tensor_new(const size_t n_rows, const size_t n_cols){
+    JVPTensor* tensor = (JVPTensor*)malloc(sizeof(JVPTensor));
+    if (tensor == NULL){
+        printf("Failed to allocate memory for JVP Tensor.\n");
+        exit(1);
+    }
+
+    const size_t n = n_rows * n_cols;
+    tensor->n_rows = n_rows;
+    tensor->n_cols = n_cols;
+    tensor->values = (double*)calloc(n ? n : 1, sizeof(double));
+
+    // Vector loads and stores need the lanes aligned to their full width
+    void* tangents = NULL;
+    if (tensor->values == NULL || posix_memalign(&tangents, sizeof(JVPLanes), (n ? n : 1) * sizeof(JVPLanes)) != 0){
+        printf("Failed to allocate memory for JVP Tensor buffers.\n");
+        exit(1);
+    }
+    tensor->tangents = (JVPLanes*)tangents;
+    memset(tensor->tangents, 0, (n ? n : 1) * sizeof(JVPLanes));
+
+    tensor->destroy = jvp_tensor_destroy;
+    tensor->print = jvp_tensor_print;
+    return tensor;
+};
+
+// Values of a Tensor with all tangents zero
+JVPTensor* jvp_tensor_from_tensor(Tensor* tensor){
+    JVPTensor* result = jvp_tensor_new(tensor->n_rows, tensor->n_cols);
+    for (size_t i = 0; i < tensor->n_rows; i++){
+        for (size_t j = 0; j < tensor->n_cols; j++){
+            result->values[i * tensor->n_cols + j] = *tensor_get_node(tensor, i, j)->value;
+        }
+    }
+    return result;
+};
+
+JVPTensor* jvp_tensor_copy(JVPTensor* self){
+    JVPTensor* result = jvp_tensor_new(self->n_rows, self->n_cols);
+    memcpy(result->values, self->values, self->n_rows * self->n_cols * sizeof(double));
+    memcpy(result->tangents, self->tangents, self->n_rows * self->n_cols * sizeof(JVPLanes));
+    return result;
+};
+
+void jvp_tensor_seed(JVPTensor* self, const size_t i, const size_t j, const size_t lane, const double tangent){
+    if (i >= self->n_rows || j >= self->n_cols || lane >= JVP_LANES){
+        printf("Index (%lu, %lu) or lane %lu out of range in jvp_tensor_seed.\n", i, j, lane);
+        exit(1);
+    }
+    self->tangents[i * self->n_cols + j][lane] = tangent;
+};
+
+double jvp_tensor_get_val(JVPTensor* self, const size_t i, const size_t j){
+    return self->values[i * self->n_cols + j];
+};
+
+double jvp_tensor_get_tangent(JVPTensor* self, const size_t i, const size_t j, const size_t lane){
+    return self->tangents[i * self->n_cols + j][lane];
+};
+
+// One lane of an element as the scalar Dual
+Dual jvp_tensor_get_dual(JVPTensor* self, const size_t i, const size_t j, const size_t lane){
+    Dual dual = {self->values[i * self->n_cols + j], self->tangents[i * self->n_cols + j][lane]};
+    return dual;
+};
+
+#pragma region JVP Tensor Operations
+
+static void jvp_check_same_shape(JVPTensor* a, JVPTensor* b, const char* op){
+    if (a->n_rows != b->n_rows || a->n_cols != b->n_cols){
+        printf("Shapes (%lu, %lu) and (%lu, %lu) do not match in %s.\n", a->n_rows, a->n_cols, b->n_rows, b->n_cols, op);
+        exit(1);
+    }
+};
+
+void jvp_tensor_add_inplace(JVPTensor* self, JVPTensor* tensor){
+    jvp_check_same_shape(self, tensor, "jvp_tensor_add_inplace");
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        self->values[k] += tensor->values[k];
+        self->tangents[k] += tensor->tangents[k];
+    }
+};
+
+JVPTensor* jvp_tensor_add(JVPTensor* self, JVPTensor* tensor){
+    JVPTensor* result = jvp_tensor_copy(self);
+    jvp_tensor_add_inplace(result, tensor);
+    return result;
+};
+
+void jvp_tensor_subtract_inplace(JVPTensor* self, JVPTensor* tensor){
+    jvp_check_same_shape(self, tensor, "jvp_tensor_subtract_inplace");
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        self->values[k] -= tensor->values[k];
+        self->tangents[k] -= tensor->tangents[k];
+    }
+};
+
+JVPTensor* jvp_tensor_subtract(JVPTensor* self, JVPTensor* tensor){
+    JVPTensor* result = jvp_tensor_copy(self);
+    jvp_tensor_subtract_inplace(result, tensor);
+    return result;
+};
+
+// Constant operand (e.g. parameters): its tangent is zero
+void jvp_tensor_add_tensor_inplace(JVPTensor* self, Tensor* tensor){
+    if (self->n_rows != tensor->n_rows || self->n_cols != tensor->n_cols){
+        printf("Shapes do not match in jvp_tensor_add_tensor_inplace.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            self->values[i * self->n_cols + j] += *tensor_get_node(tensor, i, j)->value;
+        }
+    }
+};
+
+void jvp_tensor_scalar_product_inplace(JVPTensor* self, const double scalar){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        self->values[k] *= scalar;
+        self->tangents[k] *= scalar;
+    }
+};
+
+JVPTensor* jvp_tensor_scalar_product(JVPTensor* self, const double scalar){
+    JVPTensor* result = jvp_tensor_copy(self);
+    jvp_tensor_scalar_product_inplace(result, scalar);
+    return result;
+};
+
+// Product rule: d(AB) = dA B + A dB
+JVPTensor* jvp_tensor_dot_product(JVPTensor* self, JVPTensor* tensor){
+    if (self->n_cols != tensor->n_rows){
+        printf("Shapes (%lu, %lu) and (%lu, %lu) do not align in jvp_tensor_dot_product.\n", self->n_rows, self->n_cols, tensor->n_rows, tensor->n_cols);
+        exit(1);
+    }
+
+    JVPTensor* result = jvp_tensor_new(self->n_rows, tensor->n_cols);
+    for (size_t i = 0; i < self->n_rows; i++){
+        for (size_t k = 0; k < self->n_cols; k++){
+            const double a = self->values[i * self->n_cols + k];
+            const JVPLanes da = self->tangents[i * self->n_cols + k];
+            for (size_t j = 0; j < tensor->n_cols; j++){
+                const size_t out = i * tensor->n_cols + j;
+                const double b = tensor->values[k * tensor->n_cols + j];
+                result->values[out] += a * b;
+                result->tangents[out] += da * b + a * tensor->tangents[k * tensor->n_cols + j];
+            }
+        }
+    }
+    return result;
+};
+
+// W X for a constant W (layer weights), the counterpart of tensor_dot_product_reversed_order_inplace
+JVPTensor* jvp_tensor_dot_product_tensor(Tensor* weights, JVPTensor* self){
+    if (weights->n_cols != self->n_rows){
+        printf("Shapes (%lu, %lu) and (%lu, %lu) do not align in jvp_tensor_dot_product_tensor.\n", weights->n_rows, weights->n_cols, self->n_rows, self->n_cols);
+        exit(1);
+    }
+
+    JVPTensor* result = jvp_tensor_new(weights->n_rows, self->n_cols);
+    for (size_t i = 0; i < weights->n_rows; i++){
+        for (size_t k = 0; k < weights->n_cols; k++){
+            const double w = *tensor_get_node(weights, i, k)->value;
+            for (size_t j = 0; j < self->n_cols; j++){
+                const size_t out = i * self->n_cols + j;
+                result->values[out] += w * self->values[k * self->n_cols + j];
+                result->tangents[out] += w * self->tangents[k * self->n_cols + j];
+            }
+        }
+    }
+    return result;
+};
+
+JVPTensor* jvp_tensor_transpose(JVPTensor* self){
+    JVPTensor* result = jvp_tensor_new(self->n_cols, self->n_rows);
+    for (size_t i = 0; i < self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            result->values[j * self->n_rows + i] = self->values[i * self->n_cols + j];
+            result->tangents[j * self->n_rows + i] = self->tangents[i * self->n_cols + j];
+        }
+    }
+    return result;
+};
+
+#pragma endregion JVP Tensor Operations
+
+#pragma region JVP Activations
+// Chain rule per element: value <- f(value), tangents <- f'(value) * tangents
+
+void jvp_tensor_relu_inplace(JVPTensor* self){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        const double slope = self->values[k] > 0 ? 1.0 : 0.0;
+        self->values[k] *= slope;
+        self->tangents[k] *= slope;
+    }
+};
+
+void jvp_tensor_sigmoid_inplace(JVPTensor* self){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        const double s = 1.0 / (1.0 + exp(-self->values[k]));
+        self->values[k] = s;
+        self->tangents[k] *= s * (1.0 - s);
+    }
+};
+
+void jvp_tensor_tanh_inplace(JVPTensor* self){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        const double t = tanh(self->values[k]);
+        self->values[k] = t;
+        self->tangents[k] *= 1.0 - t * t;
+    }
+};
+
+void jvp_tensor_exp_inplace(JVPTensor* self){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        const double e = exp(self->values[k]);
+        self->values[k] = e;
+        self->tangents[k] *= e;
+    }
+};
+
+void jvp_tensor_log_inplace(JVPTensor* self){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        const double inv = 1.0 / self->values[k];
+        self->values[k] = log(self->values[k]);
+        self->tangents[k] *= inv;
+    }
+};
+
+void jvp_tensor_sqrt_inplace(JVPTensor* self){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        const double r = sqrt(self->values[k]);
+        self->values[k] = r;
+        self->tangents[k] *= 0.5 / r;
+    }
+};
+
+void jvp_tensor_abs_inplace(JVPTensor* self){
+    const size_t n = self->n_rows * self->n_cols;
+    for (size_t k = 0; k < n; k++){
+        const double sign = self->values[k] < 0 ? -1.0 : 1.0;
+        self->values[k] *= sign;
+        self->tangents[k] *= sign;
+    }
+};
+
+// Forward-mode counterpart of an in-place Tensor activation, NULL if there is none
+void (*jvp_activation_for(void (*act_fn)(Tensor* X)))(JVPTensor* X){
+    if (act_fn == tensor_relu_inplace) return jvp_tensor_relu_inplace;
+    if (act_fn == tensor_sigmoid_inplace) return jvp_tensor_sigmoid_inplace;
+    if (act_fn == tensor_tanh_inplace) return jvp_tensor_tanh_inplace;
+    if (act_fn == tensor_exp_inplace) return jvp_tensor_exp_inplace;
+    if (act_fn == tensor_log_inplace) return jvp_tensor_log_inplace;
+    if (act_fn == tensor_sqrt_inplace) return jvp_tensor_sqrt_inplace;
+    if (act_fn == tensor_abs_inplace) return jvp_tensor_abs_inplace;
+    return NULL;
+};
+
+#pragma endregion JVP Activations
+
+#endif // __FORWARD_MODE_H__
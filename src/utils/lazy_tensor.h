@@ -0,0 +1,557 @@
+#ifndef __LAZY_TENSOR_H__
+#define __LAZY_TENSOR_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tensor.h"
+
+/*
+Lazy tensor evaluation
+
+Lazy ops only record an expression DAG. Nothing is computed until a value is read (lazy_eval,
+lazy_get_val_at). At that point all elementwise and broadcast ops between the result and its
+sources are compiled into one small program and evaluated by a single registered op node (see
+node_apply_op). That node sweeps the output once, tile by tile, keeping the intermediates of a
+tile in a few cache resident registers. Sources are wrapped tensors and materialized results.
+Eager Tensor ops instead write every intermediate to a new tensor of nodes.
+
+Matrix products are barriers: their operands are materialized first and the product is an
+ordinary tensor_dot_product, which the next chain reads as a source.
+
+    LazyContext* ctx = lazy_context_new();
+    LazyTensor* Z = lazy_add(ctx, lazy_matmul(ctx, lazy_tensor(ctx, W), lazy_tensor(ctx, X)), lazy_tensor(ctx, b));
+    Tensor* Y = lazy_eval(lazy_sigmoid(ctx, Z));      // one fused node for + b and the sigmoid
+    ...
+    lazy_context_reset(ctx);                          // step boundary
+
+All expressions of a step live in their context and are freed together by lazy_context_reset.
+Materialized tensors are detached there: their nodes belong to the graph built on top of them
+like those of any other op result. Expressions that were never read cost nothing.
+*/
+
+#ifndef LAZY_TILE
+#define LAZY_TILE 256
+#endif
+
+typedef enum {
+    LAZY_SOURCE,
+    LAZY_ADD,
+    LAZY_SUBTRACT,
+    LAZY_MULTIPLY,
+    LAZY_SCALE,
+    LAZY_RELU,
+    LAZY_SIGMOID,
+    LAZY_TANH,
+    LAZY_EXP,
+    LAZY_LOG,
+    LAZY_SQRT,
+    LAZY_ABS,
+    LAZY_MATMUL,
+}LazyOp;
+
+struct LazyContext;
+
+typedef struct LazyTensor{
+    LazyOp op;
+    size_t n_batch;
+    size_t n_rows;
+    size_t n_cols;
+    struct LazyTensor* inputs[2];
+    double scalar;
+
+    // Wrapped tensor of a source, also set once the expression is materialized
+    Tensor* tensor;
+    char owns_tensor;
+
+    // Compiler scratch, valid while mark equals the generation of the compiler that set it
+    size_t mark;
+    size_t slot;
+    struct LazyContext* ctx;
+}LazyTensor;
+
+typedef struct LazyContext{
+    LazyTensor** nodes;
+    size_t num_nodes;
+    size_t capacity;
+    size_t generation;
+
+    void (*reset)(struct LazyContext* self);
+    void (*destroy)(struct LazyContext* self);
+}LazyContext;
+
+void lazy_context_reset(LazyContext* self){
+    for (size_t i = 0; i < self->num_nodes; i++){
+        LazyTensor* node = self->nodes[i];
+        if (node->owns_tensor) tensor_detach(node->tensor);
+        free(node);
+    }
+    self->num_nodes = 0;
+};
+
+static void lazy_release_regs(void);
+
+void lazy_context_destroy(LazyContext* self){
+    if (self == NULL) return;
+    lazy_context_reset(self);
+    lazy_release_regs();
+    free(self->nodes);
+    free(self);
+};
+
+LazyContext* lazy_context_new(){
+    LazyContext* ctx = (LazyContext*)malloc(sizeof(LazyContext));
+    if (ctx == NULL){
+        printf("Failed to allocate memory for Lazy Context.\n");
+        exit(1);
+    }
+
+    ctx->capacity = 64;
+    ctx->nodes = (LazyTensor**)malloc(ctx->capacity * sizeof(LazyTensor*));
+    if (ctx->nodes == NULL){
+        printf("Failed to allocate memory for Lazy Context nodes.\n");
+        exit(1);
+    }
+    ctx->num_nodes = 0;
+    ctx->generation = 0;
+
+    ctx->reset = lazy_context_reset;
+    ctx->destroy = lazy_context_destroy;
+    return ctx;
+};
+
+static LazyTensor* lazy_node_new(LazyContext* ctx, const LazyOp op, const size_t n_batch, const size_t n_rows, const size_t n_cols){
+    LazyTensor* node = (LazyTensor*)calloc(1, sizeof(LazyTensor));
+    if (node == NULL){
+        printf("Failed to allocate memory for Lazy Tensor.\n");
+        exit(1);
+    }
+
+    if (ctx->num_nodes == ctx->capacity){
+        ctx->capacity *= 2;
+        ctx->nodes = (LazyTensor**)realloc(ctx->nodes, ctx->capacity * sizeof(LazyTensor*));
+        if (ctx->nodes == NULL){
+            printf("Failed to allocate memory for Lazy Context nodes.\n");
+            exit(1);
+        }
+    }
+    ctx->nodes[ctx->num_nodes++] = node;
+
+    node->op = op;
+    node->n_batch = n_batch;
+    node->n_rows = n_rows;
+    node->n_cols = n_cols;
+    node->ctx = ctx;
+    return node;
+};
+
+#pragma region Lazy Ops
+// Source wrapping a tensor, the tensor stays owned by the caller
+LazyTensor* lazy_tensor(LazyContext* ctx, Tensor* tensor){
+    if (tensor == NULL){
+        printf("Tensor to be wrapped points to an empty address.\n");
+        exit(0);
+    }
+
+    LazyTensor* node = lazy_node_new(ctx, LAZY_SOURCE, tensor->n_batch, tensor->n_rows, tensor->n_cols);
+    node->tensor = tensor;
+    return node;
+};
+
+static LazyTensor* lazy_binary(LazyContext* ctx, const LazyOp op, LazyTensor* a, LazyTensor* b, const char* name){
+    const size_t n_batch = tensor_broadcast_dim(a->n_batch, b->n_batch, name);
+    const size_t n_rows = tensor_broadcast_dim(a->n_rows, b->n_rows, name);
+    const size_t n_cols = tensor_broadcast_dim(a->n_cols, b->n_cols, name);
+
+    LazyTensor* node = lazy_node_new(ctx, op, n_batch, n_rows, n_cols);
+    node->inputs[0] = a;
+    node->inputs[1] = b;
+    return node;
+};
+
+static LazyTensor* lazy_unary(LazyContext* ctx, const LazyOp op, LazyTensor* a){
+    LazyTensor* node = lazy_node_new(ctx, op, a->n_batch, a->n_rows, a->n_cols);
+    node->inputs[0] = a;
+    return node;
+};
+
+LazyTensor* lazy_add(LazyContext* ctx, LazyTensor* a, LazyTensor* b){
+    return lazy_binary(ctx, LAZY_ADD, a, b, "lazy_add");
+};
+
+LazyTensor* lazy_subtract(LazyContext* ctx, LazyTensor* a, LazyTensor* b){
+    return lazy_binary(ctx, LAZY_SUBTRACT, a, b, "lazy_subtract");
+};
+
+// Elementwise product
+LazyTensor* lazy_multiply(LazyContext* ctx, LazyTensor* a, LazyTensor* b){
+    return lazy_binary(ctx, LAZY_MULTIPLY, a, b, "lazy_multiply");
+};
+
+LazyTensor* lazy_scale(LazyContext* ctx, LazyTensor* a, const double scalar){
+    LazyTensor* node = lazy_unary(ctx, LAZY_SCALE, a);
+    node->scalar = scalar;
+    return node;
+};
+
+LazyTensor* lazy_relu(LazyContext* ctx, LazyTensor* a){ return lazy_unary(ctx, LAZY_RELU, a); };
+LazyTensor* lazy_sigmoid(LazyContext* ctx, LazyTensor* a){ return lazy_unary(ctx, LAZY_SIGMOID, a); };
+LazyTensor* lazy_tanh(LazyContext* ctx, LazyTensor* a){ return lazy_unary(ctx, LAZY_TANH, a); };
+LazyTensor* lazy_exp(LazyContext* ctx, LazyTensor* a){ return lazy_unary(ctx, LAZY_EXP, a); };
+LazyTensor* lazy_log(LazyContext* ctx, LazyTensor* a){ return lazy_unary(ctx, LAZY_LOG, a); };
+LazyTensor* lazy_sqrt(LazyContext* ctx, LazyTensor* a){ return lazy_unary(ctx, LAZY_SQRT, a); };
+LazyTensor* lazy_abs(LazyContext* ctx, LazyTensor* a){ return lazy_unary(ctx, LAZY_ABS, a); };
+
+// Batched matrix product, a barrier for fusion
+LazyTensor* lazy_matmul(LazyContext* ctx, LazyTensor* a, LazyTensor* b){
+    if (a->n_cols != b->n_rows){
+        printf("Lazy tensor dimensions do not match for multiplication.\n");
+        exit(0);
+    }
+
+    const size_t n_batch = tensor_broadcast_dim(a->n_batch, b->n_batch, "lazy_matmul");
+    LazyTensor* node = lazy_node_new(ctx, LAZY_MATMUL, n_batch, a->n_rows, b->n_cols);
+    node->inputs[0] = a;
+    node->inputs[1] = b;
+    return node;
+};
+
+// Lazy counterpart of an in-place Tensor activation, NULL if there is none
+LazyTensor* (*lazy_activation_for(void (*act_fn)(Tensor* X)))(LazyContext* ctx, LazyTensor* X){
+    if (act_fn == tensor_relu_inplace) return lazy_relu;
+    if (act_fn == tensor_sigmoid_inplace) return lazy_sigmoid;
+    if (act_fn == tensor_tanh_inplace) return lazy_tanh;
+    if (act_fn == tensor_exp_inplace) return lazy_exp;
+    if (act_fn == tensor_log_inplace) return lazy_log;
+    if (act_fn == tensor_sqrt_inplace) return lazy_sqrt;
+    if (act_fn == tensor_abs_inplace) return lazy_abs;
+    return NULL;
+};
+#pragma endregion Lazy Ops
+
+#pragma region Fused Program
+/*
+A compiled chain is a program of instructions in topological order, the last one is the
+result. LAZY_SOURCE instructions load source a. Sources are laid out one after another in the
+op input buffer, each row major in its own (possibly broadcast) shape. The program is stored
+as the params of its op node:
+
+    LazyProgram | LazySource[num_sources] | LazyInstr[num_instrs]
+*/
+typedef struct {
+    LazyOp op;
+    size_t a;
+    size_t b;
+    double scalar;
+}LazyInstr;
+
+typedef struct {
+    size_t offset;
+    size_t n_batch;
+    size_t n_rows;
+    size_t n_cols;
+}LazySource;
+
+typedef struct {
+    size_t n_batch;
+    size_t n_rows;
+    size_t n_cols;
+    size_t num_sources;
+    size_t num_instrs;
+}LazyProgram;
+
+static const LazySource* lazy_program_sources(const LazyProgram* program){
+    return (const LazySource*)(program + 1);
+};
+
+static const LazyInstr* lazy_program_instrs(const LazyProgram* program){
+    return (const LazyInstr*)(lazy_program_sources(program) + program->num_sources);
+};
+
+// Position in the input buffer of the source element broadcast to output element f
+static size_t lazy_source_index(const LazyProgram* program, const LazySource* source, const size_t f){
+    const size_t j = f % program->n_cols;
+    const size_t i = (f / program->n_cols) % program->n_rows;
+    const size_t b = f / (program->n_cols * program->n_rows);
+    const size_t bb = source->n_batch == 1 ? 0 : b;
+    const size_t ii = source->n_rows == 1 ? 0 : i;
+    const size_t jj = source->n_cols == 1 ? 0 : j;
+    return source->offset + (bb * source->n_rows + ii) * source->n_cols + jj;
+};
+
+// Evaluate elements [begin, begin + len) into regs, instruction k at regs[k * LAZY_TILE]
+static void lazy_run_tile(const LazyProgram* program, const double* in, const size_t begin, const size_t len, double* regs){
+    const LazySource* sources = lazy_program_sources(program);
+    const LazyInstr* instrs = lazy_program_instrs(program);
+
+    for (size_t k = 0; k < program->num_instrs; k++){
+        const LazyInstr* instr = instrs + k;
+        double* r = regs + k * LAZY_TILE;
+        const double* x = regs + instr->a * LAZY_TILE;
+        const double* y = regs + instr->b * LAZY_TILE;
+
+        switch(instr->op){
+            case LAZY_SOURCE:
+                for (size_t e = 0; e < len; e++) r[e] = in[lazy_source_index(program, sources + instr->a, begin + e)];
+                break;
+            case LAZY_ADD: for (size_t e = 0; e < len; e++) r[e] = x[e] + y[e]; break;
+            case LAZY_SUBTRACT: for (size_t e = 0; e < len; e++) r[e] = x[e] - y[e]; break;
+            case LAZY_MULTIPLY: for (size_t e = 0; e < len; e++) r[e] = x[e] * y[e]; break;
+            case LAZY_SCALE: for (size_t e = 0; e < len; e++) r[e] = instr->scalar * x[e]; break;
+            case LAZY_RELU: for (size_t e = 0; e < len; e++) r[e] = x[e] > 0 ? x[e] : 0.0; break;
+            case LAZY_SIGMOID: for (size_t e = 0; e < len; e++) r[e] = 1/(1 + exp(-x[e])); break;
+            case LAZY_TANH: for (size_t e = 0; e < len; e++) r[e] = tanh(x[e]); break;
+            case LAZY_EXP: for (size_t e = 0; e < len; e++) r[e] = exp(x[e]); break;
+            case LAZY_LOG: for (size_t e = 0; e < len; e++) r[e] = log(x[e]); break;
+            case LAZY_SQRT: for (size_t e = 0; e < len; e++) r[e] = sqrt(x[e]); break;
+            case LAZY_ABS: for (size_t e = 0; e < len; e++) r[e] = fabs(x[e]); break;
+            case LAZY_MATMUL: break;
+        }
+    }
+};
+
+// Register tiles of the running thread, grown to the largest program and reused by every call
+static __thread double* lazy_regs = NULL;
+static __thread size_t lazy_regs_size = 0;
+
+static double* lazy_reserve_regs(const size_t num_instrs, const size_t banks){
+    const size_t size = (num_instrs ? num_instrs : 1) * banks * LAZY_TILE;
+    if (size > lazy_regs_size){
+        free(lazy_regs);
+        lazy_regs = (double*)malloc(size * sizeof(double));
+        if (lazy_regs == NULL){
+            printf("Failed to allocate memory for the fused program registers.\n");
+            exit(1);
+        }
+        lazy_regs_size = size;
+    }
+    return lazy_regs;
+};
+
+// Frees the tiles of the calling thread, the next fused kernel on it allocates them again
+static void lazy_release_regs(void){
+    free(lazy_regs);
+    lazy_regs = NULL;
+    lazy_regs_size = 0;
+};
+
+static void lazy_fused_forward(const void* params, const double* in, const size_t n_in, double* out, const size_t n_out){
+    (void)n_in;
+    const LazyProgram* program = (const LazyProgram*)params;
+    double* regs = lazy_reserve_regs(program->num_instrs, 1);
+    const double* result = regs + (program->num_instrs - 1) * LAZY_TILE;
+
+    for (size_t begin = 0; begin < n_out; begin += LAZY_TILE){
+        const size_t len = n_out - begin < LAZY_TILE ? n_out - begin : LAZY_TILE;
+        lazy_run_tile(program, in, begin, len, regs);
+        memcpy(out + begin, result, len * sizeof(double));
+    }
+};
+
+// Tiles are recomputed, then the adjoints flow back through the program
+static void lazy_fused_backward(const void* params, const double* in, const size_t n_in, const double* out,
+                                const double* grad_out, const size_t n_out, double* grad_in){
+    (void)n_in;
+    (void)out;
+    const LazyProgram* program = (const LazyProgram*)params;
+    const LazySource* sources = lazy_program_sources(program);
+    const LazyInstr* instrs = lazy_program_instrs(program);
+    const size_t n = program->num_instrs;
+    double* regs = lazy_reserve_regs(n, 2);
+    double* adjoints = regs + n * LAZY_TILE;
+
+    for (size_t begin = 0; begin < n_out; begin += LAZY_TILE){
+        const size_t len = n_out - begin < LAZY_TILE ? n_out - begin : LAZY_TILE;
+        lazy_run_tile(program, in, begin, len, regs);
+        memset(adjoints, 0, n * LAZY_TILE * sizeof(double));
+        memcpy(adjoints + (n - 1) * LAZY_TILE, grad_out + begin, len * sizeof(double));
+
+        for (size_t k = n; k-- > 0;){
+            const LazyInstr* instr = instrs + k;
+            const double* g = adjoints + k * LAZY_TILE;
+            const double* r = regs + k * LAZY_TILE;
+            const double* x = regs + instr->a * LAZY_TILE;
+            const double* y = regs + instr->b * LAZY_TILE;
+            double* gx = adjoints + instr->a * LAZY_TILE;
+            double* gy = adjoints + instr->b * LAZY_TILE;
+
+            switch(instr->op){
+                case LAZY_SOURCE:
+                    for (size_t e = 0; e < len; e++) grad_in[lazy_source_index(program, sources + instr->a, begin + e)] += g[e];
+                    break;
+                case LAZY_ADD:
+                    for (size_t e = 0; e < len; e++){ gx[e] += g[e]; gy[e] += g[e]; }
+                    break;
+                case LAZY_SUBTRACT:
+                    for (size_t e = 0; e < len; e++){ gx[e] += g[e]; gy[e] -= g[e]; }
+                    break;
+                case LAZY_MULTIPLY:
+                    for (size_t e = 0; e < len; e++){ gx[e] += g[e] * y[e]; gy[e] += g[e] * x[e]; }
+                    break;
+                case LAZY_SCALE: for (size_t e = 0; e < len; e++) gx[e] += g[e] * instr->scalar; break;
+                case LAZY_RELU: for (size_t e = 0; e < len; e++) gx[e] += r[e] > 0 ? g[e] : 0.0; break;
+                case LAZY_SIGMOID: for (size_t e = 0; e < len; e++) gx[e] += g[e] * r[e] * (1 - r[e]); break;
+                case LAZY_TANH: for (size_t e = 0; e < len; e++) gx[e] += g[e] * (1 - r[e] * r[e]); break;
+                case LAZY_EXP: for (size_t e = 0; e < len; e++) gx[e] += g[e] * r[e]; break;
+                case LAZY_LOG: for (size_t e = 0; e < len; e++) gx[e] += g[e] / x[e]; break;
+                case LAZY_SQRT: for (size_t e = 0; e < len; e++) gx[e] += 0.5 * g[e] / r[e]; break;
+                case LAZY_ABS: for (size_t e = 0; e < len; e++) gx[e] += x[e] < 0 ? -g[e] : g[e]; break;
+                case LAZY_MATMUL: break;
+            }
+        }
+    }
+};
+#pragma endregion Fused Program
+
+#pragma region Materialization
+Tensor* lazy_eval(LazyTensor* self);
+
+// Every compiler takes its own generation, barriers below it compile nested chains of their own
+typedef struct {
+    LazyTensor** sources;
+    size_t num_sources;
+    LazyInstr* instrs;
+    size_t num_instrs;
+    size_t capacity;
+    size_t source_capacity;
+    size_t generation;
+}LazyCompiler;
+
+// Emit the instructions of node and everything below it, returns its instruction index
+static size_t lazy_compile(LazyCompiler* compiler, LazyTensor* node){
+    if (node->mark == compiler->generation) return node->slot;
+
+    LazyInstr instr = {node->op, 0, 0, node->scalar};
+    // Wrapped tensors, products and results materialized before are read as sources
+    if (node->tensor || node->op == LAZY_MATMUL){
+        lazy_eval(node);
+        instr.op = LAZY_SOURCE;
+        if (compiler->num_sources == compiler->source_capacity){
+            compiler->source_capacity *= 2;
+            compiler->sources = (LazyTensor**)realloc(compiler->sources, compiler->source_capacity * sizeof(LazyTensor*));
+            if (compiler->sources == NULL){
+                printf("Failed to allocate memory for the lazy compiler.\n");
+                exit(1);
+            }
+        }
+        instr.a = compiler->num_sources;
+        compiler->sources[compiler->num_sources++] = node;
+    }
+    else {
+        instr.a = lazy_compile(compiler, node->inputs[0]);
+        if (node->inputs[1]) instr.b = lazy_compile(compiler, node->inputs[1]);
+    }
+
+    if (compiler->num_instrs == compiler->capacity){
+        compiler->capacity *= 2;
+        compiler->instrs = (LazyInstr*)realloc(compiler->instrs, compiler->capacity * sizeof(LazyInstr));
+        if (compiler->instrs == NULL){
+            printf("Failed to allocate memory for the lazy compiler.\n");
+            exit(1);
+        }
+    }
+
+    node->mark = compiler->generation;
+    node->slot = compiler->num_instrs;
+    compiler->instrs[compiler->num_instrs++] = instr;
+    return node->slot;
+};
+
+// Compile the chain below self into one fused op node per evaluation
+static Tensor* lazy_materialize_chain(LazyTensor* self){
+    static const ADOpDef lazy_fused = {"lazy_fused", lazy_fused_forward, lazy_fused_backward};
+    LazyContext* ctx = self->ctx;
+
+    LazyCompiler compiler;
+    compiler.capacity = 16;
+    compiler.source_capacity = 16;
+    compiler.num_sources = 0;
+    compiler.num_instrs = 0;
+    compiler.instrs = (LazyInstr*)malloc(compiler.capacity * sizeof(LazyInstr));
+    compiler.sources = (LazyTensor**)malloc(compiler.source_capacity * sizeof(LazyTensor*));
+    if (compiler.instrs == NULL || compiler.sources == NULL){
+        printf("Failed to allocate memory for the lazy compiler.\n");
+        exit(1);
+    }
+
+    compiler.generation = ++ctx->generation;
+    lazy_compile(&compiler, self);
+
+    // Params: header, sources, instructions
+    const size_t params_size = sizeof(LazyProgram) + compiler.num_sources * sizeof(LazySource) + compiler.num_instrs * sizeof(LazyInstr);
+    LazyProgram* program = (LazyProgram*)malloc(params_size);
+    if (program == NULL){
+        printf("Failed to allocate memory for the fused program.\n");
+        exit(1);
+    }
+    program->n_batch = self->n_batch;
+    program->n_rows = self->n_rows;
+    program->n_cols = self->n_cols;
+    program->num_sources = compiler.num_sources;
+    program->num_instrs = compiler.num_instrs;
+
+    LazySource* sources = (LazySource*)(program + 1);
+    size_t n_in = 0;
+    for (size_t s = 0; s < compiler.num_sources; s++){
+        const Tensor* tensor = compiler.sources[s]->tensor;
+        sources[s] = (LazySource){n_in, tensor->n_batch, tensor->n_rows, tensor->n_cols};
+        n_in += tensor->n_batch * tensor->n_rows * tensor->n_cols;
+    }
+    memcpy(sources + compiler.num_sources, compiler.instrs, compiler.num_instrs * sizeof(LazyInstr));
+
+    const size_t n_out = self->n_batch * self->n_rows * self->n_cols;
+    ADNode** inputs = (ADNode**)malloc((n_in ? n_in : 1) * sizeof(ADNode*));
+    ADNode** outputs = (ADNode**)malloc((n_out ? n_out : 1) * sizeof(ADNode*));
+    if (inputs == NULL || outputs == NULL){
+        printf("Failed to allocate memory for the fused op nodes.\n");
+        exit(1);
+    }
+
+    for (size_t s = 0; s < compiler.num_sources; s++){
+        Tensor* tensor = compiler.sources[s]->tensor;
+        for (size_t i = 0; i < tensor->n_batch * tensor->n_rows; i++){
+            for (size_t j = 0; j < tensor->n_cols; j++){
+                inputs[sources[s].offset + i * tensor->n_cols + j] = tensor->get_node(tensor, i, j);
+            }
+        }
+    }
+
+    node_apply_op(ad_op_register(&lazy_fused), inputs, n_in, outputs, n_out, program, params_size);
+
+    Tensor* result = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
+    for (size_t k = 0; k < n_out; k++){
+        result->set_node(result, outputs[k], k / self->n_cols, k % self->n_cols);
+    }
+
+    free(inputs);
+    free(outputs);
+    free(program);
+    free(compiler.instrs);
+    free(compiler.sources);
+    return result;
+};
+
+// Materialize self, the result stays cached and owned by the context
+Tensor* lazy_eval(LazyTensor* self){
+    if (self == NULL){
+        printf("Lazy Tensor points to an empty address.\n");
+        exit(0);
+    }
+    if (self->tensor) return self->tensor;
+
+    if (self->op == LAZY_MATMUL){
+        self->tensor = tensor_dot_product(lazy_eval(self->inputs[0]), lazy_eval(self->inputs[1]));
+    }
+    else {
+        self->tensor = lazy_materialize_chain(self);
+    }
+    self->owns_tensor = 1;
+    return self->tensor;
+};
+
+double lazy_get_val_at(LazyTensor* self, const size_t b, const size_t i, const size_t j){
+    return tensor_get_val_at(lazy_eval(self), b, i, j);
+};
+#pragma endregion Materialization
+
+#endif // __LAZY_TENSOR_H__
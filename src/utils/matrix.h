@@ -28,6 +28,17 @@ void matrix_realloc(Matrix* mat, const size_t n_rows, const size_t n_cols){
     mat->n_cols = n_cols;
 };
 
+// Reshape *mat (created if NULL), reallocating only when the number of elements changes
+void matrix_resize(Matrix** mat, const size_t n_rows, const size_t n_cols){
+    if (*mat == NULL){
+        matrix_create(mat, n_rows, n_cols);
+        return;
+    }
+    if ((*mat)->n_rows * (*mat)->n_cols != n_rows * n_cols) matrix_realloc(*mat, n_rows, n_cols);
+    (*mat)->n_rows = n_rows;
+    (*mat)->n_cols = n_cols;
+};
+
 void matrix_destroy(Matrix* mat){
     if (mat == NULL) return;
 
@@ -212,6 +223,85 @@ void matrix_multiply(Matrix* a, Matrix* b, Matrix** output, const unsigned char
     if (free){ matrix_destroy(a); matrix_destroy(b);}
 };
 
+#pragma region GEMM
+/*
+Blocked matrix multiplication
+
+    C = alpha * op(A) * op(B) + beta * C,    op(X) = X, or X^T if trans_x is set
+
+C must already have the shape of the product. op(B) is copied block by block (GEMM_KC x GEMM_NC
+doubles, sized to stay in L2) into a row major panel scaled by alpha, so the inner loop adds a
+panel row to a row of C with unit stride whether B is transposed or not. A is read in place.
+*/
+#define GEMM_KC 128
+#define GEMM_NC 256
+#define GEMM_PANEL_SIZE (GEMM_KC * GEMM_NC)
+
+static inline double matrix_op_get(const Matrix* X, const char trans, const size_t i, const size_t j){
+    return trans ? X->data[j * X->n_cols + i] : X->data[i * X->n_cols + j];
+};
+
+// panel = alpha * op(B)[pc : pc + kc, jc : jc + nc], row major
+void gemm_pack_panel(const Matrix* B, const char trans_b, const double alpha, const size_t pc, const size_t kc,
+                     const size_t jc, const size_t nc, double* panel){
+    for (size_t p = 0; p < kc; p++){
+        for (size_t j = 0; j < nc; j++) panel[p * nc + j] = alpha * matrix_op_get(B, trans_b, pc + p, jc + j);
+    }
+};
+
+// c[0 : nc] += op(A)[i, pc : pc + kc] * panel
+static inline void gemm_panel_row(const Matrix* A, const char trans_a, const size_t i, const size_t pc, const size_t kc,
+                                  const double* panel, const size_t nc, double* c){
+    for (size_t p = 0; p < kc; p++){
+        const double a = matrix_op_get(A, trans_a, i, pc + p);
+        const double* b = panel + p * nc;
+        for (size_t j = 0; j < nc; j++) c[j] += a * b[j];
+    }
+};
+
+// matrix_gemm with a caller owned panel of GEMM_PANEL_SIZE doubles, allocates nothing
+void matrix_gemm_with_panel(const char trans_a, const char trans_b, const double alpha, const Matrix* A, const Matrix* B,
+                            const double beta, Matrix* C, double* panel){
+    const size_t m = trans_a ? A->n_cols : A->n_rows;
+    const size_t k = trans_a ? A->n_rows : A->n_cols;
+    const size_t n = trans_b ? B->n_rows : B->n_cols;
+
+    if ((trans_b ? B->n_cols : B->n_rows) != k || C->n_rows != m || C->n_cols != n){
+        printf("Matrix dimensions do not match for gemm.\n");
+        exit(0);
+    }
+
+    if (beta == 0.0) memset(C->data, 0, m * n * sizeof(double));
+    else if (beta != 1.0){
+        for (size_t x = 0; x < m * n; x++) C->data[x] *= beta;
+    }
+
+    for (size_t jc = 0; jc < n; jc += GEMM_NC){
+        const size_t nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+
+        for (size_t pc = 0; pc < k; pc += GEMM_KC){
+            const size_t kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            gemm_pack_panel(B, trans_b, alpha, pc, kc, jc, nc, panel);
+
+            for (size_t i = 0; i < m; i++){
+                gemm_panel_row(A, trans_a, i, pc, kc, panel, nc, C->data + i * n + jc);
+            }
+        }
+    }
+};
+
+void matrix_gemm(const char trans_a, const char trans_b, const double alpha, const Matrix* A, const Matrix* B, const double beta, Matrix* C){
+    double* panel = (double*)malloc(GEMM_PANEL_SIZE * sizeof(double));
+    if (panel == NULL){
+        printf("Failed to allocate memory for the gemm panel.\n");
+        exit(1);
+    }
+
+    matrix_gemm_with_panel(trans_a, trans_b, alpha, A, B, beta, C, panel);
+    free(panel);
+};
+#pragma endregion GEMM
+
 void matrix_abs(Matrix* X){
     for (size_t i = 0; i < X->n_rows; i++){
         for (size_t j = 0; j < X->n_cols; j++){
@@ -0,0 +1,157 @@
+#ifndef __MEMORY_PLANNER_H__
+#define __MEMORY_PLANNER_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+Static memory planner
+
+Every buffer is described by its size and the interval of steps [start, end] during which
+it is live. The planner assigns each buffer an offset into one shared slab such that buffers
+with overlapping lifetimes never overlap in memory.
+
+Buffers are placed in order of their first use. Buffers whose lifetime ended are returned to
+a free list, and a new buffer takes the smallest free block that fits (best fit), splitting
+off the remainder. Only when no block fits the slab grows.
+*/
+
+typedef struct {
+    size_t size;    // bytes
+    size_t start;   // first step the buffer is live
+    size_t end;     // last step the buffer is live (inclusive)
+    size_t offset;  // assigned by the planner
+}BufferInterval;
+
+typedef struct {
+    size_t offset;
+    size_t size;
+}FreeBlock;
+
+typedef struct {
+    FreeBlock* blocks;  // sorted by size
+    size_t num_blocks;
+    size_t capacity;
+}FreeList;
+
+static const BufferInterval* planner_sort_base = NULL;
+
+static int planner_cmp_start(const void* a, const void* b){
+    const BufferInterval* x = planner_sort_base + *(const size_t*)a;
+    const BufferInterval* y = planner_sort_base + *(const size_t*)b;
+    if (x->start != y->start) return (x->start > y->start) - (x->start < y->start);
+    return (*(const size_t*)a > *(const size_t*)b) - (*(const size_t*)a < *(const size_t*)b);
+};
+
+static int planner_cmp_end(const void* a, const void* b){
+    const BufferInterval* x = planner_sort_base + *(const size_t*)a;
+    const BufferInterval* y = planner_sort_base + *(const size_t*)b;
+    if (x->end != y->end) return (x->end > y->end) - (x->end < y->end);
+    return (*(const size_t*)a > *(const size_t*)b) - (*(const size_t*)a < *(const size_t*)b);
+};
+
+// First block with size >= size (num_blocks if none)
+static size_t free_list_lower_bound(const FreeList* list, const size_t size){
+    size_t lo = 0, hi = list->num_blocks;
+    while (lo < hi){
+        const size_t mid = lo + (hi - lo) / 2;
+        if (list->blocks[mid].size < size) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+};
+
+// First block with size > size
+static size_t free_list_upper_bound(const FreeList* list, const size_t size){
+    size_t lo = 0, hi = list->num_blocks;
+    while (lo < hi){
+        const size_t mid = lo + (hi - lo) / 2;
+        if (list->blocks[mid].size <= size) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+};
+
+static void free_list_insert(FreeList* list, const size_t offset, const size_t size){
+    if (list->num_blocks == list->capacity){
+        list->capacity = list->capacity ? 2 * list->capacity : 16;
+        list->blocks = (FreeBlock*)realloc(list->blocks, list->capacity * sizeof(FreeBlock));
+        if (list->blocks == NULL){
+            printf("Failed to allocate memory for the planner free list.\n");
+            exit(1);
+        }
+    }
+
+    // Insert behind blocks of equal size, equal sized buffers then come and go at the end
+    const size_t idx = free_list_upper_bound(list, size);
+    memmove(list->blocks + idx + 1, list->blocks + idx, (list->num_blocks - idx) * sizeof(FreeBlock));
+    list->blocks[idx].offset = offset;
+    list->blocks[idx].size = size;
+    list->num_blocks++;
+};
+
+// Take the best fitting block, returns 0 if no block is large enough
+static char free_list_take(FreeList* list, const size_t size, size_t* offset){
+    const size_t first = free_list_lower_bound(list, size);
+    if (first == list->num_blocks) return 0;
+
+    const size_t idx = free_list_upper_bound(list, list->blocks[first].size) - 1;
+    const FreeBlock block = list->blocks[idx];
+    memmove(list->blocks + idx, list->blocks + idx + 1, (list->num_blocks - idx - 1) * sizeof(FreeBlock));
+    list->num_blocks--;
+
+    *offset = block.offset;
+    if (block.size > size) free_list_insert(list, block.offset + size, block.size - size);
+    return 1;
+};
+
+// Assign offsets to all intervals, returns the peak slab size in bytes.
+// Sizes are rounded up to a multiple of alignment.
+size_t memory_plan_best_fit(BufferInterval* intervals, const size_t n, const size_t alignment){
+    if (n == 0) return 0;
+
+    size_t* by_start = (size_t*)malloc(n * sizeof(size_t));
+    size_t* by_end = (size_t*)malloc(n * sizeof(size_t));
+    if (by_start == NULL || by_end == NULL){
+        printf("Failed to allocate memory for the memory planner.\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n; i++){
+        by_start[i] = i;
+        by_end[i] = i;
+        intervals[i].size = (intervals[i].size + alignment - 1) / alignment * alignment;
+    }
+
+    planner_sort_base = intervals;
+    qsort(by_start, n, sizeof(size_t), planner_cmp_start);
+    qsort(by_end, n, sizeof(size_t), planner_cmp_end);
+    planner_sort_base = NULL;
+
+    FreeList free_list = {NULL, 0, 0};
+    size_t top = 0;
+    size_t released = 0;
+
+    for (size_t k = 0; k < n; k++){
+        BufferInterval* interval = intervals + by_start[k];
+
+        // Everything that died before this buffer is born can be reused
+        while (released < n && intervals[by_end[released]].end < interval->start){
+            const BufferInterval* dead = intervals + by_end[released++];
+            free_list_insert(&free_list, dead->offset, dead->size);
+        }
+
+        if (!free_list_take(&free_list, interval->size, &interval->offset)){
+            interval->offset = top;
+            top += interval->size;
+        }
+    }
+
+    free(free_list.blocks);
+    free(by_start);
+    free(by_end);
+    return top;
+};
+
+#endif // __MEMORY_PLANNER_H__
@@ -0,0 +1,217 @@
+#ifndef __MODEL_FILE_H__
+#define __MODEL_FILE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#pragma region Model File
+/*
+Binary model files. A file is a header, a section table and the sections themselves:
+
+    offset 0     ModelFileHeader      magic "CMLMODEL", format version, model kind, file size
+    offset 64    ModelFileSection[n]  id, offset and size of every section
+    ...          sections             each starting on a MODEL_FILE_ALIGNMENT boundary
+
+All integers and floats are little endian and every section is a plain array of fixed-width
+records, so on a little-endian host a loaded model reads its sections straight out of the
+mapping: model_file_map maps the file read-only and shared, and nothing is parsed or copied.
+Pages are faulted in on first touch and every process mapping the same file shares them
+through the page cache. Big-endian hosts are refused rather than swapped.
+
+    ModelFileChunk chunks[2] = {{ID_A, a, size_a}, {ID_B, b, size_b}};
+    model_file_write("model.cml", MODEL_FILE_KIND_..., chunks, 2);
+
+    ModelFile* file = model_file_map("model.cml", MODEL_FILE_KIND_...);
+    const void* a = model_file_section(file, ID_A, &size_a);   // points into the mapping
+    model_file_unmap(file);
+
+Saving the model classes is done next to them (sequential_nn_save, KNN_save,
+dt_classifier_save). Bumping MODEL_FILE_VERSION makes older readers refuse the file.
+*/
+
+#define MODEL_FILE_MAGIC "CMLMODEL"
+#define MODEL_FILE_VERSION 1
+#define MODEL_FILE_ALIGNMENT 64
+
+typedef enum {
+    MODEL_FILE_KIND_SEQUENTIAL_NN = 1,
+    MODEL_FILE_KIND_KNN = 2,
+    MODEL_FILE_KIND_DT_CLASSIFIER = 3,
+}ModelFileKind;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t num_sections;
+    uint32_t alignment;
+    uint64_t file_size;
+    uint8_t reserved[32];
+}ModelFileHeader;
+
+typedef struct {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+}ModelFileSection;
+
+// One section to write, data is copied to the file as is
+typedef struct {
+    uint32_t id;
+    const void* data;
+    uint64_t size;
+}ModelFileChunk;
+
+typedef struct ModelFile{
+    void* data;
+    size_t size;
+    const ModelFileHeader* header;
+    const ModelFileSection* sections;
+}ModelFile;
+
+static char model_file_host_is_little_endian(void){
+    const uint32_t probe = 1;
+    return *(const uint8_t*)&probe == 1;
+};
+
+static uint64_t model_file_align(const uint64_t offset){
+    return (offset + MODEL_FILE_ALIGNMENT - 1) / MODEL_FILE_ALIGNMENT * MODEL_FILE_ALIGNMENT;
+};
+
+// Writes the file next to path and renames it into place, returns 0 on failure
+char model_file_write(const char* path, const ModelFileKind kind, const ModelFileChunk* chunks, const size_t num_chunks){
+    if (!model_file_host_is_little_endian()){
+        printf("Model files are little endian, writing on this host is not supported.\n");
+        return 0;
+    }
+
+    ModelFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.kind = (uint32_t)kind;
+    header.num_sections = (uint32_t)num_chunks;
+    header.alignment = MODEL_FILE_ALIGNMENT;
+
+    ModelFileSection* sections = (ModelFileSection*)calloc(num_chunks ? num_chunks : 1, sizeof(ModelFileSection));
+    uint64_t offset = model_file_align(sizeof(ModelFileHeader) + num_chunks * sizeof(ModelFileSection));
+    for (size_t i = 0; i < num_chunks; i++){
+        sections[i].id = chunks[i].id;
+        sections[i].offset = offset;
+        sections[i].size = chunks[i].size;
+        offset = model_file_align(offset + chunks[i].size);
+    }
+    header.file_size = offset;
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL){
+        printf("Cannot write the model file %s.\n", tmp_path);
+        free(sections);
+        return 0;
+    }
+
+    static const uint8_t padding[MODEL_FILE_ALIGNMENT] = {0};
+    char ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(sections, sizeof(ModelFileSection), num_chunks, file) == num_chunks;
+    uint64_t position = sizeof(header) + num_chunks * sizeof(ModelFileSection);
+    for (size_t i = 0; ok && i < num_chunks; i++){
+        ok = fwrite(padding, 1, sections[i].offset - position, file) == sections[i].offset - position;
+        ok = ok && fwrite(chunks[i].data, 1, chunks[i].size, file) == chunks[i].size;
+        position = sections[i].offset + chunks[i].size;
+    }
+    ok = ok && fwrite(padding, 1, header.file_size - position, file) == header.file_size - position;
+    ok = (fclose(file) == 0) && ok;
+    free(sections);
+
+    if (!ok || rename(tmp_path, path) != 0){
+        printf("Cannot write the model file %s.\n", path);
+        remove(tmp_path);
+        return 0;
+    }
+    return 1;
+};
+
+void model_file_unmap(ModelFile* file){
+    if (file == NULL) return;
+    munmap(file->data, file->size);
+    free(file);
+};
+
+// Maps a model file of the given kind, returns NULL if it is missing, of another kind or malformed
+ModelFile* model_file_map(const char* path, const ModelFileKind kind){
+    if (!model_file_host_is_little_endian()){
+        printf("Model files are little endian, loading on this host is not supported.\n");
+        return NULL;
+    }
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        printf("Cannot open the model file %s.\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ModelFileHeader)){
+        printf("Model file %s is truncated.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED){
+        printf("Cannot map the model file %s.\n", path);
+        return NULL;
+    }
+
+    ModelFile* file = (ModelFile*)malloc(sizeof(ModelFile));
+    file->data = data;
+    file->size = (size_t)st.st_size;
+    file->header = (const ModelFileHeader*)data;
+    file->sections = (const ModelFileSection*)((const char*)data + sizeof(ModelFileHeader));
+
+    const ModelFileHeader* header = file->header;
+    const char* error = NULL;
+    if (memcmp(header->magic, MODEL_FILE_MAGIC, sizeof(header->magic)) != 0) error = "is not a model file";
+    else if (header->version != MODEL_FILE_VERSION) error = "has an unsupported format version";
+    else if (header->kind != (uint32_t)kind) error = "holds another kind of model";
+    else if (header->file_size != file->size || header->alignment != MODEL_FILE_ALIGNMENT) error = "is truncated";
+    else if (sizeof(ModelFileHeader) + (uint64_t)header->num_sections * sizeof(ModelFileSection) > file->size) error = "is truncated";
+
+    for (uint32_t i = 0; error == NULL && i < header->num_sections; i++){
+        const ModelFileSection* section = file->sections + i;
+        if (section->offset % MODEL_FILE_ALIGNMENT != 0 || section->offset > file->size || section->size > file->size - section->offset){
+            error = "has a section out of bounds";
+        }
+    }
+
+    if (error != NULL){
+        printf("Model file %s %s.\n", path, error);
+        model_file_unmap(file);
+        return NULL;
+    }
+    return file;
+};
+
+// Start of the section with this id inside the mapping, NULL if the file has none
+const void* model_file_section(const ModelFile* file, const uint32_t id, uint64_t* size){
+    for (uint32_t i = 0; i < file->header->num_sections; i++){
+        if (file->sections[i].id != id) continue;
+        if (size) *size = file->sections[i].size;
+        return (const char*)file->data + file->sections[i].offset;
+    }
+    if (size) *size = 0;
+    return NULL;
+};
+
+#pragma endregion Model File
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "point.h"
+#include "matrix.h"
 #include "autodifferentation.h"
 
 
@@ -12,8 +13,21 @@ typedef struct Tensor{
     // Attributes
         struct Tensor* self;
         ADNode** nodes;
+        size_t n_batch;
         size_t n_rows;
         size_t n_cols;
+
+        // Node (b, i, j) is nodes[offset + b * stride_batch + i * stride_row + j * stride_col]
+        size_t stride_batch;
+        size_t stride_row;
+        size_t stride_col;
+        size_t offset;
+
+        // Views share the nodes of their base tensor, which has to outlive them
+        struct Tensor* base;
+
+        // Contiguous row major values and grads of the nodes created for this tensor
+        ADStorage* storage;
     
     // Methods
         void (*realloc)(struct Tensor* self, const size_t n_rows, const size_t n_cols);
@@ -55,7 +69,18 @@ typedef struct Tensor{
 
 void tensor_init(Tensor* self);
 
-Tensor* tensor_new(const size_t n_rows, const size_t n_cols){
+/*
+Tensors have a leading batch dimension: n_batch matrices of n_rows x n_cols. A tensor created
+by an op stores them densely one after another; views (tensor_transpose, tensor_slice,
+tensor_reshape) address the nodes of their base through strides and an offset. Elementwise ops
+treat a batched tensor as n_batch * n_rows stacked rows and the (i, j) accessors address
+batch 0.
+
+Binary ops broadcast numpy-style: every dimension of the operands must match or be 1, a
+dimension of size 1 is repeated along the other operand. A bias of shape (1, n, 1) thus adds
+to every column of every sample of a (B, n, m) tensor.
+*/
+Tensor* tensor_new_batched(const size_t n_batch, const size_t n_rows, const size_t n_cols){
     Tensor* tensor = (Tensor*)malloc(sizeof(Tensor));
     
     if (tensor == NULL){
@@ -63,10 +88,18 @@ Tensor* tensor_new(const size_t n_rows, const size_t n_cols){
         exit(1);
     }
 
+    const size_t size = n_batch * n_rows * n_cols;
     tensor->self = tensor;
-    tensor->nodes = (ADNode**)malloc(n_rows * n_cols * sizeof(ADNode*));
+    tensor->nodes = (ADNode**)calloc(size ? size : 1, sizeof(ADNode*));
+    tensor->n_batch = n_batch;
     tensor->n_rows = n_rows;
     tensor->n_cols = n_cols;
+    tensor->stride_batch = n_rows * n_cols;
+    tensor->stride_row = n_cols;
+    tensor->stride_col = 1;
+    tensor->offset = 0;
+    tensor->base = NULL;
+    tensor->storage = NULL;
 
     tensor->init = tensor_init;
     tensor->init(tensor); 
@@ -74,12 +107,20 @@ Tensor* tensor_new(const size_t n_rows, const size_t n_cols){
     return tensor;
 };
 
+Tensor* tensor_new(const size_t n_rows, const size_t n_cols){
+    return tensor_new_batched(1, n_rows, n_cols);
+};
+
+static size_t tensor_numel(const Tensor* self){
+    return self->n_batch * self->n_rows * self->n_cols;
+};
+
 Tensor* tensor_new_init(const size_t n_rows, const size_t n_cols, const double val){
     Tensor* tensor = tensor_new(n_rows, n_cols);
 
     for(size_t i = 0; i < n_rows; i++){
         for(size_t j = 0; j < n_cols; j++){
-            tensor->nodes[i * n_cols + j] = node_new(val, 0, 0);
+            tensor->set_node(tensor, node_new(val, 0, 0), i, j);
         }
     };
     return tensor;
@@ -90,29 +131,132 @@ Tensor* tensor_new_random(const size_t n_rows, const size_t n_cols){
     for (size_t i = 0; i < n_rows; i++){
        for (size_t j = 0; j < n_cols; j++){
             const double val = (double)rand() / (double)RAND_MAX;
-            tensor->nodes[i * n_cols + j] = node_new(val, 0, 0);
+            tensor->set_node(tensor, node_new(val, 0, 0), i, j);
         }
     }
     return tensor;
 };
-void tensor_realloc(Tensor* self, const size_t n_rows, const size_t n_cols){
-    self->nodes = (ADNode**) realloc(self->nodes, n_rows * n_cols * sizeof(ADNode*));
+
+static char tensor_is_dense(const Tensor* self){
+    return self->base == NULL && self->offset == 0 && self->stride_col == 1 &&
+           self->stride_row == self->n_cols && self->stride_batch == self->n_rows * self->n_cols;
+};
+
+void tensor_realloc_batched(Tensor* self, const size_t n_batch, const size_t n_rows, const size_t n_cols){
+    if (!tensor_is_dense(self)){
+        printf("Views and transposed tensors cannot be reallocated.\n");
+        exit(0);
+    }
+
+    const size_t old_size = tensor_numel(self);
+    const size_t new_size = n_batch * n_rows * n_cols;
+    self->nodes = (ADNode**) realloc(self->nodes, new_size * sizeof(ADNode*));
+    if (new_size > old_size){
+        memset(self->nodes + old_size, 0, (new_size - old_size) * sizeof(ADNode*));
+    }
+
+    // The current nodes keep their storage alive, new nodes get a storage of the new shape
+    ad_storage_release(self->storage);
+    self->storage = NULL;
     
+    self->n_batch = n_batch;
     self->n_rows = n_rows;
     self->n_cols = n_cols;
+    self->stride_batch = n_rows * n_cols;
+    self->stride_row = n_cols;
+};
+
+void tensor_realloc(Tensor* self, const size_t n_rows, const size_t n_cols){
+    tensor_realloc_batched(self, self->n_batch, n_rows, n_cols);
+};
+
+// Position in the nodes array of row i of the stacked n_batch * n_rows rows
+static size_t tensor_node_index(const Tensor* self, const size_t i, const size_t j){
+    if (self->n_batch == 1) return self->offset + i * self->stride_row + j * self->stride_col;
+    const size_t b = i / self->n_rows;
+    return self->offset + b * self->stride_batch + (i - b * self->n_rows) * self->stride_row + j * self->stride_col;
 };
 
 static ADNode* tensor_get_node(Tensor* self, const size_t i, const size_t j){
-    return self->nodes[i *  self->n_cols + j];
+    return self->nodes[tensor_node_index(self, i, j)];
 };
 
+// Nodes without a storage of their own move into the tensor storage.
+// Nodes shared with other tensors keep their location.
 void tensor_set_node(Tensor* self, ADNode* node, const size_t i, const size_t j){
-    self->nodes[i * self->n_cols + j] = node;
+    const size_t k = tensor_node_index(self, i, j);
+
+    // Views write through to the nodes of their base but never own a storage
+    if (self->base == NULL && node != NULL && node->storage == NULL){
+        // In-place ops replace nodes that are still parents in the graph, their values must survive
+        ADNode* previous = self->nodes[k];
+        if (self->storage && previous && previous != node && previous->value == self->storage->values + k){
+            ad_storage_release(self->storage);
+            self->storage = NULL;
+        }
+
+        if (self->storage == NULL) self->storage = ad_storage_new(self->offset + self->n_batch * self->stride_batch, 1);
+        node_set_storage(node, self->storage, self->storage->values + k, self->storage->grads + k);
+    }
+
+    self->nodes[k] = node;
+};
+
+static size_t tensor_batch_index(const Tensor* self, const size_t b, const size_t i, const size_t j){
+    if (b >= self->n_batch || i >= self->n_rows || j >= self->n_cols){
+        printf("Index (%lu, %lu, %lu) exceeds tensor shape (%lu, %lu, %lu).\n", b, i, j, self->n_batch, self->n_rows, self->n_cols);
+        exit(0);
+    }
+    return self->offset + b * self->stride_batch + i * self->stride_row + j * self->stride_col;
+};
+
+ADNode* tensor_get_node_at(Tensor* self, const size_t b, const size_t i, const size_t j){
+    return self->nodes[tensor_batch_index(self, b, i, j)];
 };
 
+void tensor_set_node_at(Tensor* self, ADNode* node, const size_t b, const size_t i, const size_t j){
+    tensor_batch_index(self, b, i, j);
+    self->set_node(self, node, b * self->n_rows + i, j);
+};
+
+double tensor_get_val_at(Tensor* self, const size_t b, const size_t i, const size_t j){
+    return *self->nodes[tensor_batch_index(self, b, i, j)]->value;
+};
+
+double tensor_get_grad_at(Tensor* self, const size_t b, const size_t i, const size_t j){
+    return *self->nodes[tensor_batch_index(self, b, i, j)]->grad;
+};
+
+void tensor_set_val_at(Tensor* self, const size_t b, const size_t i, const size_t j, const double val){
+    *self->nodes[tensor_batch_index(self, b, i, j)]->value = val;
+};
+
+// Node of a broadcast operand for output position (b, i, j)
+static ADNode* tensor_broadcast_node(Tensor* self, const size_t b, const size_t i, const size_t j){
+    const size_t bb = self->n_batch == 1 ? 0 : b;
+    const size_t ii = self->n_rows == 1 ? 0 : i;
+    const size_t jj = self->n_cols == 1 ? 0 : j;
+    return self->nodes[self->offset + bb * self->stride_batch + ii * self->stride_row + jj * self->stride_col];
+};
+
+static size_t tensor_broadcast_dim(const size_t a, const size_t b, const char* op){
+    if (a != b && a != 1 && b != 1){
+        printf("Tensor dimensions %lu and %lu cannot be broadcast in %s.\n", a, b, op);
+        exit(0);
+    }
+    return a > b ? a : b;
+};
+
+// Views only free themselves, the nodes belong to their base
 void tensor_destroy(Tensor* self){
+    if (self && self->base){
+        ad_storage_release(self->storage);
+        free(self);
+        return;
+    }
+
     if (self){
-        for (size_t i = 0; i < self->n_rows; i++){
+        for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
             for (size_t j = 0; j < self->n_cols; j++){
                 ADNode* node = self->get_node(self, i, j);
                 node->destroy(node);
@@ -122,6 +266,7 @@ void tensor_destroy(Tensor* self){
             }
         }
         free(self->nodes);
+        ad_storage_release(self->storage);
         free(self);
     }
 
@@ -129,8 +274,10 @@ void tensor_destroy(Tensor* self){
 
 void tensor_detach(Tensor* self){
     if (self){
-        free(self->nodes);
+        if (self->base == NULL) free(self->nodes);
         self->nodes = NULL;
+        ad_storage_release(self->storage);
+        self->storage = NULL;
         free(self);
      }
 };
@@ -145,7 +292,7 @@ void tensor_set_val(Tensor* self, const size_t i, const size_t j, const double v
         printf("col index exceeded tensor col number.\n");
         exit(0);
     }
-    ADNode* node = self->nodes[i * self->n_cols + j];
+    ADNode* node = tensor_get_node(self, i, j);
     node->set_val(node, val);
 
 };
@@ -160,7 +307,7 @@ void tensor_set_grad(Tensor* self, const size_t i, const size_t j, const double
         printf("col index exceeded tensor col number.\n");
         exit(0);
     }
-    ADNode* node = self->nodes[i * self->n_cols + j];
+    ADNode* node = tensor_get_node(self, i, j);
     node->set_grad(node, grad);
 };
 
@@ -175,7 +322,7 @@ static double tensor_get_val(Tensor* self, const size_t i, const size_t j){
         exit(0);
     }
 
-    ADNode* node = self->nodes[i * self->n_cols + j];
+    ADNode* node = tensor_get_node(self, i, j);
     return node->get_val(node);
 
 };
@@ -191,49 +338,128 @@ static double tensor_get_grad(Tensor* self, const size_t i, const size_t j){
         exit(0);
     }
 
-    ADNode* node = self->nodes[i * self->n_cols + j];
+    ADNode* node = tensor_get_node(self, i, j);
     return node->get_grad(node);
 
 };
 
-// Nodes are Shared
+// Swaps the row and column strides, no node is moved
 void tensor_transpose_inplace(Tensor* self){
-    ADNode* temp = (ADNode*)malloc(sizeof(ADNode));
-    
-    for(size_t i = 0; i < self->n_rows; i++){
-        for(size_t j = 0; j < self->n_cols; j++){
-            ADNode* source = self->nodes[i * self->n_cols + j]; // iter cols
-            ADNode* target = self->nodes[j * self->n_rows + i];
+    const size_t n_rows = self->n_rows;
+    self->n_rows = self->n_cols;
+    self->n_cols = n_rows;
 
-            memcpy(temp, source, sizeof(ADNode));
-            memcpy(source, target, sizeof(ADNode));
-            memcpy(target, temp, sizeof(ADNode));
-        }
+    const size_t stride_row = self->stride_row;
+    self->stride_row = self->stride_col;
+    self->stride_col = stride_row;
+};
+
+#pragma region Views
+/*
+Views share the nodes array of their base tensor and only carry their own shape, strides and
+offset, so transposing, slicing and reshaping allocate nothing but the Tensor header:
+
+    Tensor* X_T = tensor_transpose(X);              // X_T(i, j) is X(j, i)
+    Tensor* head = tensor_slice(X, 0, 2, 0, X->n_cols);
+
+Ops read views like any other tensor and return new tensors. Writing a node into a view
+replaces it in the base as well. The base must outlive its views, and while they exist it must
+not be reallocated, multiplied in place or made contiguous after an in-place transpose. Views of views refer to the root tensor. Free a view with tensor_detach
+(tensor_destroy on a view frees the view only, never the shared nodes).
+*/
+static Tensor* tensor_view(Tensor* self, const size_t n_batch, const size_t n_rows, const size_t n_cols){
+    Tensor* view = (Tensor*)malloc(sizeof(Tensor));
+    if (view == NULL){
+        printf("Failed to allocate memory for Tensor view.\n");
+        exit(1);
     }
-    
-    temp->destroy(temp);        
+
+    *view = *self;
+    view->self = view;
+    view->base = self->base ? self->base : self;
+    view->storage = NULL;
+    view->n_batch = n_batch;
+    view->n_rows = n_rows;
+    view->n_cols = n_cols;
+    return view;
 };
 
 Tensor* tensor_transpose(Tensor* self){
-    Tensor* temp = tensor_new(self->n_cols, self->n_rows);
+    Tensor* view = tensor_view(self, self->n_batch, self->n_rows, self->n_cols);
+    tensor_transpose_inplace(view);
+    return view;
+};
 
-    for(size_t i = 0; i < self->n_rows; i++){
-        for(size_t j = 0; j < self->n_cols; j++){
-            ADNode* source = self->get_node(self, i, j); // iter cols
-            temp->set_node(temp, source, j,i);
-        }
+// Rows [row_begin, row_end) and columns [col_begin, col_end) of every sample
+Tensor* tensor_slice(Tensor* self, const size_t row_begin, const size_t row_end, const size_t col_begin, const size_t col_end){
+    if (row_begin >= row_end || row_end > self->n_rows || col_begin >= col_end || col_end > self->n_cols){
+        printf("Slice [%lu:%lu, %lu:%lu] exceeds tensor shape (%lu, %lu).\n", row_begin, row_end, col_begin, col_end, self->n_rows, self->n_cols);
+        exit(0);
     }
 
-    return temp;
+    Tensor* view = tensor_view(self, self->n_batch, row_end - row_begin, col_end - col_begin);
+    view->offset += row_begin * self->stride_row + col_begin * self->stride_col;
+    return view;
+};
+
+// Samples [begin, end) of a batched tensor
+Tensor* tensor_slice_batch(Tensor* self, const size_t begin, const size_t end){
+    if (begin >= end || end > self->n_batch){
+        printf("Batch slice [%lu:%lu] exceeds batch size %lu.\n", begin, end, self->n_batch);
+        exit(0);
+    }
+
+    Tensor* view = tensor_view(self, end - begin, self->n_rows, self->n_cols);
+    view->offset += begin * self->stride_batch;
+    return view;
+};
+
+// Same nodes in a new shape, only for tensors whose nodes are laid out row major
+Tensor* tensor_reshape(Tensor* self, const size_t n_batch, const size_t n_rows, const size_t n_cols){
+    if (n_batch * n_rows * n_cols != tensor_numel(self)){
+        printf("Cannot reshape tensor of shape (%lu, %lu, %lu) to (%lu, %lu, %lu).\n", self->n_batch, self->n_rows, self->n_cols, n_batch, n_rows, n_cols);
+        exit(0);
+    }
+
+    const char row_major = (self->stride_col == 1 || self->n_cols == 1) &&
+                           (self->stride_row == self->n_cols || self->n_rows == 1) &&
+                           (self->stride_batch == self->n_rows * self->n_cols || self->n_batch == 1);
+    if (!row_major){
+        printf("Only row major tensors can be reshaped, use tensor_shallow_copy first.\n");
+        exit(0);
+    }
+
+    Tensor* view = tensor_view(self, n_batch, n_rows, n_cols);
+    view->stride_batch = n_rows * n_cols;
+    view->stride_row = n_cols;
+    view->stride_col = 1;
+    return view;
+};
+#pragma endregion Views
+
+// Nodes are Shared, the copy lays them out row major
+Tensor* tensor_shallow_copy(Tensor* self){
+    Tensor* tensor = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
+    if (tensor_is_dense(self)){
+        memcpy(tensor->nodes, self->nodes, tensor_numel(self) * sizeof(ADNode*));
+        return tensor;
+    }
+
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            tensor->nodes[i * self->n_cols + j] = tensor_get_node(self, i, j);
+        }
+    }
+    return tensor;
 };
 
 Tensor* tensor_scalar_product(Tensor* self, const double scalar){
-   Tensor* result = tensor_new(self->n_rows, self->n_cols); 
+   Tensor* result = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols); 
 
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* source_node = self->get_node(self, i, j);
-            ADNode* constant_node = node_new(scalar, 0, 0);
+            ADNode* constant_node = node_new_constant(scalar);
             ADNode* resulting_node = node_multiply(source_node, constant_node);
             result->set_node(result, resulting_node, i, j);
         }
@@ -242,11 +468,11 @@ Tensor* tensor_scalar_product(Tensor* self, const double scalar){
 };
 
 void tensor_scalar_product_inplace(Tensor* self, const double scalar){ 
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
                         
             ADNode* source_node = self->get_node(self, i, j);
-            ADNode* constant_node = node_new(scalar, 0, 0);
+            ADNode* constant_node = node_new_constant(scalar);
             ADNode* target_node = node_multiply(source_node, constant_node);
             self->set_node(self, target_node, i, j);
         }
@@ -264,20 +490,19 @@ Tensor* tensor_add(Tensor* self, Tensor* tensor){
         exit(0);
     }
 
-    if (self->n_rows != tensor->n_rows || self->n_cols != tensor->n_cols){
-        printf("Tensor dimensions do not match for addition\n.");
-        exit(0);
-    }
-
-    Tensor* result = tensor_new(self->n_rows, self->n_cols);
-
-    for (size_t i = 0; i < self->n_rows; i++){
-        for (size_t j = 0; j < self->n_cols; j++){
-            ADNode* node_A = self->get_node(self, i, j);
-            ADNode* node_B = tensor->get_node(tensor, i, j);
-            ADNode* resulting_node = node_add(node_A, node_B);
+    const size_t n_batch = tensor_broadcast_dim(self->n_batch, tensor->n_batch, "tensor_add");
+    const size_t n_rows = tensor_broadcast_dim(self->n_rows, tensor->n_rows, "tensor_add");
+    const size_t n_cols = tensor_broadcast_dim(self->n_cols, tensor->n_cols, "tensor_add");
+    Tensor* result = tensor_new_batched(n_batch, n_rows, n_cols);
 
-            result->set_node(result, resulting_node, i, j);
+    for (size_t b = 0; b < n_batch; b++){
+        for (size_t i = 0; i < n_rows; i++){
+            for (size_t j = 0; j < n_cols; j++){
+                ADNode* node_A = tensor_broadcast_node(self, b, i, j);
+                ADNode* node_B = tensor_broadcast_node(tensor, b, i, j);
+                ADNode* resulting_node = node_add(node_A, node_B);
+                tensor_set_node_at(result, resulting_node, b, i, j);
+            }
         }
     }
 
@@ -286,20 +511,33 @@ Tensor* tensor_add(Tensor* self, Tensor* tensor){
 
 
 void tensor_add_inplace(Tensor* self, Tensor* tensor){
+    if (self == NULL){
+        printf("Tensor a is pointing to an empty address\n.");
+        return;
+    }
 
-    if (self->n_rows != tensor->n_rows || self->n_cols != tensor->n_cols){
+    if (tensor == NULL){
+        printf("Tensor b is pointing to an empty address\n.");
+        return;
+    }
+
+    // Only the right operand is broadcast, self keeps its shape
+    if (tensor_broadcast_dim(self->n_batch, tensor->n_batch, "tensor_add_inplace") != self->n_batch ||
+        tensor_broadcast_dim(self->n_rows, tensor->n_rows, "tensor_add_inplace") != self->n_rows ||
+        tensor_broadcast_dim(self->n_cols, tensor->n_cols, "tensor_add_inplace") != self->n_cols){
         printf("Tensor dimensions do not match for addition.\n");
-        printf("self->n_rows: %lu, tensor->n_rows: %lu\n", self->n_rows, tensor->n_rows);
-        printf("self->n_cols: %lu, tensor->n_cols: %lu\n", self->n_cols, tensor->n_cols);
+        printf("self: (%lu, %lu, %lu), tensor: (%lu, %lu, %lu)\n", self->n_batch, self->n_rows, self->n_cols, tensor->n_batch, tensor->n_rows, tensor->n_cols);
         exit(0);
     }
     
-    for (size_t i = 0; i < self->n_rows; i++){
-        for (size_t j = 0; j < self->n_cols; j++){
-            ADNode* node_A = self->get_node(self, i, j);
-            ADNode* node_B = tensor->get_node(tensor, i, j);
-            ADNode* resulting_node = node_add(node_A, node_B);
-            self->set_node(self, resulting_node, i, j);
+    for (size_t b = 0; b < self->n_batch; b++){
+        for (size_t i = 0; i < self->n_rows; i++){
+            for (size_t j = 0; j < self->n_cols; j++){
+                ADNode* node_A = tensor_get_node_at(self, b, i, j);
+                ADNode* node_B = tensor_broadcast_node(tensor, b, i, j);
+                ADNode* resulting_node = node_add(node_A, node_B);
+                tensor_set_node_at(self, resulting_node, b, i, j);
+            }
         }
     }
 };
@@ -315,20 +553,19 @@ Tensor* tensor_subtract(Tensor* self, Tensor* tensor){
         exit(0);
     }
 
-    if (self->n_rows != tensor->n_rows || self->n_cols != tensor->n_cols){
-        printf("Tensor dimensions do not match for subtraction.\n");
-        exit(0);
-    }
+    const size_t n_batch = tensor_broadcast_dim(self->n_batch, tensor->n_batch, "tensor_subtract");
+    const size_t n_rows = tensor_broadcast_dim(self->n_rows, tensor->n_rows, "tensor_subtract");
+    const size_t n_cols = tensor_broadcast_dim(self->n_cols, tensor->n_cols, "tensor_subtract");
+    Tensor* result = tensor_new_batched(n_batch, n_rows, n_cols);
 
-    Tensor* result = tensor_new(self->n_rows, self->n_cols);
-    
-    for (size_t i = 0; i < self->n_rows; i++){
-        for (size_t j = 0; j < self->n_cols; j++){
-            ADNode* node_A = self->get_node(self, i, j);
-            ADNode* node_B = tensor->get_node(tensor, i, j);
-            
-            ADNode* resulting_node = node_subtract(node_A, node_B);
-            result->set_node(result, resulting_node, i, j);
+    for (size_t b = 0; b < n_batch; b++){
+        for (size_t i = 0; i < n_rows; i++){
+            for (size_t j = 0; j < n_cols; j++){
+                ADNode* node_A = tensor_broadcast_node(self, b, i, j);
+                ADNode* node_B = tensor_broadcast_node(tensor, b, i, j);
+                ADNode* resulting_node = node_subtract(node_A, node_B);
+                tensor_set_node_at(result, resulting_node, b, i, j);
+            }
         }
     }
 
@@ -346,31 +583,36 @@ void tensor_subtract_inplace(Tensor* self, Tensor* tensor){
         return;
     }
 
-    if (self->n_rows != tensor->n_rows || self->n_cols != tensor->n_cols){
+    // Only the right operand is broadcast, self keeps its shape
+    if (tensor_broadcast_dim(self->n_batch, tensor->n_batch, "tensor_subtract_inplace") != self->n_batch ||
+        tensor_broadcast_dim(self->n_rows, tensor->n_rows, "tensor_subtract_inplace") != self->n_rows ||
+        tensor_broadcast_dim(self->n_cols, tensor->n_cols, "tensor_subtract_inplace") != self->n_cols){
         printf("Tensor dimensions do not match for subtraction.\n");
+        printf("self: (%lu, %lu, %lu), tensor: (%lu, %lu, %lu)\n", self->n_batch, self->n_rows, self->n_cols, tensor->n_batch, tensor->n_rows, tensor->n_cols);
         exit(0);
     }
     
-    for (size_t i = 0; i < self->n_rows; i++){
-        for (size_t j = 0; j < self->n_cols; j++){
-            ADNode* node_A = self->get_node(self, i, j);
-            ADNode* node_B = tensor->get_node(tensor, i, j);
-            
-            ADNode* resulting_node = node_subtract(node_A, node_B);
-            self->set_node(self, resulting_node, i, j);
+    for (size_t b = 0; b < self->n_batch; b++){
+        for (size_t i = 0; i < self->n_rows; i++){
+            for (size_t j = 0; j < self->n_cols; j++){
+                ADNode* node_A = tensor_get_node_at(self, b, i, j);
+                ADNode* node_B = tensor_broadcast_node(tensor, b, i, j);
+                ADNode* resulting_node = node_subtract(node_A, node_B);
+                tensor_set_node_at(self, resulting_node, b, i, j);
+            }
         }
     }
-
 };
 
 void tensor_print_val(Tensor* self){
-    for(size_t i = 0; i < self->n_rows; i++){
+    for(size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for(size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             if (node == NULL){
                 printf("NULL ");
+                continue;
             }
-            const double val = self->get_val(self, i, j);
+            const double val = *node->value;
             printf("    %f ", val);
         }
         printf("\n");
@@ -378,15 +620,70 @@ void tensor_print_val(Tensor* self){
 };
 
 void tensor_print_grad(Tensor* self){
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
-            const double grad = self->get_grad(self, i, j);
+            const double grad = *self->get_node(self, i, j)->grad;
             printf("    %f ", grad);  
         }
         printf("\n");
     }
 }
 
+// out[b] = a[b] . c[b], a or c with a single batch is shared by all samples
+static void tensor_batched_dot_product_into(Tensor* a, Tensor* c, Tensor* out){
+    for (size_t b = 0; b < out->n_batch; b++){
+        const size_t ba = a->n_batch == 1 ? 0 : b;
+        const size_t bc = c->n_batch == 1 ? 0 : b;
+
+        for (size_t i = 0; i < a->n_rows; i++){
+            for (size_t j = 0; j < c->n_cols; j++){
+                ADNode* result_node = node_new(0.0, a->n_cols, 0);
+
+                for (size_t k = 0; k < a->n_cols; k++){
+                    ADNode* a_node = tensor_get_node_at(a, ba, i, k);
+                    ADNode* c_node = tensor_get_node_at(c, bc, k, j);
+                    ADNode* product_node = node_multiply(a_node, c_node);
+                    result_node->set_parent(result_node, product_node, k);
+                    *result_node->value += product_node->get_val(product_node);
+                }
+
+                // Set forward and backward
+                result_node->forward = forward_add;
+                result_node->backward = backward_add;
+
+                // set the resulting node
+                tensor_set_node_at(out, result_node, b, i, j);
+            }
+        }
+    }
+};
+
+// Gives self a fresh row major nodes array of the new shape, the old layout is kept in old
+static void tensor_reset_layout(Tensor* self, Tensor* old, const size_t n_batch, const size_t n_rows, const size_t n_cols){
+    *old = *self;
+
+    const size_t size = n_batch * n_rows * n_cols;
+    self->nodes = (ADNode**)calloc(size ? size : 1, sizeof(ADNode*));
+    if (self->nodes == NULL){
+        printf("Failed to allocate memory for Tensor nodes.\n");
+        exit(1);
+    }
+    self->n_batch = n_batch;
+    self->n_rows = n_rows;
+    self->n_cols = n_cols;
+    self->stride_batch = n_rows * n_cols;
+    self->stride_row = n_cols;
+    self->stride_col = 1;
+    self->offset = 0;
+    self->base = NULL;
+    self->storage = NULL;
+};
+
+static void tensor_release_layout(Tensor* old){
+    if (old->base == NULL) free(old->nodes);
+    ad_storage_release(old->storage);
+};
+
 Tensor* tensor_dot_product(Tensor* self, Tensor* tensor){
     if (self == NULL){
         printf("Tensor a is pointing to an empty address\n.");
@@ -402,30 +699,10 @@ Tensor* tensor_dot_product(Tensor* self, Tensor* tensor){
         printf("Tensor dimensions do not match for multiplication.\n");
         exit(0);
     }
-    
-    Tensor* result = tensor_new(self->n_rows, tensor->n_cols); 
-    
-    for (size_t i = 0; i < self->n_rows; i++){
-        for (size_t j = 0; j < tensor->n_cols; j++){
-            
-            ADNode* result_node = node_new(0.0, self->n_cols, 0);
-
-            for (size_t k = 0; k < self->n_cols; k++){
-                ADNode* self_node = self->get_node(self, i, k);
-                ADNode* tensor_node = tensor->get_node(tensor, k, j);
-                ADNode* product_node = node_multiply(self_node, tensor_node); 
-                result_node->set_parent(result_node, product_node, k);
-                result_node->data.value += product_node->get_val(product_node);
-            }
-
-            // Set backward
-            result_node->backward = backward_add;
 
-            // set the resulting node
-            result->set_node(result, result_node, i, j);         
-            
-        }
-    }
+    const size_t n_batch = tensor_broadcast_dim(self->n_batch, tensor->n_batch, "tensor_dot_product");
+    Tensor* result = tensor_new_batched(n_batch, self->n_rows, tensor->n_cols); 
+    tensor_batched_dot_product_into(self, tensor, result);
     return result;  
 };
 
@@ -445,32 +722,14 @@ void tensor_dot_product_inplace(Tensor* self, Tensor* tensor){
         exit(0);
     }
 
-    Tensor* tmp = (self)->copy(self);
-    
-    // reallocate_memory
-    self->realloc(self, self->n_rows, tensor->n_cols);
-
-    for (size_t i = 0; i < tmp->n_rows; i++){
-        for (size_t j = 0; j < tensor->n_cols; j++){
-            ADNode* result_node = node_new(0.0, self->n_cols, 0);
-
-            for (size_t k = 0; k < tmp->n_cols; k++){
-                ADNode* self_node = tmp->get_node(tmp, i, k);
-                ADNode* tensor_node = tensor->get_node(tensor, k, j);
-                ADNode* product_node = node_multiply(self_node, tensor_node);
-                result_node->set_parent(result_node, product_node, k);
-                result_node->data.value += product_node->get_val(result_node);
-            }
+    const size_t n_batch = tensor_broadcast_dim(self->n_batch, tensor->n_batch, "tensor_dot_product_inplace");
 
-            // Set backward
-            result_node->backward = backward_add;
+    // The product nodes point to the current nodes of self, read them through the old layout
+    Tensor old;
+    tensor_reset_layout(self, &old, n_batch, self->n_rows, tensor->n_cols);
+    tensor_batched_dot_product_into(&old, tensor, self);
+    tensor_release_layout(&old);
 
-            // set the resulting node
-            self->set_node(self, result_node, i, j); 
-        }
-    }
-    tmp->detach(tmp);
-    
 };
 
 void tensor_dot_product_reversed_order_inplace(Tensor* self, Tensor* tensor){
@@ -491,53 +750,18 @@ void tensor_dot_product_reversed_order_inplace(Tensor* self, Tensor* tensor){
         exit(0);
     }
 
-    // Copy self
-    Tensor* tmp = self->copy(self);
-
-    // Free nodes in self
-    for (size_t i = 0; i < self->n_rows; i++){
-        for (size_t j = 0; j < self->n_cols; j++){
-            ADNode* node = self->get_node(self, i, j);
-            node->destroy(node);
-            node = NULL;
-            self->set_node(self, node, i, j);
-        }
-    }
-
-    // reallocate_memory
-    // tensor n_rows, self n_cols
-    if (self->n_rows != tensor->n_rows){
-        self->realloc(self, tensor->n_rows, self->n_cols);
-    }
-
-    for (size_t i = 0; i < tensor->n_rows; i++){
-        for (size_t j = 0; j < tmp->n_cols; j++){
-            ADNode* result_node = node_new(0.0, tensor->n_cols, 0);
-
-            for (size_t k = 0; k < tensor->n_cols; k++){
-                ADNode* tensor_node = tensor->get_node(tensor, i, k);
-                ADNode* self_node = tmp->get_node(tmp, k, j);
-                ADNode* product_node = node_multiply(tensor_node, self_node);
-
-                result_node->set_parent(result_node, product_node, k);
-                result_node->data.value += product_node->get_val(product_node);
-            }
-
-            // Set backward
-            result_node->backward = backward_add;
-
-            // set the resulting node
-            self->set_node(self, result_node, i, j); 
-
-        }
-    }
+    const size_t n_batch = tensor_broadcast_dim(self->n_batch, tensor->n_batch, "tensor_dot_product_reversed_order_inplace");
 
-    tmp->detach(tmp);
+    // The product nodes point to the current nodes of self, which stay alive as part of the graph
+    Tensor old;
+    tensor_reset_layout(self, &old, n_batch, tensor->n_rows, self->n_cols);
+    tensor_batched_dot_product_into(tensor, &old, self);
+    tensor_release_layout(&old);
 };
 
 Tensor* tensor_copy(Tensor* self){
 
-    Tensor* tensor = tensor_new(self->n_rows, self->n_cols);
+    Tensor* tensor = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
     
     if (tensor == NULL){
         printf("Failed to allocate memory for Tensor.\n");
@@ -555,7 +779,7 @@ Tensor* tensor_copy(Tensor* self){
     ADNode* new_node = NULL;
     ADNode* tensor_node = NULL;
     
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             node = self->get_node(self, i, j);
             new_node = node_copy(node);
@@ -569,34 +793,22 @@ Tensor* tensor_copy(Tensor* self){
 };
 
 void tensor_abs_inplace(Tensor* self){
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
-            if (node->get_val(node) < 0){
-                ADNode* constant_node = node_new(-1.0, 0, 0);
-                ADNode* result_node = node_multiply(node, constant_node);
-                self->set_node(self, result_node, i, j);
-            }
+            ADNode* result_node = node_abs(node);
+            self->set_node(self, result_node, i, j);
         }
     }
 }; 
 
 Tensor* tensor_abs(Tensor* self){
-    Tensor* tensor = tensor_new(self->n_rows, self->n_cols);
+    Tensor* tensor = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
 
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
-            ADNode* result_node = NULL;
-            ADNode* constant_node = NULL; 
-
-            if (node->get_val(node) < 0){
-                constant_node = node_new(-1.0, 0, 0);
-            }
-            else {
-                constant_node = node_new(1.0, 0, 0);
-            }
-            result_node = node_multiply(node, constant_node);
+            ADNode* result_node = node_abs(node);
             tensor->set_node(tensor, result_node, i, j);
         }
     }
@@ -605,46 +817,31 @@ Tensor* tensor_abs(Tensor* self){
 };
 
 Tensor* tensor_relu(Tensor* self){
-    Tensor* result = tensor_new(self->n_rows, self->n_cols);
-    ADNode* n = NULL;
+    Tensor* result = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
 
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
-            if (node->get_val(node) >= 0){
-                n = node_new(node->get_val(node), 1, 0);
-            } 
-            else {
-                n = node_new(0.0, 1, 0);
-            }
-                result->set_node(result, n, i, j);
-                n->set_parent(n, node, 0);
+            ADNode* result_node = node_relu(node);
+            result->set_node(result, result_node, i, j);
         }
     }
     return result;    
 };
 
 void tensor_relu_inplace(Tensor* self){
-    ADNode* n = NULL;
-
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
-            if (node->get_val(node) >= 0){
-                n = node;
-            } 
-            else {
-                n = node_multiply(node, node_new(0.0, 0, 0));
-            }
-
-            self->set_node(self, n, i, j);
+            ADNode* result_node = node_relu(node);
+            self->set_node(self, result_node, i, j);
         }
     }
 };
 
 Tensor* tensor_sigmoid(Tensor* self){
-    Tensor* result = tensor_new(self->n_rows, self->n_cols);
-    for (size_t i = 0; i < self->n_rows; i++){
+    Tensor* result = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node_sigmoid(node);
@@ -654,9 +851,19 @@ Tensor* tensor_sigmoid(Tensor* self){
     return result;
 };
 
+void tensor_sigmoid_inplace(Tensor* self){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            ADNode* node = self->get_node(self, i, j);
+            ADNode* result_node = node_sigmoid(node);
+            self->set_node(self, result_node, i, j);
+        }
+    }
+};
+
 Tensor* tensor_tanh(Tensor* self){
-    Tensor* result = tensor_new(self->n_rows, self->n_cols);
-    for (size_t i = 0; i < self->n_rows; i++){
+    Tensor* result = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node_tanh(node);
@@ -666,6 +873,16 @@ Tensor* tensor_tanh(Tensor* self){
     return result;
 };
 
+void tensor_tanh_inplace(Tensor* self){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            ADNode* node = self->get_node(self, i, j);
+            ADNode* result_node = node_tanh(node);
+            self->set_node(self, result_node, i, j);
+        }
+    }
+};
+
 Tensor* tensor_create_identity(const size_t n){
     Tensor* identity = tensor_new(n, n);
 
@@ -685,18 +902,19 @@ Tensor* tensor_create_identity(const size_t n){
 double tensor_froebenius_norm(Tensor* self){
     // euclidian norm of the vector, which is the matrix flattened out
     double sum = 0.0;
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
-            sum += self->get_val(self, i, j) * self->get_val(self, i, j);
+            const double val = *self->get_node(self, i, j)->value;
+            sum += val * val;
         }
     }
     return sqrt(sum);
 }; 
 
 Tensor* tensor_sqrt(Tensor* self){
-    Tensor* tensor = tensor_new(self->n_rows, self->n_cols);
+    Tensor* tensor = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
 
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node->sqrt(node);
@@ -709,7 +927,7 @@ Tensor* tensor_sqrt(Tensor* self){
 
 void tensor_sqrt_inplace(Tensor* self){
     
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node->sqrt(node);
@@ -720,7 +938,7 @@ void tensor_sqrt_inplace(Tensor* self){
 };
 
 void tensor_exp_inplace(Tensor* self){
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node->exp(node);
@@ -730,9 +948,9 @@ void tensor_exp_inplace(Tensor* self){
 };
 
 Tensor* tensor_exp(Tensor* self){
-    Tensor* tensor = tensor_new(self->n_rows, self->n_cols);
+    Tensor* tensor = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
 
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node_exp(node);
@@ -744,7 +962,7 @@ Tensor* tensor_exp(Tensor* self){
 };
 
 void tensor_log_inplace(Tensor* self){
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node->log(node);
@@ -754,9 +972,9 @@ void tensor_log_inplace(Tensor* self){
 };
 
 Tensor* tensor_log(Tensor* self){
-    Tensor* tensor = tensor_new(self->n_rows, self->n_cols);
+    Tensor* tensor = tensor_new_batched(self->n_batch, self->n_rows, self->n_cols);
 
-    for (size_t i = 0; i < self->n_rows; i++){
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
         for (size_t j = 0; j < self->n_cols; j++){
             ADNode* node = self->get_node(self, i, j);
             ADNode* result_node = node->log(node);
@@ -789,6 +1007,208 @@ Tensor* tensor_create_from_array(const size_t n_rows, const size_t n_cols, const
     return tensor;
 }; 
 
+#pragma region Contiguous Storage
+/*
+Nodes created for a tensor (constructors and op results) live in its storage in row major
+order, so the values and grads of a tensor can be handed to Matrix kernels or written by
+loaders without touching the nodes:
+
+    Matrix W = tensor_values_matrix(weights);     // zero-copy, W.data aliases the node values
+    Matrix dW = tensor_grads_matrix(weights);
+
+A view is valid while the tensor is alive and its nodes are not moved elsewhere. Do not call
+matrix_destroy on a view. Tensors sharing the nodes of another tensor (transpose, slices,
+shallow copy) are usually not contiguous; asking them for a view moves their nodes into a
+fresh storage in their own row major order first. A batched tensor is viewed as its
+n_batch * n_rows stacked rows.
+*/
+
+char tensor_is_contiguous(Tensor* self){
+    if (self->storage == NULL) return 0;
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            ADNode* node = tensor_get_node(self, i, j);
+            if (node == NULL || node->value != self->storage->values + i * self->n_cols + j) return 0;
+        }
+    }
+    return 1;
+};
+
+// Move all nodes into a fresh storage in the row major order of this tensor. A tensor owning
+// its nodes array also gets it back in row major order, so new nodes land in matching slots.
+void tensor_make_contiguous(Tensor* self){
+    if (tensor_is_contiguous(self)) return;
+
+    if (self->base == NULL && !tensor_is_dense(self)){
+        Tensor old;
+        tensor_reset_layout(self, &old, self->n_batch, self->n_rows, self->n_cols);
+        for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
+            for (size_t j = 0; j < self->n_cols; j++){
+                self->nodes[i * self->n_cols + j] = tensor_get_node(&old, i, j);
+            }
+        }
+        tensor_release_layout(&old);
+    }
+
+    ADStorage* storage = ad_storage_new(tensor_numel(self), 1);
+    for (size_t i = 0; i < self->n_batch * self->n_rows; i++){
+        for (size_t j = 0; j < self->n_cols; j++){
+            const size_t k = i * self->n_cols + j;
+            node_set_storage(tensor_get_node(self, i, j), storage, storage->values + k, storage->grads + k);
+        }
+    }
+
+    ad_storage_release(self->storage);
+    self->storage = storage;
+};
+
+Matrix tensor_values_matrix(Tensor* self){
+    tensor_make_contiguous(self);
+    Matrix view = {self->storage->values, self->n_batch * self->n_rows, self->n_cols};
+    return view;
+};
+
+Matrix tensor_grads_matrix(Tensor* self){
+    tensor_make_contiguous(self);
+    Matrix view = {self->storage->grads, self->n_batch * self->n_rows, self->n_cols};
+    return view;
+};
+
+// Bulk copy of row major values, e.g. a batch written by a loader
+void tensor_load_values(Tensor* self, const double* values){
+    tensor_make_contiguous(self);
+    memcpy(self->storage->values, values, tensor_numel(self) * sizeof(double));
+};
+
+void tensor_zero_grad(Tensor* self){
+    tensor_make_contiguous(self);
+    memset(self->storage->grads, 0, tensor_numel(self) * sizeof(double));
+};
+
+#pragma endregion Contiguous Storage
+
+// n_batch samples of n_rows x n_cols, stored one after another in data
+Tensor* tensor_create_from_batch(const size_t n_batch, const size_t n_rows, const size_t n_cols, const double* data){
+    if (data == NULL){
+        printf("Array to be converted to Tensor points to an empty address.\n");
+        exit(0);
+    }
+
+    Tensor* tensor = tensor_new_batched(n_batch, n_rows, n_cols);
+    for (size_t k = 0; k < n_batch * n_rows * n_cols; k++){
+        tensor->set_node(tensor, node_new(data[k], 0, 0), k / n_cols, k % n_cols);
+    }
+    return tensor;
+};
+
+// Mean over the batch dimension, (n_batch, r, c) -> (1, r, c)
+Tensor* tensor_batch_mean(Tensor* self){
+    Tensor* result = tensor_new(self->n_rows, self->n_cols);
+    const size_t matrix_size = self->n_rows * self->n_cols;
+
+    for (size_t k = 0; k < matrix_size; k++){
+        const size_t i = k / self->n_cols, j = k % self->n_cols;
+        ADNode* sum = tensor_get_node_at(self, 0, i, j);
+        if (self->n_batch > 1){
+            sum = node_new(0.0, self->n_batch, 0);
+            for (size_t b = 0; b < self->n_batch; b++){
+                ADNode* node = tensor_get_node_at(self, b, i, j);
+                sum->set_parent(sum, node, b);
+                *sum->value += *node->value;
+            }
+            sum->forward = forward_add;
+            sum->backward = backward_add;
+            sum = node_multiply(sum, node_new_constant(1.0 / (double)self->n_batch));
+        }
+        result->set_node(result, sum, i, j);
+    }
+    return result;
+};
+
+#pragma region Custom Ops
+// One instance of a registered op per sample: the sample goes in row major, an n_rows x n_cols
+// result comes out. The op is one graph node, see node_apply_op.
+Tensor* tensor_apply_op(Tensor* self, const size_t op, const void* params, const size_t params_size,
+                        const size_t n_rows, const size_t n_cols){
+    const size_t n_in = self->n_rows * self->n_cols;
+    const size_t n_out = n_rows * n_cols;
+    ADNode** inputs = (ADNode**)malloc((n_in ? n_in : 1) * sizeof(ADNode*));
+    ADNode** outputs = (ADNode**)malloc((n_out ? n_out : 1) * sizeof(ADNode*));
+    if (inputs == NULL || outputs == NULL){
+        printf("Failed to allocate memory for the op nodes.\n");
+        exit(1);
+    }
+
+    Tensor* result = tensor_new_batched(self->n_batch, n_rows, n_cols);
+    for (size_t b = 0; b < self->n_batch; b++){
+        for (size_t k = 0; k < n_in; k++){
+            inputs[k] = tensor_get_node_at(self, b, k / self->n_cols, k % self->n_cols);
+        }
+
+        node_apply_op(op, inputs, n_in, outputs, n_out, params, params_size);
+        for (size_t k = 0; k < n_out; k++){
+            tensor_set_node_at(result, outputs[k], b, k / n_cols, k % n_cols);
+        }
+    }
+
+    free(inputs);
+    free(outputs);
+    return result;
+};
+
+typedef struct {
+    size_t n_rows;
+    size_t n_cols;
+}SoftmaxParams;
+
+// Every column is normalized on its own, samples are column vectors
+static void softmax_forward(const void* params, const double* in, const size_t n_in, double* out, const size_t n_out){
+    const SoftmaxParams* shape = (const SoftmaxParams*)params;
+    (void)n_in;
+    (void)n_out;
+    for (size_t j = 0; j < shape->n_cols; j++){
+        double max = in[j];
+        for (size_t i = 1; i < shape->n_rows; i++){
+            if (in[i * shape->n_cols + j] > max) max = in[i * shape->n_cols + j];
+        }
+
+        double sum = 0.0;
+        for (size_t i = 0; i < shape->n_rows; i++){
+            out[i * shape->n_cols + j] = exp(in[i * shape->n_cols + j] - max);
+            sum += out[i * shape->n_cols + j];
+        }
+        for (size_t i = 0; i < shape->n_rows; i++){
+            out[i * shape->n_cols + j] /= sum;
+        }
+    }
+};
+
+// dL/dx_i = y_i (dL/dy_i - sum_k y_k dL/dy_k)
+static void softmax_backward(const void* params, const double* in, const size_t n_in, const double* out,
+                             const double* grad_out, const size_t n_out, double* grad_in){
+    const SoftmaxParams* shape = (const SoftmaxParams*)params;
+    (void)in;
+    (void)n_in;
+    (void)n_out;
+    for (size_t j = 0; j < shape->n_cols; j++){
+        double dot = 0.0;
+        for (size_t i = 0; i < shape->n_rows; i++){
+            dot += out[i * shape->n_cols + j] * grad_out[i * shape->n_cols + j];
+        }
+        for (size_t i = 0; i < shape->n_rows; i++){
+            const size_t k = i * shape->n_cols + j;
+            grad_in[k] = out[k] * (grad_out[k] - dot);
+        }
+    }
+};
+
+Tensor* tensor_softmax(Tensor* self){
+    static const ADOpDef softmax = {"softmax", softmax_forward, softmax_backward};
+    const SoftmaxParams params = {self->n_rows, self->n_cols};
+    return tensor_apply_op(self, ad_op_register(&softmax), &params, sizeof(params), self->n_rows, self->n_cols);
+};
+#pragma endregion Custom Ops
+
 void tensor_init(Tensor* self){
     // Set methods
     
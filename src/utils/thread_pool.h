@@ -0,0 +1,244 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+Thread pool and work-stealing deques
+
+A ThreadPool keeps num_threads - 1 workers parked on a condition variable. thread_pool_run
+executes job(ctx, worker) once on every worker, the calling thread takes part as worker 0,
+and returns when all of them are done. Scheduling inside a job is up to the job itself,
+e.g. with one WorkDeque per worker:
+
+    owner    pushes and pops tasks at the tail (newest first, keeps caches warm)
+    thieves  steal tasks from the head (oldest first, usually the largest pieces of work)
+
+Set CML_NUM_THREADS to override the default of one thread per online core.
+*/
+
+typedef void (*ThreadPoolJob)(void* ctx, const size_t worker);
+
+struct ThreadPool;
+
+typedef struct {
+    struct ThreadPool* pool;
+    size_t index;
+}ThreadPoolWorker;
+
+typedef struct ThreadPool{
+    pthread_t* threads;
+    ThreadPoolWorker* workers;
+    size_t num_threads;     // including the calling thread
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    ThreadPoolJob job;
+    void* ctx;
+    size_t generation;      // bumped for every job
+    size_t active;          // workers still running the current job
+    char shutdown;
+
+    void (*run)(struct ThreadPool* self, ThreadPoolJob job, void* ctx);
+    void (*destroy)(struct ThreadPool* self);
+}ThreadPool;
+
+static void* thread_pool_worker_main(void* arg){
+    ThreadPoolWorker* worker = (ThreadPoolWorker*)arg;
+    ThreadPool* pool = worker->pool;
+    size_t seen = 0;
+
+    for (;;){
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutdown && pool->generation == seen){
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown){
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        ThreadPoolJob job = pool->job;
+        void* ctx = pool->ctx;
+        pthread_mutex_unlock(&pool->lock);
+
+        job(ctx, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+};
+
+void thread_pool_run(ThreadPool* self, ThreadPoolJob job, void* ctx){
+    if (self->num_threads == 1){
+        job(ctx, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    self->job = job;
+    self->ctx = ctx;
+    self->active = self->num_threads - 1;
+    self->generation++;
+    pthread_cond_broadcast(&self->start);
+    pthread_mutex_unlock(&self->lock);
+
+    job(ctx, 0);
+
+    pthread_mutex_lock(&self->lock);
+    while (self->active > 0){
+        pthread_cond_wait(&self->done, &self->lock);
+    }
+    pthread_mutex_unlock(&self->lock);
+};
+
+void thread_pool_destroy(ThreadPool* self){
+    if (self == NULL) return;
+
+    pthread_mutex_lock(&self->lock);
+    self->shutdown = 1;
+    pthread_cond_broadcast(&self->start);
+    pthread_mutex_unlock(&self->lock);
+
+    for (size_t i = 1; i < self->num_threads; i++){
+        pthread_join(self->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->start);
+    pthread_cond_destroy(&self->done);
+    free(self->threads);
+    free(self->workers);
+    free(self);
+};
+
+size_t thread_pool_default_threads(){
+    const char* env = getenv("CML_NUM_THREADS");
+    if (env && atoi(env) > 0) return (size_t)atoi(env);
+
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+};
+
+// num_threads == 0 picks thread_pool_default_threads()
+ThreadPool* thread_pool_new(size_t num_threads){
+    if (num_threads == 0) num_threads = thread_pool_default_threads();
+
+    ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+    if (pool == NULL){
+        printf("Failed to allocate memory for the thread pool.\n");
+        exit(1);
+    }
+
+    pool->threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    pool->workers = (ThreadPoolWorker*)malloc(num_threads * sizeof(ThreadPoolWorker));
+    if (pool->threads == NULL || pool->workers == NULL){
+        printf("Failed to allocate memory for the thread pool workers.\n");
+        exit(1);
+    }
+
+    pool->num_threads = num_threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->job = NULL;
+    pool->ctx = NULL;
+    pool->generation = 0;
+    pool->active = 0;
+    pool->shutdown = 0;
+
+    pool->run = thread_pool_run;
+    pool->destroy = thread_pool_destroy;
+
+    for (size_t i = 0; i < num_threads; i++){
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (i == 0) continue;
+
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker_main, &pool->workers[i]) != 0){
+            printf("Failed to start thread pool worker %lu.\n", i);
+            exit(1);
+        }
+    }
+
+    return pool;
+};
+
+#pragma region Work Stealing Deque
+// Bounded deque of task indices. Every task is pushed at most once per job, so the capacity
+// is the number of tasks and the deque is reset instead of wrapped around.
+typedef struct {
+    size_t* tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    pthread_mutex_t lock;
+}WorkDeque;
+
+void work_deque_init(WorkDeque* self, const size_t capacity){
+    self->tasks = (size_t*)malloc((capacity ? capacity : 1) * sizeof(size_t));
+    if (self->tasks == NULL){
+        printf("Failed to allocate memory for the work deque.\n");
+        exit(1);
+    }
+    self->head = 0;
+    self->tail = 0;
+    self->capacity = capacity;
+    pthread_mutex_init(&self->lock, NULL);
+};
+
+void work_deque_reset(WorkDeque* self){
+    pthread_mutex_lock(&self->lock);
+    self->head = 0;
+    self->tail = 0;
+    pthread_mutex_unlock(&self->lock);
+};
+
+void work_deque_push(WorkDeque* self, const size_t task){
+    pthread_mutex_lock(&self->lock);
+    if (self->tail == self->capacity){
+        printf("Work deque overflow, capacity %lu.\n", self->capacity);
+        exit(1);
+    }
+    self->tasks[self->tail++] = task;
+    pthread_mutex_unlock(&self->lock);
+};
+
+// Owner side, newest task first
+char work_deque_pop(WorkDeque* self, size_t* task){
+    char found = 0;
+    pthread_mutex_lock(&self->lock);
+    if (self->tail > self->head){
+        *task = self->tasks[--self->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&self->lock);
+    return found;
+};
+
+// Thief side, oldest task first
+char work_deque_steal(WorkDeque* self, size_t* task){
+    char found = 0;
+    pthread_mutex_lock(&self->lock);
+    if (self->tail > self->head){
+        *task = self->tasks[self->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&self->lock);
+    return found;
+};
+
+void work_deque_destroy(WorkDeque* self){
+    free(self->tasks);
+    self->tasks = NULL;
+    pthread_mutex_destroy(&self->lock);
+};
+#pragma endregion Work Stealing Deque
+
+#endif // __THREAD_POOL_H__
@@ -32,6 +32,7 @@ typedef struct {
 typedef struct{
     float dist;
     struct KDTreeNode* node;
+    unsigned int idx;           // node index when searching a KDTreeFlat
 }HeapNode;
 
 typedef struct{